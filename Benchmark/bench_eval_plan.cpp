@@ -0,0 +1,63 @@
+#include "bench_eval_plan.h"
+#include <MetaNN/meta_nn.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+struct CountUnit : public BaseEvalUnit<DeviceTags::CPU>
+{
+    CountUnit(size_t* count)
+        : m_count(count) {}
+
+    void Eval() override
+    {
+        ++*m_count;
+    }
+
+    size_t* m_count;
+};
+
+struct ChainUnit : public CountUnit
+{
+    using CountUnit::CountUnit;
+};
+
+// The average cost in ns of registering and dispatching a unit that does no work: a chain of
+// dependent units next to independent ones
+double TimeDispatch(EvalPoolEnum pool)
+{
+    const size_t unitNum = 4096;
+    const size_t repNum = 50;
+    std::vector<size_t> counts(2 * unitNum, 0);
+    EvalPlan<DeviceTags::CPU>::SetEvalPool(pool);
+    std::chrono::duration<double, std::nano> cost{0};
+    for (size_t rep = 0; rep <= repNum; ++rep)
+    {
+        // the first pass warms up the layers and groups kept by the plan
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < unitNum; ++i)
+        {
+            const void* prev = i ? &counts[unitNum + i - 1] : nullptr;
+            EvalPlan<DeviceTags::CPU>::Register<TrivalEvalGroup<CountUnit>>(CountUnit(&counts[i]), &counts[i], {});
+            EvalPlan<DeviceTags::CPU>::Register<TrivalEvalGroup<ChainUnit>>(ChainUnit(&counts[unitNum + i]),
+                                                                             &counts[unitNum + i], {prev});
+        }
+        EvalPlan<DeviceTags::CPU>::Eval();
+        if (rep != 0) cost += std::chrono::steady_clock::now() - start;
+    }
+    EvalPlan<DeviceTags::CPU>::SetEvalPool(EvalPoolEnum::Trival);
+    return cost.count() / (repNum * 2 * unitNum);
+}
+}
+
+void bench_eval_plan()
+{
+    cout << "EvalPlan, per-unit cost of registration and dispatch" << endl;
+    const double trival = TimeDispatch(EvalPoolEnum::Trival);
+    const double parallel = TimeDispatch(EvalPoolEnum::Parallel);
+    cout << "  trival pool " << trival << " ns/unit, parallel pool " << parallel << " ns/unit" << endl;
+}
@@ -0,0 +1,11 @@
+#include "bench_eval_plan.h"
+#include "bench_fused_gru.h"
+
+// Timings of the faster paths against the plain ones. They only report numbers: the results are
+// checked by GeneralTest.
+int main(int argc, char **argv)
+{
+    bench_eval_plan();
+    bench_fused_gru();
+    return 0;
+}
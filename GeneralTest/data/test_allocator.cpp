@@ -0,0 +1,168 @@
+#include "test_allocator.h"
+#include "../facilities/calculate_tags.h"
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <MetaNN/meta_nn.h>
+using namespace std;
+using namespace MetaNN;
+
+namespace
+{
+void TestAllocator1()
+{
+    cout << "Test allocator case 1 (size classes)...\t";
+    for (size_t bytes = 1; bytes < 100000; bytes += 37)
+    {
+        size_t cls = NSAllocator::SizeClass(bytes);
+        assert(cls < NSAllocator::ClassNum);
+        assert(NSAllocator::ClassSize(cls) >= bytes);
+        assert((cls == 0) || (NSAllocator::ClassSize(cls - 1) < bytes));
+        assert(NSAllocator::ClassSize(cls) * 4 <= bytes * 5 + 4 * NSAllocator::MinClassSize);
+    }
+    for (size_t cls = 0; cls < NSAllocator::ClassNum; ++cls)
+    {
+        assert(NSAllocator::SizeClass(NSAllocator::ClassSize(cls)) == cls);
+    }
+    cout << "done" << endl;
+}
+
+void TestAllocator2()
+{
+    cout << "Test allocator case 2 (alignment and reuse)...\t";
+    void* first = nullptr;
+    {
+        auto p = Allocator<CheckDevice>::Allocate<float>(1000);
+        assert(((uintptr_t)p.get()) % NSAllocator::Alignment == 0);
+        first = p.get();
+        p.get()[999] = 1.0f;
+    }
+    {
+        auto p = Allocator<CheckDevice>::Allocate<float>(1001);
+        assert(p.get() == first);
+    }
+    auto q = Allocator<CheckDevice>::Allocate<char>(3);
+    assert(((uintptr_t)q.get()) % NSAllocator::Alignment == 0);
+    assert(Allocator<CheckDevice>::Allocate<int>(0) == nullptr);
+    cout << "done" << endl;
+}
+
+void TestAllocator3()
+{
+    cout << "Test allocator case 3 (multi-thread)...\t";
+    std::vector<std::thread> threads;
+    std::vector<std::shared_ptr<int>> shared(8);
+    for (size_t t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([t, &shared]()
+                             {
+                                 std::vector<std::pair<std::shared_ptr<int>, size_t>> live;
+                                 for (size_t i = 0; i < 20000; ++i)
+                                 {
+                                     const size_t len = 1 + (i * 7919 + t * 104729) % 5000;
+                                     auto p = Allocator<CheckDevice>::Allocate<int>(len);
+                                     p.get()[0] = (int)i;
+                                     p.get()[len - 1] = (int)i;
+                                     live.emplace_back(p, len);
+                                     if (live.size() > 64)
+                                     {
+                                         const auto& old = live.front();
+                                         assert(old.first.get()[0] == old.first.get()[old.second - 1]);
+                                         live.erase(live.begin());
+                                     }
+                                 }
+                                 shared[t] = live.back().first;
+                             });
+    }
+    for (auto& t : threads) t.join();
+    // blocks allocated by exited threads are released on this thread
+    shared.clear();
+    cout << "done" << endl;
+}
+
+void TestAllocator4()
+{
+    cout << "Test allocator case 4 (trim)...\t";
+    const size_t oldLimit = NSAllocator::CentralCache::Instance().CacheLimit();
+    {
+        std::vector<std::shared_ptr<float>> buf;
+        for (size_t i = 0; i < 64; ++i)
+        {
+            buf.push_back(Allocator<CheckDevice>::Allocate<float>(1 << 18));
+        }
+    }
+    NSAllocator::ThreadCache::Local()->Flush();
+    assert(NSAllocator::CentralCache::Instance().CachedBytes() >= 64 * (1 << 20));
+    
+    Allocator<CheckDevice>::SetCacheLimit(1 << 20);
+    assert(NSAllocator::CentralCache::Instance().CachedBytes() <= (1 << 20));
+
+    // large blocks bypass the thread cache, so the limit applies to them at once
+    Allocator<CheckDevice>::SetCacheLimit(oldLimit);
+    const size_t cachedBefore = NSAllocator::CentralCache::Instance().CachedBytes();
+    Allocator<CheckDevice>::Allocate<float>(1 << 22);
+    const size_t largeCls = NSAllocator::SizeClass((1 << 22) * sizeof(float));
+    assert(NSAllocator::CentralCache::Instance().CachedBytes() ==
+           cachedBefore + NSAllocator::ClassSize(largeCls));
+    Allocator<CheckDevice>::SetCacheLimit(1 << 20);
+    assert(NSAllocator::CentralCache::Instance().CachedBytes() <= (1 << 20));
+    Allocator<CheckDevice>::SetCacheLimit(oldLimit);
+    cout << "done" << endl;
+}
+
+void TestAllocator5()
+{
+    cout << "Test allocator case 5 (statistics)...\t";
+    // Blocks cached by other threads (e.g. the workers of an EvalPool) are not released here,
+    // so cached counts are compared with those before
+    Allocator<CheckDevice>::ReleaseCached();
+    const auto before = Allocator<CheckDevice>::Stats();
+
+    const size_t cls = NSAllocator::SizeClass(4000 * sizeof(float));
+    {
+        auto p1 = Allocator<CheckDevice>::Allocate<float>(4000);
+        auto p2 = Allocator<CheckDevice>::Allocate<float>(4000);
+
+        const auto s = Allocator<CheckDevice>::Stats();
+        assert(s.m_classes[cls].m_liveNum == before.m_classes[cls].m_liveNum + 2);
+        assert(s.m_classes[cls].m_allocations == before.m_classes[cls].m_allocations + 2);
+        assert(s.m_misses == before.m_misses + 2);
+        assert(s.m_liveBytes == before.m_liveBytes + 2 * NSAllocator::ClassSize(cls));
+        assert(s.m_peakReservedBytes >= s.m_reservedBytes);
+    }
+
+    auto s = Allocator<CheckDevice>::Stats();
+    assert(s.m_classes[cls].m_liveNum == before.m_classes[cls].m_liveNum);
+    assert(s.m_classes[cls].m_cachedNum == before.m_classes[cls].m_cachedNum + 2);
+    assert(s.m_cachedBytes == before.m_cachedBytes + 2 * NSAllocator::ClassSize(cls));
+    assert(s.m_peakReservedBytes >= before.m_reservedBytes + 2 * NSAllocator::ClassSize(cls));
+
+    {
+        auto p = Allocator<CheckDevice>::Allocate<float>(4000);
+        s = Allocator<CheckDevice>::Stats();
+        assert(s.m_hits == before.m_hits + 1);
+        assert(s.m_allocations == before.m_allocations + 3);
+        assert(s.HitRatio() > 0);
+        assert(s.AllocationRate() > 0);
+    }
+
+    Allocator<CheckDevice>::ReleaseCached();
+    Allocator<CheckDevice>::ResetPeak();
+    s = Allocator<CheckDevice>::Stats();
+    assert(s.m_cachedBytes == before.m_cachedBytes);
+    assert(s.m_reservedBytes == before.m_reservedBytes);
+    assert(s.m_peakReservedBytes == s.m_reservedBytes);
+    cout << "done" << endl;
+}
+}
+
+void test_allocator()
+{
+    TestAllocator1();
+    TestAllocator2();
+    TestAllocator3();
+    TestAllocator4();
+    TestAllocator5();
+}
@@ -0,0 +1,46 @@
+#include "test_batch_one_hot_vector.h"
+#include "../facilities/calculate_tags.h"
+#include <iostream>
+#include <cassert>
+#include <MetaNN/meta_nn.h>
+using namespace std;
+using namespace MetaNN;
+
+namespace
+{
+void test_batch_one_hot_vector1()
+{
+    cout << "Test batch one-hot vector case 1...\t";
+    static_assert(IsBatchMatrix<BatchOneHotVector<int, CheckDevice>>, "Test Error");
+    static_assert(IsBatchMatrix<BatchOneHotVector<int, CheckDevice> &>, "Test Error");
+    static_assert(IsBatchMatrix<const BatchOneHotVector<int, CheckDevice> &>, "Test Error");
+
+    auto rm = BatchOneHotVector<int, CheckDevice>(100, {37, 0, 99});
+    assert(rm.RowNum() == 1);
+    assert(rm.ColNum() == 100);
+    assert(rm.BatchNum() == 3);
+    assert(rm.HotPos(0) == 37);
+    assert(rm.HotPos(2) == 99);
+    auto rm2 = BatchOneHotVector<int, CheckDevice>(100, {37, 0, 99});
+    auto rm3 = BatchOneHotVector<int, CheckDevice>(100, {37, 1, 99});
+    assert(rm == rm2);
+    assert(rm != rm3);
+
+    auto rm1 = Evaluate(rm);
+    assert(rm1.BatchNum() == 3);
+    for (size_t b = 0; b < 3; ++b)
+    {
+        for (size_t j = 0; j < 100; ++j)
+        {
+            assert(rm1[b](0, j) == ((j == rm.HotPos(b)) ? 1 : 0));
+        }
+    }
+
+    cout << "done" << endl;
+}
+}
+
+void test_batch_one_hot_vector()
+{
+    test_batch_one_hot_vector1();
+}
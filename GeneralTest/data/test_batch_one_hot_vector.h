@@ -0,0 +1,3 @@
+#pragma once
+
+void test_batch_one_hot_vector();
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "test_eval_plan.h"
 #include "../facilities/calculate_tags.h"
+#include "../facilities/data_gen.h"
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <cmath>
 #include <set>
+#include <vector>
 #include <MetaNN/meta_nn.h>
 using namespace std;
 using namespace MetaNN;
@@ -62,6 +66,237 @@ void TestEvalPlan4()
     assert(eh1.Data() == eh2.Data());
     cout << "done" << endl;
 }
+void TestEvalPlan5()
+{
+    cout << "Test eval plan case 5...\t";
+    ParallelEvalPool<CheckDevice>::SetWorkerNum(4);
+    
+    auto weight = GenMatrix<float>(40, 30, 0.1f, 0.001f);
+    std::vector<Matrix<float, CheckDevice>> inputs;
+    for (size_t i = 0; i < 16; ++i)
+    {
+        inputs.push_back(GenMatrix<float>(8, 40, (float)i, 0.002f));
+    }
+    auto sout = GenBatchMatrix<float>(1, 6, 5, 0.3f, 0.01f);
+    auto grad = GenBatchMatrix<float>(1, 6, 5, 0.1f, 0.02f);
+    
+    std::vector<Matrix<float, CheckDevice>> expected;
+    for (auto& in : inputs)
+    {
+        expected.push_back(Evaluate(Sigmoid(Dot(in, weight))));
+    }
+    auto expectedSm = Evaluate(VecSoftmaxDerivative(grad, sout));
+    
+    EvalPlan<CheckDevice>::SetEvalPool(EvalPoolEnum::Parallel);
+    std::vector<decltype(Sigmoid(Dot(inputs[0], weight)).EvalRegister())> handles;
+    for (auto& in : inputs)
+    {
+        handles.push_back(Sigmoid(Dot(in, weight)).EvalRegister());
+    }
+    auto smHandle = VecSoftmaxDerivative(grad, sout).EvalRegister();
+    EvalPlan<CheckDevice>::Eval();
+    EvalPlan<CheckDevice>::SetEvalPool(EvalPoolEnum::Trival);
+    
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        auto res = handles[i].Data();
+        for (size_t r = 0; r < 8; ++r)
+        {
+            for (size_t c = 0; c < 30; ++c)
+            {
+                assert(fabs(res(r, c) - expected[i](r, c)) < 0.0001);
+            }
+        }
+    }
+    auto smRes = smHandle.Data();
+    for (size_t b = 0; b < 5; ++b)
+    {
+        for (size_t c = 0; c < 6; ++c)
+        {
+            assert(fabs(smRes[b](0, c) - expectedSm[b](0, c)) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
+void TestEvalPlan6()
+{
+    cout << "Test eval plan case 6...\t";
+    ParallelEvalPool<CheckDevice>::SetWorkerNum(4);
+    
+    std::vector<int> hits(100000, 0);
+    ParallelFor(hits.size(), 1, [&hits](size_t b, size_t e)
+                {
+                    for (size_t i = b; i < e; ++i) ++hits[i];
+                });
+    assert(std::all_of(hits.begin(), hits.end(), [](int v) { return v == 1; }));
+    
+    auto m1 = GenMatrix<float>(300, 200, 0.1f, 0.0001f);
+    auto m2 = GenMatrix<float>(200, 310, 0.2f, 0.0001f);
+    auto dotRes = Evaluate(Dot(m1, m2));
+    for (size_t i = 0; i < 300; i += 7)
+    {
+        for (size_t j = 0; j < 310; j += 3)
+        {
+            double h = 0;
+            for (size_t k = 0; k < 200; ++k)
+            {
+                h += (double)m1(i, k) * m2(k, j);
+            }
+            assert(fabs(h - dotRes(i, j)) <= 1e-4 * fabs(h));
+        }
+    }
+    
+    auto b1 = GenBatchMatrix<float>(64, 100, 20, 0.1f, 0.0001f);
+    auto b2 = GenBatchMatrix<float>(64, 100, 20, -0.3f, 0.0002f);
+    auto addRes = Evaluate(b1 + b2);
+    auto sigRes = Evaluate(Sigmoid(b1));
+    auto tanhRes = Evaluate(Tanh(b2));
+    for (size_t b = 0; b < 20; ++b)
+    {
+        for (size_t i = 0; i < 64; ++i)
+        {
+            for (size_t j = 0; j < 100; ++j)
+            {
+                assert(fabs(addRes[b](i, j) - (b1[b](i, j) + b2[b](i, j))) < 0.0001);
+                assert(fabs(sigRes[b](i, j) - 1 / (1 + exp(-b1[b](i, j)))) < 0.0001);
+                assert(fabs(tanhRes[b](i, j) - tanh(b2[b](i, j))) < 0.0001);
+            }
+        }
+    }
+    cout << "done" << endl;
+}
+
+void TestEvalPlan7()
+{
+    cout << "Test eval plan case 7...\t";
+    auto in = GenMatrix<float>(256, 256, -0.5f, 0.00001f);
+    auto w = GenMatrix<float>(256, 256, 0.01f, -0.0000001f);
+
+    auto peak = [&in, &w](bool memoryPlan, Matrix<float, CheckDevice>& res)
+    {
+        EvalPlan<CheckDevice>::SetMemoryPlan(memoryPlan);
+        Allocator<CheckDevice>::ReleaseCached();
+        Allocator<CheckDevice>::ResetPeak();
+        const size_t base = Allocator<CheckDevice>::Stats().m_reservedBytes;
+        res = Evaluate(Dot(Dot(Dot(Dot(Dot(Dot(in, w), w), w), w), w), w));
+        EvalPlan<CheckDevice>::SetMemoryPlan(false);
+        return Allocator<CheckDevice>::Stats().m_peakReservedBytes - base;
+    };
+    Matrix<float, CheckDevice> res1, res2;
+    const size_t peak1 = peak(false, res1);
+    const size_t peak2 = peak(true, res2);
+    assert(peak1 >= 6 * 256 * 256 * sizeof(float));
+    assert(peak2 * 2 <= peak1);
+    for (size_t i = 0; i < 256; ++i)
+    {
+        for (size_t j = 0; j < 256; ++j)
+        {
+            assert(res1(i, j) == res2(i, j));
+        }
+    }
+
+    // results still held by another expression (or the caller) are kept
+    EvalPlan<CheckDevice>::SetMemoryPlan(true);
+    auto s = Sigmoid(in);
+    auto t = Tanh(Tanh(s));
+    auto h1 = s.EvalRegister();
+    auto h2 = t.EvalRegister();
+    EvalPlan<CheckDevice>::Eval();
+    EvalPlan<CheckDevice>::SetMemoryPlan(false);
+    assert(fabs(h1.Data()(3, 5) - 1 / (1 + exp(-in(3, 5)))) < 0.0001);
+    assert(fabs(h2.Data()(3, 5) - tanh(tanh(h1.Data()(3, 5)))) < 0.0001);
+    cout << "done" << endl;
+}
+struct CountUnit : public BaseEvalUnit<CheckDevice>
+{
+    CountUnit(size_t* count)
+        : m_count(count) {}
+
+    void Eval() override
+    {
+        ++*m_count;
+    }
+
+    size_t* m_count;
+};
+
+struct ChainUnit : public CountUnit
+{
+    using CountUnit::CountUnit;
+};
+
+// Registers a unit in the nested layer, then fails
+struct ThrowUnit : public CountUnit
+{
+    using CountUnit::CountUnit;
+
+    void Eval() override
+    {
+        EvalPlan<CheckDevice>::Register<TrivalEvalGroup<CountUnit>>(CountUnit(m_count), m_count, {});
+        throw std::runtime_error("ThrowUnit");
+    }
+};
+
+void TestEvalPlan8()
+{
+    cout << "Test eval plan case 8...\t";
+    // a chain of dependent units next to independent ones, in both pools
+    const size_t unitNum = 256;
+    std::vector<size_t> counts(2 * unitNum, 0);
+    for (auto pool : {EvalPoolEnum::Trival, EvalPoolEnum::Parallel})
+    {
+        EvalPlan<CheckDevice>::SetEvalPool(pool);
+        for (size_t i = 0; i < unitNum; ++i)
+        {
+            const void* prev = i ? &counts[unitNum + i - 1] : nullptr;
+            EvalPlan<CheckDevice>::Register<TrivalEvalGroup<CountUnit>>(CountUnit(&counts[i]), &counts[i], {});
+            EvalPlan<CheckDevice>::Register<TrivalEvalGroup<ChainUnit>>(ChainUnit(&counts[unitNum + i]),
+                                                                         &counts[unitNum + i], {prev});
+        }
+        EvalPlan<CheckDevice>::Eval();
+    }
+    EvalPlan<CheckDevice>::SetEvalPool(EvalPoolEnum::Trival);
+    assert(std::all_of(counts.begin(), counts.end(), [](size_t v) { return v == 2; }));
+    cout << "done" << endl;
+}
+
+void TestEvalPlan9()
+{
+    cout << "Test eval plan case 9...\t";
+    // a throwing unit leaves the plan ready for the next evaluation, its registrations dropped
+    auto in = GenMatrix<float>(16, 24, -0.5f, 0.01f);
+    for (auto pool : {EvalPoolEnum::Trival, EvalPoolEnum::Parallel})
+    {
+        EvalPlan<CheckDevice>::SetEvalPool(pool);
+        int failed = 0;
+        size_t nested = 0;
+        size_t count = 0;
+        EvalPlan<CheckDevice>::Register<TrivalEvalGroup<ThrowUnit>>(ThrowUnit(&nested), &failed, {});
+        EvalPlan<CheckDevice>::Register<TrivalEvalGroup<CountUnit>>(CountUnit(&count), &count, {&failed});
+        try
+        {
+            EvalPlan<CheckDevice>::Eval();
+            assert(false);
+        }
+        catch (std::runtime_error&)
+        {
+        }
+        assert((nested == 0) && (count == 0));
+
+        EvalPlan<CheckDevice>::Register<TrivalEvalGroup<CountUnit>>(CountUnit(&count), &count, {});
+        auto res = Evaluate(Sigmoid(in));
+        assert((nested == 0) && (count == 1));
+        for (size_t i = 0; i < 16; ++i)
+        {
+            for (size_t j = 0; j < 24; ++j)
+            {
+                assert(fabs(res(i, j) - 1 / (1 + exp(-in(i, j)))) < 0.0001);
+            }
+        }
+    }
+    EvalPlan<CheckDevice>::SetEvalPool(EvalPoolEnum::Trival);
+    cout << "done" << endl;
+}
 }
 
 void test_eval_plan()
@@ -70,4 +305,9 @@ void test_eval_plan()
     TestEvalPlan2();
     TestEvalPlan3();
     TestEvalPlan4();
+    TestEvalPlan5();
+    TestEvalPlan6();
+    TestEvalPlan7();
+    TestEvalPlan8();
+    TestEvalPlan9();
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+#include "data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+// Helpers of the recurrent layer tests, which compare two ways of computing the same steps
+
+using CpuMatrix = MetaNN::Matrix<float, MetaNN::DeviceTags::CPU>;
+using ParamMap = std::map<std::string, CpuMatrix>;
+
+inline const std::vector<std::string> GruParamNames{"-Wz", "-Wr", "-W", "-Uz", "-Ur", "-U"};
+
+inline bool Same(const CpuMatrix& a, const CpuMatrix& b)
+{
+    if ((a.RowNum() != b.RowNum()) || (a.ColNum() != b.ColNum())) return false;
+    for (size_t i = 0; i < a.RowNum(); ++i)
+    {
+        for (size_t j = 0; j < a.ColNum(); ++j)
+        {
+            if (std::fabs(a(i, j) - b(i, j)) > 0.0001f) return false;
+        }
+    }
+    return true;
+}
+
+// The weights name + suffix of a step: the first half of suffixes multiply the input (inLen
+// rows), the others the hidden state (outLen rows)
+inline ParamMap GenParams(const std::string& name, size_t inLen, size_t outLen,
+                          const std::vector<std::string>& suffixes = GruParamNames)
+{
+    ParamMap res;
+    float start = -13;
+    for (size_t k = 0; k < suffixes.size(); ++k)
+    {
+        const size_t rowNum = (2 * k < suffixes.size()) ? inLen : outLen;
+        res[name + suffixes[k]] = GenMatrix<float>(rowNum, outLen, start, (k % 2) ? 0.017f : -0.011f);
+        start += 7;
+    }
+    return res;
+}
+
+using CpuSequence = MetaNN::Sequence<float, MetaNN::DeviceTags::CPU, MetaNN::CategoryTags::Matrix>;
+
+inline CpuSequence MakeSequence(const std::vector<CpuMatrix>& mats)
+{
+    CpuSequence res(mats.size(), mats[0].RowNum(), mats[0].ColNum());
+    for (size_t t = 0; t < mats.size(); ++t)
+    {
+        for (size_t i = 0; i < mats[t].RowNum(); ++i)
+        {
+            for (size_t j = 0; j < mats[t].ColNum(); ++j)
+            {
+                res.SetValue(t, i, j, mats[t](i, j));
+            }
+        }
+    }
+    return res;
+}
+
+inline auto MakeParamInitializer(const ParamMap& params)
+{
+    auto res = MetaNN::MakeInitializer<float>();
+    for (const auto& [name, mat] : params)
+    {
+        res.SetMatrix(name, mat);
+    }
+    return res;
+}
+
+// gradHidden is the gradient of the hidden state before the first step
+struct RunResult
+{
+    std::vector<CpuMatrix> outs;
+    std::vector<CpuMatrix> gradInputs;
+    CpuMatrix gradHidden;
+    ParamMap grads;
+};
+
+// The gradient of each saved weight of layer, cut out of the merged gradients of col
+template <typename TLayer>
+ParamMap GradsByName(TLayer& layer, MetaNN::GradCollector<float, MetaNN::DeviceTags::CPU>& col)
+{
+    using namespace MetaNN;
+    ParamMap weights;
+    layer.SaveWeights(weights);
+    ParamMap res;
+    for (const auto& g : MergeGrads(col))
+    {
+        const auto mem = LowerAccess(g.weight);
+        for (const auto& [name, w] : weights)
+        {
+            const float* p = LowerAccess(w).RawMemory();
+            if (p < mem.RawMemory()) continue;
+            const size_t row = (p - mem.RawMemory()) / mem.RowLen();
+            const size_t col = (p - mem.RawMemory()) % mem.RowLen();
+            if ((row < g.weight.RowNum()) && (col < g.weight.ColNum()))
+            {
+                auto cur = g.grad;
+                cur.Shrink(row, row + w.RowNum(), col, col + w.ColNum());
+                res[name] = cur;
+            }
+        }
+    }
+    return res;
+}
+
+inline void Compare(const RunResult& a, const RunResult& b, size_t paramNum)
+{
+    assert(a.outs.size() == b.outs.size());
+    for (size_t t = 0; t < a.outs.size(); ++t)
+    {
+        assert(Same(a.outs[t], b.outs[t]));
+        assert(Same(a.gradInputs[t], b.gradInputs[t]));
+    }
+    assert(Same(a.gradHidden, b.gradHidden));
+    assert(a.grads.size() == paramNum);
+    assert(b.grads.size() == paramNum);
+    for (const auto& [name, g] : a.grads)
+    {
+        assert(Same(g, b.grads.at(name)));
+    }
+}
@@ -0,0 +1,165 @@
+#include <MetaNN/meta_nn.h>
+#include "../../facilities/data_gen.h"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+template <typename TIn, typename TLabel>
+float CheckLoss(const TIn& in, const TLabel& label)
+{
+    double check = 0;
+    for (size_t i = 0; i < in.RowNum(); ++i)
+    {
+        double sum = 0;
+        for (size_t j = 0; j < in.ColNum(); ++j)
+        {
+            sum += exp(in(i, j));
+        }
+        for (size_t j = 0; j < in.ColNum(); ++j)
+        {
+            check -= label(i, j) * (in(i, j) - log(sum));
+        }
+    }
+    return (float)check;
+}
+
+void test_softmax_cross_entropy_layer1()
+{
+    cout << "Test softmax cross entropy layer case 1 ...\t";
+    using RootLayer = InjectPolicy<SoftmaxCrossEntropyLayer>;
+    static_assert(!RootLayer::IsFeedbackOutput, "Test Error");
+    static_assert(!RootLayer::IsUpdate, "Test Error");
+
+    RootLayer layer;
+    auto in = GenMatrix<float>(3, 4, 0.1f, 0.05f);
+    auto label = GenMatrix<float>(3, 4, 0.3f, 0.1f);
+
+    auto input = CostLayerIn::Create().Set<CostLayerIn>(in).Set<CostLayerLabel>(label);
+
+    LayerNeutralInvariant(layer);
+
+    auto out = layer.FeedForward(input);
+    auto res = Evaluate(out.Get<LayerIO>());
+    assert(fabs(res.Value() - CheckLoss(in, label)) < 0.0001);
+
+    LayerNeutralInvariant(layer);
+
+    NullParameter fbIn;
+    auto out_grad = layer.FeedBackward(fbIn);
+    auto fb1 = out_grad.Get<CostLayerIn>();
+    static_assert(std::is_same<decltype(fb1), NullParameter>::value, "Test error");
+
+    cout << "done" << endl;
+}
+
+void test_softmax_cross_entropy_layer2()
+{
+    cout << "Test softmax cross entropy layer case 2 ...\t";
+    using RootLayer = InjectPolicy<SoftmaxCrossEntropyLayer, PFeedbackOutput>;
+    static_assert(RootLayer::IsFeedbackOutput, "Test Error");
+    static_assert(!RootLayer::IsUpdate, "Test Error");
+
+    RootLayer layer;
+    auto in = GenMatrix<float>(3, 4, 0.1f, 0.05f);
+    Matrix<float, DeviceTags::CPU> label(3, 4);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 4; ++j)
+        {
+            label.SetValue(i, j, (i + 1 == j) ? 1 : 0);
+        }
+    }
+
+    auto input = CostLayerIn::Create()
+                        .Set<CostLayerIn>(in)
+                        .Set<CostLayerLabel>(label);
+
+    LayerNeutralInvariant(layer);
+
+    auto out = layer.FeedForward(input);
+    auto res = Evaluate(out.Get<LayerIO>());
+    assert(fabs(res.Value() - CheckLoss(in, label)) < 0.0001);
+
+    auto fb = LayerIO::Create().Set<LayerIO>(Scalar<float>(0.5));
+    auto out_grad = layer.FeedBackward(fb);
+    LayerNeutralInvariant(layer);
+
+    auto g = Evaluate(out_grad.Get<CostLayerIn>());
+    for (size_t i = 0; i < 3; ++i)
+    {
+        double sum = 0;
+        for (size_t j = 0; j < 4; ++j)
+        {
+            sum += exp(in(i, j));
+        }
+        for (size_t j = 0; j < 4; ++j)
+        {
+            assert(fabs(g(i, j) - 0.5 * (exp(in(i, j)) / sum - label(i, j))) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_softmax_cross_entropy_layer3()
+{
+    cout << "Test softmax cross entropy layer case 3 ...\t";
+    using RootLayer = InjectPolicy<SoftmaxCrossEntropyLayer, PFeedbackOutput>;
+    RootLayer layer;
+
+    vector<Matrix<float, DeviceTags::CPU>> op_in;
+    vector<Matrix<float, DeviceTags::CPU>> op_label;
+
+    LayerNeutralInvariant(layer);
+    for (size_t loop_count = 1; loop_count < 10; ++loop_count)
+    {
+        auto in = GenMatrix<float>(loop_count * 2, 4, 0.1f, 0.05f);
+        auto label = GenMatrix<float>(loop_count * 2, 4, 0.3f, 0.1f);
+
+        op_in.push_back(in);
+        op_label.push_back(label);
+
+        auto input = CostLayerIn::Create().Set<CostLayerIn>(in).Set<CostLayerLabel>(label);
+
+        auto out = layer.FeedForward(input);
+        auto res = Evaluate(out.Get<LayerIO>());
+        assert(fabs(res.Value() - CheckLoss(in, label)) < 0.001);
+    }
+
+    for (size_t loop_count = 9; loop_count >= 1; --loop_count)
+    {
+        auto out_grad = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(Scalar<float>(0.5 * loop_count)));
+        auto fb = Evaluate(out_grad.Get<CostLayerIn>());
+
+        auto in = op_in.back(); op_in.pop_back();
+        auto label = op_label.back(); op_label.pop_back();
+        for (size_t i = 0; i < loop_count * 2; ++i)
+        {
+            double sum = 0, labelSum = 0;
+            for (size_t j = 0; j < 4; ++j)
+            {
+                sum += exp(in(i, j));
+                labelSum += label(i, j);
+            }
+            for (size_t j = 0; j < 4; ++j)
+            {
+                const double check = 0.5 * loop_count * (exp(in(i, j)) / sum * labelSum - label(i, j));
+                assert(fabs(fb(i, j) - check) < 0.0001);
+            }
+        }
+    }
+
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
+}
+
+void test_softmax_cross_entropy_layer()
+{
+    test_softmax_cross_entropy_layer1();
+    test_softmax_cross_entropy_layer2();
+    test_softmax_cross_entropy_layer3();
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void test_softmax_cross_entropy_layer();
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <iostream>
 #include <map>
+#include <vector>
 using namespace MetaNN;
 using namespace std;
 
@@ -362,6 +363,48 @@ void test_bias_layer7()
     }
     cout << "done" << endl;
 }
+void test_bias_layer8()
+{
+    cout << "Test bias layer case 8 ...\t";
+    using RootLayer = InjectPolicy<BiasLayer, PUpdate, PBatchMode>;
+    RootLayer layer("root", 1, 6);
+
+    auto initializer = MakeInitializer<float, PInitializerIs<struct ConstantTag>>()
+                            .SetFiller<ConstantTag>(ConstantFiller{0.5});
+    map<string, Matrix<float, DeviceTags::CPU>> loader;
+    layer.Init(initializer, loader);
+
+    vector<Batch<float, DeviceTags::CPU, CategoryTags::Matrix>> op_grad;
+    for (size_t step = 0; step < 4; ++step)
+    {
+        layer.FeedForward(LayerIO::Create().Set<LayerIO>(GenBatchMatrix<float>(1, 6, 3, 0.1f, 0.1f)));
+    }
+    for (size_t step = 0; step < 4; ++step)
+    {
+        op_grad.push_back(GenBatchMatrix<float>(1, 6, 3, step * 0.3f, -0.05f));
+        layer.FeedBackward(LayerIO::Create().Set<LayerIO>(op_grad.back()));
+    }
+
+    GradCollector<float, DeviceTags::CPU> grad_collector(true);
+    layer.GradCollect(grad_collector);
+    assert(grad_collector.size() == 1);
+    assert(grad_collector.begin()->grad.size() == 1);
+    auto g = Evaluate(Collapse(grad_collector.begin()->grad));
+    for (size_t j = 0; j < 6; ++j)
+    {
+        float aim = 0;
+        for (size_t step = 0; step < 4; ++step)
+        {
+            for (size_t b = 0; b < 3; ++b)
+            {
+                aim += op_grad[step][b](0, j);
+            }
+        }
+        assert(fabs(g(0, j) - aim) < 0.0001f);
+    }
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
 }
 
 void test_bias_layer()
@@ -373,4 +416,5 @@ void test_bias_layer()
     test_bias_layer5();
     test_bias_layer6();
     test_bias_layer7();
+    test_bias_layer8();
 }
@@ -0,0 +1,317 @@
+#include <MetaNN/meta_nn.h>
+#include "../../facilities/data_gen.h"
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+void test_embedding_layer1()
+{
+    cout << "Test embedding layer case 1 ...\t";
+    using RootLayer = InjectPolicy<EmbeddingLayer>;
+    static_assert(!RootLayer::IsFeedbackOutput, "Test Error");
+    static_assert(!RootLayer::IsUpdate, "Test Error");
+
+    RootLayer layer("root", 100, 3);
+
+    auto w = GenMatrix<float>(100, 3, 0.1f, 0.01f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    LayerNeutralInvariant(layer);
+    auto wi = LayerIO::Create().Set<LayerIO>(OneHotVector<float, DeviceTags::CPU>(100, 42));
+
+    auto out = layer.FeedForward(wi);
+    auto res = Evaluate(out.Get<LayerIO>());
+    assert(res.RowNum() == 1);
+    assert(res.ColNum() == 3);
+    for (size_t j = 0; j < 3; ++j)
+    {
+        assert(res(0, j) == w(42, j));
+    }
+
+    auto out_grad = layer.FeedBackward(LayerIO::Create());
+    auto fbOut = out_grad.Get<LayerIO>();
+    static_assert(is_same<decltype(fbOut), NullParameter>::value, "Test error");
+
+    params.clear();
+    layer.SaveWeights(params);
+    assert(params.find("root") != params.end());
+
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
+
+void test_embedding_layer2()
+{
+    cout << "Test embedding layer case 2 ...\t";
+    using RootLayer = InjectPolicy<EmbeddingLayer, PUpdate>;
+    static_assert(!RootLayer::IsFeedbackOutput, "Test Error");
+    static_assert(RootLayer::IsUpdate, "Test Error");
+
+    RootLayer layer("root", 100, 3);
+
+    auto w = GenMatrix<float>(100, 3, 0.1f, 0.01f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    LayerNeutralInvariant(layer);
+    const size_t pos[] = {42, 7, 42};
+    for (size_t i = 0; i < 3; ++i)
+    {
+        auto wi = LayerIO::Create().Set<LayerIO>(OneHotVector<float, DeviceTags::CPU>(100, pos[i]));
+        auto res = Evaluate(layer.FeedForward(wi).Get<LayerIO>());
+        for (size_t j = 0; j < 3; ++j)
+        {
+            assert(res(0, j) == w(pos[i], j));
+        }
+    }
+
+    for (size_t i = 3; i > 0; --i)
+    {
+        auto g = GenMatrix<float>(1, 3, (float)i, 0.1f);
+        auto out_grad = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(g));
+        auto fbOut = out_grad.Get<LayerIO>();
+        static_assert(is_same<decltype(fbOut), NullParameter>::value, "Test error");
+    }
+
+    GradCollector<float, DeviceTags::CPU> grad_collector(false, true);
+    layer.GradCollect(grad_collector);
+    assert(grad_collector.size() == 0);
+    assert(grad_collector.rows_size() == 1);
+
+    const auto& info = *grad_collector.rows_begin();
+    assert(info.weight.RowNum() == 100);
+    assert(info.weight(42, 1) == w(42, 1));
+    assert(info.rows.size() == 3);
+    assert(info.grad.size() == 3);
+
+    // row-wise sum of the sparse gradients against the dense gradient of a weight layer
+    Matrix<float, DeviceTags::CPU> dense(100, 3);
+    for (size_t i = 0; i < 100; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            dense.SetValue(i, j, 0);
+        }
+    }
+    for (size_t k = 0; k < info.grad.size(); ++k)
+    {
+        assert(info.rows[k].size() == 1);
+        auto g = Evaluate(info.grad[k]);
+        assert(g.BatchNum() == 1);
+        for (size_t j = 0; j < 3; ++j)
+        {
+            const size_t row = info.rows[k][0];
+            dense.SetValue(row, j, dense(row, j) + g[0](0, j));
+        }
+    }
+    for (size_t j = 0; j < 3; ++j)
+    {
+        assert(fabs(dense(42, j) - (0.1f * (1 + j) + 0.1f * (3 + j))) < 0.0001);
+        assert(fabs(dense(7, j) - 0.1f * (2 + j)) < 0.0001);
+        assert(dense(0, j) == 0);
+    }
+
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
+
+void test_embedding_layer3()
+{
+    cout << "Test embedding layer case 3 ...\t";
+    using RootLayer = InjectPolicy<EmbeddingLayer, PUpdate, PBatchMode>;
+    RootLayer layer("root", 100, 3);
+
+    auto w = GenMatrix<float>(100, 3, 0.1f, 0.01f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    LayerNeutralInvariant(layer);
+    auto label = BatchOneHotVector<float, DeviceTags::CPU>(100, {5, 99, 5, 0});
+    auto res = Evaluate(layer.FeedForward(LayerIO::Create().Set<LayerIO>(label)).Get<LayerIO>());
+    assert(res.BatchNum() == 4);
+    for (size_t b = 0; b < 4; ++b)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            assert(res[b](0, j) == w(label.HotPos(b), j));
+        }
+    }
+
+    auto g = GenBatchMatrix<float>(1, 3, 4, 1.0f, 0.1f);
+    layer.FeedBackward(LayerIO::Create().Set<LayerIO>(g));
+
+    GradCollector<float, DeviceTags::CPU> grad_collector(false, true);
+    layer.GradCollect(grad_collector);
+    assert(grad_collector.rows_size() == 1);
+    const auto& info = *grad_collector.rows_begin();
+    assert(info.rows.size() == 1);
+    assert(info.rows[0] == label.HotPos());
+
+    auto info_g = Evaluate(info.grad[0]);
+    assert(info_g.BatchNum() == 4);
+    for (size_t b = 0; b < 4; ++b)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            assert(info_g[b](0, j) == g[b](0, j));
+        }
+    }
+
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
+
+void test_embedding_layer4()
+{
+    cout << "Test embedding layer case 4 ...\t";
+    using RootLayer = InjectPolicy<EmbeddingLayer, PUpdate, PBatchMode>;
+    RootLayer layer("root", 100, 3);
+
+    auto w = GenMatrix<float>(100, 3, 0.1f, 0.01f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    Matrix<float, DeviceTags::CPU> expected(100, 3);
+    for (size_t i = 0; i < 100; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            expected.SetValue(i, j, 0);
+        }
+    }
+
+    // The accumulating collector keeps one sum of the touched rows however many steps are collected
+    GradCollector<float, DeviceTags::CPU> grad_collector(true, true);
+    const vector<size_t> hotPos[] = {{5, 99, 5, 0}, {7, 5, 7, 99}, {0, 0, 42, 5}};
+    auto step = [&](size_t s)
+    {
+        auto label = BatchOneHotVector<float, DeviceTags::CPU>(100, hotPos[s % 3]);
+        layer.FeedForward(LayerIO::Create().Set<LayerIO>(label));
+        auto g = GenBatchMatrix<float>(1, 3, 4, (float)s, 0.01f);
+        layer.FeedBackward(LayerIO::Create().Set<LayerIO>(g));
+        layer.GradCollect(grad_collector);
+        for (size_t b = 0; b < 4; ++b)
+        {
+            const size_t row = label.HotPos(b);
+            for (size_t j = 0; j < 3; ++j)
+            {
+                expected.SetValue(row, j, expected(row, j) + g[b](0, j));
+            }
+        }
+    };
+    for (size_t s = 0; s < 30; ++s)
+    {
+        step(s);
+        const auto& info = *grad_collector.rows_begin();
+        assert(info.rows.size() == 1);
+        assert(info.grad.size() == 1);
+    }
+    assert(grad_collector.size() == 0);
+    assert(grad_collector.rows_size() == 1);
+
+    const auto& info = *grad_collector.rows_begin();
+    assert(info.rows[0] == vector<size_t>({5, 99, 0, 7, 42}));
+    auto sum = Evaluate(info.grad[0]);
+    assert(sum.BatchNum() == 5);
+    for (size_t k = 0; k < 5; ++k)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            assert(fabs(sum[k](0, j) - expected(info.rows[0][k], j)) < 0.001);
+        }
+    }
+
+    // A dense gradient of the same weight takes the summed rows, and the rows collected later
+    auto weight = info.weight;
+    auto dense = GenMatrix<float>(100, 3, 1.0f, 0.01f);
+    grad_collector.Collect(weight, dense);
+    assert(grad_collector.size() == 1);
+    assert(grad_collector.rows_size() == 0);
+    step(30);
+    assert(grad_collector.rows_size() == 0);
+
+    auto buf = Evaluate(grad_collector.begin()->grad[0]);
+    for (size_t i = 0; i < 100; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            assert(fabs(buf(i, j) - expected(i, j) - dense(i, j)) < 0.001);
+        }
+    }
+
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
+
+void test_embedding_layer5()
+{
+    cout << "Test embedding layer case 5 ...\t";
+    using RootLayer = InjectPolicy<EmbeddingLayer, PUpdate, PBatchMode>;
+    RootLayer layer("root", 100, 3);
+
+    auto w = GenMatrix<float>(100, 3, 0.1f, 0.01f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    // Without keepRows, the rows are collected as the dense gradient of the table, visited by
+    // begin() / end() as that of a weight layer
+    auto label = BatchOneHotVector<float, DeviceTags::CPU>(100, {5, 99, 5, 0});
+    auto g = GenBatchMatrix<float>(1, 3, 4, 1.0f, 0.1f);
+    for (bool accumulate : {false, true})
+    {
+        GradCollector<float, DeviceTags::CPU> grad_collector(accumulate);
+        for (size_t s = 0; s < 2; ++s)
+        {
+            layer.FeedForward(LayerIO::Create().Set<LayerIO>(label));
+            layer.FeedBackward(LayerIO::Create().Set<LayerIO>(g));
+            layer.GradCollect(grad_collector);
+        }
+        assert(grad_collector.size() == 1);
+        assert(grad_collector.rows_size() == 0);
+
+        const auto& info = *grad_collector.begin();
+        assert(info.weight(42, 1) == w(42, 1));
+        assert(info.grad.size() == (accumulate ? 1 : 2));
+        auto dense = Evaluate(Collapse(info.grad));
+        for (size_t i = 0; i < 100; ++i)
+        {
+            for (size_t j = 0; j < 3; ++j)
+            {
+                float expected = 0;
+                if (i == 5) expected = g[0](0, j) + g[2](0, j);
+                if (i == 99) expected = g[1](0, j);
+                if (i == 0) expected = g[3](0, j);
+                assert(fabs(dense(i, j) - 2 * expected) < 0.0001);
+            }
+        }
+    }
+
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
+}
+
+void test_embedding_layer()
+{
+    test_embedding_layer1();
+    test_embedding_layer2();
+    test_embedding_layer3();
+    test_embedding_layer4();
+    test_embedding_layer5();
+}
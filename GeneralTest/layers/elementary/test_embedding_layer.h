@@ -0,0 +1,3 @@
+#pragma once
+
+void test_embedding_layer();
\ No newline at end of file
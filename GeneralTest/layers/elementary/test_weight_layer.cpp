@@ -344,6 +344,144 @@ void test_weight_layer6()
     
     cout << "done" << endl;
 }
+void test_weight_layer7()
+{
+    cout << "Test weight layer case 7 ...\t";
+    // the packed weight is rebuilt after an in-place write to the weight
+    using RootLayer = InjectPolicy<WeightLayer>;
+    RootLayer layer("root", 300, 300);
+
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", GenMatrix<float>(300, 300, -0.3f, 0.00001f));
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    Matrix<float, DeviceTags::CPU> input(1, 300);
+    for (size_t i = 0; i < 300; ++i)
+    {
+        input.SetValue(0, i, 1);
+    }
+    auto out = layer.FeedForward(LayerIO::Create().Set<LayerIO>(input));
+    Evaluate(out.Get<LayerIO>());
+
+    auto mem = LowerAccess(params["root"]);
+    std::fill(mem.MutableRawMemory(), mem.MutableRawMemory() + 300 * 300, 1.f);
+    out = layer.FeedForward(LayerIO::Create().Set<LayerIO>(input));
+    auto res = Evaluate(out.Get<LayerIO>());
+    for (size_t j = 0; j < 300; ++j)
+    {
+        assert(fabs(res(0, j) - 300) < 0.001f);
+    }
+    cout << "done" << endl;
+}
+
+void test_weight_layer8()
+{
+    cout << "Test weight layer case 8 ...\t";
+    // an accumulating collector sums the gradients of all steps into one buffer
+    using RootLayer = InjectPolicy<WeightLayer, PUpdate>;
+    RootLayer layer("root", 30, 20);
+
+    auto w = GenMatrix<float>(30, 20, -0.3f, 0.001f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    GradCollector<float, DeviceTags::CPU> plain_collector;
+    GradCollector<float, DeviceTags::CPU> acc_collector(true);
+    assert(!plain_collector.IsAccumulate());
+    assert(acc_collector.IsAccumulate());
+
+    for (size_t round = 0; round < 4; ++round)
+    {
+        for (size_t step = 0; step < 25; ++step)
+        {
+            auto input = GenMatrix<float>(1, 30, (round % 2) * 0.1f + step * 0.01f, 0.003f);
+            layer.FeedForward(LayerIO::Create().Set<LayerIO>(input));
+        }
+        for (size_t step = 0; step < 25; ++step)
+        {
+            auto grad = GenMatrix<float>(1, 20, 0.2f - step * 0.01f, -0.002f);
+            layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad));
+        }
+        if (round < 2)
+        {
+            layer.GradCollect(acc_collector);
+        }
+        else
+        {
+            layer.GradCollect(plain_collector);
+        }
+        LayerNeutralInvariant(layer);
+    }
+
+    assert(acc_collector.size() == 1);
+    assert(acc_collector.begin()->grad.size() == 1);
+    assert(plain_collector.begin()->grad.size() == 50);
+
+    auto acc_g = Evaluate(Collapse(acc_collector.begin()->grad));
+    auto plain_g = Evaluate(Collapse(plain_collector.begin()->grad));
+    for (size_t i = 0; i < 30; ++i)
+    {
+        for (size_t j = 0; j < 20; ++j)
+        {
+            assert(fabs(acc_g(i, j) - plain_g(i, j)) < 0.0001f);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_weight_layer9()
+{
+    cout << "Test weight layer case 9 ...\t";
+    using RootLayer = InjectPolicy<WeightLayer, PUpdate, PBatchMode>;
+    RootLayer layer("root", 8, 5);
+
+    auto w = GenMatrix<float>(8, 5, 0.1f, -0.02f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root", w);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    layer.Init(initializer, params);
+
+    vector<Batch<float, DeviceTags::CPU, CategoryTags::Matrix>> op_in;
+    vector<Batch<float, DeviceTags::CPU, CategoryTags::Matrix>> op_grad;
+    for (size_t step = 0; step < 6; ++step)
+    {
+        op_in.push_back(GenBatchMatrix<float>(1, 8, 3, step * 0.1f, 0.01f));
+        layer.FeedForward(LayerIO::Create().Set<LayerIO>(op_in.back()));
+    }
+    for (size_t step = 0; step < 6; ++step)
+    {
+        op_grad.push_back(GenBatchMatrix<float>(1, 5, 3, -0.5f + step * 0.1f, 0.03f));
+        layer.FeedBackward(LayerIO::Create().Set<LayerIO>(op_grad.back()));
+    }
+    reverse(op_grad.begin(), op_grad.end());
+
+    GradCollector<float, DeviceTags::CPU> grad_collector(true);
+    layer.GradCollect(grad_collector);
+    assert(grad_collector.size() == 1);
+    assert(grad_collector.begin()->grad.size() == 1);
+    auto info_g = Evaluate(Collapse(grad_collector.begin()->grad));
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        for (size_t j = 0; j < 5; ++j)
+        {
+            float aim = 0;
+            for (size_t step = 0; step < 6; ++step)
+            {
+                for (size_t b = 0; b < 3; ++b)
+                {
+                    aim += op_in[step][b](0, i) * op_grad[step][b](0, j);
+                }
+            }
+            assert(fabs(aim - info_g(i, j)) < 0.0001f);
+        }
+    }
+    LayerNeutralInvariant(layer);
+    cout << "done" << endl;
+}
 }
 
 void test_weight_layer()
@@ -354,4 +492,7 @@ void test_weight_layer()
     test_weight_layer4();
     test_weight_layer5();
     test_weight_layer6();
+    test_weight_layer7();
+    test_weight_layer8();
+    test_weight_layer9();
 }
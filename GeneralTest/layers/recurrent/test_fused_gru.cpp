@@ -0,0 +1,239 @@
+#include "test_fused_gru.h"
+#include "../../facilities/recurrent_check.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+using GruKernel = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput>;
+using FusedGruKernel = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep>;
+
+// Forward over xs from h0, backward with out_t - 0.5 as the gradient of each output
+template <typename TLayer>
+RunResult Run(TLayer& layer, const vector<CpuMatrix>& xs, const CpuMatrix& h0,
+              GradCollector<float, DeviceTags::CPU>& col)
+{
+    using TData = DynamicData<float, DeviceTags::CPU, CategoryTags::Matrix>;
+    vector<TData> outs;
+    for (size_t t = 0; t < xs.size(); ++t)
+    {
+        auto in = TLayer::InputType::Create().template Set<LayerIO>(xs[t]);
+        if (t == 0)
+        {
+            auto res = layer.FeedForward(std::move(in).template Set<RnnLayerHiddenBefore>(h0));
+            outs.push_back(MakeDynamic(res.template Get<LayerIO>()));
+        }
+        else
+        {
+            outs.push_back(MakeDynamic(layer.FeedForward(std::move(in)).template Get<LayerIO>()));
+        }
+    }
+
+    vector<TData> gradInputs(xs.size());
+    TData gradHidden;
+    for (size_t t = xs.size(); t-- > 0;)
+    {
+        auto grad = outs[t] - Scalar<float>(0.5f);
+        auto res = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad));
+        gradInputs[t] = MakeDynamic(res.template Get<LayerIO>());
+        gradHidden = MakeDynamic(res.template Get<RnnLayerHiddenBefore>());
+    }
+
+    RunResult result;
+    for (size_t t = 0; t < xs.size(); ++t)
+    {
+        result.outs.push_back(Evaluate(outs[t]));
+        result.gradInputs.push_back(Evaluate(gradInputs[t]));
+    }
+    result.gradHidden = Evaluate(gradHidden);
+
+    layer.GradCollect(col);
+    result.grads = GradsByName(layer, col);
+    layer.NeutralInvariant();
+    return result;
+}
+
+// As Run, with the steps of each chunk fed as one sequence
+template <typename TLayer>
+RunResult RunSequence(TLayer& layer, const vector<vector<CpuMatrix>>& chunks, const CpuMatrix& h0,
+                      GradCollector<float, DeviceTags::CPU>& col)
+{
+    vector<CpuSequence> outs;
+    for (size_t c = 0; c < chunks.size(); ++c)
+    {
+        auto in = TLayer::InputType::Create().template Set<LayerIO>(MakeSequence(chunks[c]));
+        if (c == 0)
+        {
+            auto res = layer.FeedForwardSequence(std::move(in).template Set<RnnLayerHiddenBefore>(h0));
+            outs.push_back(Evaluate(res.template Get<LayerIO>()));
+        }
+        else
+        {
+            outs.push_back(Evaluate(layer.FeedForwardSequence(std::move(in)).template Get<LayerIO>()));
+        }
+    }
+
+    RunResult result;
+    vector<vector<CpuMatrix>> gradInputs(chunks.size());
+    for (size_t c = chunks.size(); c-- > 0;)
+    {
+        vector<CpuMatrix> grads;
+        for (size_t t = 0; t < outs[c].Length(); ++t)
+        {
+            grads.push_back(Evaluate(outs[c][t] - Scalar<float>(0.5f)));
+        }
+        auto res = layer.FeedBackwardSequence(GruSequenceOutput::Create().Set<LayerIO>(MakeSequence(grads)));
+        const auto gradInput = Evaluate(res.template Get<LayerIO>());
+        for (size_t t = 0; t < gradInput.Length(); ++t)
+        {
+            gradInputs[c].push_back(gradInput[t]);
+        }
+        result.gradHidden = Evaluate(res.template Get<RnnLayerHiddenBefore>());
+    }
+
+    for (size_t c = 0; c < chunks.size(); ++c)
+    {
+        for (size_t t = 0; t < outs[c].Length(); ++t)
+        {
+            result.outs.push_back(outs[c][t]);
+            result.gradInputs.push_back(gradInputs[c][t]);
+        }
+    }
+    layer.GradCollect(col);
+    result.grads = GradsByName(layer, col);
+    layer.NeutralInvariant();
+    return result;
+}
+
+void test_fused_gru1()
+{
+    cout << "Test fused gru case 1 ...\t";
+    // the fused step computes what the composed GruStep computes, forward and backward
+    auto initializer = MakeParamInitializer(GenParams("gru", 5, 7));
+
+    vector<CpuMatrix> xs{GenMatrix<float>(3, 5, -8, 0.05f),
+                         GenMatrix<float>(3, 5, 4, -0.03f),
+                         GenMatrix<float>(3, 5, -1, 0.07f)};
+    auto h0 = GenMatrix<float>(3, 7, -10, 0.04f);
+
+    GruKernel gru("gru", 5, 7);
+    ParamMap params;
+    gru.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> col;
+    const auto expected = Run(gru, xs, h0, col);
+
+    FusedGruKernel fused("gru", 5, 7);
+    ParamMap fusedParams;
+    fused.Init(initializer, fusedParams);
+    GradCollector<float, DeviceTags::CPU> fusedCol(true);
+    const auto res = Run(fused, xs, h0, fusedCol);
+    Compare(expected, res, 6);
+
+    // the gates of one kind share a matrix, exposed under the names of GruStep
+    assert(fusedParams.size() == 6);
+    assert(LowerAccess(fusedParams["gru-Wr"]).RawMemory() == LowerAccess(fusedParams["gru-Wz"]).RawMemory() + 7);
+    assert(LowerAccess(fusedParams["gru-W"]).RawMemory() == LowerAccess(fusedParams["gru-Wz"]).RawMemory() + 14);
+    assert(LowerAccess(fusedParams["gru-Ur"]).RawMemory() == LowerAccess(fusedParams["gru-Uz"]).RawMemory() + 7);
+    cout << "done" << endl;
+}
+
+void test_fused_gru2()
+{
+    cout << "Test fused gru case 2 ...\t";
+    // weights saved by either step load into the other one, also when packed in an arena
+    const auto origin = GenParams("rnn", 4, 6);
+    auto initializer = MakeInitializer<float>();
+
+    vector<CpuMatrix> xs{GenMatrix<float>(2, 4, 3, 0.06f), GenMatrix<float>(2, 4, -5, 0.04f)};
+    auto h0 = GenMatrix<float>(2, 6, 2, -0.05f);
+
+    FusedGruKernel fused("rnn", 4, 6);
+    ParamMap loaded = origin;
+    fused.Init(initializer, loaded);
+    ParamMap saved;
+    fused.SaveWeights(saved);
+    assert(saved.size() == 6);
+    for (const auto& [name, mat] : origin)
+    {
+        assert(Same(saved[name], mat));
+        assert(saved[name] == loaded[name]);
+    }
+
+    GruKernel gru("rnn", 4, 6);
+    gru.Init(initializer, saved);
+    GradCollector<float, DeviceTags::CPU> col;
+    const auto expected = Run(gru, xs, h0, col);
+
+    ParamMap params = origin;
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+    FusedGruKernel packed("rnn", 4, 6);
+    packed.Init(initializer, params);
+    arena.Pack(params);
+    assert(arena.ParamNum() == 6);
+    assert(arena.Size() == 80 + 80 + 48);
+
+    FusedGruKernel inArena("rnn", 4, 6);
+    inArena.Init(initializer, params);
+    ParamMap arenaSaved;
+    inArena.SaveWeights(arenaSaved);
+    for (const auto& [name, mat] : arenaSaved)
+    {
+        assert(arena.Contains(mat) && (mat == params[name]));
+    }
+
+    GradCollector<float, DeviceTags::CPU> arenaCol(arena);
+    const auto res = Run(inArena, xs, h0, arenaCol);
+    Compare(expected, res, 6);
+    for (const auto& [name, mat] : arenaSaved)
+    {
+        assert(Same(arena.Grad(mat), res.grads.at(name)));
+    }
+    cout << "done" << endl;
+}
+
+void test_fused_gru3()
+{
+    cout << "Test fused gru case 3 ...\t";
+    // a whole sequence, or chunks of it, in one call each computes what the single steps compute
+    auto initializer = MakeParamInitializer(GenParams("gru", 6, 5));
+
+    vector<CpuMatrix> xs;
+    for (size_t t = 0; t < 5; ++t)
+    {
+        xs.push_back(GenMatrix<float>(4, 6, -7.f + 3 * t, (t % 2) ? 0.05f : -0.04f));
+    }
+    auto h0 = GenMatrix<float>(4, 5, 3, -0.06f);
+
+    ParamMap params;
+    FusedGruKernel stepwise("gru", 6, 5);
+    stepwise.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> col;
+    const auto expected = Run(stepwise, xs, h0, col);
+
+    FusedGruKernel whole("gru", 6, 5);
+    whole.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> wholeCol;
+    Compare(expected, RunSequence(whole, {xs}, h0, wholeCol), 6);
+
+    FusedGruKernel chunked("gru", 6, 5);
+    chunked.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> chunkedCol;
+    const vector<vector<CpuMatrix>> chunks{{xs[0], xs[1]}, {xs[2]}, {xs[3], xs[4]}};
+    Compare(expected, RunSequence(chunked, chunks, h0, chunkedCol), 6);
+    cout << "done" << endl;
+}
+}
+
+void test_fused_gru()
+{
+    test_fused_gru1();
+    test_fused_gru2();
+    test_fused_gru3();
+}
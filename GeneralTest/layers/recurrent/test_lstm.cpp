@@ -0,0 +1,337 @@
+#include "test_lstm.h"
+#include "../../facilities/recurrent_check.h"
+#include <MetaNN/meta_nn.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+using LstmKernel = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecLSTMStep>;
+
+const vector<string> GateNames{"-Wi", "-Wf", "-Wo", "-Wg", "-Ui", "-Uf", "-Uo", "-Ug"};
+
+// The state [h | c] before the first step
+CpuMatrix GenState(size_t rowNum, size_t outLen)
+{
+    auto h0 = GenMatrix<float>(rowNum, outLen, -6, 0.05f);
+    auto c0 = GenMatrix<float>(rowNum, outLen, 9, -0.08f);
+    CpuMatrix res(rowNum, 2 * outLen);
+    for (size_t i = 0; i < rowNum; ++i)
+    {
+        for (size_t j = 0; j < outLen; ++j)
+        {
+            res.SetValue(i, j, h0(i, j));
+            res.SetValue(i, outLen + j, c0(i, j));
+        }
+    }
+    return res;
+}
+
+// The LSTM computed element by element in double, with out_t - 0.5 as the gradient of each
+// output. The outputs are fed back window by window; the gradient of each window goes on
+// through up to length - window steps before it, as RecurrentLayer does with truncated BPTT.
+RunResult Reference(const ParamMap& params, const string& name, const vector<CpuMatrix>& xs,
+                    const CpuMatrix& s0, size_t window, size_t length)
+{
+    const size_t stepNum = xs.size();
+    const size_t rowNum = s0.RowNum();
+    const size_t n = s0.ColNum() / 2;
+    const size_t inLen = xs[0].ColNum();
+    const size_t xhLen = inLen + n;
+
+    // w[p][k]: row p of [W ; U], column k of [i | f | o | g]
+    vector<vector<double>> w(xhLen, vector<double>(4 * n));
+    for (size_t g = 0; g < 4; ++g)
+    {
+        const auto& wg = params.at(name + GateNames[g]);
+        const auto& ug = params.at(name + GateNames[4 + g]);
+        for (size_t j = 0; j < n; ++j)
+        {
+            for (size_t p = 0; p < inLen; ++p) w[p][g * n + j] = wg(p, j);
+            for (size_t p = 0; p < n; ++p) w[inLen + p][g * n + j] = ug(p, j);
+        }
+    }
+
+    // xh[t][r], gates[t][r], c[t][r] (the cell state before step t), h[t][r] (the output of step t - 1)
+    using Rows = vector<vector<double>>;
+    vector<Rows> xh(stepNum, Rows(rowNum)), gates(stepNum, Rows(rowNum, vector<double>(4 * n)));
+    vector<Rows> h(stepNum + 1, Rows(rowNum, vector<double>(n))), c = h;
+    for (size_t r = 0; r < rowNum; ++r)
+    {
+        for (size_t j = 0; j < n; ++j)
+        {
+            h[0][r][j] = s0(r, j);
+            c[0][r][j] = s0(r, n + j);
+        }
+    }
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        for (size_t r = 0; r < rowNum; ++r)
+        {
+            for (size_t p = 0; p < inLen; ++p) xh[t][r].push_back(xs[t](r, p));
+            for (size_t p = 0; p < n; ++p) xh[t][r].push_back(h[t][r][p]);
+            for (size_t k = 0; k < 4 * n; ++k)
+            {
+                double pre = 0;
+                for (size_t p = 0; p < xhLen; ++p) pre += xh[t][r][p] * w[p][k];
+                gates[t][r][k] = (k < 3 * n) ? 1 / (1 + exp(-pre)) : tanh(pre);
+            }
+            for (size_t j = 0; j < n; ++j)
+            {
+                const auto& g = gates[t][r];
+                c[t + 1][r][j] = g[n + j] * c[t][r][j] + g[j] * g[3 * n + j];
+                h[t + 1][r][j] = g[2 * n + j] * tanh(c[t + 1][r][j]);
+            }
+        }
+    }
+
+    RunResult res;
+    res.gradInputs.resize(stepNum);
+    res.gradHidden = CpuMatrix(rowNum, 2 * n);
+    vector<vector<double>> gw(xhLen, vector<double>(4 * n));
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        CpuMatrix out(rowNum, n);
+        for (size_t r = 0; r < rowNum; ++r)
+        {
+            for (size_t j = 0; j < n; ++j) out.SetValue(r, j, (float)h[t + 1][r][j]);
+        }
+        res.outs.push_back(out);
+    }
+
+    for (size_t begin = 0; begin < stepNum; begin += window)
+    {
+        const size_t end = min(stepNum, begin + window);
+        const size_t start = (begin > length - window) ? begin - (length - window) : 0;
+        Rows dh(rowNum, vector<double>(n)), dc = dh;
+        for (size_t t = end; t-- > start;)
+        {
+            CpuMatrix gradInput(rowNum, inLen);
+            for (size_t r = 0; r < rowNum; ++r)
+            {
+                const auto& g = gates[t][r];
+                vector<double> pre(4 * n);
+                for (size_t j = 0; j < n; ++j)
+                {
+                    const double tc = tanh(c[t + 1][r][j]);
+                    const double dhj = dh[r][j] + ((t >= begin) ? (double)res.outs[t](r, j) - 0.5 : 0);
+                    const double dcj = dc[r][j] + dhj * g[2 * n + j] * (1 - tc * tc);
+                    pre[j] = dcj * g[3 * n + j] * g[j] * (1 - g[j]);
+                    pre[n + j] = dcj * c[t][r][j] * g[n + j] * (1 - g[n + j]);
+                    pre[2 * n + j] = dhj * tc * g[2 * n + j] * (1 - g[2 * n + j]);
+                    pre[3 * n + j] = dcj * g[j] * (1 - g[3 * n + j] * g[3 * n + j]);
+                    dc[r][j] = dcj * g[n + j];
+                }
+                for (size_t p = 0; p < xhLen; ++p)
+                {
+                    double sum = 0;
+                    for (size_t k = 0; k < 4 * n; ++k)
+                    {
+                        gw[p][k] += xh[t][r][p] * pre[k];
+                        sum += pre[k] * w[p][k];
+                    }
+                    if (p < inLen) gradInput.SetValue(r, p, (float)sum);
+                    else dh[r][p - inLen] = sum;
+                }
+            }
+            if (t >= begin) res.gradInputs[t] = gradInput;
+            if (t == 0)
+            {
+                for (size_t r = 0; r < rowNum; ++r)
+                {
+                    for (size_t j = 0; j < n; ++j)
+                    {
+                        res.gradHidden.SetValue(r, j, (float)dh[r][j]);
+                        res.gradHidden.SetValue(r, n + j, (float)dc[r][j]);
+                    }
+                }
+            }
+        }
+    }
+
+    for (size_t g = 0; g < 8; ++g)
+    {
+        const size_t rowB = (g < 4) ? 0 : inLen;
+        const size_t rowNum = (g < 4) ? inLen : n;
+        CpuMatrix cur(rowNum, n);
+        for (size_t p = 0; p < rowNum; ++p)
+        {
+            for (size_t j = 0; j < n; ++j) cur.SetValue(p, j, (float)gw[rowB + p][(g % 4) * n + j]);
+        }
+        res.grads[name + GateNames[g]] = cur;
+    }
+    return res;
+}
+
+// Forward over the steps of a window from s0 (the first one) or the state the layer carries,
+// then backward with out_t - 0.5 as the gradient of each output
+template <typename TLayer>
+RunResult Run(TLayer& layer, const vector<CpuMatrix>& xs, const CpuMatrix& s0, size_t window,
+              GradCollector<float, DeviceTags::CPU>& col)
+{
+    RunResult result;
+    result.gradInputs.resize(xs.size());
+    for (size_t begin = 0; begin < xs.size(); begin += window)
+    {
+        const size_t end = min(xs.size(), begin + window);
+        for (size_t t = begin; t < end; ++t)
+        {
+            auto in = TLayer::InputType::Create().template Set<LayerIO>(xs[t]);
+            if (t == 0)
+            {
+                auto res = layer.FeedForward(std::move(in).template Set<RnnLayerHiddenBefore>(s0));
+                result.outs.push_back(Evaluate(res.template Get<LayerIO>()));
+            }
+            else
+            {
+                result.outs.push_back(Evaluate(layer.FeedForward(std::move(in)).template Get<LayerIO>()));
+            }
+        }
+        for (size_t t = end; t-- > begin;)
+        {
+            auto grad = Evaluate(result.outs[t] - Scalar<float>(0.5f));
+            auto res = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad));
+            result.gradInputs[t] = Evaluate(res.template Get<LayerIO>());
+            if (t == 0)
+            {
+                result.gradHidden = Evaluate(res.template Get<RnnLayerHiddenBefore>());
+            }
+        }
+        layer.GradCollect(col);
+        layer.NeutralInvariant();
+    }
+    result.grads = GradsByName(layer, col);
+    return result;
+}
+
+vector<CpuMatrix> GenInputs(size_t stepNum, size_t rowNum, size_t inLen)
+{
+    vector<CpuMatrix> res;
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        res.push_back(GenMatrix<float>(rowNum, inLen, -7.f + 3 * t, (t % 2) ? 0.05f : -0.04f));
+    }
+    return res;
+}
+
+void test_lstm1()
+{
+    cout << "Test lstm case 1 ...\t";
+    // forward and BPTT match the LSTM computed element by element
+    const auto origin = GenParams("lstm", 5, 7, GateNames);
+    auto initializer = MakeInitializer<float>();
+    for (const auto& [name, mat] : origin)
+    {
+        initializer.SetMatrix(name, mat);
+    }
+    const auto xs = GenInputs(3, 3, 5);
+    const auto s0 = GenState(3, 7);
+
+    LstmKernel layer("lstm", 5, 7);
+    ParamMap params;
+    layer.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> col;
+    Compare(Reference(origin, "lstm", xs, s0, 3, 3), Run(layer, xs, s0, 3, col), 8);
+
+    // the weights of all gates share one matrix, [W ; U] with the gates side by side
+    assert(params.size() == 8);
+    const float* base = LowerAccess(params["lstm-Wi"]).RawMemory();
+    assert(LowerAccess(params["lstm-Wf"]).RawMemory() == base + 7);
+    assert(LowerAccess(params["lstm-Wg"]).RawMemory() == base + 21);
+    assert(LowerAccess(params["lstm-Ui"]).RawMemory() == base + 5 * 28);
+    assert(LowerAccess(params["lstm-Uo"]).RawMemory() == base + 5 * 28 + 14);
+    cout << "done" << endl;
+}
+
+void test_lstm2()
+{
+    cout << "Test lstm case 2 ...\t";
+    // saved weights load back in place, also when packed in an arena
+    const auto origin = GenParams("rnn", 4, 6, GateNames);
+    auto initializer = MakeInitializer<float>();
+    const auto xs = GenInputs(2, 2, 4);
+    const auto s0 = GenState(2, 6);
+
+    LstmKernel layer("rnn", 4, 6);
+    ParamMap loaded = origin;
+    layer.Init(initializer, loaded);
+    ParamMap saved;
+    layer.SaveWeights(saved);
+    assert(saved.size() == 8);
+    for (const auto& [name, mat] : origin)
+    {
+        assert(Same(saved[name], mat));
+        assert(saved[name] == loaded[name]);
+    }
+
+    ParamMap params = origin;
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+    LstmKernel packed("rnn", 4, 6);
+    packed.Init(initializer, params);
+    arena.Pack(params);
+    assert(arena.ParamNum() == 8);
+    assert(arena.Size() == 10 * 24);
+
+    LstmKernel inArena("rnn", 4, 6);
+    inArena.Init(initializer, params);
+    ParamMap arenaSaved;
+    inArena.SaveWeights(arenaSaved);
+    for (const auto& [name, mat] : arenaSaved)
+    {
+        assert(arena.Contains(mat) && (mat == params[name]));
+    }
+
+    GradCollector<float, DeviceTags::CPU> arenaCol(arena);
+    const auto res = Run(inArena, xs, s0, 2, arenaCol);
+    Compare(Reference(origin, "rnn", xs, s0, 2, 2), res, 8);
+    for (const auto& [name, mat] : arenaSaved)
+    {
+        assert(Same(arena.Grad(mat), res.grads.at(name)));
+    }
+    cout << "done" << endl;
+}
+
+void test_lstm3()
+{
+    cout << "Test lstm case 3 ...\t";
+    // checkpoints and truncated BPTT carry the whole state [h | c]
+    using Checkpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecLSTMStep, PCheckpointSegment<2>>;
+    using Truncated = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecLSTMStep,
+                                   PBpttWindow<2>, PBpttLength<3>>;
+    const auto origin = GenParams("lstm", 6, 5, GateNames);
+    auto initializer = MakeInitializer<float>();
+    for (const auto& [name, mat] : origin)
+    {
+        initializer.SetMatrix(name, mat);
+    }
+    const auto xs = GenInputs(5, 4, 6);
+    const auto s0 = GenState(4, 5);
+    ParamMap params;
+
+    Checkpoint checkpoint("lstm", 6, 5);
+    checkpoint.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> col;
+    Compare(Reference(origin, "lstm", xs, s0, 5, 5), Run(checkpoint, xs, s0, 5, col), 8);
+    assert(checkpoint.MemoryReport().recomputedSteps == 5);
+
+    Truncated truncated("lstm", 6, 5);
+    truncated.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> truncatedCol(true);
+    Compare(Reference(origin, "lstm", xs, s0, 2, 3), Run(truncated, xs, s0, 2, truncatedCol), 8);
+    cout << "done" << endl;
+}
+}
+
+void test_lstm()
+{
+    test_lstm1();
+    test_lstm2();
+    test_lstm3();
+}
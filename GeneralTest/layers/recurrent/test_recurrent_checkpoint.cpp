@@ -0,0 +1,247 @@
+#include "test_recurrent_checkpoint.h"
+#include "../../facilities/recurrent_check.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+// Forward over xs from h0, with the hidden states in given passed at their steps instead of the
+// carried ones, backward with out_t - 0.5 as the gradient of each output
+template <typename TLayer>
+RunResult Run(TLayer& layer, const vector<CpuMatrix>& xs, const CpuMatrix& h0,
+              const map<size_t, CpuMatrix>& given = {})
+{
+    RunResult result;
+    for (size_t t = 0; t < xs.size(); ++t)
+    {
+        auto in = TLayer::InputType::Create().template Set<LayerIO>(xs[t]);
+        if ((t == 0) || given.count(t))
+        {
+            const auto& hidden = (t == 0) ? h0 : given.at(t);
+            auto res = layer.FeedForward(std::move(in).template Set<RnnLayerHiddenBefore>(hidden));
+            result.outs.push_back(Evaluate(res.template Get<LayerIO>()));
+        }
+        else
+        {
+            result.outs.push_back(Evaluate(layer.FeedForward(std::move(in)).template Get<LayerIO>()));
+        }
+    }
+
+    result.gradInputs.resize(xs.size());
+    for (size_t t = xs.size(); t-- > 0;)
+    {
+        auto grad = MakeDynamic(result.outs[t] - Scalar<float>(0.5f));
+        auto res = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad));
+        result.gradInputs[t] = Evaluate(res.template Get<LayerIO>());
+        result.gradHidden = Evaluate(res.template Get<RnnLayerHiddenBefore>());
+    }
+
+    GradCollector<float, DeviceTags::CPU> col;
+    layer.GradCollect(col);
+    result.grads = GradsByName(layer, col);
+    layer.NeutralInvariant();
+    return result;
+}
+
+template <typename TPlain, typename TCheckpoint>
+void Check(size_t inLen, size_t outLen, size_t stepNum, size_t segment)
+{
+    auto initializer = MakeParamInitializer(GenParams("rnn", inLen, outLen));
+
+    vector<CpuMatrix> xs;
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        xs.push_back(GenMatrix<float>(3, inLen, -5.f + 2 * t, (t % 2) ? 0.06f : -0.05f));
+    }
+    auto h0 = GenMatrix<float>(3, outLen, 4, -0.07f);
+
+    ParamMap params;
+    TPlain plain("rnn", inLen, outLen);
+    plain.Init(initializer, params);
+    const auto expected = Run(plain, xs, h0);
+    const auto& plainReport = plain.MemoryReport();
+    assert(plainReport.segment == 0);
+    assert(plainReport.forwardSteps == stepNum);
+    assert(plainReport.recomputedSteps == 0);
+    assert(plainReport.peakCheckpoints == 0);
+    assert(plainReport.peakRecordedSteps == stepNum);
+
+    TCheckpoint layer("rnn", inLen, outLen);
+    layer.Init(initializer, params);
+    Compare(expected, Run(layer, xs, h0), 6);
+    const auto& report = layer.MemoryReport();
+    assert(report.segment == segment);
+    assert(report.forwardSteps == stepNum);
+    assert(report.recomputedSteps == stepNum);
+    assert(report.peakCheckpoints == (stepNum + segment - 1) / segment);
+    assert(report.peakRecordedSteps == segment);
+    // the allocator is only sampled with PEnableMemoryReport
+    assert(report.peakLiveBytes == 0);
+
+    // a second sequence starts afresh
+    layer.ResetMemoryReport();
+    Compare(expected, Run(layer, xs, h0), 6);
+    assert(layer.MemoryReport().recomputedSteps == stepNum);
+}
+
+// A hidden state passed in the middle of a segment starts a new one
+template <typename TPlain, typename TCheckpoint>
+void CheckGivenState(size_t inLen, size_t outLen, size_t stepNum, const map<size_t, CpuMatrix>& given)
+{
+    auto initializer = MakeParamInitializer(GenParams("rnn", inLen, outLen));
+
+    vector<CpuMatrix> xs;
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        xs.push_back(GenMatrix<float>(3, inLen, -5.f + 2 * t, (t % 2) ? 0.06f : -0.05f));
+    }
+    auto h0 = GenMatrix<float>(3, outLen, 4, -0.07f);
+
+    ParamMap params;
+    TPlain plain("rnn", inLen, outLen);
+    plain.Init(initializer, params);
+    const auto expected = Run(plain, xs, h0, given);
+
+    TCheckpoint layer("rnn", inLen, outLen);
+    layer.Init(initializer, params);
+    Compare(expected, Run(layer, xs, h0, given), 6);
+    assert(layer.MemoryReport().recomputedSteps == stepNum);
+}
+
+struct MemoryUse
+{
+    size_t afterForward;
+    size_t peak;
+};
+
+// Bytes held by the layer after a forward pass over stepNum steps whose outputs are evaluated and
+// dropped, and the peak over the forward and backward passes from the report of the layer. The
+// gradients are collected after each backward step.
+template <typename TLayer>
+MemoryUse Measure(size_t rowNum, size_t inLen, size_t outLen, size_t stepNum)
+{
+    auto initializer = MakeParamInitializer(GenParams("rnn", inLen, outLen));
+    ParamMap params;
+    TLayer layer("rnn", inLen, outLen);
+    layer.Init(initializer, params);
+
+    vector<CpuMatrix> xs;
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        xs.push_back(GenMatrix<float>(rowNum, inLen, -0.5f + 0.01f * t, 0.001f));
+    }
+    auto h0 = GenMatrix<float>(rowNum, outLen, 0.1f, -0.001f);
+    auto grad = MakeDynamic(GenMatrix<float>(rowNum, outLen, 0.2f, -0.001f));
+
+    const size_t base = Allocator<DeviceTags::CPU>::Stats().m_liveBytes;
+    layer.ResetMemoryReport();
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        auto in = TLayer::InputType::Create().template Set<LayerIO>(xs[t]);
+        if (t == 0)
+        {
+            Evaluate(layer.FeedForward(std::move(in).template Set<RnnLayerHiddenBefore>(h0)).template Get<LayerIO>());
+        }
+        else
+        {
+            Evaluate(layer.FeedForward(std::move(in)).template Get<LayerIO>());
+        }
+    }
+    MemoryUse res;
+    res.afterForward = Allocator<DeviceTags::CPU>::Stats().m_liveBytes - base;
+    // the operands of the weight gradients of a step are dropped once they are collected
+    GradCollector<float, DeviceTags::CPU> col(true);
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        Evaluate(layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad)).template Get<LayerIO>());
+        layer.GradCollect(col);
+    }
+    const auto& report = layer.MemoryReport();
+    assert(report.peakLiveBytes >= report.liveBytes);
+    assert(report.peakLiveBytes >= base + res.afterForward);
+    res.peak = report.peakLiveBytes - base;
+    layer.NeutralInvariant();
+    return res;
+}
+
+// After the forward pass the layer with checkpoints holds a hidden state per segment and the
+// carried one (the inputs share the buffers of xs)
+template <typename TPlain, typename TCheckpoint>
+void CheckMemory(size_t segment)
+{
+    const size_t rowNum = 32, inLen = 64, outLen = 128, stepNum = 64;
+    const auto plain = Measure<TPlain>(rowNum, inLen, outLen, stepNum);
+    const auto checkpoint = Measure<TCheckpoint>(rowNum, inLen, outLen, stepNum);
+    const size_t stateBytes = rowNum * outLen * sizeof(float);
+    assert(checkpoint.afterForward <= (stepNum / segment + 1) * stateBytes);
+    assert(checkpoint.afterForward * 4 < plain.afterForward);
+    assert(checkpoint.peak * 2 < plain.peak);
+}
+
+void test_recurrent_checkpoint1()
+{
+    cout << "Test recurrent checkpoint case 1 ...\t";
+    using Plain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput>;
+    using Checkpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PCheckpointSegment<2>>;
+    Check<Plain, Checkpoint>(4, 6, 5, 2);
+    cout << "done" << endl;
+}
+
+void test_recurrent_checkpoint2()
+{
+    cout << "Test recurrent checkpoint case 2 ...\t";
+    using Plain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep>;
+    using Checkpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep,
+                                    PCheckpointSegment<3>>;
+    Check<Plain, Checkpoint>(5, 4, 7, 3);
+    cout << "done" << endl;
+}
+
+void test_recurrent_checkpoint3()
+{
+    cout << "Test recurrent checkpoint case 3 ...\t";
+    // the forward pass with checkpoints holds the inputs and every 8th hidden state only
+    using Plain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PEnableMemoryReport>;
+    using Checkpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PEnableMemoryReport,
+                                    PCheckpointSegment<8>>;
+    CheckMemory<Plain, Checkpoint>(8);
+
+    using FusedPlain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PEnableMemoryReport,
+                                    PRecFusedGRUStep>;
+    using FusedCheckpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PEnableMemoryReport,
+                                         PRecFusedGRUStep, PCheckpointSegment<8>>;
+    CheckMemory<FusedPlain, FusedCheckpoint>(8);
+    cout << "done" << endl;
+}
+
+void test_recurrent_checkpoint4()
+{
+    cout << "Test recurrent checkpoint case 4 ...\t";
+    map<size_t, CpuMatrix> given;
+    given[2] = GenMatrix<float>(3, 5, -1, 0.09f);
+    given[7] = GenMatrix<float>(3, 5, 2, -0.03f);
+    using Plain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput>;
+    using Checkpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PCheckpointSegment<4>>;
+    CheckGivenState<Plain, Checkpoint>(4, 5, 9, given);
+
+    using FusedPlain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep>;
+    using FusedCheckpoint = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep,
+                                         PCheckpointSegment<4>>;
+    CheckGivenState<FusedPlain, FusedCheckpoint>(4, 5, 9, given);
+    cout << "done" << endl;
+}
+}
+
+void test_recurrent_checkpoint()
+{
+    test_recurrent_checkpoint1();
+    test_recurrent_checkpoint2();
+    test_recurrent_checkpoint3();
+    test_recurrent_checkpoint4();
+}
@@ -0,0 +1,173 @@
+#include "test_truncated_bptt.h"
+#include "../../facilities/recurrent_check.h"
+#include <MetaNN/meta_nn.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+// Truncated BPTT computed by hand with full BPTT: for each window, the steps from up to
+// length - window steps before it are run again from the hidden state there, and only the
+// outputs of the window get a gradient
+template <typename TPlain>
+void Reference(size_t inLen, size_t outLen, size_t window, size_t length,
+               const vector<CpuMatrix>& xs, const CpuMatrix& h0,
+               vector<CpuMatrix>& outs, vector<CpuMatrix>& gradInputs, ParamMap& grads)
+{
+    auto initializer = MakeParamInitializer(GenParams("rnn", inLen, outLen));
+    ParamMap params;
+
+    vector<CpuMatrix> hiddens{h0};
+    {
+        TPlain layer("rnn", inLen, outLen);
+        layer.Init(initializer, params);
+        for (size_t t = 0; t < xs.size(); ++t)
+        {
+            auto in = TPlain::InputType::Create().template Set<LayerIO>(xs[t])
+                                                 .template Set<RnnLayerHiddenBefore>(hiddens.back());
+            hiddens.push_back(Evaluate(layer.FeedForward(std::move(in)).template Get<LayerIO>()));
+        }
+    }
+    outs.assign(hiddens.begin() + 1, hiddens.end());
+    gradInputs.resize(xs.size());
+
+    GradCollector<float, DeviceTags::CPU> col;
+    TPlain last("rnn", inLen, outLen);
+    last.Init(initializer, params);
+    for (size_t begin = 0; begin < xs.size(); begin += window)
+    {
+        const size_t end = min(xs.size(), begin + window);
+        const size_t start = (begin > length - window) ? begin - (length - window) : 0;
+        TPlain layer("rnn", inLen, outLen);
+        layer.Init(initializer, params);
+        for (size_t t = start; t < end; ++t)
+        {
+            auto in = TPlain::InputType::Create().template Set<LayerIO>(xs[t])
+                                                 .template Set<RnnLayerHiddenBefore>(hiddens[t]);
+            layer.FeedForward(std::move(in));
+        }
+        for (size_t t = end; t-- > start;)
+        {
+            auto grad = (t >= begin) ? Evaluate(outs[t] - Scalar<float>(0.5f)) : GenMatrix<float>(h0.RowNum(), outLen, 0, 0);
+            auto res = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad));
+            if (t >= begin)
+            {
+                gradInputs[t] = Evaluate(res.template Get<LayerIO>());
+            }
+        }
+        layer.GradCollect(col);
+    }
+    grads = GradsByName(last, col);
+}
+
+template <typename TPlain, typename TTruncated>
+void Check(size_t inLen, size_t outLen, size_t stepNum, size_t window, size_t length)
+{
+    vector<CpuMatrix> xs;
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        xs.push_back(GenMatrix<float>(3, inLen, -5.f + 2 * t, (t % 2) ? 0.06f : -0.05f));
+    }
+    auto h0 = GenMatrix<float>(3, outLen, 4, -0.07f);
+
+    vector<CpuMatrix> expectedOuts;
+    vector<CpuMatrix> expectedGradInputs;
+    ParamMap expectedGrads;
+    Reference<TPlain>(inLen, outLen, window, length, xs, h0, expectedOuts, expectedGradInputs, expectedGrads);
+
+    auto initializer = MakeParamInitializer(GenParams("rnn", inLen, outLen));
+    ParamMap params;
+    TTruncated layer("rnn", inLen, outLen);
+    layer.Init(initializer, params);
+    GradCollector<float, DeviceTags::CPU> col(true);
+    for (size_t begin = 0; begin < stepNum; begin += window)
+    {
+        const size_t end = min(stepNum, begin + window);
+        vector<CpuMatrix> outs;
+        for (size_t t = begin; t < end; ++t)
+        {
+            auto in = TTruncated::InputType::Create().template Set<LayerIO>(xs[t]);
+            if (t == 0)
+            {
+                auto res = layer.FeedForward(std::move(in).template Set<RnnLayerHiddenBefore>(h0));
+                outs.push_back(Evaluate(res.template Get<LayerIO>()));
+            }
+            else
+            {
+                outs.push_back(Evaluate(layer.FeedForward(std::move(in)).template Get<LayerIO>()));
+            }
+            assert(Same(outs.back(), expectedOuts[t]));
+        }
+        if (end - begin == window)
+        {
+            // the window is full until it is fed back
+            bool thrown = false;
+            try
+            {
+                layer.FeedForward(TTruncated::InputType::Create().template Set<LayerIO>(xs[0]));
+            }
+            catch (const runtime_error&)
+            {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+        for (size_t t = end; t-- > begin;)
+        {
+            auto grad = Evaluate(outs[t - begin] - Scalar<float>(0.5f));
+            auto res = layer.FeedBackward(LayerIO::Create().Set<LayerIO>(grad));
+            assert(Same(Evaluate(res.template Get<LayerIO>()), expectedGradInputs[t]));
+        }
+        layer.GradCollect(col);
+        layer.NeutralInvariant();
+    }
+
+    const auto grads = GradsByName(layer, col);
+    assert(grads.size() == 6);
+    for (const auto& [name, g] : expectedGrads)
+    {
+        assert(Same(g, grads.at(name)));
+    }
+
+    const auto& report = layer.MemoryReport();
+    assert(report.forwardSteps == stepNum);
+    assert(report.peakRecordedSteps == window);
+    size_t recomputed = 0;
+    for (size_t begin = window; begin < stepNum; begin += window)
+    {
+        recomputed += min(begin, length - window);
+    }
+    assert(report.recomputedSteps == recomputed);
+}
+
+void test_truncated_bptt1()
+{
+    cout << "Test truncated bptt case 1 ...\t";
+    using Plain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput>;
+    using Truncated = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PBpttWindow<2>, PBpttLength<3>>;
+    Check<Plain, Truncated>(4, 6, 7, 2, 3);
+    cout << "done" << endl;
+}
+
+void test_truncated_bptt2()
+{
+    cout << "Test truncated bptt case 2 ...\t";
+    using Plain = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep>;
+    using Truncated = InjectPolicy<RecurrentLayer, PUpdate, PFeedbackOutput, PRecFusedGRUStep, PBpttWindow<3>>;
+    Check<Plain, Truncated>(5, 4, 8, 3, 3);
+    cout << "done" << endl;
+}
+}
+
+void test_truncated_bptt()
+{
+    test_truncated_bptt1();
+    test_truncated_bptt2();
+}
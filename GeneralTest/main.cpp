@@ -4,11 +4,13 @@
 #include "facilities/test_var_type_dict.h"
 #include "evaluate/test_eval_plan.h"
 
+#include "data/test_allocator.h"
 #include "data/test_array.h"
 #include "data/test_duplicate.h"
 #include "data/test_scalar.h"
 #include "data/test_general_matrix.h"
 #include "data/test_one_hot_vector.h"
+#include "data/test_batch_one_hot_vector.h"
 #include "data/test_trival_matrix.h"
 #include "data/test_zero_matrix.h"
 #include "data/test_batch_scalar.h"
@@ -25,9 +27,12 @@
 #include "operators/test_divide.h"
 #include "operators/test_dot.h"
 #include "operators/test_element_mul.h"
+#include "operators/test_fusion.h"
 #include "operators/test_interpolate.h"
 #include "operators/test_negative_log_likelihood.h"
 #include "operators/test_negative_log_likelihood_derivative.h"
+#include "operators/test_softmax_cross_entropy.h"
+#include "operators/test_softmax_cross_entropy_derivative.h"
 #include "operators/test_sigmoid.h"
 #include "operators/test_sigmoid_derivative.h"
 #include "operators/test_sign.h"
@@ -43,20 +48,31 @@
 #include "layers/elementary/test_add_layer.h"
 #include "layers/elementary/test_bias_layer.h"
 #include "layers/elementary/test_element_mul_layer.h"
+#include "layers/elementary/test_embedding_layer.h"
 #include "layers/elementary/test_interpolate_layer.h"
 #include "layers/elementary/test_sigmoid_layer.h"
 #include "layers/elementary/test_softmax_layer.h"
 #include "layers/elementary/test_tanh_layer.h"
 #include "layers/elementary/test_weight_layer.h"
 #include "layers/cost/test_negative_log_likelihood_layer.h"
+#include "layers/cost/test_softmax_cross_entropy_layer.h"
 #include "layers/compose/test_compose_kernel.h"
 #include "layers/compose/test_linear_layer.h"
 #include "layers/compose/test_single_layer.h"
 #include "layers/recurrent/test_gru.h"
 #include "layers/recurrent/test_gru_2.h"
+#include "layers/recurrent/test_fused_gru.h"
+#include "layers/recurrent/test_recurrent_checkpoint.h"
+#include "layers/recurrent/test_truncated_bptt.h"
+#include "layers/recurrent/test_lstm.h"
+#include "model/grad_col/test_grad_norm.h"
 #include "model/param_initializer/test_constant_filler.h"
 #include "model/param_initializer/test_gaussian_filler.h"
 #include "model/param_initializer/test_var_scale_filter.h"
+#include "model/param_initializer/test_param_arena.h"
+#include "model/optimizer/test_sgd.h"
+#include "model/optimizer/test_adam.h"
+#include "model/optimizer/test_update_rules.h"
 
 int main(int argc, char **argv)
 {
@@ -66,10 +82,13 @@ int main(int argc, char **argv)
     
     test_var_type_dict();
     test_eval_plan();
+
+    test_allocator();
     
 	test_scalar();
     test_general_matrix();
     test_one_hot_vector();
+    test_batch_one_hot_vector();
     test_trival_matrix();
     test_zero_matrix();
     test_array();
@@ -90,9 +109,12 @@ int main(int argc, char **argv)
     test_divide();
     test_dot();
     test_element_mul();
+    test_fusion();
     test_interpolate();
     test_negative_log_likelihood();
     test_negative_log_likelihood_derivative();
+    test_softmax_cross_entropy();
+    test_softmax_cross_entropy_derivative();
     test_sigmoid();
     test_sigmoid_derivative();
     test_sign();
@@ -108,6 +130,7 @@ int main(int argc, char **argv)
     test_add_layer();
     test_bias_layer();
     test_element_mul_layer();
+    test_embedding_layer();
     test_interpolate_layer();
     test_sigmoid_layer();
     test_softmax_layer();
@@ -115,6 +138,7 @@ int main(int argc, char **argv)
     test_weight_layer();
     
     test_negative_log_likelihood_layer();
+    test_softmax_cross_entropy_layer();
     
     test_compose_kernel();
     test_linear_layer();
@@ -122,10 +146,21 @@ int main(int argc, char **argv)
     
     test_gru();
     test_gru_2();
+    test_fused_gru();
+    test_recurrent_checkpoint();
+    test_truncated_bptt();
+    test_lstm();
     
+    test_grad_norm();
+
     test_constant_filler();
     test_gaussian_filler();
     test_var_scale_filter();
+    test_param_arena();
+
+    test_sgd();
+    test_adam();
+    test_update_rules();
 	return 0;
 }
 
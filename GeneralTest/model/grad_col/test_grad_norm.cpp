@@ -0,0 +1,224 @@
+#include "test_grad_norm.h"
+#include "../../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <map>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+struct Norm
+{
+    double l1 = 0;
+    double l2 = 0;
+};
+
+void Add(Norm& res, const Matrix<float, DeviceTags::CPU>& g)
+{
+    for (size_t i = 0; i < g.RowNum(); ++i)
+    {
+        for (size_t j = 0; j < g.ColNum(); ++j)
+        {
+            res.l1 += fabs(g(i, j));
+            res.l2 += (double)g(i, j) * g(i, j);
+        }
+    }
+}
+
+bool Near(double a, double b)
+{
+    return fabs(a - b) <= 1e-4 * std::max(1.0, fabs(b));
+}
+
+// w1: two dense gradients, w2: a shrunk weight, w3: rows 1, 4, 1 of an embedding table
+template <typename TCol>
+void CollectCase(TCol& col, const Matrix<float, DeviceTags::CPU>& w1,
+                 const Matrix<float, DeviceTags::CPU>& w2, const Matrix<float, DeviceTags::CPU>& w3)
+{
+    col.Collect(w1, GenMatrix<float>(7, 13, -1.0f, 0.02f));
+    col.Collect(w1, GenMatrix<float>(7, 13, 0.3f, 0.01f));
+    col.Collect(w2, GenMatrix<float>(17, 31, 0.2f, -0.003f));
+    Batch<float, DeviceTags::CPU, CategoryTags::Matrix> rows(3, 1, 5);
+    for (size_t b = 0; b < 3; ++b)
+        for (size_t j = 0; j < 5; ++j)
+            rows.SetValue(b, 0, j, 0.1f * b - 0.05f * j);
+    col.CollectRows(w3, {1, 4, 1}, rows);
+}
+
+// the expected norms of CollectCase
+map<const float*, Norm> Expected(const Matrix<float, DeviceTags::CPU>& w1,
+                                 const Matrix<float, DeviceTags::CPU>& w2,
+                                 const Matrix<float, DeviceTags::CPU>& w3)
+{
+    map<const float*, Norm> res;
+    auto g1 = GenMatrix<float>(7, 13, -1.0f, 0.02f);
+    auto g2 = GenMatrix<float>(7, 13, 0.3f, 0.01f);
+    Matrix<float, DeviceTags::CPU> sum(7, 13);
+    for (size_t i = 0; i < 7; ++i)
+        for (size_t j = 0; j < 13; ++j)
+            sum.SetValue(i, j, g1(i, j) + g2(i, j));
+    Add(res[LowerAccess(w1).RawMemory()], sum);
+    Add(res[LowerAccess(w2).RawMemory()], GenMatrix<float>(17, 31, 0.2f, -0.003f));
+
+    Matrix<float, DeviceTags::CPU> rows(2, 5);
+    for (size_t j = 0; j < 5; ++j)
+    {
+        rows.SetValue(0, j, (0.0f - 0.05f * j) + (0.2f - 0.05f * j));
+        rows.SetValue(1, j, 0.1f - 0.05f * j);
+    }
+    Add(res[LowerAccess(w3).RawMemory()], rows);
+    return res;
+}
+
+template <typename TNorms>
+void Check(const TNorms& norms, const map<const float*, Norm>& expected, double scale = 1)
+{
+    assert(norms.params.size() == expected.size());
+    Norm global;
+    for (const auto& p : norms.params)
+    {
+        const auto& e = expected.at(LowerAccess(p.weight).RawMemory());
+        assert(Near(p.l1, e.l1 * scale));
+        assert(Near(p.l2, sqrt(e.l2) * scale));
+        global.l1 += e.l1;
+        global.l2 += e.l2;
+    }
+    assert(Near(norms.l1, global.l1 * scale));
+    assert(Near(norms.l2, sqrt(global.l2) * scale));
+}
+
+void test_grad_norm1()
+{
+    cout << "Test grad norm case 1 ...\t";
+    auto w1 = GenMatrix<float>(7, 13);
+    auto w2 = GenMatrix<float>(40, 50);
+    w2.Shrink(3, 20, 5, 36);
+    auto w3 = GenMatrix<float>(6, 5);
+    const auto expected = Expected(w1, w2, w3);
+
+    // the rows of w3 are kept as rows, or added to a dense gradient
+    for (bool keepRows : {false, true})
+    {
+        GradCollector<float, DeviceTags::CPU> col(false, keepRows);
+        CollectCase(col, w1, w2, w3);
+        assert(col.size() == (keepRows ? 2 : 3));
+        Check(GradNorm(col), expected);
+
+        GradCollector<float, DeviceTags::CPU> accCol(true, keepRows);
+        CollectCase(accCol, w1, w2, w3);
+        assert(accCol.rows_size() == (keepRows ? 1 : 0));
+        Check(GradNorm(accCol), expected);
+    }
+    cout << "done" << endl;
+}
+
+void test_grad_norm2()
+{
+    cout << "Test grad norm case 2 ...\t";
+    auto w1 = GenMatrix<float>(7, 13);
+    auto w2 = GenMatrix<float>(40, 50);
+    w2.Shrink(3, 20, 5, 36);
+    auto w3 = GenMatrix<float>(6, 5);
+    const auto expected = Expected(w1, w2, w3);
+    double total = 0;
+    for (const auto& [k, v] : expected) total += v.l2;
+    total = sqrt(total);
+
+    // clipping scales every gradient by the same factor, lazily or in place
+    for (bool accumulate : {false, true})
+    {
+        GradCollector<float, DeviceTags::CPU> col(accumulate, true);
+        CollectCase(col, w1, w2, w3);
+        auto before = ClipGradByGlobalNorm(col, (float)(total * 2));
+        Check(before, expected);
+        Check(GradNorm(col), expected);
+
+        before = ClipGradByGlobalNorm(col, (float)(total / 4));
+        Check(before, expected);
+        Check(GradNorm(col), expected, 0.25);
+    }
+    cout << "done" << endl;
+}
+
+void test_grad_norm3()
+{
+    cout << "Test grad norm case 3 ...\t";
+    // with a ParamArena, the global norms are those of the flat gradient block
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    params["a"] = GenMatrix<float>(30, 70);
+    params["b"] = GenMatrix<float>(1, 3);
+    params["c"] = GenMatrix<float>(300, 100);
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+
+    GradCollector<float, DeviceTags::CPU> col(arena);
+    col.Collect(params["a"], GenMatrix<float>(30, 70, 0.1f, -0.001f));
+    col.Collect(params["b"], GenMatrix<float>(1, 3, -2.0f, 1.0f));
+    col.Collect(params["c"], GenMatrix<float>(300, 100, -0.5f, 0.0001f));
+    col.Collect(params["a"], GenMatrix<float>(30, 70, 0.0f, 0.002f));
+
+    Norm flat;
+    Add(flat, arena.FlatGrad());
+    auto norms = ClipGradByGlobalNorm(col, 1.0f);
+    assert(Near(norms.l1, flat.l1));
+    assert(Near(norms.l2, sqrt(flat.l2)));
+
+    Norm clipped;
+    Add(clipped, arena.FlatGrad());
+    assert(Near(sqrt(clipped.l2), 1.0));
+    cout << "done" << endl;
+}
+
+void test_grad_norm4()
+{
+    cout << "Test grad norm case 4 ...\t";
+    auto w1 = GenMatrix<float>(7, 13);
+    auto w2 = GenMatrix<float>(40, 50);
+    w2.Shrink(3, 20, 5, 36);
+    auto w3 = GenMatrix<float>(6, 5);
+    const auto expected = Expected(w1, w2, w3);
+    double total = 0;
+    for (const auto& [k, v] : expected) total += v.l2;
+    total = sqrt(total);
+
+    // the norm pass leaves the sums in the collector: clipping scales them in place and the
+    // MergeGrads of an optimizer returns them as they are
+    GradCollector<float, DeviceTags::CPU> col(false, true);
+    CollectCase(col, w1, w2, w3);
+    Check(GradNorm(col), expected);
+    for (auto it = col.begin(); it != col.end(); ++it)
+    {
+        assert(it->grad.size() == 1);
+    }
+    for (auto it = col.rows_begin(); it != col.rows_end(); ++it)
+    {
+        assert((it->grad.size() == 1) && (it->rows.size() == 1));
+    }
+
+    map<const float*, const float*> sums;
+    for (const auto& m : MergeGrads(col))
+    {
+        sums[LowerAccess(m.weight).RawMemory()] = LowerAccess(m.grad).RawMemory();
+    }
+    ClipGradByGlobalNorm(col, (float)(total / 4));
+    for (const auto& m : MergeGrads(col))
+    {
+        // the gradient of w2 is the one collected, it is scaled into a new matrix
+        const float* key = LowerAccess(m.weight).RawMemory();
+        assert((key == LowerAccess(w2).RawMemory()) || (sums.at(key) == LowerAccess(m.grad).RawMemory()));
+    }
+    Check(GradNorm(col), expected, 0.25);
+    cout << "done" << endl;
+}
+}
+
+void test_grad_norm()
+{
+    test_grad_norm1();
+    test_grad_norm2();
+    test_grad_norm3();
+    test_grad_norm4();
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void test_grad_norm();
\ No newline at end of file
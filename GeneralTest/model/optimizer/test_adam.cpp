@@ -0,0 +1,81 @@
+#include "test_adam.h"
+#include "../../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+void test_adam1()
+{
+    cout << "Test Adam case 1 ...\t";
+    auto w = GenMatrix<double>(6, 21, 0.3, -0.01);
+    vector<double> ref_w(6 * 21);
+    vector<double> ref_m(6 * 21, 0);
+    vector<double> ref_v(6 * 21, 0);
+    for (size_t i = 0; i < ref_w.size(); ++i) ref_w[i] = w(i / 21, i % 21);
+
+    Adam<double, DeviceTags::CPU> opt(0.01);
+    for (size_t step = 1; step <= 4; ++step)
+    {
+        auto g = GenMatrix<double>(6, 21, step * 0.5 - 1.4, 0.03);
+        GradCollector<double, DeviceTags::CPU> col;
+        col.Collect(w, g);
+        opt.Update(col);
+        for (size_t i = 0; i < ref_w.size(); ++i)
+        {
+            const double gi = g(i / 21, i % 21);
+            ref_m[i] = 0.9 * ref_m[i] + 0.1 * gi;
+            ref_v[i] = 0.999 * ref_v[i] + 0.001 * gi * gi;
+            const double m_hat = ref_m[i] / (1 - pow(0.9, step));
+            const double v_hat = ref_v[i] / (1 - pow(0.999, step));
+            ref_w[i] -= 0.01 * m_hat / (sqrt(v_hat) + 1e-8);
+        }
+    }
+    assert(opt.StepNum() == 4);
+    for (size_t i = 0; i < ref_w.size(); ++i)
+    {
+        assert(fabs(w(i / 21, i % 21) - ref_w[i]) < 1e-9);
+    }
+    cout << "done" << endl;
+}
+
+void test_adam2()
+{
+    cout << "Test Adam case 2 ...\t";
+    // the states follow the weight memory: a released weight does not pass its states on
+    Adam<float, DeviceTags::CPU> opt(0.1f);
+    auto g = GenMatrix<float>(3, 4, 1.0f, 0.1f);
+    for (size_t step = 1; step <= 2; ++step)
+    {
+        Matrix<float, DeviceTags::CPU> w(3, 4);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            for (size_t j = 0; j < 4; ++j) w.SetValue(i, j, 0);
+        }
+        GradCollector<float, DeviceTags::CPU> col;
+        col.Collect(w, g);
+        opt.Update(col);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            for (size_t j = 0; j < 4; ++j)
+            {
+                const double m_hat = 0.1 * g(i, j) / (1 - pow(0.9, step));
+                const double v_hat = 0.001 * g(i, j) * g(i, j) / (1 - pow(0.999, step));
+                assert(fabs(w(i, j) + 0.1 * m_hat / (sqrt(v_hat) + 1e-8)) < 0.0001f);
+            }
+        }
+    }
+    cout << "done" << endl;
+}
+}
+
+void test_adam()
+{
+    test_adam1();
+    test_adam2();
+}
@@ -0,0 +1,130 @@
+#include "test_sgd.h"
+#include "../../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+Matrix<float, DeviceTags::CPU> Clone(const Matrix<float, DeviceTags::CPU>& m)
+{
+    Matrix<float, DeviceTags::CPU> res(m.RowNum(), m.ColNum());
+    for (size_t i = 0; i < m.RowNum(); ++i)
+    {
+        for (size_t j = 0; j < m.ColNum(); ++j)
+        {
+            res.SetValue(i, j, m(i, j));
+        }
+    }
+    return res;
+}
+
+void test_sgd1()
+{
+    cout << "Test SGD case 1 ...\t";
+    // a shared weight is updated once with the sum of its gradients
+    auto w1 = GenMatrix<float>(7, 13, 0.5f, -0.01f);
+    auto w2 = GenMatrix<float>(40, 50, 0.1f, 0.001f);
+    w2.Shrink(3, 20, 5, 36);
+    auto g1 = GenMatrix<float>(7, 13, -1.0f, 0.02f);
+    auto g2 = GenMatrix<float>(7, 13, 0.3f, 0.01f);
+    auto g3 = GenMatrix<float>(17, 31, 0.2f, -0.003f);
+    auto c1 = Clone(w1);
+    auto c2 = Clone(w2);
+
+    GradCollector<float, DeviceTags::CPU> col;
+    col.Collect(w1, g1);
+    col.Collect(w2, g3);
+    col.Collect(w1, g2);
+
+    SGD<float, DeviceTags::CPU> opt(0.1f);
+    opt.Update(col);
+    assert(opt.StepNum() == 1);
+    for (size_t i = 0; i < 7; ++i)
+    {
+        for (size_t j = 0; j < 13; ++j)
+        {
+            assert(fabs(w1(i, j) - (c1(i, j) - 0.1f * (g1(i, j) + g2(i, j)))) < 0.00001f);
+        }
+    }
+    for (size_t i = 0; i < 17; ++i)
+    {
+        for (size_t j = 0; j < 31; ++j)
+        {
+            assert(fabs(w2(i, j) - (c2(i, j) - 0.1f * g3(i, j))) < 0.00001f);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_sgd2()
+{
+    cout << "Test SGD case 2 ...\t";
+    // row gradients: only the collected rows change, repeated rows are summed
+    auto emb = GenMatrix<float>(20, 9, 0.1f, 0.01f);
+    auto both = GenMatrix<float>(20, 9, -0.2f, 0.01f);
+    auto c_emb = Clone(emb);
+    auto c_both = Clone(both);
+    auto rg = GenBatchMatrix<float>(1, 9, 3, 1.0f, 0.1f);
+    auto dg = GenMatrix<float>(20, 9, 0.5f, -0.01f);
+
+    GradCollector<float, DeviceTags::CPU> col(false, true);
+    col.CollectRows(emb, {4, 17, 4}, rg);
+    col.CollectRows(both, {2, 3, 2}, rg);
+    col.Collect(both, dg);
+
+    SGD<float, DeviceTags::CPU> opt(0.5f);
+    opt.Update(col);
+    for (size_t i = 0; i < 20; ++i)
+    {
+        for (size_t j = 0; j < 9; ++j)
+        {
+            float g_emb = 0;
+            float g_both = dg(i, j);
+            if (i == 4) g_emb = rg[0](0, j) + rg[2](0, j);
+            if (i == 17) g_emb = rg[1](0, j);
+            if (i == 2) g_both += rg[0](0, j) + rg[2](0, j);
+            if (i == 3) g_both += rg[1](0, j);
+            assert(fabs(emb(i, j) - (c_emb(i, j) - 0.5f * g_emb)) < 0.00001f);
+            assert(fabs(both(i, j) - (c_both(i, j) - 0.5f * g_both)) < 0.00001f);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_sgd3()
+{
+    cout << "Test SGD case 3 ...\t";
+    // the packed panels of an updated weight are rebuilt
+    auto w = GenMatrix<float>(300, 2100, -1.0f, 0.0001f);
+    auto x = GenMatrix<float>(3, 300, 0.5f, 0.001f);
+    EnablePackCache(w);
+    auto res = Evaluate(Dot(x, w));
+
+    GradCollector<float, DeviceTags::CPU> col(true);
+    col.Collect(w, Dot(Transpose(x), GenMatrix<float>(3, 2100, 0.1f, 0.0001f)));
+    SGD<float, DeviceTags::CPU> opt(0.01f);
+    opt.Update(col);
+
+    res = Evaluate(Dot(x, w));
+    auto check = Evaluate(Dot(x, Clone(w)));
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 2100; ++j)
+        {
+            assert(res(i, j) == check(i, j));
+        }
+    }
+    cout << "done" << endl;
+}
+}
+
+void test_sgd()
+{
+    test_sgd1();
+    test_sgd2();
+    test_sgd3();
+}
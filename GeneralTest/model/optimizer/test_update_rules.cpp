@@ -0,0 +1,288 @@
+#include "test_update_rules.h"
+#include "../../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+using CpuMatrix = Matrix<float, DeviceTags::CPU>;
+using States = array<float, 2>;
+
+// A row of the rule table: Make() returns the optimizer, Ref(w, g, s, t) is the scalar update of
+// one element and its states at step t (counted from 1)
+template <typename TMake, typename TRef>
+struct Rule
+{
+    const char* name;
+    TMake Make;
+    TRef Ref;
+};
+
+template <typename TMake, typename TRef>
+Rule<TMake, TRef> MakeRule(const char* name, TMake make, TRef ref)
+{
+    return Rule<TMake, TRef>{name, make, ref};
+}
+
+auto Rules()
+{
+    return make_tuple(
+        MakeRule("SGD",
+                 []() { return SGD<float, DeviceTags::CPU>(0.1f); },
+                 [](float& w, float g, States&, size_t) { w -= 0.1f * g; }),
+        MakeRule("Momentum",
+                 []() { return Momentum<float, DeviceTags::CPU>(0.1f, 0.8f); },
+                 [](float& w, float g, States& s, size_t)
+                 {
+                     s[0] = 0.8f * s[0] + g;
+                     w -= 0.1f * s[0];
+                 }),
+        MakeRule("AdaGrad",
+                 []() { return AdaGrad<float, DeviceTags::CPU>(0.1f); },
+                 [](float& w, float g, States& s, size_t)
+                 {
+                     s[0] += g * g;
+                     w -= 0.1f * g / (sqrt(s[0]) + 1e-8f);
+                 }),
+        MakeRule("RMSProp",
+                 []() { return RMSProp<float, DeviceTags::CPU>(0.01f, 0.9f); },
+                 [](float& w, float g, States& s, size_t)
+                 {
+                     s[0] = 0.9f * s[0] + 0.1f * g * g;
+                     w -= 0.01f * g / (sqrt(s[0]) + 1e-8f);
+                 }),
+        MakeRule("Adam",
+                 []() { return Adam<float, DeviceTags::CPU>(0.01f); },
+                 [](float& w, float g, States& s, size_t t)
+                 {
+                     s[0] = 0.9f * s[0] + 0.1f * g;
+                     s[1] = 0.999f * s[1] + 0.001f * g * g;
+                     const double m_hat = s[0] / (1 - pow(0.9, t));
+                     const double v_hat = s[1] / (1 - pow(0.999, t));
+                     w -= (float)(0.01 * m_hat / (sqrt(v_hat) + 1e-8));
+                 }));
+}
+
+// The expected values of a weight and its states
+struct RefWeight
+{
+    RefWeight(const CpuMatrix& w)
+        : rowNum(w.RowNum())
+        , colNum(w.ColNum())
+        , vals(w.RowNum() * w.ColNum())
+        , states(w.RowNum() * w.ColNum(), States{0, 0})
+    {
+        for (size_t i = 0; i < vals.size(); ++i) vals[i] = w(i / colNum, i % colNum);
+    }
+
+    template <typename TRef>
+    void UpdateRow(const TRef& ref, size_t row, const vector<float>& g, size_t t)
+    {
+        for (size_t j = 0; j < colNum; ++j)
+        {
+            ref(vals[row * colNum + j], g[j], states[row * colNum + j], t);
+        }
+    }
+
+    template <typename TRef>
+    void Update(const TRef& ref, const CpuMatrix& g, size_t t)
+    {
+        for (size_t i = 0; i < rowNum; ++i)
+        {
+            vector<float> row(colNum);
+            for (size_t j = 0; j < colNum; ++j) row[j] = g(i, j);
+            UpdateRow(ref, i, row, t);
+        }
+    }
+
+    void Check(const CpuMatrix& w) const
+    {
+        assert((w.RowNum() == rowNum) && (w.ColNum() == colNum));
+        for (size_t i = 0; i < vals.size(); ++i)
+        {
+            const float v = w(i / colNum, i % colNum);
+            assert(fabs(v - vals[i]) <= 1e-4f * max(1.0f, fabs(vals[i])));
+        }
+    }
+
+    size_t rowNum;
+    size_t colNum;
+    vector<float> vals;
+    vector<States> states;
+};
+
+CpuMatrix Clone(const CpuMatrix& m)
+{
+    CpuMatrix res(m.RowNum(), m.ColNum());
+    for (size_t i = 0; i < m.RowNum(); ++i)
+    {
+        for (size_t j = 0; j < m.ColNum(); ++j)
+        {
+            res.SetValue(i, j, m(i, j));
+        }
+    }
+    return res;
+}
+
+// Dense weights of every tail width of the SIMD lanes, stored without gaps (one flat segment)
+// and as views with gaps between their rows (row by row)
+template <typename TRule>
+void CheckDense(const TRule& rule)
+{
+    for (size_t colNum : {1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 33})
+    {
+        for (bool gaps : {false, true})
+        {
+            CpuMatrix w = GenMatrix<float>(3, colNum, 0.3f, -0.01f);
+            if (gaps)
+            {
+                w = GenMatrix<float>(6, colNum + 5, 0.2f, 0.01f);
+                w.Shrink(2, 5, 3, 3 + colNum);
+            }
+            RefWeight ref(w);
+            auto opt = rule.Make();
+            for (size_t step = 1; step <= 3; ++step)
+            {
+                auto g = GenMatrix<float>(3, colNum, step * 0.5f - 1.4f, 0.03f);
+                GradCollector<float, DeviceTags::CPU> col;
+                col.Collect(w, g);
+                opt.Update(col);
+                ref.Update(rule.Ref, g, step);
+            }
+            ref.Check(w);
+        }
+    }
+}
+
+// Weights packed in an arena are updated through the gradient block, cut into flat segments;
+// the large one spans several segments
+template <typename TRule>
+void CheckArena(const TRule& rule)
+{
+    map<string, CpuMatrix> params{{"a", GenMatrix<float>(130, 131, -0.5f, 0.0001f)},
+                                  {"b", GenMatrix<float>(3, 5, 0.1f, 0.01f)}};
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+    map<string, RefWeight> refs;
+    for (const auto& [name, w] : params) refs.emplace(name, RefWeight(w));
+
+    auto opt = rule.Make();
+    for (size_t step = 1; step <= 2; ++step)
+    {
+        GradCollector<float, DeviceTags::CPU> col(arena);
+        for (auto& [name, w] : params)
+        {
+            auto g = GenMatrix<float>(w.RowNum(), w.ColNum(), step * 0.3f - 0.7f, 0.00002f);
+            col.Collect(w, g);
+            refs.at(name).Update(rule.Ref, g, step);
+        }
+        opt.Update(col);
+        arena.ZeroGrad();
+    }
+    for (const auto& [name, w] : params) refs.at(name).Check(w);
+}
+
+// Row gradients only update the rows they touch, together with their states; repeated rows
+// are summed
+template <typename TRule>
+void CheckRows(const TRule& rule)
+{
+    auto emb = GenMatrix<float>(20, 9, 0.1f, 0.01f);
+    RefWeight ref(emb);
+    const vector<vector<size_t>> rowsOfStep{{4, 17, 4}, {2, 4}, {17}};
+
+    auto opt = rule.Make();
+    for (size_t step = 1; step <= rowsOfStep.size(); ++step)
+    {
+        const auto& rows = rowsOfStep[step - 1];
+        auto rg = GenBatchMatrix<float>(1, 9, rows.size(), step * 0.7f - 1.0f, 0.1f);
+        GradCollector<float, DeviceTags::CPU> col(false, true);
+        col.CollectRows(emb, rows, rg);
+        opt.Update(col);
+
+        map<size_t, vector<float>> sums;
+        for (size_t k = 0; k < rows.size(); ++k)
+        {
+            auto& sum = sums[rows[k]];
+            sum.resize(9, 0);
+            for (size_t j = 0; j < 9; ++j) sum[j] += rg[k](0, j);
+        }
+        for (const auto& [row, g] : sums) ref.UpdateRow(rule.Ref, row, g, step);
+    }
+    ref.Check(emb);
+}
+
+// The packed GEMM panels of an updated weight are rebuilt
+template <typename TRule>
+void CheckPackCache(const TRule& rule)
+{
+    auto w = GenMatrix<float>(40, 70, -1.0f, 0.001f);
+    auto x = GenMatrix<float>(3, 40, 0.5f, 0.01f);
+    auto& cache = NSGemm::PackCache<float>::Instance();
+    EnablePackCache(w);
+    const size_t packNum = cache.PackNum();
+    Evaluate(Dot(x, w));
+    assert(cache.PackNum() == packNum + 1);
+
+    auto opt = rule.Make();
+    GradCollector<float, DeviceTags::CPU> col;
+    col.Collect(w, GenMatrix<float>(40, 70, 0.1f, 0.001f));
+    opt.Update(col);
+
+    auto res = Evaluate(Dot(x, w));
+    assert(cache.PackNum() == packNum + 2);
+    auto check = Evaluate(Dot(x, Clone(w)));
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 70; ++j)
+        {
+            assert(res(i, j) == check(i, j));
+        }
+    }
+}
+
+void test_update_rules1()
+{
+    cout << "Test update rules case 1 ...\t";
+    apply([](const auto&... rule) { (CheckDense(rule), ...); }, Rules());
+    cout << "done" << endl;
+}
+
+void test_update_rules2()
+{
+    cout << "Test update rules case 2 ...\t";
+    apply([](const auto&... rule) { (CheckArena(rule), ...); }, Rules());
+    cout << "done" << endl;
+}
+
+void test_update_rules3()
+{
+    cout << "Test update rules case 3 ...\t";
+    apply([](const auto&... rule) { (CheckRows(rule), ...); }, Rules());
+    cout << "done" << endl;
+}
+
+void test_update_rules4()
+{
+    cout << "Test update rules case 4 ...\t";
+    apply([](const auto&... rule) { (CheckPackCache(rule), ...); }, Rules());
+    cout << "done" << endl;
+}
+}
+
+void test_update_rules()
+{
+    test_update_rules1();
+    test_update_rules2();
+    test_update_rules3();
+    test_update_rules4();
+}
@@ -0,0 +1,235 @@
+#include "test_param_arena.h"
+#include "../../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+bool Same(const Matrix<float, DeviceTags::CPU>& a, const Matrix<float, DeviceTags::CPU>& b)
+{
+    if ((a.RowNum() != b.RowNum()) || (a.ColNum() != b.ColNum())) return false;
+    for (size_t i = 0; i < a.RowNum(); ++i)
+    {
+        for (size_t j = 0; j < a.ColNum(); ++j)
+        {
+            if (fabs(a(i, j) - b(i, j)) > 0.0001f) return false;
+        }
+    }
+    return true;
+}
+
+void test_param_arena1()
+{
+    cout << "Test param arena case 1 ...\t";
+    auto w1 = GenMatrix<float>(7, 13, 0.5f, -0.01f);
+    auto w2 = GenMatrix<float>(40, 50, 0.1f, 0.001f);
+    w2.Shrink(3, 20, 5, 36);
+    auto w3 = GenMatrix<float>(1, 3, -1.0f, 0.2f);
+
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    params["a"] = w1;
+    params["b"] = w2;
+    params["c"] = w3;
+    params["d"] = w1;
+
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+    assert(arena.ParamNum() == 3);
+    assert(arena.Size() == 96 + 528 + 16);
+    assert(params["a"] == params["d"]);
+    assert(Same(params["a"], w1));
+    assert(Same(params["b"], w2));
+    assert(Same(params["c"], w3));
+
+    // every parameter starts on an aligned boundary, the padding is zero
+    double sum = 0;
+    for (const auto& [name, mat] : params)
+    {
+        const float* p = LowerAccess(mat).RawMemory();
+        assert((uintptr_t)p % 64 == 0);
+        assert((p >= arena.Data()) && (p + mat.RowNum() * mat.ColNum() <= arena.Data() + arena.Size()));
+        assert(LowerAccess(mat).RowLen() == mat.ColNum());
+        assert(arena.Contains(mat));
+        if (name != "d")
+        {
+            for (size_t i = 0; i < mat.RowNum(); ++i)
+                for (size_t j = 0; j < mat.ColNum(); ++j)
+                    sum += mat(i, j);
+        }
+    }
+    double flatSum = 0;
+    const auto flat = arena.Flat();
+    assert((flat.RowNum() == 1) && (flat.ColNum() == arena.Size()));
+    for (size_t j = 0; j < flat.ColNum(); ++j)
+    {
+        flatSum += flat(0, j);
+    }
+    assert(fabs(sum - flatSum) < 0.01);
+
+    // the gradient block has the same layout
+    auto g = arena.Grad(params["b"]);
+    assert(LowerAccess(g).RawMemory() - arena.GradData() == LowerAccess(params["b"]).RawMemory() - arena.Data());
+    assert((g.RowNum() == 17) && (g.ColNum() == 31));
+    assert(!arena.Contains(w1));
+    // a part of a parameter is not one, but lies in the arena
+    auto part = params["b"];
+    part.Shrink(1, 2, 3, 31);
+    assert(!arena.Contains(part) && arena.ContainsView(part));
+    assert(!arena.ContainsView(w2));
+    assert(LowerAccess(arena.Grad(part)).RawMemory() == LowerAccess(g).RawMemory() + 31 + 3);
+
+    // column views of one matrix stay side by side
+    auto whole = GenMatrix<float>(4, 10, 0.3f, 0.01f);
+    auto left = whole;
+    left.Shrink(0, 4, 0, 3);
+    auto right = whole;
+    right.Shrink(0, 4, 3, 10);
+    map<string, Matrix<float, DeviceTags::CPU>> views{{"l", left}, {"r", right}};
+    ParamArena<float, DeviceTags::CPU> viewArena;
+    viewArena.Pack(views);
+    assert((viewArena.ParamNum() == 2) && (viewArena.Size() == 48));
+    assert(LowerAccess(views["r"]).RawMemory() == LowerAccess(views["l"]).RawMemory() + 3);
+    assert((LowerAccess(views["l"]).RowLen() == 10) && (LowerAccess(views["r"]).RowLen() == 10));
+    assert(Same(views["l"], left) && Same(views["r"], right));
+    const auto wholeView = Matrix<float, DeviceTags::CPU>(LowerAccess(views["l"]).SharedMemory(),
+                                                          LowerAccess(views["l"]).MutableRawMemory(), 4, 10, 10);
+    assert(Same(wholeView, whole));
+    assert(!viewArena.Contains(wholeView) && viewArena.ContainsView(wholeView));
+    assert(viewArena.Contains(views["l"]) && viewArena.Contains(views["r"]));
+
+    // overlapping views starting at the same element are both parameters
+    map<string, Matrix<float, DeviceTags::CPU>> overlap{{"l", left}, {"w", whole}};
+    ParamArena<float, DeviceTags::CPU> overlapArena;
+    overlapArena.Pack(overlap);
+    assert((overlapArena.ParamNum() == 2) && (overlapArena.Size() == 48));
+    assert(LowerAccess(overlap["l"]).RawMemory() == LowerAccess(overlap["w"]).RawMemory());
+    assert(Same(overlap["l"], left) && Same(overlap["w"], whole));
+    assert(overlapArena.Contains(overlap["l"]) && overlapArena.Contains(overlap["w"]));
+
+    // packing again moves the views to a new arena
+    arena.Pack(params);
+    assert(arena.Contains(params["a"]) && (params["a"] == params["d"]));
+    assert(Same(params["b"], w2));
+    cout << "done" << endl;
+}
+
+void test_param_arena2()
+{
+    cout << "Test param arena case 2 ...\t";
+    // a model in an arena computes, collects and updates as one with separate matrices
+    using RootLayer = InjectPolicy<LinearLayer, PUpdate>;
+    auto w = GenMatrix<float>(20, 30, 0.1f, -0.001f);
+    auto b = GenMatrix<float>(1, 30, -0.2f, 0.01f);
+    auto initializer = MakeInitializer<float>();
+    initializer.SetMatrix("root-weight", w);
+    initializer.SetMatrix("root-bias", b);
+
+    RootLayer plain("root", 20, 30);
+    map<string, Matrix<float, DeviceTags::CPU>> plainParams;
+    plain.Init(initializer, plainParams);
+
+    RootLayer packed("root", 20, 30);
+    map<string, Matrix<float, DeviceTags::CPU>> params;
+    packed.Init(initializer, params);
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+    packed.Init(initializer, params);
+
+    map<string, Matrix<float, DeviceTags::CPU>> saved;
+    packed.SaveWeights(saved);
+    assert(arena.Contains(saved["root-weight"]) && arena.Contains(saved["root-bias"]));
+
+    GradCollector<float, DeviceTags::CPU> plainCol(true);
+    GradCollector<float, DeviceTags::CPU> packedCol(arena);
+    SGD<float, DeviceTags::CPU> plainSgd(0.1f);
+    SGD<float, DeviceTags::CPU> packedSgd(0.1f);
+    for (size_t round = 0; round < 3; ++round)
+    {
+        auto x = GenMatrix<float>(1, 20, 0.3f * round, 0.01f);
+        auto y = GenMatrix<float>(1, 30, 0.1f, -0.02f * round);
+        auto out1 = Evaluate(plain.FeedForward(LayerIO::Create().Set<LayerIO>(x)).Get<LayerIO>());
+        auto out2 = Evaluate(packed.FeedForward(LayerIO::Create().Set<LayerIO>(x)).Get<LayerIO>());
+        assert(Same(out1, out2));
+        plain.FeedBackward(LayerIO::Create().Set<LayerIO>(y));
+        packed.FeedBackward(LayerIO::Create().Set<LayerIO>(y));
+
+        plain.GradCollect(plainCol);
+        packed.GradCollect(packedCol);
+        assert(packedCol.size() == 2);
+        for (const auto& info : packedCol)
+        {
+            assert(arena.Contains(info.weight));
+            const auto g = info.grad[0].EvalRegister();
+            EvalPlan<DeviceTags::CPU>::Eval();
+            assert(g.Data() == arena.Grad(info.weight));
+        }
+        plainSgd.Update(plainCol);
+        packedSgd.Update(packedCol);
+        plainCol.clear();
+        packedCol.clear();
+    }
+
+    map<string, Matrix<float, DeviceTags::CPU>> plainSaved;
+    plain.SaveWeights(plainSaved);
+    assert(Same(plainSaved["root-weight"], params["root-weight"]));
+    assert(Same(plainSaved["root-bias"], params["root-bias"]));
+    assert(!Same(plainSaved["root-weight"], w));
+    cout << "done" << endl;
+}
+
+void test_param_arena3()
+{
+    cout << "Test param arena case 3 ...\t";
+    // a write through the arena block rebuilds the packed panels of its parameters
+    map<string, Matrix<float, DeviceTags::CPU>> params{{"w", GenMatrix<float>(300, 500, -1.0f, 0.0001f)}};
+    ParamArena<float, DeviceTags::CPU> arena;
+    arena.Pack(params);
+    const auto w = params["w"];
+    auto x = GenMatrix<float>(3, 300, 0.5f, 0.001f);
+
+    auto& cache = NSGemm::PackCache<float>::Instance();
+    EnablePackCache(w);
+    const size_t packNum = cache.PackNum();
+    Evaluate(Dot(x, w));
+    assert(cache.PackNum() == packNum + 1);
+
+    float* data = arena.Data();
+    for (size_t i = 0; i < arena.Size(); ++i)
+    {
+        data[i] = data[i] * 2 - 0.5f;
+    }
+    auto res = Evaluate(Dot(x, w));
+    assert(cache.PackNum() == packNum + 2);
+
+    Matrix<float, DeviceTags::CPU> fresh(300, 500);
+    for (size_t i = 0; i < 300; ++i)
+    {
+        for (size_t j = 0; j < 500; ++j)
+        {
+            fresh.SetValue(i, j, w(i, j));
+        }
+    }
+    auto check = Evaluate(Dot(x, fresh));
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 500; ++j)
+        {
+            assert(res(i, j) == check(i, j));
+        }
+    }
+    cout << "done" << endl;
+}
+}
+
+void test_param_arena()
+{
+    test_param_arena1();
+    test_param_arena2();
+    test_param_arena3();
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void test_param_arena();
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <MetaNN/meta_nn.h>
 #include <iostream>
 #include <cassert>
+#include <cmath>
 using namespace std;
 using namespace MetaNN;
 
@@ -110,6 +111,374 @@ void test_dot_3()
     }
     cout << "done" << endl;
 }
+
+void test_dot_4()
+{
+    cout << "Test dot case 4 ...\t";
+    // sizes cross the micro-tile and K-block boundaries of the GEMM kernel
+    Matrix<int, DeviceTags::CPU> rm(75, 600);
+    Matrix<int, DeviceTags::CPU> cm(600, 37);
+    for (size_t i = 0; i < 75; ++i)
+    {
+        for (size_t k = 0; k < 600; ++k)
+        {
+            rm.SetValue(i, k, (int)((i * 7 + k * 3) % 11) - 5);
+        }
+    }
+    for (size_t k = 0; k < 600; ++k)
+    {
+        for (size_t j = 0; j < 37; ++j)
+        {
+            cm.SetValue(k, j, (int)((k * 5 + j * 13) % 9) - 4);
+        }
+    }
+
+    auto mul_r = Evaluate(Dot(rm, cm));
+    assert(mul_r.RowNum() == 75);
+    assert(mul_r.ColNum() == 37);
+    for (size_t i = 0; i < 75; ++i)
+    {
+        for (size_t j = 0; j < 37; ++j)
+        {
+            int h = 0;
+            for (size_t k = 0; k < 600; ++k)
+            {
+                h += rm(i, k) * cm(k, j);
+            }
+            assert(h == mul_r(i, j));
+        }
+    }
+
+    auto fm1 = GenMatrix<float>(150, 310, 0, 0.001f);
+    auto fm2 = GenMatrix<float>(310, 90, 1, 0.0003f);
+    fm1.Shrink(3, 133, 7, 300);
+    fm2.Shrink(5, 298, 10, 77);
+    auto fmul_r = Evaluate(Dot(fm1, fm2));
+    for (size_t i = 0; i < 130; ++i)
+    {
+        for (size_t j = 0; j < 67; ++j)
+        {
+            double h = 0;
+            for (size_t k = 0; k < 293; ++k)
+            {
+                h += (double)fm1(i, k) * fm2(k, j);
+            }
+            assert(fabs(h - fmul_r(i, j)) <= 1e-4 * fabs(h) + 1e-4);
+        }
+    }
+    cout << "done" << endl;
+}
+void test_dot_5()
+{
+    cout << "Test dot case 5 ...\t";
+    // shared weight with a shrunk batch (rows not evenly strided) and with a shared left operand
+    auto bm = GenBatchMatrix<int>(9, 40, 5, 0, 1);
+    bm.Shrink(1, 8, 3, 38);
+    auto w = GenMatrix<int>(35, 21, 2, 1);
+    auto mul_r = Evaluate(Dot(bm, w));
+    assert(mul_r.BatchNum() == 5);
+    for (size_t b = 0; b < 5; ++b)
+    {
+        auto cur = bm[b];
+        for (size_t i = 0; i < 7; ++i)
+        {
+            for (size_t j = 0; j < 21; ++j)
+            {
+                int h = 0;
+                for (size_t k = 0; k < 35; ++k)
+                {
+                    h += cur(i, k) * w(k, j);
+                }
+                assert(h == mul_r[b](i, j));
+            }
+        }
+    }
+
+    auto lm = GenMatrix<int>(13, 17, 1, 1);
+    auto rb = GenBatchMatrix<int>(17, 11, 6, 3, 1);
+    auto mul2_r = Evaluate(Dot(lm, rb));
+    assert(mul2_r.BatchNum() == 6);
+    for (size_t b = 0; b < 6; ++b)
+    {
+        auto cur = rb[b];
+        for (size_t i = 0; i < 13; ++i)
+        {
+            for (size_t j = 0; j < 11; ++j)
+            {
+                int h = 0;
+                for (size_t k = 0; k < 17; ++k)
+                {
+                    h += lm(i, k) * cur(k, j);
+                }
+                assert(h == mul2_r[b](i, j));
+            }
+        }
+    }
+
+    auto mul3_r = Evaluate(Dot(MakeDuplicate(4, lm), MakeDuplicate(4, rb[2])));
+    assert(mul3_r.BatchNum() == 4);
+    for (size_t b = 0; b < 4; ++b)
+    {
+        for (size_t i = 0; i < 13; ++i)
+        {
+            for (size_t j = 0; j < 11; ++j)
+            {
+                assert(mul3_r[b](i, j) == mul2_r[2](i, j));
+            }
+        }
+    }
+    cout << "done" << endl;
+}
+void test_dot_6()
+{
+    cout << "Test dot case 6 ...\t";
+    // one-hot rows select rows of the weight
+    auto w = GenMatrix<float>(1000, 7, 0.3f, 0.01f);
+    auto res = Evaluate(Dot(OneHotVector<float, DeviceTags::CPU>(1000, 345), w));
+    auto res2 = Evaluate(Dot(MakeDynamic(OneHotVector<float, DeviceTags::CPU>(1000, 17)), w));
+    assert(res.RowNum() == 1);
+    assert(res.ColNum() == 7);
+    for (size_t j = 0; j < 7; ++j)
+    {
+        assert(res(0, j) == w(345, j));
+        assert(res2(0, j) == w(17, j));
+    }
+
+    auto sw = GenMatrix<float>(1111, 19, 0.3f, 0.01f);
+    sw.Shrink(10, 1010, 3, 10);
+    res = Evaluate(Dot(OneHotVector<float, DeviceTags::CPU>(1000, 999), sw));
+    for (size_t j = 0; j < 7; ++j)
+    {
+        assert(res(0, j) == sw(999, j));
+    }
+
+    auto label = BatchOneHotVector<float, DeviceTags::CPU>(1000, {3, 999, 0, 500, 3});
+    auto bres = Evaluate(Dot(label, w));
+    auto bw = GenBatchMatrix<float>(1000, 7, 5, 0.1f, 0.001f);
+    auto bres2 = Evaluate(Dot(label, bw));
+    assert(bres.BatchNum() == 5);
+    for (size_t b = 0; b < 5; ++b)
+    {
+        for (size_t j = 0; j < 7; ++j)
+        {
+            assert(bres[b](0, j) == w(label.HotPos(b), j));
+            assert(bres2[b](0, j) == bw[b](label.HotPos(b), j));
+        }
+    }
+
+    // a gathered row in an element-wise tree is not turned into a GEMM epilogue
+    Matrix<float, DeviceTags::CPU> bias(1, 7);
+    for (size_t j = 0; j < 7; ++j)
+    {
+        bias.SetValue(0, j, 0.1f * j);
+    }
+    res = Evaluate(Sigmoid(Dot(OneHotVector<float, DeviceTags::CPU>(1000, 345), w) + bias));
+    auto check = Evaluate(Sigmoid(Dot(Evaluate(OneHotVector<float, DeviceTags::CPU>(1000, 345)), w) + bias));
+    for (size_t j = 0; j < 7; ++j)
+    {
+        assert(fabs(res(0, j) - check(0, j)) < 0.0001);
+    }
+    cout << "done" << endl;
+}
+void test_dot_7()
+{
+    cout << "Test dot case 7 ...\t";
+    // packed panels of a tracked weight are reused until the weight is invalidated
+    auto w = GenMatrix<float>(600, 2100, -1.0f, 0.0001f);
+    auto x = GenMatrix<float>(3, 600, 0.5f, 0.001f);
+    auto bx = GenBatchMatrix<float>(2, 600, 4, 0.2f, 0.001f);
+    auto check = Evaluate(Dot(x, w));
+    auto bcheck = Evaluate(Dot(bx, w));
+
+    auto& cache = NSGemm::PackCache<float>::Instance();
+    EnablePackCache(w);
+    const size_t packNum = cache.PackNum();
+    auto res = Evaluate(Dot(x, w));
+    assert(cache.PackNum() == packNum + 1);
+    res = Evaluate(Dot(x, w));
+    auto bres = Evaluate(Dot(bx, w));
+    assert(cache.PackNum() == packNum + 1);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        for (size_t j = 0; j < 2100; ++j)
+        {
+            assert(res(i, j) == check(i, j));
+        }
+    }
+    for (size_t b = 0; b < 4; ++b)
+    {
+        for (size_t i = 0; i < 2; ++i)
+        {
+            for (size_t j = 0; j < 2100; ++j)
+            {
+                assert(bres[b](i, j) == bcheck[b](i, j));
+            }
+        }
+    }
+
+    // in-place updates are detected through the write version of the memory
+    auto checkUpdate = [&](size_t newPacks)
+    {
+        Matrix<float, DeviceTags::CPU> w2(600, 2100);
+        for (size_t i = 0; i < 600; ++i)
+        {
+            for (size_t j = 0; j < 2100; ++j)
+            {
+                w2.SetValue(i, j, w(i, j));
+            }
+        }
+        check = Evaluate(Dot(x, w2));
+        res = Evaluate(Dot(x, w));
+        assert(cache.PackNum() == packNum + newPacks);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            for (size_t j = 0; j < 2100; ++j)
+            {
+                assert(res(i, j) == check(i, j));
+            }
+        }
+    };
+    {
+        auto mem = LowerAccess(w);
+        for (size_t j = 0; j < 2100; ++j)
+        {
+            mem.MutableRawMemory()[599 * mem.RowLen() + j] += 1;
+        }
+    }
+    checkUpdate(2);
+    // element writes are not counted: they are followed by InvalidatePackCache
+    w.SetValue(3, 7, 100.f);
+    InvalidatePackCache(w);
+    checkUpdate(3);
+    res = Evaluate(Dot(x, w));
+    assert(cache.PackNum() == packNum + 3);
+
+    // untracked operands are not packed, also while weights are tracked
+    auto y = GenMatrix<float>(600, 40, 0.3f, -0.001f);
+    res = Evaluate(Dot(x, y));
+    assert(cache.PackNum() == packNum + 3);
+    cout << "done" << endl;
+}
+void test_dot_8()
+{
+    cout << "Test dot case 8 ...\t";
+    // transposed operands are read by the GEMM without being copied
+    auto a = GenMatrix<int>(111, 113, 0, 1);
+    auto b = GenMatrix<int>(111, 113, 2, 3);
+    a.Shrink(11, 18, 3, 12);
+    b.Shrink(20, 25, 7, 14);
+    auto c = GenMatrix<int>(7, 4, -3, 1);
+    auto d = GenMatrix<int>(3, 9, 5, -1);
+    auto e = GenMatrix<int>(9, 5, 1, 2);
+    auto ta = Evaluate(Transpose(a));
+    auto tb = Evaluate(Transpose(b));
+
+    auto check = [](const auto& res, const auto& ref)
+    {
+        assert(res.RowNum() == ref.RowNum());
+        assert(res.ColNum() == ref.ColNum());
+        for (size_t i = 0; i < ref.RowNum(); ++i)
+        {
+            for (size_t j = 0; j < ref.ColNum(); ++j)
+            {
+                assert(res(i, j) == ref(i, j));
+            }
+        }
+    };
+    check(Evaluate(Dot(Transpose(a), c)), Evaluate(Dot(ta, c)));
+    check(Evaluate(Dot(d, Transpose(a))), Evaluate(Dot(d, ta)));
+    check(Evaluate(Dot(Transpose(a), Transpose(b))), Evaluate(Dot(ta, tb)));
+    check(Evaluate(Dot(Transpose(a), Transpose(b)) + e), Evaluate(Dot(ta, tb) + e));
+    check(Evaluate(Transpose(a) + ta), Evaluate(ta + ta));
+
+    auto ba = GenBatchMatrix<int>(6, 4, 3, -5, 1);
+    auto bb = GenBatchMatrix<int>(5, 6, 3, 7, -1);
+    auto w = GenMatrix<int>(5, 6, 1, 2);
+
+    auto res1 = Evaluate(Dot(Transpose(ba), Transpose(bb)));
+    auto res2 = Evaluate(Dot(Transpose(ba), Transpose(w)));
+    auto res3 = Evaluate(Dot(Transpose(ba), Transpose(w)) + Dot(Transpose(ba), Transpose(bb)));
+    for (size_t k = 0; k < 3; ++k)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            for (size_t j = 0; j < 5; ++j)
+            {
+                int h1 = 0;
+                int h2 = 0;
+                for (size_t p = 0; p < 6; ++p)
+                {
+                    h1 += ba[k](p, i) * bb[k](j, p);
+                    h2 += ba[k](p, i) * w(j, p);
+                }
+                assert(res1[k](i, j) == h1);
+                assert(res2[k](i, j) == h2);
+                assert(res3[k](i, j) == h1 + h2);
+            }
+        }
+    }
+    cout << "done" << endl;
+}
+void test_dot_9()
+{
+    cout << "Test dot case 9 ...\t";
+    // DotAccumulate adds the product to the result
+    auto a = GenMatrix<float>(37, 300, -0.5f, 0.0001f);
+    auto b = GenMatrix<float>(300, 45, 0.3f, -0.0002f);
+    auto c = GenMatrix<float>(37, 45, 1.0f, 0.01f);
+    auto check = Evaluate(c + Dot(a, b));
+    DotAccumulate(c, Dot(a, b));
+    for (size_t i = 0; i < 37; ++i)
+    {
+        for (size_t j = 0; j < 45; ++j)
+        {
+            assert(fabs(c(i, j) - check(i, j)) < 0.0001f);
+        }
+    }
+
+    // batch products are added up, the batch of Transpose(x) * g is folded into one GEMM
+    auto x = GenBatchMatrix<float>(2, 7, 5, 0.1f, 0.01f);
+    auto g = GenBatchMatrix<float>(2, 4, 5, -0.2f, 0.02f);
+    auto w = GenMatrix<float>(7, 3, 0.5f, -0.01f);
+    Matrix<float, DeviceTags::CPU> acc1(7, 4);
+    Matrix<float, DeviceTags::CPU> acc2(4, 3);
+    for (size_t i = 0; i < 7; ++i)
+    {
+        for (size_t j = 0; j < 4; ++j) acc1.SetValue(i, j, 1.0f);
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j) acc2.SetValue(i, j, 0);
+    }
+    DotAccumulate(acc1, Dot(Transpose(x), g));
+    DotAccumulate(acc2, Dot(Transpose(g), Dot(x, w)));
+    auto xw = Evaluate(Dot(x, w));
+    for (size_t i = 0; i < 7; ++i)
+    {
+        for (size_t j = 0; j < 4; ++j)
+        {
+            float h = 1.0f;
+            for (size_t t = 0; t < 5; ++t)
+            {
+                for (size_t p = 0; p < 2; ++p) h += x[t](p, i) * g[t](p, j);
+            }
+            assert(fabs(acc1(i, j) - h) < 0.0001f);
+        }
+    }
+    for (size_t i = 0; i < 4; ++i)
+    {
+        for (size_t j = 0; j < 3; ++j)
+        {
+            float h = 0;
+            for (size_t t = 0; t < 5; ++t)
+            {
+                for (size_t p = 0; p < 2; ++p) h += g[t](p, i) * xw[t](p, j);
+            }
+            assert(fabs(acc2(i, j) - h) < 0.0001f);
+        }
+    }
+    cout << "done" << endl;
+}
 }
 
 void test_dot()
@@ -117,4 +486,10 @@ void test_dot()
     test_dot_1();
     test_dot_2();   // BatchMatrix dot matrix
     test_dot_3();
+    test_dot_4();
+    test_dot_5();
+    test_dot_6();
+    test_dot_7();
+    test_dot_8();   // transposed operands
+    test_dot_9();
 }
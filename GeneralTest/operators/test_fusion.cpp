@@ -0,0 +1,240 @@
+#include "test_fusion.h"
+#include "../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+void test_fusion1()
+{
+    cout << "Test fusion case 1 ...\t";
+    auto a = GenMatrix<float>(111, 113, -1, 0.0001f);
+    auto b = GenMatrix<float>(111, 113, 0.5f, 0.0002f);
+    auto c = GenMatrix<float>(111, 113, 3, -0.0003f);
+    a.Shrink(11, 75, 7, 100);
+    b.Shrink(21, 85, 13, 106);
+    c.Shrink(1, 65, 0, 93);
+
+    const size_t allocs = Allocator<DeviceTags::CPU>::Stats().m_allocations;
+    auto res = Evaluate(Sigmoid(Tanh(a) + b * c));
+    // one buffer for the result, no intermediate
+    assert(Allocator<DeviceTags::CPU>::Stats().m_allocations == allocs + 1);
+
+    auto step = Evaluate(Tanh(a));
+    step = Evaluate(step + Evaluate(b * c));
+    step = Evaluate(Sigmoid(step));
+
+    assert(res.RowNum() == 64);
+    assert(res.ColNum() == 93);
+    for (size_t i = 0; i < 64; ++i)
+    {
+        for (size_t j = 0; j < 93; ++j)
+        {
+            assert(res(i, j) == step(i, j));
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_fusion2()
+{
+    cout << "Test fusion case 2 ...\t";
+    auto a = GenMatrix<float>(17, 23, -1, 0.01f);
+    auto b = GenMatrix<float>(17, 23, 0.5f, 0.002f);
+    auto c = GenMatrix<float>(17, 23, 0.1f, 0.003f);
+
+    auto res1 = Evaluate(Abs(Sign(a) - a / b));
+    auto res2 = Evaluate(Interpolate(Sigmoid(a), Tanh(b), c));
+    auto res3 = Evaluate(SigmoidDerivative(a * b, Sigmoid(c)) + TanhDerivative(b, Tanh(a)));
+    for (size_t i = 0; i < 17; ++i)
+    {
+        for (size_t j = 0; j < 23; ++j)
+        {
+            const float x = a(i, j), y = b(i, j), z = c(i, j);
+            const float sign = (x == 0) ? 0 : ((x > 0) ? 1 : -1);
+            assert(fabs(res1(i, j) - fabs(sign - x / y)) < 0.0001);
+
+            const float sx = 1 / (1 + exp(-x));
+            const float sz = 1 / (1 + exp(-z));
+            assert(fabs(res2(i, j) - (sx * z + tanh(y) * (1 - z))) < 0.0001);
+            assert(fabs(res3(i, j) - (x * y * sz * (1 - sz) + y * (1 - tanh(x) * tanh(x)))) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_fusion3()
+{
+    cout << "Test fusion case 3 ...\t";
+    auto x = GenBatchMatrix<float>(8, 30, 5, -0.3f, 0.001f);
+    auto w = GenMatrix<float>(30, 20, 0.2f, -0.001f);
+    auto bias = GenMatrix<float>(8, 20, -0.1f, 0.01f);
+    auto h = GenBatchMatrix<float>(8, 20, 5, 0.1f, 0.002f);
+
+    auto res = Evaluate(Interpolate(Tanh(Dot(x, w) + bias), h, Sigmoid(h)));
+    auto dot = Evaluate(Dot(x, w));
+    assert(res.BatchNum() == 5);
+    for (size_t k = 0; k < 5; ++k)
+    {
+        for (size_t i = 0; i < 8; ++i)
+        {
+            for (size_t j = 0; j < 20; ++j)
+            {
+                const float t = tanh(dot[k](i, j) + bias(i, j));
+                const float s = 1 / (1 + exp(-h[k](i, j)));
+                assert(fabs(res[k](i, j) - (t * s + h[k](i, j) * (1 - s))) < 0.0001);
+            }
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_fusion4()
+{
+    cout << "Test fusion case 4 ...\t";
+    auto x = GenMatrix<float>(40, 60, -0.3f, 0.001f);
+    auto w = GenMatrix<float>(60, 30, 0.2f, -0.001f);
+    auto bias = GenMatrix<float>(40, 30, -0.1f, 0.01f);
+
+    // an evaluated operand is read from its buffer, the product is not computed again
+    auto h = Dot(x, w) + bias;
+    auto hVal = Evaluate(h);
+    auto mem_x = LowerAccess(x).MutableRawMemory();
+    std::fill(mem_x, mem_x + 40 * 60, 0.f);
+    auto res1 = Evaluate(Sigmoid(h));
+
+    // an operand read twice is computed once by its own unit
+    auto a = GenMatrix<float>(40, 30, -1, 0.001f);
+    auto t = Tanh(a);
+    size_t allocs = Allocator<DeviceTags::CPU>::Stats().m_allocations;
+    auto res2 = Evaluate(t * t + Sigmoid(t));
+    assert(Allocator<DeviceTags::CPU>::Stats().m_allocations == allocs + 2);
+
+    // an operand registered by another unit of the same plan is read from its buffer
+    auto u = Abs(a) + bias;
+    auto handle1 = u.EvalRegister();
+    auto handle2 = Tanh(u).EvalRegister();
+    EvalPlan<DeviceTags::CPU>::Eval();
+    auto res3 = handle2.Data();
+    assert(handle1.Data() == Evaluate(u));
+
+    for (size_t i = 0; i < 40; ++i)
+    {
+        for (size_t j = 0; j < 30; ++j)
+        {
+            assert(fabs(res1(i, j) - 1 / (1 + exp(-hVal(i, j)))) < 0.0001);
+            const float ta = tanh(a(i, j));
+            assert(fabs(res2(i, j) - (ta * ta + 1 / (1 + exp(-ta)))) < 0.0001);
+            assert(fabs(res3(i, j) - tanh(fabs(a(i, j)) + bias(i, j))) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_fusion5()
+{
+    cout << "Test fusion case 5 ...\t";
+    auto x = GenMatrix<float>(70, 300, -0.3f, 0.0001f);
+    auto w = GenMatrix<float>(300, 90, 0.2f, -0.0001f);
+    auto bias = GenMatrix<float>(70, 90, -0.1f, 0.01f);
+
+    // the product is computed into the result buffer, bias and activation applied on store
+    const size_t allocs = Allocator<DeviceTags::CPU>::Stats().m_allocations;
+    auto res = Evaluate(Sigmoid(Dot(x, w) + bias));
+    assert(Allocator<DeviceTags::CPU>::Stats().m_allocations == allocs + 1);
+
+    auto dot = Evaluate(Dot(x, w));
+    auto step = Evaluate(Sigmoid(dot + bias));
+    for (size_t i = 0; i < 70; ++i)
+    {
+        for (size_t j = 0; j < 90; ++j)
+        {
+            assert(res(i, j) == step(i, j));
+        }
+    }
+
+    // shared right operand (batch folded into rows), shared left operand (batch folded
+    // into columns) and two batch operands
+    auto xb = GenBatchMatrix<float>(7, 300, 3, -0.3f, 0.0001f);
+    auto wl = GenMatrix<float>(20, 7, 0.2f, -0.01f);
+    auto yb = GenBatchMatrix<float>(90, 11, 3, 0.1f, -0.001f);
+    auto bias7 = GenMatrix<float>(7, 90, 0.3f, -0.01f);
+    auto res1 = Evaluate(Tanh(Dot(xb, w) + bias7));
+    auto res2 = Evaluate(Tanh(Dot(wl, xb)));
+    auto res3 = Evaluate(Sigmoid(Dot(Tanh(Dot(xb, w)), yb)));
+    // two products: both are evaluated by their own units
+    auto res4 = Evaluate(Abs(Dot(xb, w) - Dot(xb, w)) + bias7);
+    auto dot1 = Evaluate(Dot(xb, w));
+    auto step1 = Evaluate(Tanh(Evaluate(dot1 + bias7)));
+    auto step2 = Evaluate(Tanh(Evaluate(Dot(wl, xb))));
+    auto dot3 = Evaluate(Dot(Evaluate(Tanh(dot1)), yb));
+    for (size_t k = 0; k < 3; ++k)
+    {
+        for (size_t i = 0; i < 7; ++i)
+        {
+            for (size_t j = 0; j < 90; ++j)
+            {
+                assert(res1[k](i, j) == step1[k](i, j));
+                assert(res4[k](i, j) == bias7(i, j));
+            }
+            for (size_t j = 0; j < 11; ++j)
+            {
+                assert(fabs(res3[k](i, j) - 1 / (1 + exp(-dot3[k](i, j)))) < 0.0001);
+            }
+        }
+        for (size_t i = 0; i < 20; ++i)
+        {
+            for (size_t j = 0; j < 300; ++j)
+            {
+                assert(res2[k](i, j) == step2[k](i, j));
+            }
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_fusion6()
+{
+    cout << "Test fusion case 6 ...\t";
+    // Dot(one-hot, w) behind a DynamicData gathers rows, the one-hot matrix is never built
+    const size_t vocab = 100000;
+    auto w = GenMatrix<float>(vocab, 7, 0.3f, 0.00001f);
+    auto bias = GenMatrix<float>(1, 7, 0.1f, 0.1f);
+    auto bw = GenBatchMatrix<float>(vocab, 7, 3, -0.2f, 0.00001f);
+    auto bbias = GenMatrix<float>(1, 7, -0.1f, 0.05f);
+
+    const size_t denseCls = NSAllocator::SizeClass(vocab * sizeof(float));
+    const size_t denseAllocs = Allocator<DeviceTags::CPU>::Stats().m_classes[denseCls].m_allocations;
+    auto x = MakeDynamic(OneHotVector<float, DeviceTags::CPU>(vocab, 345));
+    auto res = Evaluate(Tanh(Dot(x, w) + bias));
+    auto bx = MakeDynamic(BatchOneHotVector<float, DeviceTags::CPU>(vocab, {3, 99999, 500}));
+    auto bres = Evaluate(Sigmoid(Dot(bx, bw) + bbias));
+    assert(Allocator<DeviceTags::CPU>::Stats().m_classes[denseCls].m_allocations == denseAllocs);
+
+    const size_t hot[] = {3, 99999, 500};
+    for (size_t j = 0; j < 7; ++j)
+    {
+        assert(fabs(res(0, j) - tanh(w(345, j) + bias(0, j))) < 0.0001);
+        for (size_t b = 0; b < 3; ++b)
+        {
+            assert(fabs(bres[b](0, j) - 1 / (1 + exp(-(bw[b](hot[b], j) + bbias(0, j))))) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
+}
+
+void test_fusion()
+{
+    test_fusion1();
+    test_fusion2();
+    test_fusion3();
+    test_fusion4();
+    test_fusion5();
+    test_fusion6();
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void test_fusion();
\ No newline at end of file
@@ -101,6 +101,32 @@ void test_negative_log_likelihood3()
     }
     cout << "done" << endl;
 }
+void test_negative_log_likelihood4()
+{
+    cout << "Test negative log likelihood case 4 ...\t";
+    auto pre = GenMatrix<float>(1, 1000, 0.1f, 0.001f);
+    auto t_r = Evaluate(NegativeLogLikelihood(OneHotVector<float, DeviceTags::CPU>(1000, 345), pre));
+    assert(fabs(t_r.Value() + log(pre(0, 345))) < 0.0001);
+
+    // label hidden behind a dynamic wrapper, as stored by the cost layers
+    auto label = MakeDynamic(OneHotVector<float, DeviceTags::CPU>(1000, 17));
+    t_r = Evaluate(NegativeLogLikelihood(label, pre));
+    assert(fabs(t_r.Value() + log(pre(0, 17))) < 0.0001);
+
+    auto bpre = GenBatchMatrix<float>(1, 1000, 5, 0.1f, 0.0001f);
+    auto blabel = BatchOneHotVector<float, DeviceTags::CPU>(1000, {3, 999, 0, 500, 3});
+    auto check = Evaluate(NegativeLogLikelihood(Evaluate(blabel), bpre));
+    auto bt_r = Evaluate(NegativeLogLikelihood(blabel, bpre));
+    auto bt_r2 = Evaluate(NegativeLogLikelihood(MakeDynamic(blabel), bpre));
+    assert(bt_r.BatchNum() == 5);
+    for (size_t b = 0; b < 5; ++b)
+    {
+        assert(fabs(bt_r[b] + log(bpre[b](0, blabel.HotPos(b)))) < 0.0001);
+        assert(fabs(bt_r[b] - check[b]) < 0.0001);
+        assert(fabs(bt_r2[b] - check[b]) < 0.0001);
+    }
+    cout << "done" << endl;
+}
 }
 
 void test_negative_log_likelihood()
@@ -108,4 +134,5 @@ void test_negative_log_likelihood()
     test_negative_log_likelihood1();
     test_negative_log_likelihood2();
     test_negative_log_likelihood3();
+    test_negative_log_likelihood4();
 }
@@ -95,6 +95,35 @@ void test_negative_log_likelihood_derivative3()
     }
     cout << "done" << endl;
 }
+void test_negative_log_likelihood_derivative4()
+{
+    cout << "Test negative log likelihood derivative case 4 ...\t";
+    auto pre = GenMatrix<float>(1, 1000, 0.1f, 0.001f);
+    auto label = OneHotVector<float, DeviceTags::CPU>(1000, 345);
+    auto div_r = Evaluate(NegativeLogLikelihoodDerivative(Scalar<float>(0.5), label, pre));
+    auto div_r2 = Evaluate(NegativeLogLikelihoodDerivative(Scalar<float>(0.5), MakeDynamic(label), pre));
+    for (size_t j = 0; j < 1000; ++j)
+    {
+        const float check = (j == 345) ? (-0.5f / pre(0, j)) : 0;
+        assert(fabs(div_r(0, j) - check) < 0.0001);
+        assert(fabs(div_r2(0, j) - check) < 0.0001);
+    }
+
+    auto bpre = GenBatchMatrix<float>(1, 1000, 5, 0.1f, 0.0001f);
+    auto blabel = BatchOneHotVector<float, DeviceTags::CPU>(1000, {3, 999, 0, 500, 3});
+    auto grad = MakeDuplicate(5, Scalar<float>(0.5));
+    auto check = Evaluate(NegativeLogLikelihoodDerivative(grad, Evaluate(blabel), bpre));
+    auto bdiv_r = Evaluate(NegativeLogLikelihoodDerivative(grad, blabel, bpre));
+    assert(bdiv_r.BatchNum() == 5);
+    for (size_t b = 0; b < 5; ++b)
+    {
+        for (size_t j = 0; j < 1000; ++j)
+        {
+            assert(fabs(bdiv_r[b](0, j) - check[b](0, j)) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
 }
 
 void test_negative_log_likelihood_derivative()
@@ -102,4 +131,5 @@ void test_negative_log_likelihood_derivative()
     test_negative_log_likelihood_derivative1();
     test_negative_log_likelihood_derivative2();
     test_negative_log_likelihood_derivative3();
+    test_negative_log_likelihood_derivative4();
 }
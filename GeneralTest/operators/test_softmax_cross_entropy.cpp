@@ -0,0 +1,83 @@
+#include "test_softmax_cross_entropy.h"
+#include "../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+void test_softmax_cross_entropy1()
+{
+    cout << "Test softmax cross entropy case 1 ...\t";
+    auto label = GenMatrix<float>(1, 10, 0.1f, 0.01f);
+    auto score = GenMatrix<float>(1, 10, -1.0f, 0.3f);
+    auto res = Evaluate(SoftmaxCrossEntropy(label, score));
+    auto check = Evaluate(NegativeLogLikelihood(label, VecSoftmax(score)));
+    assert(fabs(res.Value() - check.Value()) < 0.0001);
+
+    // one softmax per row, shrunk operands
+    label = GenMatrix<float>(111, 113, 0.1f, 0.0001f);
+    score = GenMatrix<float>(111, 113, -3.0f, 0.001f);
+    label.Shrink(31, 34, 17, 22);
+    score.Shrink(41, 44, 27, 32);
+    res = Evaluate(SoftmaxCrossEntropy(label, score));
+    double expected = 0;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        double sum = 0;
+        for (size_t j = 0; j < 5; ++j)
+        {
+            sum += exp(score(i, j));
+        }
+        for (size_t j = 0; j < 5; ++j)
+        {
+            expected -= label(i, j) * (score(i, j) - log(sum));
+        }
+    }
+    assert(fabs(res.Value() - expected) < 0.0001);
+    cout << "done" << endl;
+}
+
+void test_softmax_cross_entropy2()
+{
+    cout << "Test softmax cross entropy case 2 ...\t";
+    // scores far beyond the range of exp: log-sum-exp keeps the loss finite
+    Matrix<float, DeviceTags::CPU> score(1, 3);
+    score.SetValue(0, 0, 1000);
+    score.SetValue(0, 1, 0);
+    score.SetValue(0, 2, -1000);
+    auto label = OneHotVector<float, DeviceTags::CPU>(3, 1);
+    auto res = Evaluate(SoftmaxCrossEntropy(label, score));
+    assert(fabs(res.Value() - 1000) < 0.001);
+
+    auto label2 = OneHotVector<float, DeviceTags::CPU>(3, 0);
+    res = Evaluate(SoftmaxCrossEntropy(label2, score));
+    assert(fabs(res.Value()) < 0.0001);
+    cout << "done" << endl;
+}
+
+void test_softmax_cross_entropy3()
+{
+    cout << "Test softmax cross entropy case 3 ...\t";
+    auto label = GenBatchMatrix<float>(1, 300, 7, 0.001f, 0.00001f);
+    auto score = GenBatchMatrix<float>(1, 300, 7, -1.0f, 0.01f);
+    auto res = Evaluate(SoftmaxCrossEntropy(label, score));
+    auto check = Evaluate(NegativeLogLikelihood(label, VecSoftmax(score)));
+    assert(res.BatchNum() == 7);
+    for (size_t b = 0; b < 7; ++b)
+    {
+        assert(fabs(res[b] - check[b]) < 0.0001);
+    }
+    cout << "done" << endl;
+}
+}
+
+void test_softmax_cross_entropy()
+{
+    test_softmax_cross_entropy1();
+    test_softmax_cross_entropy2();
+    test_softmax_cross_entropy3();
+}
@@ -0,0 +1,94 @@
+#include "test_softmax_cross_entropy_derivative.h"
+#include "../facilities/data_gen.h"
+#include <MetaNN/meta_nn.h>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+using namespace MetaNN;
+using namespace std;
+
+namespace
+{
+void test_softmax_cross_entropy_derivative1()
+{
+    cout << "Test softmax cross entropy derivative case 1 ...\t";
+    auto label = GenMatrix<float>(1, 10, 0.1f, 0.01f);
+    auto score = GenMatrix<float>(1, 10, -1.0f, 0.3f);
+    auto sm = VecSoftmax(score);
+    auto res = Evaluate(SoftmaxCrossEntropyDerivative(Scalar<float>(0.7f), label, score));
+    auto check = Evaluate(VecSoftmaxDerivative(NegativeLogLikelihoodDerivative(Scalar<float>(0.7f), label, sm), sm));
+    for (size_t j = 0; j < 10; ++j)
+    {
+        assert(fabs(res(0, j) - check(0, j)) < 0.0001);
+    }
+    cout << "done" << endl;
+}
+
+void test_softmax_cross_entropy_derivative2()
+{
+    cout << "Test softmax cross entropy derivative case 2 ...\t";
+    // one-hot labels: softmax - label
+    auto score = GenMatrix<float>(1, 1000, -5.0f, 0.01f);
+    auto label = OneHotVector<float, DeviceTags::CPU>(1000, 345);
+    auto res = Evaluate(SoftmaxCrossEntropyDerivative(Scalar<float>(1), label, score));
+    auto sm = Evaluate(VecSoftmax(score));
+    for (size_t j = 0; j < 1000; ++j)
+    {
+        const float expected = sm(0, j) - ((j == 345) ? 1 : 0);
+        assert(fabs(res(0, j) - expected) < 0.00001);
+    }
+
+    // shrunk operands with several rows
+    auto label2 = GenMatrix<float>(111, 113, 0.1f, 0.0001f);
+    auto score2 = GenMatrix<float>(111, 113, -3.0f, 0.001f);
+    label2.Shrink(31, 34, 17, 22);
+    score2.Shrink(41, 44, 27, 32);
+    auto res2 = Evaluate(SoftmaxCrossEntropyDerivative(Scalar<float>(0.5f), label2, score2));
+    for (size_t i = 0; i < 3; ++i)
+    {
+        double sum = 0, labelSum = 0;
+        for (size_t j = 0; j < 5; ++j)
+        {
+            sum += exp(score2(i, j));
+            labelSum += label2(i, j);
+        }
+        for (size_t j = 0; j < 5; ++j)
+        {
+            const double expected = 0.5 * (exp(score2(i, j)) / sum * labelSum - label2(i, j));
+            assert(fabs(res2(i, j) - expected) < 0.00001);
+        }
+    }
+    cout << "done" << endl;
+}
+
+void test_softmax_cross_entropy_derivative3()
+{
+    cout << "Test softmax cross entropy derivative case 3 ...\t";
+    auto label = GenBatchMatrix<float>(1, 300, 7, 0.001f, 0.00001f);
+    auto score = GenBatchMatrix<float>(1, 300, 7, -1.0f, 0.01f);
+    Batch<float, DeviceTags::CPU, CategoryTags::Scalar> grad(7);
+    for (size_t b = 0; b < 7; ++b)
+    {
+        grad.SetValue(b, 0.3f + 0.1f * b);
+    }
+    auto sm = VecSoftmax(score);
+    auto res = Evaluate(SoftmaxCrossEntropyDerivative(grad, label, score));
+    auto check = Evaluate(VecSoftmaxDerivative(NegativeLogLikelihoodDerivative(grad, label, sm), sm));
+    assert(res.BatchNum() == 7);
+    for (size_t b = 0; b < 7; ++b)
+    {
+        for (size_t j = 0; j < 300; ++j)
+        {
+            assert(fabs(res[b](0, j) - check[b](0, j)) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
+}
+
+void test_softmax_cross_entropy_derivative()
+{
+    test_softmax_cross_entropy_derivative1();
+    test_softmax_cross_entropy_derivative2();
+    test_softmax_cross_entropy_derivative3();
+}
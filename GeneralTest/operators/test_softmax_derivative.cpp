@@ -247,6 +247,33 @@ void test_softmax_derivative5()
     }
     cout << "done" << endl;
 }
+void test_softmax_derivative6()
+{
+    cout << "Test softmax derivative case 6 ...\t";
+    // a large output layer: the Jacobian (50000 x 50000) must not be built
+    const size_t colNum = 50000;
+    auto mSout = GenBatchMatrix<float>(1, colNum, 3, 0.00001f, 0.0000001f);
+    auto mGrad = GenBatchMatrix<float>(1, colNum, 3, -0.5f, 0.00003f);
+
+    const size_t reserved = Allocator<CheckDevice>::Stats().m_reservedBytes;
+    auto t_r = Evaluate(VecSoftmaxDerivative(mGrad, mSout));
+    assert(Allocator<CheckDevice>::Stats().m_reservedBytes - reserved <= 2 * 3 * colNum * sizeof(float));
+
+    for (size_t b = 0; b < 3; ++b)
+    {
+        double inner = 0;
+        for (size_t i = 0; i < colNum; ++i)
+        {
+            inner += (double)mGrad[b](0, i) * mSout[b](0, i);
+        }
+        for (size_t i = 0; i < colNum; i += 7)
+        {
+            const double expected = mSout[b](0, i) * (mGrad[b](0, i) - inner);
+            assert(fabs(t_r[b](0, i) - expected) < 0.0001);
+        }
+    }
+    cout << "done" << endl;
+}
 }
 
 void test_softmax_derivative()
@@ -256,4 +283,5 @@ void test_softmax_derivative()
     test_softmax_derivative3();
     test_softmax_derivative4();
     test_softmax_derivative5();
+    test_softmax_derivative6();
 }
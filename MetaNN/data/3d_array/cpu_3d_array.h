@@ -97,7 +97,6 @@ private:
     size_t m_pageNum;
     size_t m_rowNum;
     size_t m_colNum;
-    size_t m_rowLen;
 };
 
 template<typename TElem>
@@ -109,7 +108,7 @@ struct LowerAccessImpl<ThreeDArray<TElem, DeviceTags::CPU>>
 
     auto MutableRawMemory()
     {
-        return m_matrix.m_mem.RawMemory();
+        return m_matrix.m_mem.MutableRawMemory();
     }
 
     const auto RawMemory() const
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <MetaNN/data/batch.h>
+#include <MetaNN/data/matrices/one_hot_vector.h>
+#include <MetaNN/evaluate/facilities/eval_buffer.h>
+#include <MetaNN/evaluate/facilities/eval_group.h>
+#include <MetaNN/evaluate/facilities/eval_handle.h>
+#include <MetaNN/evaluate/facilities/eval_plan.h>
+#include <MetaNN/evaluate/facilities/eval_unit.h>
+
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace MetaNN
+{
+namespace NSBatchOneHotVector
+{
+template <typename TElem, typename TDevice>
+class EvalUnit;
+
+template <typename TElement>
+class EvalUnit<TElement, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    EvalUnit(EvalHandle<Batch<TElement, DeviceTags::CPU, CategoryTags::Matrix>> resBuf,
+             size_t colNum, std::vector<size_t> hotPos)
+        : m_resHandle(std::move(resBuf))
+        , m_colNum(colNum)
+        , m_hotPos(std::move(hotPos)) { }
+
+    void Eval() override
+    {
+        const size_t batchNum = m_hotPos.size();
+        m_resHandle.Allocate(batchNum, 1, m_colNum);
+        auto& mutableData = m_resHandle.MutableData();
+        auto lowLayer = LowerAccess(mutableData);
+        auto mem = lowLayer.MutableRawMemory();
+        const size_t matrixSize = lowLayer.RawMatrixSize();
+        for (size_t i = 0; i < batchNum; ++i)
+        {
+            memset(mem, 0, sizeof(TElement) * m_colNum);
+            mem[m_hotPos[i]] = 1;
+            mem += matrixSize;
+        }
+        m_resHandle.SetEval();
+    }
+
+private:
+    EvalHandle<Batch<TElement, DeviceTags::CPU, CategoryTags::Matrix>> m_resHandle;
+    size_t m_colNum;
+    std::vector<size_t> m_hotPos;
+};
+}
+
+// A batch of one-hot row vectors: sample i has a single 1 at column HotPos(i).
+// Operators that know about it (e.g. NegativeLogLikelihood) use the positions directly,
+// the others see the dense batch produced by EvalRegister.
+template <typename TElem, typename TDevice>
+class BatchOneHotVector
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = TDevice;
+
+public:
+    BatchOneHotVector(size_t p_colNum, std::vector<size_t> p_hotPos)
+        : m_colNum(p_colNum)
+        , m_hotPos(std::move(p_hotPos))
+    {
+        assert(!m_hotPos.empty());
+        for (auto pos : m_hotPos)
+        {
+            assert(pos < m_colNum);
+        }
+    }
+
+    bool operator== (const BatchOneHotVector& val) const
+    {
+        return (m_colNum == val.m_colNum) &&
+               (m_hotPos == val.m_hotPos);
+    }
+
+    template <typename TOtherType>
+    bool operator== (const TOtherType&) const
+    {
+        return false;
+    }
+
+    template <typename TData>
+    bool operator!= (const TData& val) const
+    {
+        return !(operator==(val));
+    }
+
+    size_t RowNum() const { return 1; }
+    size_t ColNum() const { return m_colNum; }
+    size_t BatchNum() const { return m_hotPos.size(); }
+
+    auto EvalRegister() const
+    {
+        using TEvalUnit = NSBatchOneHotVector::EvalUnit<ElementType, DeviceType>;
+        using TEvalGroup = TrivalEvalGroup<TEvalUnit>;
+        if (!m_evalBuf.IsEvaluated())
+        {
+            auto evalHandle = m_evalBuf.Handle();
+            decltype(auto) outputPtr = evalHandle.DataPtr();
+            TEvalUnit unit(std::move(evalHandle), m_colNum, m_hotPos);
+            EvalPlan<DeviceType>::template Register<TEvalGroup>(std::move(unit), outputPtr, {});
+        }
+        return m_evalBuf.ConstHandle();
+    }
+
+    size_t HotPos(size_t p_batchId) const
+    {
+        assert(p_batchId < m_hotPos.size());
+        return m_hotPos[p_batchId];
+    }
+
+    const std::vector<size_t>& HotPos() const
+    {
+        return m_hotPos;
+    }
+
+private:
+    size_t m_colNum;
+    std::vector<size_t> m_hotPos;
+    EvalBuffer<Batch<ElementType, DeviceType, CategoryTags::Matrix>> m_evalBuf;
+};
+
+template <typename TElem, typename TDevice>
+struct DataCategory_<BatchOneHotVector<TElem, TDevice>>
+{
+    using type = CategoryTags::BatchMatrix;
+};
+
+// OneHotVector for a matrix category, BatchOneHotVector for a batch one
+template <typename TElem, typename TDevice, typename TCate>
+using OneHotType = std::conditional_t<std::is_same<TCate, CategoryTags::Matrix>::value,
+                                      OneHotVector<TElem, TDevice>,
+                                      BatchOneHotVector<TElem, TDevice>>;
+}
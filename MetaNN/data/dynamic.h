@@ -4,6 +4,7 @@
 #include <MetaNN/data/facilities/tags.h>
 #include <MetaNN/evaluate/facilities/eval_buffer.h>
 #include <memory>
+#include <type_traits>
 
 namespace MetaNN
 {
@@ -138,6 +139,38 @@ private:
     const size_t m_batchNum;
 };
 
+template <typename TElem, typename TDevice>
+class DynamicCategory<TElem, TDevice, CategoryTags::MatrixSequence>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = TDevice;
+    using EvalType = PrincipalDataType<CategoryTags::MatrixSequence, ElementType, DeviceType>;
+
+public:
+    template <typename TBase>
+    DynamicCategory(const TBase& base)
+        : m_length(base.Length())
+        , m_rowNum(base.RowNum())
+        , m_colNum(base.ColNum()) {}
+
+    virtual ~DynamicCategory() = default;
+
+    virtual bool operator== (const DynamicCategory& val) const = 0;
+    virtual bool operator!= (const DynamicCategory& val) const = 0;
+
+    size_t Length() const { return m_length; }
+    size_t RowNum() const { return m_rowNum; }
+    size_t ColNum() const { return m_colNum; }
+
+    virtual DynamicConstEvalHandle<EvalType> EvalRegister() const = 0;
+
+private:
+    const size_t m_length;
+    const size_t m_rowNum;
+    const size_t m_colNum;
+};
+
 template <typename TBaseData>
 class DynamicWrapper : public DynamicCategory<typename TBaseData::ElementType,
                                               typename TBaseData::DeviceType,
@@ -469,6 +502,77 @@ private:
     std::shared_ptr<BaseData> m_baseData;
 };
 
+template <typename TElem, typename TDevice>
+class DynamicData<TElem, TDevice, CategoryTags::MatrixSequence>
+{
+    using BaseData = DynamicCategory<TElem, TDevice, CategoryTags::MatrixSequence>;
+    
+public:
+    using ElementType = TElem;
+    using DeviceType = TDevice;
+    using ResHandleType = decltype(std::declval<BaseData>().EvalRegister());
+
+    DynamicData() = default;
+    
+    template <typename TOriData>
+    DynamicData(std::shared_ptr<DynamicWrapper<TOriData>> data)
+    {
+        m_baseData = std::move(data);
+    }
+
+    size_t Length() const { return m_baseData->Length(); }
+    size_t RowNum() const { return m_baseData->RowNum(); }
+    size_t ColNum() const { return m_baseData->ColNum(); }
+
+    auto EvalRegister() const
+    {
+        return m_baseData->EvalRegister();
+    }
+
+    bool operator== (const DynamicData& val) const
+    {
+        if ((!m_baseData) && (!val.m_baseData))
+        {
+            return true;
+        }
+        if ((!m_baseData) || (!val.m_baseData))
+        {
+            return false;
+        }
+        BaseData& val1 = *m_baseData;
+        BaseData& val2 = *(val.m_baseData);
+        return val1 == val2;
+    }
+
+    template <typename TOtherType>
+    bool operator== (const TOtherType& val) const
+    {
+        return false;
+    }
+
+    template <typename TOtherType>
+    bool operator!= (const TOtherType& val) const
+    {
+        return !(operator==(val));
+    }
+
+    template <typename T>
+    const T* TypeCast() const
+    {
+        const BaseData* ptr = m_baseData.get();
+        auto ptrCast = dynamic_cast<const DynamicWrapper<T>*>(ptr);
+
+        return (ptrCast ? &(ptrCast->BaseData()) : nullptr);
+    }
+    
+    bool IsEmpty() const
+    {
+        return m_baseData == nullptr;
+    }
+private:
+    std::shared_ptr<BaseData> m_baseData;
+};
+
 template <typename TData>
 constexpr bool IsDynamic = false;
 
@@ -505,6 +609,24 @@ auto MakeDynamic(TData&& data)
     }
 }
 
+// The data seen as T, either directly or behind a DynamicData; nullptr if it is something else
+template <typename T, typename TData>
+const T* DataCast(const TData& data)
+{
+    if constexpr (std::is_same<TData, T>::value)
+    {
+        return &data;
+    }
+    else if constexpr (IsDynamic<TData>)
+    {
+        return data.template TypeCast<T>();
+    }
+    else
+    {
+        return nullptr;
+    }
+}
+
 template <typename TElem, typename TDevice, typename TCate>
 struct DataCategory_<DynamicData<TElem, TDevice, TCate>>
 {
@@ -1,50 +1,501 @@
 #pragma once
 
 #include <MetaNN/data/facilities/tags.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <mutex>
-#include <unordered_map>
-#include <deque>
+#include <new>
+#include <thread>
+#include <vector>
 
 namespace MetaNN
 {
 template <typename TDevice>
 struct Allocator;
 
-template <>
-struct Allocator<DeviceTags::CPU>
+namespace NSAllocator
 {
-private:
-    struct AllocHelper
+// Blocks are 64-byte aligned so that SIMD kernels can use aligned loads on whole buffers
+constexpr size_t Alignment = 64;
+
+// Geometric size classes with 4 classes per power of two (at most 25% internal waste):
+// 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, ...
+constexpr size_t MinClassSize = 64;
+constexpr size_t ClassNum = 1 + 4 * 26;
+
+inline size_t SizeClass(size_t bytes)
+{
+    if (bytes <= MinClassSize) return 0;
+    const size_t p = 63 - (size_t)__builtin_clzll((unsigned long long)(bytes - 1));
+    const size_t step = (size_t)1 << (p - 2);
+    const size_t k = (bytes - 1 - ((size_t)1 << p)) / step;
+    return std::min((p - 6) * 4 + k + 1, ClassNum);
+}
+
+inline size_t ClassSize(size_t cls)
+{
+    if (cls == 0) return MinClassSize;
+    const size_t p = (cls - 1) / 4 + 6;
+    const size_t k = (cls - 1) % 4;
+    return ((size_t)1 << p) + (k + 1) * ((size_t)1 << (p - 2));
+}
+
+// A snapshot of the allocator state. Index ClassNum of m_classes holds the requests that are
+// too large for a size class; they are never cached.
+struct Statistics
+{
+    struct Class
     {
-        std::unordered_map<size_t, std::deque<void*> > memBuffer;
-        ~AllocHelper()
+        size_t m_liveNum = 0;
+        size_t m_cachedNum = 0;
+        size_t m_allocations = 0;
+        size_t m_hits = 0;
+    };
+
+    std::array<Class, ClassNum + 1> m_classes;
+
+    size_t m_liveBytes = 0;
+    size_t m_cachedBytes = 0;
+    size_t m_reservedBytes = 0;        // obtained from the OS: live + cached
+    size_t m_peakReservedBytes = 0;
+
+    size_t m_allocations = 0;
+    size_t m_hits = 0;                 // served from a free list
+    size_t m_misses = 0;               // served by the OS
+    double m_seconds = 0;              // since the first allocation
+
+    double HitRatio() const
+    {
+        return m_allocations ? (double)m_hits / m_allocations : 0;
+    }
+
+    // Allocations per second since the first allocation. The rate over an interval is the
+    // difference of two snapshots.
+    double AllocationRate() const
+    {
+        return (m_seconds > 0) ? m_allocations / m_seconds : 0;
+    }
+};
+
+// Counters of one thread. Only the owning thread writes them, so plain load/store pairs
+// suffice; other threads only read them when a snapshot is taken.
+struct Counters
+{
+    static void Add(std::atomic<size_t>& counter, size_t val)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+    }
+
+    static void Sub(std::atomic<size_t>& counter, size_t val)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) - val, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<size_t>, ClassNum + 1> m_allocations{};
+    std::array<std::atomic<size_t>, ClassNum + 1> m_releases{};
+    std::array<std::atomic<size_t>, ClassNum + 1> m_hits{};
+    std::array<std::atomic<size_t>, ClassNum + 1> m_cached{};
+};
+
+// Keeps track of the counters of all threads and of the memory obtained from the OS
+class StatsRegistry
+{
+public:
+    static StatsRegistry& Instance()
+    {
+        // Never destroyed, for the same reason as CentralCache
+        static StatsRegistry* inst = new StatsRegistry();
+        return *inst;
+    }
+
+    void Add(Counters* counters)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_threads.push_back(counters);
+    }
+
+    // Folds the counters of an exiting thread into m_retired
+    void Remove(Counters* counters)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_threads.erase(std::find(m_threads.begin(), m_threads.end(), counters));
+        for (size_t cls = 0; cls <= ClassNum; ++cls)
+        {
+            m_retired.m_allocations[cls].fetch_add(counters->m_allocations[cls].load(std::memory_order_relaxed),
+                                                   std::memory_order_relaxed);
+            m_retired.m_releases[cls].fetch_add(counters->m_releases[cls].load(std::memory_order_relaxed),
+                                                std::memory_order_relaxed);
+            m_retired.m_hits[cls].fetch_add(counters->m_hits[cls].load(std::memory_order_relaxed),
+                                            std::memory_order_relaxed);
+        }
+    }
+
+    // Used by threads whose own counters are already gone
+    Counters& Retired()
+    {
+        return m_retired;
+    }
+
+    void Reserve(size_t bytes)
+    {
+        const size_t cur = m_reservedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        size_t peak = m_peakReservedBytes.load(std::memory_order_relaxed);
+        while ((peak < cur) &&
+               !m_peakReservedBytes.compare_exchange_weak(peak, cur, std::memory_order_relaxed));
+    }
+
+    void Unreserve(size_t bytes)
+    {
+        m_reservedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    void ResetPeak()
+    {
+        m_peakReservedBytes.store(m_reservedBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    // Fills everything but the cached blocks of the central cache
+    void Collect(Statistics& res)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto collect = [&res](const Counters& counters)
         {
-            for (auto& p : memBuffer)
+            for (size_t cls = 0; cls <= ClassNum; ++cls)
             {
-                auto& refVec = p.second;
-                for (auto& p1 : refVec)
-                {
-                    char* buf = (char*)(p1);
-                    delete []buf;
-                }
-                refVec.clear();
+                auto& dest = res.m_classes[cls];
+                dest.m_allocations += counters.m_allocations[cls].load(std::memory_order_relaxed);
+                dest.m_liveNum += counters.m_allocations[cls].load(std::memory_order_relaxed) -
+                                  counters.m_releases[cls].load(std::memory_order_relaxed);
+                dest.m_hits += counters.m_hits[cls].load(std::memory_order_relaxed);
+                dest.m_cachedNum += counters.m_cached[cls].load(std::memory_order_relaxed);
             }
+        };
+        collect(m_retired);
+        for (auto* p : m_threads)
+        {
+            collect(*p);
         }
+        res.m_reservedBytes = m_reservedBytes.load(std::memory_order_relaxed);
+        res.m_peakReservedBytes = m_peakReservedBytes.load(std::memory_order_relaxed);
+        res.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    StatsRegistry()
+        : m_start(std::chrono::steady_clock::now()) {}
+
+    std::mutex m_mutex;
+    std::vector<Counters*> m_threads;
+    Counters m_retired;
+
+    std::atomic<size_t> m_reservedBytes{0};
+    std::atomic<size_t> m_peakReservedBytes{0};
+    std::chrono::steady_clock::time_point m_start;
+};
+
+inline void* AllocateBlock(size_t bytes)
+{
+    void* res = ::operator new(bytes, std::align_val_t(Alignment));
+    StatsRegistry::Instance().Reserve(bytes);
+    return res;
+}
+
+inline void ReleaseBlock(void* p, size_t bytes)
+{
+    ::operator delete(p, std::align_val_t(Alignment));
+    StatsRegistry::Instance().Unreserve(bytes);
+}
+
+// Lock-free stack of free blocks (Treiber stack). The link is stored in the free block itself,
+// the head carries a tag in its upper bits against ABA. Blocks taken by TakeAll may be handed
+// back to the OS, so it waits until no Pop can still be reading a link of the old list.
+class CentralList
+{
+    struct Node
+    {
+        Node* m_next;
     };
 
+    static constexpr unsigned PtrBits = (sizeof(void*) == 8) ? 48 : 32;
+    static constexpr uint64_t PtrMask = (((uint64_t)1) << PtrBits) - 1;
+
+    static Node* Ptr(uint64_t v) { return reinterpret_cast<Node*>((uintptr_t)(v & PtrMask)); }
+    static uint64_t Pack(Node* p, uint64_t prev)
+    {
+        return (uint64_t)(uintptr_t)p | (((prev >> PtrBits) + 1) << PtrBits);
+    }
+
+public:
+    void Push(void* p)
+    {
+        Node* node = static_cast<Node*>(p);
+        uint64_t old = m_head.load(std::memory_order_relaxed);
+        do
+        {
+            node->m_next = Ptr(old);
+        } while (!m_head.compare_exchange_weak(old, Pack(node, old),
+                                               std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void* Pop()
+    {
+        m_readers.fetch_add(1, std::memory_order_seq_cst);
+        uint64_t old = m_head.load(std::memory_order_acquire);
+        while (Ptr(old))
+        {
+            Node* next = Ptr(old)->m_next;
+            if (m_head.compare_exchange_weak(old, Pack(next, old),
+                                             std::memory_order_acquire, std::memory_order_acquire))
+            {
+                break;
+            }
+        }
+        m_readers.fetch_sub(1, std::memory_order_release);
+        return Ptr(old);
+    }
+
+    // Detaches the whole list; calls fun(block) for each of its blocks
+    template <typename TFun>
+    void TakeAll(TFun&& fun)
+    {
+        uint64_t old = m_head.load(std::memory_order_relaxed);
+        while (!m_head.compare_exchange_weak(old, Pack(nullptr, old),
+                                             std::memory_order_acquire, std::memory_order_relaxed));
+        while (m_readers.load(std::memory_order_seq_cst) != 0)
+        {
+            std::this_thread::yield();
+        }
+        Node* cur = Ptr(old);
+        while (cur)
+        {
+            Node* next = cur->m_next;
+            fun(static_cast<void*>(cur));
+            cur = next;
+        }
+    }
+
+private:
+    std::atomic<uint64_t> m_head{0};
+    std::atomic<size_t> m_readers{0};
+};
+
+class CentralCache
+{
+public:
+    static CentralCache& Instance()
+    {
+        // Never destroyed: blocks may be released by static destructors and exiting threads.
+        // What is cached when static objects are destroyed is returned to the OS.
+        static CentralCache* inst = new CentralCache();
+        static struct Releaser
+        {
+            ~Releaser() { inst->Trim(0); }
+        } releaser;
+        return *inst;
+    }
+
+    void* Pop(size_t cls)
+    {
+        void* res = m_lists[cls].Pop();
+        if (res)
+        {
+            m_cachedBytes.fetch_sub(ClassSize(cls), std::memory_order_relaxed);
+            m_cachedNum[cls].fetch_sub(1, std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    void Push(size_t cls, void* p)
+    {
+        m_lists[cls].Push(p);
+        m_cachedNum[cls].fetch_add(1, std::memory_order_relaxed);
+        const size_t cached = m_cachedBytes.fetch_add(ClassSize(cls), std::memory_order_relaxed) +
+                              ClassSize(cls);
+        if (cached > m_cacheLimit.load(std::memory_order_relaxed))
+        {
+            Trim(m_cacheLimit.load(std::memory_order_relaxed) / 2);
+        }
+    }
+
+    // Returns cached blocks to the OS, largest classes first, until at most `target` bytes remain
+    void Trim(size_t target)
+    {
+        for (size_t cls = ClassNum; cls-- > 0;)
+        {
+            if (m_cachedBytes.load(std::memory_order_relaxed) <= target) break;
+            const size_t classSize = ClassSize(cls);
+            m_lists[cls].TakeAll([this, cls, classSize](void* p)
+                                 {
+                                     m_cachedBytes.fetch_sub(classSize, std::memory_order_relaxed);
+                                     m_cachedNum[cls].fetch_sub(1, std::memory_order_relaxed);
+                                     ReleaseBlock(p, classSize);
+                                 });
+        }
+    }
+
+    void SetCacheLimit(size_t bytes)
+    {
+        m_cacheLimit.store(bytes, std::memory_order_relaxed);
+        if (m_cachedBytes.load(std::memory_order_relaxed) > bytes)
+        {
+            Trim(bytes);
+        }
+    }
+
+    size_t CacheLimit() const
+    {
+        return m_cacheLimit.load(std::memory_order_relaxed);
+    }
+
+    size_t CachedBytes() const
+    {
+        return m_cachedBytes.load(std::memory_order_relaxed);
+    }
+
+    size_t CachedNum(size_t cls) const
+    {
+        return m_cachedNum[cls].load(std::memory_order_relaxed);
+    }
+
+private:
+    CentralCache() = default;
+
+    std::array<CentralList, ClassNum> m_lists;
+    std::array<std::atomic<size_t>, ClassNum> m_cachedNum{};
+    std::atomic<size_t> m_cachedBytes{0};
+    std::atomic<size_t> m_cacheLimit{(size_t)1 << 30};
+};
+
+// Per-thread free lists, served without any synchronization. A class keeps at most
+// ThreadCacheBytes (and between 2 and 256 blocks); half of the blocks move to the central
+// cache when it overflows, and all of them when the thread exits. Classes larger than
+// ThreadCacheBytes are not cached per thread, so SetCacheLimit / Trim can always reach them.
+class ThreadCache
+{
+    static constexpr size_t ThreadCacheBytes = (size_t)4 << 20;
+
+    static size_t Capacity(size_t cls)
+    {
+        if (ClassSize(cls) > ThreadCacheBytes) return 0;
+        return std::min<size_t>(std::max<size_t>(ThreadCacheBytes / ClassSize(cls), 2), 256);
+    }
+
+    enum class State : unsigned char { Uninit, Alive, Dead };
+
+    static State& LocalState()
+    {
+        static thread_local State inst = State::Uninit;
+        return inst;
+    }
+
+public:
+    // nullptr once the thread cache of the calling thread has been destroyed
+    static ThreadCache* Local()
+    {
+        if (LocalState() == State::Dead) return nullptr;
+        static thread_local ThreadCache inst;
+        return &inst;
+    }
+
+    ThreadCache()
+    {
+        LocalState() = State::Alive;
+        StatsRegistry::Instance().Add(&m_counters);
+    }
+
+    ~ThreadCache()
+    {
+        Flush();
+        StatsRegistry::Instance().Remove(&m_counters);
+        LocalState() = State::Dead;
+    }
+
+    void* Pop(size_t cls)
+    {
+        auto& bin = m_bins[cls];
+        if (bin.empty()) return nullptr;
+        void* res = bin.back();
+        bin.pop_back();
+        Counters::Sub(m_counters.m_cached[cls], 1);
+        return res;
+    }
+
+    void Push(size_t cls, void* p)
+    {
+        if (Capacity(cls) == 0)
+        {
+            CentralCache::Instance().Push(cls, p);
+            return;
+        }
+        auto& bin = m_bins[cls];
+        bin.push_back(p);
+        Counters::Add(m_counters.m_cached[cls], 1);
+        if (bin.size() > Capacity(cls))
+        {
+            auto& central = CentralCache::Instance();
+            const size_t keep = bin.size() / 2;
+            for (size_t i = keep; i < bin.size(); ++i)
+            {
+                central.Push(cls, bin[i]);
+            }
+            Counters::Sub(m_counters.m_cached[cls], bin.size() - keep);
+            bin.resize(keep);
+        }
+    }
+
+    void Flush()
+    {
+        auto& central = CentralCache::Instance();
+        for (size_t cls = 0; cls < ClassNum; ++cls)
+        {
+            for (void* p : m_bins[cls])
+            {
+                central.Push(cls, p);
+            }
+            Counters::Sub(m_counters.m_cached[cls], m_bins[cls].size());
+            m_bins[cls].clear();
+        }
+    }
+
+    Counters& GetCounters()
+    {
+        return m_counters;
+    }
+
+private:
+    std::array<std::vector<void*>, ClassNum> m_bins;
+    Counters m_counters;
+};
+}
+
+template <>
+struct Allocator<DeviceTags::CPU>
+{
+private:
+    // Stored in the control block of each allocation, shared by all views of the memory
     struct DesImpl
     {
-        DesImpl(std::deque<void*>& p_refPool)
-            : m_refPool(p_refPool) {}
+        DesImpl(size_t p_class, size_t p_bytes)
+            : m_class(p_class)
+            , m_bytes(p_bytes) {}
+
+        DesImpl(const DesImpl& val)
+            : m_class(val.m_class)
+            , m_bytes(val.m_bytes) {}
 
         void operator () (void* p_val) const
         {
-            std::lock_guard<std::mutex> guard(GetMutex());
-            m_refPool.push_back(p_val);
+            Deallocate(p_val, m_class, m_bytes);
         }
+
+        std::atomic<size_t> m_writeVersion{0};
     private:
-        std::deque<void*>& m_refPool;
+        size_t m_class;
+        size_t m_bytes;
     };
 
 public:
@@ -55,35 +506,135 @@ public:
         {
             return nullptr;
         }
-        p_elemSize *= sizeof(T);
-        
-        if (p_elemSize & 0x3ff)
+        const size_t bytes = p_elemSize * sizeof(T);
+        const size_t cls = NSAllocator::SizeClass(bytes);
+        auto* cache = NSAllocator::ThreadCache::Local();
+        auto& counters = cache ? cache->GetCounters() : NSAllocator::StatsRegistry::Instance().Retired();
+        Count(counters.m_allocations[cls], cache);
+
+        if (cls == NSAllocator::ClassNum)
         {
-            p_elemSize = ((p_elemSize >> 10) + 1) << 10;
+            return std::shared_ptr<T>((T*)NSAllocator::AllocateBlock(bytes), DesImpl(cls, bytes));
         }
 
-        std::lock_guard<std::mutex> guard(GetMutex());
-
-        static AllocHelper allocateHelper;
-        auto& slot = allocateHelper.memBuffer[p_elemSize];
-        if (slot.empty())
+        void* mem = cache ? cache->Pop(cls) : nullptr;
+        if (!mem)
+        {
+            mem = NSAllocator::CentralCache::Instance().Pop(cls);
+        }
+        if (mem)
         {
-            auto raw_buf = (T*)new char[p_elemSize];
-            return std::shared_ptr<T>(raw_buf, DesImpl(slot));
+            Count(counters.m_hits[cls], cache);
         }
         else
         {
-            void* mem = slot.back();
-            slot.pop_back();
-            return std::shared_ptr<T>((T*)mem, DesImpl(slot));
+            mem = NSAllocator::AllocateBlock(NSAllocator::ClassSize(cls));
         }
+        return std::shared_ptr<T>((T*)mem, DesImpl(cls, bytes));
     }
-    
+
+    // Each allocation counts the mutable accesses to its memory, so that values derived from
+    // the memory (e.g. packed GEMM panels) can be checked for staleness
+    template <typename T>
+    static void MarkWritten(const std::shared_ptr<T>& p)
+    {
+        if (auto* des = std::get_deleter<DesImpl>(p))
+        {
+            des->m_writeVersion.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename T>
+    static size_t WriteVersion(const std::shared_ptr<T>& p)
+    {
+        const auto* des = std::get_deleter<DesImpl>(p);
+        return des ? des->m_writeVersion.load(std::memory_order_relaxed) : 0;
+    }
+
+    // Cached memory beyond this limit is returned to the OS
+    static void SetCacheLimit(size_t bytes)
+    {
+        NSAllocator::CentralCache::Instance().SetCacheLimit(bytes);
+    }
+
+    // Moves the blocks cached by the calling thread to the central cache, then returns cached
+    // blocks to the OS until at most keepBytes remain there. Blocks cached by other threads are
+    // only released when they spill over or exit.
+    static void Trim(size_t keepBytes)
+    {
+        if (auto* cache = NSAllocator::ThreadCache::Local())
+        {
+            cache->Flush();
+        }
+        NSAllocator::CentralCache::Instance().Trim(keepBytes);
+    }
+
+    static void ReleaseCached()
+    {
+        Trim(0);
+    }
+
+    static NSAllocator::Statistics Stats()
+    {
+        NSAllocator::Statistics res;
+        NSAllocator::StatsRegistry::Instance().Collect(res);
+
+        auto& central = NSAllocator::CentralCache::Instance();
+        for (size_t cls = 0; cls < NSAllocator::ClassNum; ++cls)
+        {
+            auto& info = res.m_classes[cls];
+            info.m_cachedNum += central.CachedNum(cls);
+            res.m_cachedBytes += info.m_cachedNum * NSAllocator::ClassSize(cls);
+        }
+        for (const auto& info : res.m_classes)
+        {
+            res.m_allocations += info.m_allocations;
+            res.m_hits += info.m_hits;
+        }
+        res.m_misses = res.m_allocations - res.m_hits;
+        // Counters are read one by one while other threads keep allocating
+        res.m_liveBytes = (res.m_reservedBytes > res.m_cachedBytes) ? (res.m_reservedBytes - res.m_cachedBytes) : 0;
+        return res;
+    }
+
+    // Restarts the peak tracking from the current reserved size
+    static void ResetPeak()
+    {
+        NSAllocator::StatsRegistry::Instance().ResetPeak();
+    }
+
 private:
-    static std::mutex& GetMutex()
+    // The counters of a live thread cache are only written by their thread
+    static void Count(std::atomic<size_t>& counter, bool owned)
     {
-        static std::mutex inst;
-        return inst;
+        if (owned)
+        {
+            NSAllocator::Counters::Add(counter, 1);
+        }
+        else
+        {
+            counter.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void Deallocate(void* p, size_t cls, size_t bytes)
+    {
+        auto* cache = NSAllocator::ThreadCache::Local();
+        Count(cache ? cache->GetCounters().m_releases[cls] : NSAllocator::StatsRegistry::Instance().Retired().m_releases[cls],
+              cache);
+
+        if (cls == NSAllocator::ClassNum)
+        {
+            NSAllocator::ReleaseBlock(p, bytes);
+        }
+        else if (cache)
+        {
+            cache->Push(cls, p);
+        }
+        else
+        {
+            NSAllocator::CentralCache::Instance().Push(cls, p);
+        }
     }
 };
 }
@@ -27,6 +27,14 @@ public:
 
     auto RawMemory() const { return m_memStart; }
 
+    // The memory is about to be written, for every view of the same allocation. Called once per
+    // write loop: element writes (SetValue) read the pointer through RawMemory and are not counted.
+    auto MutableRawMemory()
+    {
+        Allocator<TDevice>::MarkWritten(m_mem);
+        return m_memStart;
+    }
+
     const std::shared_ptr<ElementType> SharedPtr() const
     {
         return m_mem;
@@ -10,6 +10,7 @@ template <typename TElem, typename TDevice> class Scalar;
 template <typename TElem, typename TDevice> class ThreeDArray;
 
 template<typename TElement, typename TDevice, typename TCategory> class Batch;
+template<typename TElement, typename TDevice, typename TCategory> class Sequence;
 
 template <typename TCategory, typename TElem, typename TDevice>
 struct PrincipalDataType_;
@@ -50,6 +51,12 @@ struct PrincipalDataType_<CategoryTags::BatchThreeDArray, TElem, TDevice>
     using type = Batch<TElem, TDevice, CategoryTags::ThreeDArray>;
 };
 
+template <typename TElem, typename TDevice>
+struct PrincipalDataType_<CategoryTags::MatrixSequence, TElem, TDevice>
+{
+    using type = Sequence<TElem, TDevice, CategoryTags::Matrix>;
+};
+
 template <typename TCategory, typename TElem, typename TDevice>
 using PrincipalDataType = typename PrincipalDataType_<TCategory, TElem, TDevice>::type;
 
@@ -95,7 +95,7 @@ struct LowerAccessImpl<LinearTable<TElem, TDevice, CategoryTags::ThreeDArray>>
 
     auto MutableRawMemory()
     {
-        return m_rawData.m_mem.RawMemory();
+        return m_rawData.m_mem.MutableRawMemory();
     }
 
     const auto RawMemory() const
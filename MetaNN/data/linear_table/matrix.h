@@ -70,6 +70,13 @@ public:
         m_rowNum = p_rowE - p_rowB;
         m_colNum = p_colE - p_colB;
     }
+
+    // Keeps the first p_batchNum matrices, a copy of a table so shrunk views part of its memory
+    void ShrinkBatch(size_t p_batchNum)
+    {
+        assert(p_batchNum <= m_batchNum);
+        m_batchNum = p_batchNum;
+    }
     
 protected:
     size_t Count() const { return m_batchNum; }
@@ -92,7 +99,7 @@ struct LowerAccessImpl<LinearTable<TElem, TDevice, CategoryTags::Matrix>>
 
     auto MutableRawMemory()
     {
-        return m_rawData.m_mem.RawMemory();
+        return m_rawData.m_mem.MutableRawMemory();
     }
 
     const auto RawMemory() const
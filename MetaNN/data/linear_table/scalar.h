@@ -71,7 +71,7 @@ struct LowerAccessImpl<LinearTable<TElem, DeviceTags::CPU, CategoryTags::Scalar>
 
     auto MutableRawMemory()
     {
-        return m_data.m_mem.RawMemory();
+        return m_data.m_mem.MutableRawMemory();
     }
 
     const auto RawMemory() const
@@ -111,7 +111,7 @@ struct LowerAccessImpl<Matrix<TElem, DeviceTags::CPU>>
 
     auto MutableRawMemory()
     {
-        return m_matrix.m_mem.RawMemory();
+        return m_matrix.m_mem.MutableRawMemory();
     }
 
     const auto RawMemory() const
@@ -124,6 +124,11 @@ struct LowerAccessImpl<Matrix<TElem, DeviceTags::CPU>>
         return m_matrix.m_rowLen;
     }
 
+    auto SharedMemory() const
+    {
+        return m_matrix.m_mem.SharedPtr();
+    }
+
 private:
     Matrix<TElem, DeviceTags::CPU> m_matrix;
 };
@@ -0,0 +1,432 @@
+#pragma once
+
+#include <MetaNN/data/facilities/tags.h>
+#include <MetaNN/evaluate/facilities/eval_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace MetaNN
+{
+template <>
+class ParallelEvalPool<DeviceTags::CPU> : public BaseEvalPool<DeviceTags::CPU>
+{
+    using UnitPtr = std::shared_ptr<BaseEvalUnit<DeviceTags::CPU>>;
+
+    // Units submitted by one thread between two barriers
+    struct TaskGroup
+    {
+        std::atomic<size_t> m_pending{0};
+        std::mutex m_errorMutex;
+        std::exception_ptr m_error;
+    };
+
+    struct Task
+    {
+        UnitPtr m_unit;
+        TaskGroup* m_group;
+        void* m_context;
+    };
+
+    struct Worker
+    {
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+        std::thread m_thread;
+    };
+
+public:
+    static ParallelEvalPool& Instance()
+    {
+        static ParallelEvalPool inst;
+        return inst;
+    }
+
+    // Must be called while the pool is idle. 0 selects the hardware concurrency.
+    static void SetWorkerNum(size_t workerNum)
+    {
+        if (workerNum == 0)
+        {
+            workerNum = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        ConfiguredWorkerNum() = workerNum;
+
+        ParallelEvalPool& inst = Instance();
+        if (inst.m_workers.size() != workerNum)
+        {
+            inst.Stop();
+            inst.Start(workerNum);
+        }
+    }
+
+    size_t WorkerNum() const
+    {
+        return m_workers.size();
+    }
+
+    // True on a thread owned by this pool
+    static bool InWorker()
+    {
+        return WorkerId() != NoWorker;
+    }
+
+    // The pool once it has been created by SetWorkerNum() or by an EvalPlan using it, or nullptr
+    static ParallelEvalPool* Active()
+    {
+        return ActiveInst().load(std::memory_order_acquire);
+    }
+
+    // Runs fun(i) for i in [0, taskNum) on the workers and the calling thread, and returns once
+    // all of them have finished. The tasks run in their own group, so this can be called from
+    // inside a unit without waiting for the other units submitted by the same thread.
+    template <typename TFun>
+    void Run(size_t taskNum, const TFun& fun)
+    {
+        if (taskNum == 0) return;
+
+        TaskGroup group;
+        for (size_t i = 1; i < taskNum; ++i)
+        {
+            Submit(std::make_shared<FunUnit<TFun>>(fun, i), group);
+        }
+        try
+        {
+            fun(0);
+        }
+        catch (...)
+        {
+            Wait(group, true);
+            throw;
+        }
+        Wait(group, true);
+    }
+
+private:
+    template <typename TFun>
+    class FunUnit : public BaseEvalUnit<DeviceTags::CPU>
+    {
+    public:
+        FunUnit(const TFun& fun, size_t id)
+            : m_fun(fun)
+            , m_id(id) {}
+
+        void Eval() override
+        {
+            m_fun(m_id);
+        }
+
+    private:
+        const TFun& m_fun;
+        size_t m_id;
+    };
+
+    class RangeUnit : public BaseEvalUnit<DeviceTags::CPU>
+    {
+    public:
+        RangeUnit(BaseEvalGroup<DeviceTags::CPU>& group, size_t unitB, size_t unitE)
+            : m_group(group)
+            , m_unitB(unitB)
+            , m_unitE(unitE) {}
+
+        void Eval() override
+        {
+            m_group.Eval(m_unitB, m_unitE);
+        }
+
+    private:
+        BaseEvalGroup<DeviceTags::CPU>& m_group;
+        size_t m_unitB;
+        size_t m_unitE;
+    };
+
+    ParallelEvalPool()
+    {
+        Start(ConfiguredWorkerNum());
+        ActiveInst().store(this, std::memory_order_release);
+    }
+
+    ~ParallelEvalPool()
+    {
+        ActiveInst().store(nullptr, std::memory_order_release);
+        Stop();
+    }
+
+public:
+    void Process(UnitPtr& eu) override
+    {
+        Submit(eu, LocalGroup());
+    }
+
+    // The units are split into a few ranges, each range is one task. A group of a single unit
+    // is held back: if no other group follows before Barrier(), the calling thread evaluates it
+    // itself rather than handing it to a worker and waiting (e.g. a chain of dependent units).
+    void Process(BaseEvalGroup<DeviceTags::CPU>& group) override
+    {
+        const size_t unitNum = group.UnitNum();
+        if (unitNum == 1)
+        {
+            if (auto prev = std::exchange(Deferred(), &group))
+            {
+                Submit(std::make_shared<RangeUnit>(*prev, 0, 1), LocalGroup());
+            }
+            return;
+        }
+
+        const size_t taskNum = std::min(unitNum, 4 * m_workers.size());
+        for (size_t i = 0; i < taskNum; ++i)
+        {
+            Submit(std::make_shared<RangeUnit>(group, unitNum * i / taskNum, unitNum * (i + 1) / taskNum),
+                   LocalGroup());
+        }
+    }
+
+    // Waits for the units submitted by the calling thread, helping to run queued units
+    // meanwhile. The first exception thrown by one of these units is rethrown here.
+    void Barrier() override
+    {
+        if (auto deferred = std::exchange(Deferred(), nullptr))
+        {
+            try
+            {
+                deferred->Eval(0, 1);
+            }
+            catch (...)
+            {
+                TaskGroup& group = LocalGroup();
+                std::lock_guard<std::mutex> guard(group.m_errorMutex);
+                if (!group.m_error)
+                {
+                    group.m_error = std::current_exception();
+                }
+            }
+        }
+        Wait(LocalGroup());
+    }
+
+private:
+    static constexpr size_t NoWorker = (size_t)-1;
+
+    static std::atomic<ParallelEvalPool*>& ActiveInst()
+    {
+        static std::atomic<ParallelEvalPool*> inst{nullptr};
+        return inst;
+    }
+
+    static size_t& ConfiguredWorkerNum()
+    {
+        static size_t inst = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        return inst;
+    }
+
+    static size_t& WorkerId()
+    {
+        static thread_local size_t inst = NoWorker;
+        return inst;
+    }
+
+    static TaskGroup& LocalGroup()
+    {
+        static thread_local TaskGroup inst;
+        return inst;
+    }
+
+    // The single-unit group held back by Process() on this thread
+    static BaseEvalGroup<DeviceTags::CPU>*& Deferred()
+    {
+        static thread_local BaseEvalGroup<DeviceTags::CPU>* inst = nullptr;
+        return inst;
+    }
+
+    void Submit(UnitPtr unit, TaskGroup& group)
+    {
+        group.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+        size_t target = WorkerId();
+        if (target == NoWorker)
+        {
+            target = m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_sleepMutex);
+            m_queued.fetch_add(1, std::memory_order_relaxed);
+        }
+        {
+            Worker& w = *m_workers[target];
+            std::lock_guard<std::mutex> guard(w.m_mutex);
+            w.m_tasks.push_back(Task{std::move(unit), &group, EvalContext<DeviceTags::CPU>::Current()});
+        }
+        m_sleepCond.notify_one();
+    }
+
+    // An isolated wait only helps with the tasks of its own group, all of which have been
+    // submitted already. The calling thread may hold per-thread state (e.g. packing buffers)
+    // that an unrelated unit must not reuse.
+    void Wait(TaskGroup& group, bool isolated = false)
+    {
+        while (group.m_pending.load(std::memory_order_acquire) != 0)
+        {
+            Task task;
+            if (TryGetTask(WorkerId(), task, isolated ? &group : nullptr))
+            {
+                Execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_doneMutex);
+            m_doneCond.wait(lock, [&group, isolated, this]
+                            {
+                                return (group.m_pending.load(std::memory_order_acquire) == 0) ||
+                                       (!isolated && (m_queued.load(std::memory_order_acquire) != 0));
+                            });
+        }
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> guard(group.m_errorMutex);
+            std::swap(error, group.m_error);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void Start(size_t workerNum)
+    {
+        m_stop = false;
+        m_workers.clear();
+        for (size_t i = 0; i < workerNum; ++i)
+        {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < workerNum; ++i)
+        {
+            m_workers[i]->m_thread = std::thread([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_sleepMutex);
+            m_stop = true;
+        }
+        m_sleepCond.notify_all();
+        for (auto& w : m_workers)
+        {
+            if (w->m_thread.joinable())
+            {
+                w->m_thread.join();
+            }
+            assert(w->m_tasks.empty());
+        }
+        m_workers.clear();
+    }
+
+    // The owner takes its newest task, thieves take the oldest ones of other workers.
+    // With a group given, only tasks of this group are taken.
+    bool TryGetTask(size_t self, Task& task, const TaskGroup* only = nullptr)
+    {
+        if (m_queued.load(std::memory_order_acquire) == 0) return false;
+
+        auto matches = [only](const Task& t) { return !only || (t.m_group == only); };
+        const size_t workerNum = m_workers.size();
+        if (self != NoWorker)
+        {
+            Worker& w = *m_workers[self];
+            std::lock_guard<std::mutex> guard(w.m_mutex);
+            auto it = std::find_if(w.m_tasks.rbegin(), w.m_tasks.rend(), matches);
+            if (it != w.m_tasks.rend())
+            {
+                task = std::move(*it);
+                w.m_tasks.erase(std::next(it).base());
+                m_queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        const size_t start = (self == NoWorker) ? 0 : self + 1;
+        for (size_t i = 0; i < workerNum; ++i)
+        {
+            Worker& w = *m_workers[(start + i) % workerNum];
+            std::lock_guard<std::mutex> guard(w.m_mutex);
+            auto it = std::find_if(w.m_tasks.begin(), w.m_tasks.end(), matches);
+            if (it != w.m_tasks.end())
+            {
+                task = std::move(*it);
+                w.m_tasks.erase(it);
+                m_queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Execute(Task& task)
+    {
+        {
+            EvalContext<DeviceTags::CPU>::Guard contextGuard(task.m_context);
+            try
+            {
+                task.m_unit->Eval();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(task.m_group->m_errorMutex);
+                if (!task.m_group->m_error)
+                {
+                    task.m_group->m_error = std::current_exception();
+                }
+            }
+            task.m_unit.reset();
+        }
+
+        if (task.m_group->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> guard(m_doneMutex);
+            m_doneCond.notify_all();
+        }
+    }
+
+    void WorkerLoop(size_t id)
+    {
+        WorkerId() = id;
+        while (true)
+        {
+            Task task;
+            if (TryGetTask(id, task))
+            {
+                Execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleepCond.wait(lock, [this]
+                             {
+                                 return m_stop || (m_queued.load(std::memory_order_acquire) != 0);
+                             });
+            if (m_stop && (m_queued.load(std::memory_order_acquire) == 0)) break;
+        }
+        WorkerId() = NoWorker;
+    }
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_nextWorker{0};
+    std::atomic<size_t> m_queued{0};
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCond;
+    bool m_stop = false;
+
+    std::mutex m_doneMutex;
+    std::condition_variable m_doneCond;
+};
+}
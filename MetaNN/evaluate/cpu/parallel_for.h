@@ -0,0 +1,54 @@
+#pragma once
+
+#include <MetaNN/evaluate/cpu/parallel_eval_pool.h>
+#include <algorithm>
+#include <cstddef>
+
+namespace MetaNN
+{
+namespace NSParallelFor
+{
+// Work below this (in units of roughly one multiply-add) is not worth a task switch
+constexpr size_t MinChunkCost = 1 << 15;
+}
+
+// Number of threads ParallelFor can spread work over. Intra-unit parallelism runs on the
+// workers of ParallelEvalPool<CPU>: it stays serial until that pool has been started, and
+// chunks are queued on the same work-stealing deques as the units, so a unit already running
+// inside the pool never creates extra threads.
+inline size_t ParallelConcurrency()
+{
+    auto* pool = ParallelEvalPool<DeviceTags::CPU>::Active();
+    return pool ? (pool->WorkerNum() + 1) : 1;
+}
+
+// Calls fun(begin, end) over disjoint sub-ranges covering [0, count). itemCost is the
+// approximate cost of one item and drives the grain size.
+template <typename TFun>
+void ParallelFor(size_t count, size_t itemCost, const TFun& fun)
+{
+    if (count == 0) return;
+
+    auto* pool = ParallelEvalPool<DeviceTags::CPU>::Active();
+    size_t chunkNum = 1;
+    if (pool)
+    {
+        const size_t totalCost = count * std::max<size_t>(itemCost, 1);
+        chunkNum = std::min({count, totalCost / NSParallelFor::MinChunkCost, pool->WorkerNum() + 1});
+    }
+
+    if (chunkNum <= 1)
+    {
+        fun((size_t)0, count);
+        return;
+    }
+
+    const size_t chunkSize = (count + chunkNum - 1) / chunkNum;
+    pool->Run((count + chunkSize - 1) / chunkSize,
+              [&fun, count, chunkSize](size_t id)
+              {
+                  const size_t begin = id * chunkSize;
+                  fun(begin, std::min(count, begin + chunkSize));
+              });
+}
+}
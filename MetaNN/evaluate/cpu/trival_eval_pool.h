@@ -21,6 +21,11 @@ public:
         eu->Eval();
     }
 
+    void Process(BaseEvalGroup<DeviceTags::CPU>& group) override
+    {
+        group.Eval(0, group.UnitNum());
+    }
+
     void Barrier() override {}
 };
 }
\ No newline at end of file
@@ -25,6 +25,18 @@ public:
     {
         return m_handle.IsEvaluated();
     }
+
+    // Whether the buffer waits in the active evaluation plan
+    bool IsRegistered() const
+    {
+        return EvalPlan<typename TData::DeviceType>::IsRegistered(m_handle.DataPtr());
+    }
+
+    // Number of copies of the owning operator (and of handles) sharing the buffer
+    long UseCount() const noexcept
+    {
+        return m_handle.UseCount();
+    }
     
 private:
     EvalHandle<TData> m_handle;
@@ -1,8 +1,8 @@
 #pragma once
 
 #include <MetaNN/evaluate/facilities/eval_unit.h>
-#include <list>
 #include <memory>
+#include <vector>
 
 namespace MetaNN
 {
@@ -11,7 +11,14 @@ class BaseEvalGroup
 {
 public:
     virtual ~BaseEvalGroup() = default;
-    virtual std::shared_ptr<BaseEvalUnit<TDevice>> GetEvalUnit() = 0;
+    virtual size_t UnitNum() const = 0;
+
+    // Evaluates the units [unitB, unitE). Disjoint ranges may be evaluated concurrently.
+    virtual void Eval(size_t unitB, size_t unitE) = 0;
+
+    // Drops the units once they have been evaluated, the storage is kept for the next plan
+    virtual void Clear() = 0;
+
     virtual void Merge(BaseEvalUnit<TDevice>&) = 0;
     virtual void Merge(BaseEvalUnit<TDevice>&&) = 0;
 };
@@ -21,28 +28,35 @@ class TrivalEvalGroup : public BaseEvalGroup<typename TEvalUnit::DeviceType>
 {
     using DeviceType = typename TEvalUnit::DeviceType;
 public:
-    std::shared_ptr<BaseEvalUnit<DeviceType>> GetEvalUnit() override
+    size_t UnitNum() const override
+    {
+        return m_units.size();
+    }
+
+    void Eval(size_t unitB, size_t unitE) override
     {
-        std::shared_ptr<BaseEvalUnit<DeviceType>> res;
-        if (!m_unitList.empty())
+        for (size_t i = unitB; i < unitE; ++i)
         {
-            res = std::make_shared<TEvalUnit>(std::move(m_unitList.front()));
-            m_unitList.pop_front();
+            m_units[i].TEvalUnit::Eval();
         }
-        return res;
+    }
+
+    void Clear() override
+    {
+        m_units.clear();
     }
 
     void Merge(BaseEvalUnit<DeviceType>& unit) override
     {
-        m_unitList.push_back(static_cast<TEvalUnit&>(unit));
+        m_units.push_back(static_cast<TEvalUnit&>(unit));
     }
-    
+
     void Merge(BaseEvalUnit<DeviceType>&& unit) override
     {
-        m_unitList.push_back(static_cast<TEvalUnit&&>(unit));
+        m_units.push_back(static_cast<TEvalUnit&&>(unit));
     }
 
 private:
-    std::list<TEvalUnit> m_unitList;
+    std::vector<TEvalUnit> m_units;
 };
-}
\ No newline at end of file
+}
@@ -6,6 +6,9 @@
 
 namespace MetaNN
 {
+template <typename TDevice>
+class EvalPlan;
+
 template <typename TData>
 class EvalHandle
 {
@@ -41,6 +44,22 @@ public:
             throw std::runtime_error("Data is already evaluated.");
         }
         m_data->m_eval = true;
+
+        using DeviceType = typename TData::DeviceType;
+        if (EvalPlan<DeviceType>::MemoryPlanActive())
+        {
+            EvalPlan<DeviceType>::TrackOutput(DataPtr(),
+                                             [data = std::weak_ptr<DataWithEvalInfo>(m_data)]()
+                                             {
+                                                 // Only dropped when the operator owning the buffer is its last holder
+                                                 auto p = data.lock();
+                                                 if (p && (p.use_count() == 2))
+                                                 {
+                                                     p->m_data = TData();
+                                                     p->m_eval = false;
+                                                 }
+                                             });
+        }
     }
     
     const TData& Data() const
@@ -57,6 +76,12 @@ public:
         return m_data.get();
     }
 
+    // Number of handles sharing the buffer
+    long UseCount() const noexcept
+    {
+        return m_data.use_count();
+    }
+
     template <typename...TParams>
     void Allocate(TParams&&... params) const
     {
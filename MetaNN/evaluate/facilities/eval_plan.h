@@ -1,40 +1,146 @@
 #pragma once
 
+#include <MetaNN/evaluate/cpu/parallel_eval_pool.h>
 #include <MetaNN/evaluate/cpu/trival_eval_pool.h>
 #include <MetaNN/evaluate/facilities/eval_group.h>
 #include <MetaNN/evaluate/facilities/eval_handle.h>
 #include <MetaNN/evaluate/facilities/eval_pool.h>
 #include <MetaNN/evaluate/facilities/eval_unit.h>
 #include <vector>
+#include <atomic>
 #include <cassert>
-#include <list>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <unordered_set>
-#include <typeindex>
 #include <algorithm>
 
 namespace MetaNN
 {
 namespace NSEvalPlan
 {
-inline size_t OperandDepth(const std::unordered_map<const void*, size_t>& depMap,
-                           const std::vector<const void*>& paramPtr)
+// Maps data pointers to depths with open addressing. Clear() is O(1) and keeps the table:
+// slots written before the last Clear() count as empty.
+class DepthMap
+{
+public:
+    const size_t* Find(const void* key) const
+    {
+        if ((!key) || (m_size == 0)) return nullptr;
+        for (size_t i = Hash(key); ; i = (i + 1) & m_mask)
+        {
+            const Slot& slot = m_slots[i];
+            if (slot.m_gen != m_gen) return nullptr;
+            if (slot.m_key == key) return &slot.m_value;
+        }
+    }
+
+    // Inserts key with a value of 0 if it is missing
+    size_t& operator[] (const void* key)
+    {
+        assert(key);
+        if ((m_size + 1) * 2 > m_slots.size())
+        {
+            Grow();
+        }
+        for (size_t i = Hash(key); ; i = (i + 1) & m_mask)
+        {
+            Slot& slot = m_slots[i];
+            if (slot.m_gen != m_gen)
+            {
+                slot = Slot{key, 0, m_gen};
+                ++m_size;
+                return slot.m_value;
+            }
+            if (slot.m_key == key) return slot.m_value;
+        }
+    }
+
+    void Clear()
+    {
+        if (m_size == 0) return;
+        ++m_gen;
+        m_size = 0;
+    }
+
+private:
+    struct Slot
+    {
+        const void* m_key;
+        size_t m_value;
+        uint64_t m_gen;
+    };
+
+    size_t Hash(const void* key) const
+    {
+        return (size_t)((((uintptr_t)key >> 4) * 0x9E3779B97F4A7C15ull) >> m_shift) & m_mask;
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> old;
+        old.swap(m_slots);
+        const uint64_t oldGen = m_gen;
+
+        const size_t newSize = std::max<size_t>(64, old.size() * 2);
+        m_slots.assign(newSize, Slot{nullptr, 0, 0});
+        m_mask = newSize - 1;
+        m_shift = 64;
+        for (size_t i = newSize; i > 1; i >>= 1) --m_shift;
+        m_gen = 1;
+        m_size = 0;
+        for (const Slot& slot : old)
+        {
+            if (slot.m_gen == oldGen)
+            {
+                (*this)[slot.m_key] = slot.m_value;
+            }
+        }
+    }
+
+private:
+    std::vector<Slot> m_slots;
+    size_t m_mask = 0;
+    unsigned m_shift = 64;
+    size_t m_size = 0;
+    uint64_t m_gen = 1;
+};
+
+template <typename TParams>
+size_t OperandDepth(const DepthMap& depMap, const TParams& paramPtr)
 {
     int res = -1;
         
     for (auto p : paramPtr)
     {
-        auto it = depMap.find(p);
-        if (it != depMap.end()) res = std::max(res, (int)(it->second));
+        if (const size_t* depth = depMap.Find(p)) res = std::max(res, (int)(*depth));
     }
 
     return (size_t)res;
 }
+
+inline size_t NewGroupId()
+{
+    static std::atomic<size_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename TEvalGroup>
+size_t GroupId()
+{
+    static const size_t inst = NewGroupId();
+    return inst;
+}
 }
 
+// The groups of one depth, looked up by NSEvalPlan::GroupId. A depth rarely holds more than a
+// few unit types, a linear search is cheaper than hashing.
 template <typename TDevice>
-using EvalCluster = std::unordered_map<std::type_index, std::shared_ptr<BaseEvalGroup<TDevice>>>;
+using EvalCluster = std::vector<std::pair<size_t, std::unique_ptr<BaseEvalGroup<TDevice>>>>;
 
 template <typename TDevice>
 class EvalLayer
@@ -42,7 +148,7 @@ class EvalLayer
 public:
     size_t Size() const
     {
-        return m_evalSeq.size();
+        return m_depthNum;
     }
 
     EvalCluster<TDevice>& operator[] (size_t i)
@@ -52,47 +158,107 @@ public:
 
     bool Empty() const
     {
-        return m_evalSeq.empty();
+        return m_depthNum == 0;
     }
 
+    // Groups and containers are kept, so that registering the next plan does not allocate
     void Clear()
     {
-        m_evalSeq.clear();
+        for (size_t i = 0; i < m_depthNum; ++i)
+        {
+            for (auto& eg : m_evalSeq[i])
+            {
+                eg.second->Clear();
+            }
+        }
+        m_depthNum = 0;
         m_operands.clear();
-        m_outputs.clear();
+        m_outputs.Clear();
+        m_lastUse.Clear();
+        for (auto& r : m_releases)
+        {
+            r.clear();
+        }
     }
 
-    template <typename TEvalGroup, typename TEvalUnit>
+    template <typename TEvalGroup, typename TEvalUnit, typename TParams>
     void EvalRegister(TEvalUnit&& evalReq, const void* resPtr,
-                      const std::vector<const void*>& paramPtr)
+                      const TParams& paramPtr, bool trackUse = false)
     {
         if (!resPtr) return;
-        if (m_outputs.find(resPtr) != m_outputs.end()) return;
+        if (m_outputs.Find(resPtr)) return;
 
         size_t depth = NSEvalPlan::OperandDepth(m_outputs, paramPtr) + 1;
+        if (trackUse)
+        {
+            for (auto p : paramPtr)
+            {
+                if (m_outputs.Find(p))
+                {
+                    size_t& lastUse = m_lastUse[p];
+                    lastUse = std::max(lastUse, depth);
+                }
+            }
+        }
 
-        if (m_evalSeq.size() <= (size_t)depth)
+        if (m_evalSeq.size() <= depth)
         {
             m_evalSeq.resize(depth + 1);
         }
+        m_depthNum = std::max(m_depthNum, depth + 1);
         EvalCluster<TDevice>& ec = m_evalSeq[depth];
 
-        const auto typeIndex = std::type_index(typeid(TEvalGroup));
-        auto it = ec.find(typeIndex);
-
+        const size_t groupId = NSEvalPlan::GroupId<TEvalGroup>();
+        auto it = std::find_if(ec.begin(), ec.end(),
+                               [groupId](const auto& eg) { return eg.first == groupId; });
         if (it == ec.end())
         {
-            it = ec.insert({typeIndex, std::make_shared<TEvalGroup>()}).first;
+            ec.emplace_back(groupId, std::make_unique<TEvalGroup>());
+            it = std::prev(ec.end());
         }
         it->second->Merge(std::forward<TEvalUnit>(evalReq));
 
-        m_outputs.insert({resPtr, depth});
+        m_outputs[resPtr] = depth;
+    }
+
+    bool IsRegistered(const void* resPtr) const
+    {
+        return m_outputs.Find(resPtr) != nullptr;
+    }
+
+    // Outputs read by units of this layer are released once the last of them has run
+    bool TrackOutput(const void* resPtr, std::function<void()>&& release)
+    {
+        const size_t* lastUse = m_lastUse.Find(resPtr);
+        if (!lastUse) return false;
+
+        if (m_releases.size() <= *lastUse)
+        {
+            m_releases.resize(*lastUse + 1);
+        }
+        m_releases[*lastUse].push_back(std::move(release));
+        return true;
+    }
+
+    void Release(size_t depth)
+    {
+        if (depth >= m_releases.size()) return;
+        for (auto& fun : m_releases[depth])
+        {
+            fun();
+        }
+        m_releases[depth].clear();
     }
 
 private:
     std::vector<EvalCluster<TDevice>> m_evalSeq;
+    size_t m_depthNum = 0;
     std::unordered_set<const void*> m_operands;
-    std::unordered_map<const void*, size_t> m_outputs;
+    NSEvalPlan::DepthMap m_outputs;
+
+    // depth of the last unit reading each output, only filled with memory planning
+    NSEvalPlan::DepthMap m_lastUse;
+    std::vector<std::vector<std::function<void()>>> m_releases;
 };
 
 template <typename TDevice>
@@ -111,11 +277,23 @@ private:
         return inst;
     }
     
+    static bool& GlobalMemoryPlan()
+    {
+        static bool inst = false;
+        return inst;
+    }
+
     static EvalPlan& ThreadInst()
     {
         static thread_local EvalPlan inst;
         return inst;
     }
+    
+    static EvalPlan& ActiveInst()
+    {
+        void* context = EvalContext<TDevice>::Current();
+        return context ? *static_cast<EvalPlan*>(context) : ThreadInst();
+    }
 
 public:
     static void SetEvalPool(EvalPoolEnum epType)
@@ -123,11 +301,59 @@ public:
         GlobalEvalPool() = epType;
     }
 
+    // With memory planning, an intermediate result is dropped right after the last unit of the
+    // plan reading it, so that its memory can serve the outputs of later units. It is only
+    // dropped if the operator that computed it is its sole remaining holder: reading it again
+    // through that operator recomputes it.
+    static void SetMemoryPlan(bool enable)
+    {
+        GlobalMemoryPlan() = enable;
+    }
+
+    static bool MemoryPlanActive()
+    {
+        return ActiveInst().m_memoryPlan;
+    }
+
+    static void TrackOutput(const void* outputPtr, std::function<void()>&& release)
+    {
+        EvalPlan& plan = ActiveInst();
+        std::unique_lock<std::mutex> guard(plan.m_registerMutex, std::defer_lock);
+        if (plan.m_concurrent)
+        {
+            guard.lock();
+        }
+        for (size_t i = plan.m_activeLayer + 1; i-- > 0;)
+        {
+            if (plan.m_evalLayers[i].TrackOutput(outputPtr, std::move(release))) return;
+        }
+    }
+
+    // Whether an output waits to be computed by the plan that receives the registrations
+    static bool IsRegistered(const void* outputPtr)
+    {
+        EvalPlan& plan = ActiveInst();
+        std::unique_lock<std::mutex> guard(plan.m_registerMutex, std::defer_lock);
+        if (plan.m_concurrent)
+        {
+            guard.lock();
+        }
+        return plan.m_evalLayers[plan.m_activeLayer].IsRegistered(outputPtr);
+    }
+
     template <typename TEvalGroup, typename TEvalUnit>
     static void Register(TEvalUnit&& evalReq, const void* outputPtr,
                          const std::vector<const void*>& paramPtr)
     {
-        ThreadInst().template EvalRegister<TEvalGroup>(std::forward<TEvalUnit>(evalReq), outputPtr, paramPtr);
+        RegisterImpl<TEvalGroup>(std::forward<TEvalUnit>(evalReq), outputPtr, paramPtr);
+    }
+
+    // Dependencies listed in place are registered without building a vector
+    template <typename TEvalGroup, typename TEvalUnit>
+    static void Register(TEvalUnit&& evalReq, const void* outputPtr,
+                         std::initializer_list<const void*> paramPtr)
+    {
+        RegisterImpl<TEvalGroup>(std::forward<TEvalUnit>(evalReq), outputPtr, paramPtr);
     }
 
     static void Eval()
@@ -140,6 +366,9 @@ public:
             case EvalPoolEnum::Trival:
                 plan.m_evalPool = &(TrivalEvalPool<TDevice>::Instance());
                 break;
+            case EvalPoolEnum::Parallel:
+                plan.m_evalPool = &(ParallelEvalPool<TDevice>::Instance());
+                break;
             default:
                 assert(false);
             }
@@ -150,55 +379,143 @@ public:
             throw std::runtime_error("No Evaluation Pool is available.");
         }
         
+        typename EvalContext<TDevice>::Guard contextGuard(&plan);
+        ModeGuard modeGuard(plan, ThreadEvalPool() == EvalPoolEnum::Parallel, GlobalMemoryPlan());
         plan.DoLayerEval();
     }
 
 private:
+    // Sets the evaluation mode of a plan for one Eval, restores the previous one on exit
+    class ModeGuard
+    {
+    public:
+        ModeGuard(EvalPlan& plan, bool concurrent, bool memoryPlan)
+            : m_plan(plan)
+            , m_concurrent(plan.m_concurrent)
+            , m_memoryPlan(plan.m_memoryPlan)
+        {
+            plan.m_concurrent = concurrent;
+            plan.m_memoryPlan = memoryPlan;
+        }
+
+        ~ModeGuard()
+        {
+            m_plan.m_concurrent = m_concurrent;
+            m_plan.m_memoryPlan = m_memoryPlan;
+        }
+
+        ModeGuard(const ModeGuard&) = delete;
+        ModeGuard& operator= (const ModeGuard&) = delete;
+
+    private:
+        EvalPlan& m_plan;
+        bool m_concurrent;
+        bool m_memoryPlan;
+    };
+
+    // Makes a layer active again once it is evaluated. The layer and the nested one are cleared,
+    // so that the registrations left by a throwing unit are not evaluated by the next plan.
+    class LayerGuard
+    {
+    public:
+        LayerGuard(EvalPlan& plan)
+            : m_plan(plan)
+            , m_layer(plan.m_activeLayer) {}
+
+        ~LayerGuard()
+        {
+            m_plan.m_activeLayer = m_layer;
+            m_plan.m_evalLayers[m_layer + 1].Clear();
+            m_plan.m_evalLayers[m_layer].Clear();
+        }
+
+        LayerGuard(const LayerGuard&) = delete;
+        LayerGuard& operator= (const LayerGuard&) = delete;
+
+    private:
+        EvalPlan& m_plan;
+        size_t m_layer;
+    };
+
     EvalPlan()
-        : m_evalPool(nullptr)
+        : m_activeLayer(0)
+        , m_evalPool(nullptr)
+        , m_concurrent(false)
+        , m_memoryPlan(false)
     {
         m_evalLayers.resize(1);
     }
 
-    template <typename TEvalGroup, typename TEvalUnit>
-    void EvalRegister(TEvalUnit&& evalReq, const void* outputPtr,
-                      const std::vector<const void*>& paramPtr)
+    template <typename TEvalGroup, typename TEvalUnit, typename TParams>
+    static void RegisterImpl(TEvalUnit&& evalReq, const void* outputPtr, const TParams& paramPtr)
+    {
+        EvalPlan& plan = ActiveInst();
+        if (plan.m_concurrent)
+        {
+            std::lock_guard<std::mutex> guard(plan.m_registerMutex);
+            plan.template EvalRegister<TEvalGroup>(std::forward<TEvalUnit>(evalReq), outputPtr, paramPtr);
+        }
+        else
+        {
+            plan.template EvalRegister<TEvalGroup>(std::forward<TEvalUnit>(evalReq), outputPtr, paramPtr);
+        }
+    }
+
+    template <typename TEvalGroup, typename TEvalUnit, typename TParams>
+    void EvalRegister(TEvalUnit&& evalReq, const void* outputPtr, const TParams& paramPtr)
     {
-        auto& curLayer = m_evalLayers.back();
+        auto& curLayer = m_evalLayers[m_activeLayer];
         curLayer.template EvalRegister<TEvalGroup>(std::forward<TEvalUnit>(evalReq),
-                                                   outputPtr, paramPtr);
+                                                   outputPtr, paramPtr,
+                                                   GlobalMemoryPlan());
     }
 
     void DoLayerEval()
     {
-        EvalLayer<TDevice>& curLayer = m_evalLayers.back();
+        EvalLayer<TDevice>& curLayer = m_evalLayers[m_activeLayer];
         if (curLayer.Empty()) return;
 
-        m_evalLayers.push_back(EvalLayer<TDevice>{});
+        // Layers of nested evaluation are reused from one plan to the next
+        if (m_evalLayers.size() == m_activeLayer + 1)
+        {
+            m_evalLayers.emplace_back();
+        }
+        LayerGuard layerGuard(*this);
+        ++m_activeLayer;
         size_t seqLen = curLayer.Size();
         for (size_t i = 0; i < seqLen; ++i)
         {
             EvalCluster<TDevice>& ec = curLayer[i];
             for (auto& eg : ec)
             {
-                while(auto unit = eg.second->GetEvalUnit())
+                if (eg.second->UnitNum() != 0)
                 {
-                    m_evalPool->Process(unit);
+                    m_evalPool->Process(*eg.second);
                 }
             }
             m_evalPool->Barrier();
-            if (!m_evalLayers.back().Empty())
+            if (!m_evalLayers[m_activeLayer].Empty())
             {
                 DoLayerEval();
             }
+            // The units hold handles of their operands, drop them before releasing these
+            for (auto& eg : ec)
+            {
+                eg.second->Clear();
+            }
+            curLayer.Release(i);
         }
-        m_evalLayers.pop_back();
-        curLayer.Clear();
     }
 
 private:
-    std::list<EvalLayer<TDevice>> m_evalLayers;
+    // m_evalLayers[m_activeLayer] receives the registrations, deeper ones are not in use
+    std::deque<EvalLayer<TDevice>> m_evalLayers;
+    size_t m_activeLayer;
     BaseEvalPool<TDevice>* m_evalPool;
+    
+    bool m_concurrent;
+    bool m_memoryPlan;
+    std::mutex m_registerMutex;
 };
 
 template <typename TData>
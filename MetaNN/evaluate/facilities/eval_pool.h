@@ -1,5 +1,6 @@
 #pragma once
 
+#include <MetaNN/evaluate/facilities/eval_group.h>
 #include <MetaNN/evaluate/facilities/eval_unit.h>
 #include <memory>
 
@@ -7,7 +8,8 @@ namespace MetaNN
 {
 enum class EvalPoolEnum
 {
-    Trival
+    Trival,
+    Parallel
 };
 
 template <typename TDevice>
@@ -16,9 +18,50 @@ class BaseEvalPool
 public:
     virtual ~BaseEvalPool() = default;
     virtual void Process(std::shared_ptr<BaseEvalUnit<TDevice>>&) = 0;
+
+    // Evaluates all units of the group, which has to stay alive until Barrier() returns
+    virtual void Process(BaseEvalGroup<TDevice>&) = 0;
     virtual void Barrier() = 0;
 };
 
+// The evaluation plan that units registered on the current thread belong to.
+// Pools that run units on other threads install the submitter's context around
+// each unit, so registrations made inside BaseEvalUnit::Eval() reach the right plan.
+template <typename TDevice>
+class EvalContext
+{
+public:
+    static void*& Current()
+    {
+        static thread_local void* inst = nullptr;
+        return inst;
+    }
+
+    class Guard
+    {
+    public:
+        Guard(void* context)
+            : m_prev(Current())
+        {
+            Current() = context;
+        }
+
+        ~Guard()
+        {
+            Current() = m_prev;
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator= (const Guard&) = delete;
+
+    private:
+        void* m_prev;
+    };
+};
+
 template <typename TDevice>
 class TrivalEvalPool;
-}
\ No newline at end of file
+
+template <typename TDevice>
+class ParallelEvalPool;
+}
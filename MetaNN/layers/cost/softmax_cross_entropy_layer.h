@@ -0,0 +1,114 @@
+#pragma once
+#include <MetaNN/layers/facilities/common_io.h>
+#include <MetaNN/layers/facilities/policies.h>
+#include <MetaNN/policies/policy_operations.h>
+
+namespace MetaNN
+{
+namespace NSSoftmaxCrossEntropyLayer
+{
+template <bool isFeedback>
+struct Feedback_
+{
+    template <typename TLabel, typename TIn, typename TData>
+    static void Record(const TLabel& label, const TIn& in,
+                       TData& label_stack, TData& score_stack)
+    {
+        label_stack.push(MakeDynamic(label));
+        score_stack.push(MakeDynamic(in));
+    }
+
+    template <typename TGrad, typename TData>
+    static auto Feedback(const TGrad& p_grad, TData& label, TData& score)
+    {
+        if ((label.empty()) || (score.empty()))
+        {
+            throw std::runtime_error("Cannot do FeedBackward for Softmax Cross-entropy Layer");
+        }
+        auto l = label.top();
+        auto s = score.top();
+        label.pop();
+        score.pop();
+
+        auto g = p_grad.template Get<LayerIO>();
+        auto res = SoftmaxCrossEntropyDerivative(g, std::move(l), std::move(s));
+        return CostLayerIn::Create().template Set<CostLayerIn>(std::move(res));
+    }
+};
+
+template <>
+struct Feedback_<false>
+{
+    template <typename TLabel, typename TIn, typename TData>
+    static void Record(TLabel&&, TIn&& p_in, TData&&, TData&&) { }
+
+    template <typename TGrad, typename TData>
+    static auto Feedback(TGrad&&, TData&&, TData&&)
+    {
+        return CostLayerIn::Create();
+    }
+};
+}
+
+// SoftmaxLayer followed by NegativeLogLikelihoodLayer in one layer: the input holds the scores
+// before the softmax, only these are kept for the backward pass.
+template <typename TPolicies>
+class SoftmaxCrossEntropyLayer
+{
+    static_assert(IsPolicyContainer<TPolicies>, "TPolicies is not a policy container.");
+    using CurLayerPolicy = PlainPolicy<TPolicies>;
+
+public:
+    static constexpr bool IsFeedbackOutput = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsFeedbackOutput;
+    static constexpr bool IsUpdate = false;
+    using InputType = CostLayerIn;
+    using OutputType = LayerIO;
+
+private:
+    using ElementType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Element;
+    using DeviceType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Device;
+
+    using Feedback_ = NSSoftmaxCrossEntropyLayer::Feedback_<IsFeedbackOutput>;
+public:
+    template <typename TIn>
+    auto FeedForward(const TIn& p_in)
+    {
+        const auto& input = p_in.template Get<CostLayerIn>();
+        const auto& label = p_in.template Get<CostLayerLabel>();
+
+        using rawType1 = std::decay_t<decltype(input)>;
+        using rawType2 = std::decay_t<decltype(label)>;
+        static_assert(!std::is_same<rawType1, NullParameter>::value, "Input is invalid");
+        static_assert(!std::is_same<rawType2, NullParameter>::value, "Label is invalid");
+
+        Feedback_::Record(label, input, m_label, m_score);
+        return LayerIO::Create().template Set<LayerIO>(SoftmaxCrossEntropy(label, input));
+    }
+
+    template <typename TGrad>
+    auto FeedBackward(TGrad&& p_grad)
+    {
+        return Feedback_::Feedback(std::forward<TGrad>(p_grad), m_label, m_score);
+    }
+
+    void NeutralInvariant()
+    {
+        if constexpr(IsFeedbackOutput)
+        {
+            if ((!m_label.empty()) || (!m_score.empty()))
+            {
+                throw std::runtime_error("NeutralInvariant Fail!");
+            }
+        }
+    }
+
+private:
+    using DataType = LayerTraits::LayerInternalBuf<IsFeedbackOutput,
+                                                   PolicySelect<InputPolicy, CurLayerPolicy>::BatchMode,
+                                                   typename PolicySelect<OperandPolicy, CurLayerPolicy>::Element,
+                                                   typename PolicySelect<OperandPolicy, CurLayerPolicy>::Device,
+                                                   CategoryTags::Matrix, CategoryTags::BatchMatrix>;
+    DataType m_label;
+    DataType m_score;
+};
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <MetaNN/layers/facilities/common_io.h>
+#include <MetaNN/layers/facilities/policies.h>
+#include <MetaNN/policies/policy_operations.h>
+#include <MetaNN/model/param_initializer/facilities/traits.h>
+#include <stack>
+#include <vector>
+
+namespace MetaNN
+{
+namespace NSEmbeddingLayer
+{
+template <typename TElem, typename TDevice, typename TIn>
+std::vector<size_t> HotPos(const TIn& p_in)
+{
+    using TOneHot = OneHotType<TElem, TDevice, DataCategory<TIn>>;
+    auto ptr = DataCast<TOneHot>(p_in);
+    if (!ptr)
+    {
+        throw std::runtime_error("The input of embedding layer is not one-hot");
+    }
+
+    if constexpr (IsMatrix<TIn>)
+    {
+        return {ptr->HotPos()};
+    }
+    else
+    {
+        return ptr->HotPos();
+    }
+}
+
+template <bool isUpdate>
+struct RowBuf_
+{
+    using type = std::stack<std::vector<size_t>>;
+};
+
+template <>
+struct RowBuf_<false>
+{
+    using type = NullParameter;
+};
+}
+
+// WeightLayer for one-hot inputs (OneHotVector, or BatchOneHotVector in batch mode):
+// the output is the hot row of the weight and the gradient only updates these rows,
+// it is collected by GradCollector::CollectRows (kept as rows by a collector with keepRows).
+template <typename TPolicies>
+class EmbeddingLayer
+{
+    static_assert(IsPolicyContainer<TPolicies>, "TPolicies is not a policy container.");
+    using CurLayerPolicy = PlainPolicy<TPolicies>;
+
+public:
+    static constexpr bool IsFeedbackOutput = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsFeedbackOutput;
+    static constexpr bool IsUpdate = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsUpdate;
+    using InputType = LayerIO;
+    using OutputType = LayerIO;
+
+    static_assert(!IsFeedbackOutput, "Embedding layer cannot feed back to its one-hot input");
+
+private:
+    using ElementType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Element;
+    using DeviceType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Device;
+
+public:
+    EmbeddingLayer(std::string p_name, size_t p_vocabLen, size_t p_outLen)
+        : m_name(std::move(p_name))
+        , m_vocabLen(p_vocabLen)
+        , m_outputLen(p_outLen)
+    {
+        if ((m_vocabLen == 0) || (m_outputLen == 0))
+        {
+            throw std::runtime_error("Invalidate matrix size for embedding layer");
+        }
+    }
+
+public:
+    template <typename TInitializer, typename TBuffer,
+              typename TInitPolicies = typename TInitializer::PolicyCont>
+    void Init(TInitializer& initializer, TBuffer& loadBuffer, std::ostream* log = nullptr)
+    {
+        if (auto cit = loadBuffer.find(m_name); cit != loadBuffer.end())
+        {
+            const Matrix<ElementType, DeviceType>& m = cit->second;
+            if ((m.RowNum() != m_vocabLen) || (m.ColNum() != m_outputLen))
+            {
+                throw std::runtime_error("Load matrix error in EmbeddingLayer");
+            }
+            m_weight = m;
+            if (log)
+            {
+                std::string logInfo = "Load from load buffer: " + m_name + '\n';
+                (*log) << logInfo;
+            }
+            return;
+        }
+        else if (initializer.IsMatrixExist(m_name))
+        {
+            m_weight = Matrix<ElementType, DeviceType>(m_vocabLen, m_outputLen);
+            initializer.GetMatrix(m_name, m_weight);
+            loadBuffer[m_name] = m_weight;
+            if (log)
+            {
+                std::string logInfo = "Copy from initializer: " + m_name + '\n';
+                (*log) << logInfo;
+            }
+            return;
+        }
+        else
+        {
+            m_weight = Matrix<ElementType, DeviceType>(m_vocabLen, m_outputLen);
+            using CurInitializer = PickInitializer<TInitPolicies, InitPolicy::WeightTypeCate>;
+            if constexpr (!std::is_same<CurInitializer, void>::value)
+            {
+                auto& cur_init = initializer.template GetFiller<CurInitializer>();
+                cur_init.Fill(m_weight, m_vocabLen, m_outputLen);
+                loadBuffer[m_name] = m_weight;
+                if (log)
+                {
+                    std::string logInfo = "Random init from initializer: " + m_name + '\n';
+                    (*log) << logInfo;
+                }
+            }
+            else
+            {
+                throw std::runtime_error("Cannot get initializer for InitPolicy::WeightTypeCate");
+            }
+        }
+    }
+
+    template <typename TSave>
+    void SaveWeights(TSave& saver) const
+    {
+        typename TSave::const_iterator cit = saver.find(m_name);
+        if ((cit != saver.end()) && (cit->second != m_weight))
+        {
+            throw std::runtime_error("Duplicate save for matrix: " + m_name);
+        }
+        saver[m_name] = m_weight;
+    }
+
+    template <typename TIn>
+    auto FeedForward(const TIn& p_in)
+    {
+        const auto& val = p_in.template Get<LayerIO>();
+
+        using rawType = std::decay_t<decltype(val)>;
+        static_assert(!std::is_same<rawType, NullParameter>::value, "parameter is invalid");
+
+        auto rows = NSEmbeddingLayer::HotPos<ElementType, DeviceType>(val);
+        if constexpr (IsUpdate)
+        {
+            m_inputRows.push(std::move(rows));
+        }
+
+        auto res = Dot(val, m_weight);
+        return LayerIO::Create().template Set<LayerIO>(std::move(res));
+    }
+
+    template <typename TGrad>
+    auto FeedBackward(const TGrad& p_grad)
+    {
+        if constexpr (IsUpdate)
+        {
+            if (m_inputRows.empty())
+            {
+                throw std::runtime_error("Cannot do FeedBackward for Embedding Layer");
+            }
+            m_gradRows.push(std::move(m_inputRows.top()));
+            m_inputRows.pop();
+            m_gradInfo.push(MakeDynamic(p_grad.template Get<LayerIO>()));
+        }
+        return LayerIO::Create();
+    }
+
+    template <typename TGradCollector>
+    void GradCollect(TGradCollector& col)
+    {
+        if constexpr (IsUpdate)
+        {
+            while (!m_gradInfo.empty())
+            {
+                col.CollectRows(m_weight, std::move(m_gradRows.top()), m_gradInfo.top());
+                m_gradRows.pop();
+                m_gradInfo.pop();
+            }
+        }
+    }
+
+    void NeutralInvariant() const
+    {
+        if constexpr(IsUpdate)
+        {
+            if ((!m_inputRows.empty()) || (!m_gradRows.empty()) || (!m_gradInfo.empty()))
+            {
+                throw std::runtime_error("NeutralInvariant Fail!");
+            }
+        }
+    }
+
+private:
+    const std::string m_name;
+    const size_t m_vocabLen;
+    const size_t m_outputLen;
+
+    Matrix<ElementType, DeviceType> m_weight;
+
+    using RowBufType = typename NSEmbeddingLayer::RowBuf_<IsUpdate>::type;
+    using DataType = LayerTraits::LayerInternalBuf<IsUpdate,
+                                                   PolicySelect<InputPolicy, CurLayerPolicy>::BatchMode,
+                                                   ElementType, DeviceType,
+                                                   CategoryTags::Matrix, CategoryTags::BatchMatrix>;
+    RowBufType m_inputRows;
+    RowBufType m_gradRows;
+    DataType m_gradInfo;
+};
+}
@@ -56,6 +56,7 @@ public:
                 throw std::runtime_error("Load matrix error in WeightLayer");
             }
             m_weight = m;
+            EnablePackCache(m_weight);
             if (log)
             {
                 std::string logInfo = "Load from load buffer: " + m_name + '\n';
@@ -67,6 +68,7 @@ public:
         {
             m_weight = Matrix<ElementType, DeviceType>(m_inputLen, m_outputLen);            
             initializer.GetMatrix(m_name, m_weight);
+            EnablePackCache(m_weight);
             loadBuffer[m_name] = m_weight;
             if (log)
             {
@@ -83,6 +85,7 @@ public:
             {
                 auto& cur_init = initializer.template GetFiller<CurInitializer>();
                 cur_init.Fill(m_weight, m_inputLen, m_outputLen);
+                EnablePackCache(m_weight);
                 loadBuffer[m_name] = m_weight;
                 if (log)
                 {
@@ -136,10 +139,9 @@ public:
                 throw std::runtime_error("Cannot do FeedBackward for Weight Layer");
             }
 
-            auto tw = Transpose(m_updateInfo.top());
+            m_inputInfo.push(m_updateInfo.top());
             m_updateInfo.pop();
-            auto res = NSWeightLayer::EvalHelper(tmp, tw);
-            m_gradInfo.push(MakeDynamic(res));
+            m_gradInfo.push(MakeDynamic(tmp));
         }
         
         if constexpr (IsFeedbackOutput)
@@ -160,7 +162,16 @@ public:
     {
         if constexpr (IsUpdate)
         {
-            LayerTraits::MatrixGradCollect(m_weight, m_gradInfo, col);
+            // The weight gradients are formed here, so that an accumulating collector
+            // can add each Dot to its buffer without storing the product
+            while (!m_gradInfo.empty())
+            {
+                auto tw = Transpose(m_inputInfo.top());
+                auto res = NSWeightLayer::EvalHelper(m_gradInfo.top(), tw);
+                col.Collect(m_weight, res);
+                m_inputInfo.pop();
+                m_gradInfo.pop();
+            }
         }
     }
 
@@ -168,7 +179,7 @@ public:
     {
         if constexpr(IsUpdate)
         {
-            if ((!m_updateInfo.empty()) || (!m_gradInfo.empty()))
+            if ((!m_updateInfo.empty()) || (!m_inputInfo.empty()) || (!m_gradInfo.empty()))
             {
                 throw std::runtime_error("NeutralInvariant Fail!");
             }
@@ -187,6 +198,7 @@ private:
                                                    ElementType, DeviceType,
                                                    CategoryTags::Matrix, CategoryTags::BatchMatrix>;
     DataType m_updateInfo;
+    DataType m_inputInfo;
     DataType m_gradInfo;
 };
 }
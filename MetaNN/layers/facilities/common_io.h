@@ -9,4 +9,5 @@ struct LayerIO : public VarTypeDict<LayerIO> {};
 struct CostLayerIn : public VarTypeDict<CostLayerIn, struct CostLayerLabel> {};
 
 struct RnnLayerHiddenBefore;
+struct RnnLayerHiddenAfter;
 }
@@ -2,6 +2,7 @@
 
 #include <MetaNN/policies/policy_macro_begin.h>
 #include <MetaNN/data/facilities/tags.h>
+#include <cstddef>
 namespace MetaNN
 {
 struct FeedbackPolicy
@@ -68,14 +69,31 @@ struct RecurrentLayerPolicy
     struct StepTypeCate
     {
         struct GRU;
+        struct FusedGRU;
+        struct LSTM;
     };
     struct UseBpttValueCate;
+    struct CheckpointSegmentValueCate;
+    struct BpttWindowValueCate;
+    struct BpttLengthValueCate;
+    struct MemoryReportValueCate;
 
     using Step = StepTypeCate::GRU;
     constexpr static bool UseBptt = true;
+    constexpr static size_t CheckpointSegment = 0;
+    constexpr static size_t BpttWindow = 0;
+    constexpr static size_t BpttLength = 0;
+    constexpr static bool MemoryReport = false;
 };
 TypePolicyObj(PRecGRUStep, RecurrentLayerPolicy, Step, GRU);
+TypePolicyObj(PRecFusedGRUStep, RecurrentLayerPolicy, Step, FusedGRU);
+TypePolicyObj(PRecLSTMStep, RecurrentLayerPolicy, Step, LSTM);
 ValuePolicyObj(PEnableBptt,  RecurrentLayerPolicy, UseBptt, true);
 ValuePolicyObj(PDisableBptt,  RecurrentLayerPolicy, UseBptt, false);
+ValuePolicyTemplate(PCheckpointSegment, RecurrentLayerPolicy, CheckpointSegment);
+ValuePolicyTemplate(PBpttWindow, RecurrentLayerPolicy, BpttWindow);
+ValuePolicyTemplate(PBpttLength, RecurrentLayerPolicy, BpttLength);
+ValuePolicyObj(PEnableMemoryReport,  RecurrentLayerPolicy, MemoryReport, true);
+ValuePolicyObj(PDisableMemoryReport,  RecurrentLayerPolicy, MemoryReport, false);
 }
 #include <MetaNN/policies/policy_macro_end.h>
@@ -2,6 +2,7 @@
 
 #include <MetaNN/data/dynamic.h>
 #include <MetaNN/model/grad_col/grad_collector.h>
+#include <list>
 #include <stack>
 #include <stdexcept>
 
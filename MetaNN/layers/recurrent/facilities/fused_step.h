@@ -0,0 +1,319 @@
+#pragma once
+
+#include <MetaNN/data/facilities/lower_access.h>
+#include <MetaNN/data/facilities/traits.h>
+#include <MetaNN/data/matrices/cpu_matrix.h>
+#include <MetaNN/data_copy/data_copy.h>
+#include <MetaNN/evaluate/facilities/eval_buffer.h>
+#include <MetaNN/evaluate/facilities/eval_group.h>
+#include <MetaNN/evaluate/facilities/eval_plan.h>
+#include <MetaNN/evaluate/facilities/eval_unit.h>
+#include <MetaNN/layers/facilities/policies.h>
+#include <MetaNN/model/param_initializer/facilities/traits.h>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace MetaNN
+{
+// The pieces shared by the fused recurrent steps (FusedGruStep, LstmStep): the operators that
+// run a hand-written pass over one or more steps, and the loading / saving of weights stored
+// as column blocks of one matrix.
+namespace NSFusedStep
+{
+// A forward or backward pass computed by TUnit from TOperands, with the output type of TUnit
+// (a matrix or a sequence of length Length())
+template <typename TUnit, typename... TOperands>
+class StepOp
+{
+public:
+    using ElementType = typename TUnit::ElementType;
+    using DeviceType = typename TUnit::DeviceType;
+    using WeightType = typename TUnit::WeightType;
+    using StepDataType = typename TUnit::StepDataType;
+
+public:
+    StepOp(TOperands... opers,
+           WeightType weights,
+           std::shared_ptr<StepDataType> data,
+           size_t rowNum, size_t colNum, size_t length = 1)
+        : m_opers(std::move(opers)...)
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_rowNum(rowNum)
+        , m_colNum(colNum)
+        , m_length(length) {}
+
+    bool operator== (const StepOp& val) const
+    {
+        return m_data == val.m_data;
+    }
+
+    template <typename TOtherType>
+    bool operator== (const TOtherType&) const
+    {
+        return false;
+    }
+
+    template <typename TData>
+    bool operator!= (const TData& val) const
+    {
+        return !(operator==(val));
+    }
+
+    size_t Length() const { return m_length; }
+    size_t RowNum() const { return m_rowNum; }
+    size_t ColNum() const { return m_colNum; }
+
+    auto EvalRegister() const
+    {
+        if (!m_evalBuf.IsEvaluated())
+        {
+            auto handles = std::apply([](const auto&... oper) { return std::make_tuple(oper.EvalRegister()...); },
+                                      m_opers);
+            auto outHandle = m_evalBuf.Handle();
+            const void* dataPtr = outHandle.DataPtr();
+            auto depVec = std::apply([](const auto&... handle) { return std::vector<const void*>{handle.DataPtr()...}; },
+                                     handles);
+
+            auto unit = std::apply([&](auto&... handle)
+                                   {
+                                       return TUnit(std::move(handle)..., m_weights, m_data, std::move(outHandle));
+                                   }, handles);
+            EvalPlan<DeviceType>::template Register<TrivalEvalGroup<TUnit>>(std::move(unit), dataPtr, depVec);
+        }
+        return m_evalBuf.ConstHandle();
+    }
+
+private:
+    std::tuple<TOperands...> m_opers;
+    WeightType m_weights;
+    std::shared_ptr<StepDataType> m_data;
+    size_t m_rowNum;
+    size_t m_colNum;
+    size_t m_length;
+    EvalBuffer<typename TUnit::OutputType> m_evalBuf;
+};
+
+template <typename TElem, typename TDevice, typename TStepData>
+class PartUnit : public BaseEvalUnit<TDevice>
+{
+public:
+    using MemberType = Matrix<TElem, TDevice> TStepData::*;
+
+    PartUnit(std::shared_ptr<TStepData> data, MemberType member,
+             size_t colB, size_t colE,
+             EvalHandle<Matrix<TElem, TDevice>> evalOutput)
+        : m_data(std::move(data))
+        , m_member(member)
+        , m_colB(colB)
+        , m_colE(colE)
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        Matrix<TElem, TDevice> res = (*m_data).*m_member;
+        if ((m_colB != 0) || (m_colE != res.ColNum()))
+        {
+            res.Shrink(0, res.RowNum(), m_colB, m_colE);
+        }
+        m_evalOutput.Allocate(std::move(res));
+        m_evalOutput.SetEval();
+    }
+
+private:
+    std::shared_ptr<TStepData> m_data;
+    MemberType m_member;
+    size_t m_colB;
+    size_t m_colE;
+    EvalHandle<Matrix<TElem, TDevice>> m_evalOutput;
+};
+
+// Columns [colB, colE) of a matrix in TStepData, available once source is evaluated. The
+// result is a view, not a copy.
+template <typename TSource, typename TStepData>
+class Part
+{
+public:
+    using ElementType = typename TSource::ElementType;
+    using DeviceType = typename TSource::DeviceType;
+    using MemberType = typename PartUnit<ElementType, DeviceType, TStepData>::MemberType;
+
+public:
+    Part(TSource source, std::shared_ptr<TStepData> data, MemberType member,
+         size_t rowNum, size_t colB, size_t colE)
+        : m_source(std::move(source))
+        , m_data(std::move(data))
+        , m_member(member)
+        , m_rowNum(rowNum)
+        , m_colB(colB)
+        , m_colE(colE) {}
+
+    bool operator== (const Part& val) const
+    {
+        return (m_data == val.m_data) && (m_member == val.m_member) &&
+               (m_colB == val.m_colB) && (m_colE == val.m_colE);
+    }
+
+    template <typename TOtherType>
+    bool operator== (const TOtherType&) const
+    {
+        return false;
+    }
+
+    template <typename TData>
+    bool operator!= (const TData& val) const
+    {
+        return !(operator==(val));
+    }
+
+    size_t RowNum() const { return m_rowNum; }
+    size_t ColNum() const { return m_colE - m_colB; }
+
+    auto EvalRegister() const
+    {
+        using TEvalUnit = PartUnit<ElementType, DeviceType, TStepData>;
+        if (!m_evalBuf.IsEvaluated())
+        {
+            auto handle = m_source.EvalRegister();
+            auto outHandle = m_evalBuf.Handle();
+            const void* dataPtr = outHandle.DataPtr();
+
+            TEvalUnit unit(m_data, m_member, m_colB, m_colE, std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<TrivalEvalGroup<TEvalUnit>>(std::move(unit), dataPtr,
+                                                                              {handle.DataPtr()});
+        }
+        return m_evalBuf.ConstHandle();
+    }
+
+private:
+    TSource m_source;
+    std::shared_ptr<TStepData> m_data;
+    MemberType m_member;
+    size_t m_rowNum;
+    size_t m_colB;
+    size_t m_colE;
+    EvalBuffer<Matrix<ElementType, DeviceType>> m_evalBuf;
+};
+
+// Column block k of width colNum
+template <typename TElem, typename TDevice>
+Matrix<TElem, TDevice> Slice(Matrix<TElem, TDevice> block, size_t k, size_t colNum)
+{
+    block.Shrink(0, block.RowNum(), k * colNum, (k + 1) * colNum);
+    return block;
+}
+
+// The matrix formed by the entries names of loadBuffer if they are adjacent column blocks of
+// one allocation (e.g. stored by FusedGruStep), an empty matrix otherwise
+template <typename TElem, typename TDevice, typename TBuffer>
+Matrix<TElem, TDevice> AdjacentBlocks(TBuffer& loadBuffer, const std::vector<std::string>& names,
+                                      size_t rowNum, size_t colNum)
+{
+    std::vector<Matrix<TElem, TDevice>> mats;
+    for (const auto& name : names)
+    {
+        auto it = loadBuffer.find(name);
+        if ((it == loadBuffer.end()) || (it->second.RowNum() != rowNum) || (it->second.ColNum() != colNum))
+        {
+            return Matrix<TElem, TDevice>();
+        }
+        mats.push_back(it->second);
+    }
+
+    auto mem = LowerAccess(mats[0]);
+    if (mem.RowLen() < names.size() * colNum)
+    {
+        return Matrix<TElem, TDevice>();
+    }
+    for (size_t k = 1; k < mats.size(); ++k)
+    {
+        const auto cur = LowerAccess(mats[k]);
+        if ((cur.SharedMemory() != mem.SharedMemory()) || (cur.RowLen() != mem.RowLen()) ||
+            (cur.RawMemory() != mem.RawMemory() + k * colNum))
+        {
+            return Matrix<TElem, TDevice>();
+        }
+    }
+    return Matrix<TElem, TDevice>(mem.SharedMemory(), mem.MutableRawMemory(),
+                                  rowNum, names.size() * colNum, mem.RowLen());
+}
+
+inline void Log(std::ostream* log, const std::string& info)
+{
+    if (log)
+    {
+        (*log) << (info + '\n');
+    }
+}
+
+// Fills part, the weight named name within a block, from the load buffer, the initializer or
+// its filler, and stores it in the load buffer
+template <typename TInitPolicies, typename TInitializer, typename TBuffer, typename TElem, typename TDevice>
+void LoadPart(TInitializer& initializer, TBuffer& loadBuffer, std::ostream* log,
+              const std::string& name, Matrix<TElem, TDevice> part)
+{
+    const size_t rowNum = part.RowNum();
+    const size_t colNum = part.ColNum();
+    if (auto cit = loadBuffer.find(name); cit != loadBuffer.end())
+    {
+        const Matrix<TElem, TDevice>& m = cit->second;
+        if ((m.RowNum() != rowNum) || (m.ColNum() != colNum))
+        {
+            throw std::runtime_error("Load matrix error: " + name);
+        }
+        DataCopy(m, part);
+        Log(log, "Load from load buffer: " + name);
+    }
+    else if (initializer.IsMatrixExist(name))
+    {
+        initializer.GetMatrix(name, part);
+        Log(log, "Copy from initializer: " + name);
+    }
+    else
+    {
+        using CurInitializer = PickInitializer<TInitPolicies, InitPolicy::WeightTypeCate>;
+        if constexpr (!std::is_same<CurInitializer, void>::value)
+        {
+            // fillers only write matrices that share their memory with nothing else
+            Matrix<TElem, TDevice> weight(rowNum, colNum);
+            auto& cur_init = initializer.template GetFiller<CurInitializer>();
+            cur_init.Fill(weight, rowNum, colNum);
+            DataCopy(weight, part);
+            Log(log, "Random init from initializer: " + name);
+        }
+        else
+        {
+            throw std::runtime_error("Cannot get initializer for InitPolicy::WeightTypeCate");
+        }
+    }
+    loadBuffer[name] = part;
+}
+
+template <typename TSave, typename TElem, typename TDevice>
+void SavePart(TSave& saver, const std::string& name, const Matrix<TElem, TDevice>& part)
+{
+    typename TSave::const_iterator cit = saver.find(name);
+    if ((cit != saver.end()) && (cit->second != part))
+    {
+        throw std::runtime_error("Duplicate save for matrix: " + name);
+    }
+    saver[name] = part;
+}
+}
+
+template <typename TUnit, typename... TOperands>
+struct DataCategory_<NSFusedStep::StepOp<TUnit, TOperands...>>
+{
+    using type = DataCategory<typename TUnit::OutputType>;
+};
+
+template <typename TSource, typename TStepData>
+struct DataCategory_<NSFusedStep::Part<TSource, TStepData>>
+{
+    using type = CategoryTags::Matrix;
+};
+}
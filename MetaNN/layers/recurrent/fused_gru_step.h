@@ -0,0 +1,836 @@
+#pragma once
+
+#include <MetaNN/data/matrices/zero_matrix.h>
+#include <MetaNN/data/sequence.h>
+#include <MetaNN/data_copy/data_copy.h>
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/layers/facilities/common_io.h>
+#include <MetaNN/layers/facilities/policies.h>
+#include <MetaNN/layers/recurrent/facilities/fused_step.h>
+#include <MetaNN/layers/recurrent/gru_step.h>
+#include <MetaNN/model/param_initializer/facilities/traits.h>
+#include <MetaNN/policies/policy_operations.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace MetaNN
+{
+namespace NSFusedGruStep
+{
+// The values read by the backward pass and by the weight gradients, for one step or for
+// stepNum steps with their rows stacked. gates holds z | r | h_hat side by side, gradPre the
+// gradients of their pre-activations in the same layout. h holds the hidden state before each
+// step, hLast the one after the last step.
+template <typename TElem, typename TDevice>
+struct StepData
+{
+    Matrix<TElem, TDevice> x;
+    Matrix<TElem, TDevice> h;
+    Matrix<TElem, TDevice> gates;
+    Matrix<TElem, TDevice> rh;
+    Matrix<TElem, TDevice> gradPre;
+    Matrix<TElem, TDevice> hLast;
+    size_t stepNum = 1;
+    bool bptt = true;
+};
+
+template <typename TElem, typename TDevice>
+struct Weights
+{
+    Matrix<TElem, TDevice> wcat;    // [Wz | Wr | W]
+    Matrix<TElem, TDevice> ucat;    // [Uz | Ur]
+    Matrix<TElem, TDevice> u;
+};
+
+template <typename TElem, typename TDevice>
+using SequenceType = Sequence<TElem, TDevice, CategoryTags::Matrix>;
+
+template <typename TElem, typename TDevice>
+using OperHandle = DynamicConstEvalHandle<Matrix<TElem, TDevice>>;
+
+template <typename TElem, typename TDevice>
+using SeqHandle = DynamicConstEvalHandle<SequenceType<TElem, TDevice>>;
+
+// The matrices of seq stacked into one, a view if they are stored without gaps
+template <typename TElem>
+Matrix<TElem, DeviceTags::CPU> Stack(const SequenceType<TElem, DeviceTags::CPU>& seq)
+{
+    const size_t stepNum = seq.Length();
+    const size_t rowNum = seq.RowNum();
+    const size_t colNum = seq.ColNum();
+    const auto mem = LowerAccess(seq);
+    if ((mem.RowLen() == colNum) && (mem.RawMatrixSize() == rowNum * colNum))
+    {
+        return Matrix<TElem, DeviceTags::CPU>(LowerAccess(seq[0]).SharedMemory(), (TElem*)mem.RawMemory(),
+                                              stepNum * rowNum, colNum, colNum);
+    }
+
+    Matrix<TElem, DeviceTags::CPU> res(stepNum * rowNum, colNum);
+    TElem* dst = LowerAccess(res).MutableRawMemory();
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        for (size_t i = 0; i < rowNum; ++i)
+        {
+            const TElem* src = mem.RawMemory() + t * mem.RawMatrixSize() + i * mem.RowLen();
+            std::copy(src, src + colNum, dst + (t * rowNum + i) * colNum);
+        }
+    }
+    return res;
+}
+
+// stepNum steps from h0 over the inputs stacked in d.x. The input projections of all steps are
+// one GEMM, only the products with [Uz | Ur] and U run step by step. The new hidden state of
+// step t is written to out + t * bsOut.
+template <typename TElem>
+void Forward(StepData<TElem, DeviceTags::CPU>& d, const Weights<TElem, DeviceTags::CPU>& w,
+             const Matrix<TElem, DeviceTags::CPU>& h0, size_t stepNum,
+             TElem* out, size_t rsOut, size_t bsOut)
+{
+    using TMatrix = Matrix<TElem, DeviceTags::CPU>;
+    const size_t rowNum = h0.RowNum();
+    const size_t inLen = d.x.ColNum();
+    const size_t n = w.u.ColNum();
+    assert((d.x.RowNum() == stepNum * rowNum) && (h0.ColNum() == n));
+    assert(w.wcat.RowNum() == inLen);
+
+    // the hidden states before each step: h0 itself for one step, stacked otherwise
+    d.stepNum = stepNum;
+    TElem* hist = nullptr;
+    if (stepNum == 1)
+    {
+        d.h = h0;
+    }
+    else
+    {
+        d.h = TMatrix(stepNum * rowNum, n);
+        hist = LowerAccess(d.h).MutableRawMemory();
+        const auto mem_h0 = LowerAccess(h0);
+        for (size_t i = 0; i < rowNum; ++i)
+        {
+            std::copy(mem_h0.RawMemory() + i * mem_h0.RowLen(), mem_h0.RawMemory() + i * mem_h0.RowLen() + n,
+                      hist + i * n);
+        }
+    }
+    d.gates = TMatrix(stepNum * rowNum, 3 * n);
+    d.rh = TMatrix(stepNum * rowNum, n);
+
+    const auto mem_x = LowerAccess(d.x);
+    const auto mem_h = LowerAccess(d.h);
+    const auto mem_wcat = LowerAccess(w.wcat);
+    const auto mem_ucat = LowerAccess(w.ucat);
+    const auto mem_u = LowerAccess(w.u);
+
+    const size_t rsH = mem_h.RowLen();
+    TElem* gates = LowerAccess(d.gates).MutableRawMemory();
+    const size_t rsG = 3 * n;
+    TElem* rh = LowerAccess(d.rh).MutableRawMemory();
+
+    // [z | r | h_hat] = x * [Wz | Wr | W] for all steps
+    NSGemm::Gemm(stepNum * rowNum, 3 * n, inLen,
+                 mem_x.RawMemory(), mem_x.RowLen(), 1,
+                 mem_wcat.RawMemory(), mem_wcat.RowLen(), 1,
+                 gates, rsG);
+
+    auto packedUcat = NSGemm::PackCache<TElem>::Instance().Find(mem_ucat.RawMemory(), mem_ucat.RowLen(), 1,
+                                                                n, 2 * n);
+    auto packedU = NSGemm::PackCache<TElem>::Instance().Find(mem_u.RawMemory(), mem_u.RowLen(), 1, n, n);
+    for (size_t t = 0; t < stepNum; ++t)
+    {
+        const TElem* h = mem_h.RawMemory() + t * rowNum * rsH;
+        TElem* hNext = (t + 1 < stepNum) ? hist + (t + 1) * rowNum * rsH : nullptr;
+        TElem* gateT = gates + t * rowNum * rsG;
+        TElem* rhT = rh + t * rowNum * n;
+        TElem* outT = out + t * bsOut;
+
+        // [z | r] += h * [Uz | Ur], the sigmoid and r * h are applied on the last store
+        auto gateFun = [=](size_t, size_t row, size_t col, TElem value)
+        {
+            const TElem g = 1 / (1 + std::exp(-value));
+            if (col >= n)
+            {
+                rhT[row * n + col - n] = g * h[row * rsH + col - n];
+            }
+            return g;
+        };
+        NSGemm::GemmImpl(1, rowNum, 2 * n, n, h, rsH, 1, 0,
+                         mem_ucat.RawMemory(), mem_ucat.RowLen(), NSGemm::StridedColumn{1},
+                         gateT, rsG, NSGemm::StridedColumn{1}, 0,
+                         packedUcat.get(), true, NSGemm::MakeEpilogue(gateFun));
+
+        // h_hat += (r * h) * U, then tanh and the new hidden state z * h_hat + (1 - z) * h
+        auto outFun = [=](size_t, size_t row, size_t col, TElem value)
+        {
+            const TElem hHat = std::tanh(value);
+            const TElem z = gateT[row * rsG + col];
+            const TElem res = z * hHat + (1 - z) * h[row * rsH + col];
+            outT[row * rsOut + col] = res;
+            if (hNext)
+            {
+                hNext[row * rsH + col] = res;
+            }
+            return hHat;
+        };
+        NSGemm::GemmImpl(1, rowNum, n, n, rhT, n, 1, 0,
+                         mem_u.RawMemory(), mem_u.RowLen(), NSGemm::StridedColumn{1},
+                         gateT + 2 * n, rsG, NSGemm::StridedColumn{1}, 0,
+                         packedU.get(), true, NSGemm::MakeEpilogue(outFun));
+    }
+}
+
+// The backward pass of Forward, from the last step to the first. dY + t * bsDY is the gradient
+// of the output of step t, gradLast (if not null) a further gradient of the last output. With
+// bptt the gradient of each hidden state is carried into the step before it. d.gradPre is
+// filled for all steps, dh receives the gradient of h0.
+template <typename TElem>
+void Backward(StepData<TElem, DeviceTags::CPU>& d, const Weights<TElem, DeviceTags::CPU>& w,
+              const TElem* dY, size_t rsDY, size_t bsDY, const TElem* gradLast, size_t rsLast,
+              TElem* dh, size_t rsDh)
+{
+    const size_t stepNum = d.stepNum;
+    const size_t rowNum = d.gates.RowNum() / stepNum;
+    const size_t n = w.u.ColNum();
+    d.gradPre = Matrix<TElem, DeviceTags::CPU>(stepNum * rowNum, 3 * n);
+
+    const auto mem_h = LowerAccess(d.h);
+    const auto mem_ucat = LowerAccess(w.ucat);
+    const auto mem_u = LowerAccess(w.u);
+
+    const size_t rsH = mem_h.RowLen();
+    const TElem* gates = LowerAccess(d.gates).RawMemory();
+    const size_t rsG = 3 * n;
+    TElem* gradPre = LowerAccess(d.gradPre).MutableRawMemory();
+
+    auto packedU = NSGemm::PackCache<TElem>::Instance().Find(mem_u.RawMemory(), 1, mem_u.RowLen(), n, n);
+    for (size_t t = stepNum; t-- > 0;)
+    {
+        const bool carry = d.bptt && (t + 1 < stepNum);
+        const TElem* last = (t + 1 == stepNum) ? gradLast : nullptr;
+        const TElem* dYT = dY + t * bsDY;
+        const TElem* h = mem_h.RawMemory() + t * rowNum * rsH;
+        const TElem* gateT = gates + t * rowNum * rsG;
+        TElem* preT = gradPre + t * rowNum * rsG;
+
+        // the gradients of the pre-activations of z and h_hat, and the direct path to h
+        ParallelFor(rowNum, 8 * n, [&](size_t rowB, size_t rowE)
+                    {
+                        for (size_t i = rowB; i < rowE; ++i)
+                        {
+                            const TElem* dYRow = dYT + i * rsDY;
+                            const TElem* lastRow = last ? last + i * rsLast : nullptr;
+                            const TElem* hRow = h + i * rsH;
+                            const TElem* gateRow = gateT + i * rsG;
+                            TElem* preRow = preT + i * rsG;
+                            TElem* dhRow = dh + i * rsDh;
+                            for (size_t j = 0; j < n; ++j)
+                            {
+                                TElem g = dYRow[j];
+                                if (carry) g += dhRow[j];
+                                if (lastRow) g += lastRow[j];
+                                const TElem z = gateRow[j];
+                                const TElem hHat = gateRow[2 * n + j];
+                                preRow[j] = g * (hHat - hRow[j]) * z * (1 - z);
+                                preRow[2 * n + j] = g * z * (1 - hHat * hHat);
+                                dhRow[j] = g * (1 - z);
+                            }
+                        }
+                    });
+
+        // d(r * h) = gradPre_hat * U^T, turned into the gradient of the pre-activation of r
+        // on the last store
+        auto resetFun = [=](size_t, size_t row, size_t col, TElem value)
+        {
+            const TElem r = gateT[row * rsG + n + col];
+            dh[row * rsDh + col] += value * r;
+            return value * h[row * rsH + col] * r * (1 - r);
+        };
+        NSGemm::GemmImpl(1, rowNum, n, n, preT + 2 * n, rsG, 1, 0,
+                         mem_u.RawMemory(), 1, NSGemm::StridedColumn{mem_u.RowLen()},
+                         preT + n, rsG, NSGemm::StridedColumn{1}, 0,
+                         packedU.get(), false, NSGemm::MakeEpilogue(resetFun));
+
+        // dh += [gradPre_z | gradPre_r] * [Uz | Ur]^T
+        NSGemm::GemmSum(1, rowNum, n, 2 * n, (const TElem*)preT, rsG, 1, 0,
+                        mem_ucat.RawMemory(), 1, mem_ucat.RowLen(), 0,
+                        dh, rsDh);
+    }
+}
+
+template <typename TElem, typename TDevice>
+class ForwardUnit;
+
+// oper1: x, oper2: the hidden state before the step; the output is the new hidden state
+template <typename TElem>
+class ForwardUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = Matrix<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    ForwardUnit(OperHandle<TElem, DeviceType> oper1,
+                OperHandle<TElem, DeviceType> oper2,
+                Weights<TElem, DeviceType> weights,
+                std::shared_ptr<StepData<TElem, DeviceType>> data,
+                EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        auto& d = *m_data;
+        d.x = m_oper1.Data();
+        m_evalOutput.Allocate(d.x.RowNum(), m_weights.u.ColNum());
+        auto mem_out = LowerAccess(m_evalOutput.MutableData());
+        Forward(d, m_weights, m_oper2.Data(), 1, mem_out.MutableRawMemory(), mem_out.RowLen(), 0);
+        m_evalOutput.SetEval();
+    }
+
+private:
+    OperHandle<TElem, DeviceType> m_oper1;
+    OperHandle<TElem, DeviceType> m_oper2;
+    Weights<TElem, DeviceType> m_weights;
+    std::shared_ptr<StepData<TElem, DeviceType>> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+
+template <typename TElem, typename TDevice>
+class BackwardUnit;
+
+// oper1: the gradient of the new hidden state, oper2: the forward step (only read for the
+// evaluation order). The output is the gradient of the hidden state before the step.
+template <typename TElem>
+class BackwardUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = Matrix<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    BackwardUnit(OperHandle<TElem, DeviceType> oper1,
+                 OperHandle<TElem, DeviceType> oper2,
+                 Weights<TElem, DeviceType> weights,
+                 std::shared_ptr<StepData<TElem, DeviceType>> data,
+                 EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& grad = m_oper1.Data();
+        assert((grad.RowNum() == m_data->gates.RowNum()) && (grad.ColNum() == m_weights.u.ColNum()));
+
+        m_evalOutput.Allocate(grad.RowNum(), grad.ColNum());
+        const auto mem_grad = LowerAccess(grad);
+        auto mem_out = LowerAccess(m_evalOutput.MutableData());
+        Backward(*m_data, m_weights, mem_grad.RawMemory(), mem_grad.RowLen(), 0, (const TElem*)nullptr, 0,
+                 mem_out.MutableRawMemory(), mem_out.RowLen());
+        m_evalOutput.SetEval();
+    }
+
+private:
+    OperHandle<TElem, DeviceType> m_oper1;
+    OperHandle<TElem, DeviceType> m_oper2;
+    Weights<TElem, DeviceType> m_weights;
+    std::shared_ptr<StepData<TElem, DeviceType>> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+
+template <typename TElem, typename TDevice>
+class SeqForwardUnit;
+
+// oper1: the input sequence, oper2: the hidden state before it; the output is the sequence of
+// the hidden states after each step
+template <typename TElem>
+class SeqForwardUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = SequenceType<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    SeqForwardUnit(SeqHandle<TElem, DeviceType> oper1,
+                   OperHandle<TElem, DeviceType> oper2,
+                   Weights<TElem, DeviceType> weights,
+                   std::shared_ptr<StepData<TElem, DeviceType>> data,
+                   EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        auto& d = *m_data;
+        const auto& xs = m_oper1.Data();
+        const size_t stepNum = xs.Length();
+        d.x = Stack(xs);
+        m_evalOutput.Allocate(stepNum, xs.RowNum(), m_weights.u.ColNum());
+        auto& out = m_evalOutput.MutableData();
+        auto mem_out = LowerAccess(out);
+        Forward(d, m_weights, m_oper2.Data(), stepNum,
+                mem_out.MutableRawMemory(), mem_out.RowLen(), mem_out.RawMatrixSize());
+        d.hLast = out[stepNum - 1];
+        m_evalOutput.SetEval();
+    }
+
+private:
+    SeqHandle<TElem, DeviceType> m_oper1;
+    OperHandle<TElem, DeviceType> m_oper2;
+    Weights<TElem, DeviceType> m_weights;
+    std::shared_ptr<StepData<TElem, DeviceType>> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+
+template <typename TElem, typename TDevice>
+class SeqBackwardUnit;
+
+// oper1: the gradients of the outputs of a sequence, oper2: a further gradient of the last
+// output, oper3: the forward pass (only read for the evaluation order). The output is the
+// gradient of the hidden state before the sequence.
+template <typename TElem>
+class SeqBackwardUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = Matrix<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    SeqBackwardUnit(SeqHandle<TElem, DeviceType> oper1,
+                    OperHandle<TElem, DeviceType> oper2,
+                    OperHandle<TElem, DeviceType> oper3,
+                    Weights<TElem, DeviceType> weights,
+                    std::shared_ptr<StepData<TElem, DeviceType>> data,
+                    EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_oper3(std::move(oper3))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& grads = m_oper1.Data();
+        const auto& gradLast = m_oper2.Data();
+        const size_t n = m_weights.u.ColNum();
+        if ((grads.Length() != m_data->stepNum) || (grads.RowNum() * grads.Length() != m_data->gates.RowNum()) ||
+            (grads.ColNum() != n))
+        {
+            throw std::runtime_error("The gradient does not match the forward sequence");
+        }
+        assert((gradLast.RowNum() == grads.RowNum()) && (gradLast.ColNum() == n));
+
+        m_evalOutput.Allocate(grads.RowNum(), n);
+        const auto mem_grads = LowerAccess(grads);
+        const auto mem_last = LowerAccess(gradLast);
+        auto mem_out = LowerAccess(m_evalOutput.MutableData());
+        Backward(*m_data, m_weights, mem_grads.RawMemory(), mem_grads.RowLen(), mem_grads.RawMatrixSize(),
+                 mem_last.RawMemory(), mem_last.RowLen(), mem_out.MutableRawMemory(), mem_out.RowLen());
+        m_evalOutput.SetEval();
+    }
+
+private:
+    SeqHandle<TElem, DeviceType> m_oper1;
+    OperHandle<TElem, DeviceType> m_oper2;
+    OperHandle<TElem, DeviceType> m_oper3;
+    Weights<TElem, DeviceType> m_weights;
+    std::shared_ptr<StepData<TElem, DeviceType>> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+
+template <typename TElem, typename TDevice>
+class SeqInputGradUnit;
+
+// oper1: the backward pass of a sequence (only read for the evaluation order). The output is the
+// sequence of the gradients of the inputs, gradPre * [Wz | Wr | W]^T for all steps in one GEMM.
+template <typename TElem>
+class SeqInputGradUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = SequenceType<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    SeqInputGradUnit(OperHandle<TElem, DeviceType> oper1,
+                     Weights<TElem, DeviceType> weights,
+                     std::shared_ptr<StepData<TElem, DeviceType>> data,
+                     EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& d = *m_data;
+        const size_t stepNum = d.stepNum;
+        const size_t totalRow = d.gradPre.RowNum();
+        const size_t inLen = m_weights.wcat.RowNum();
+        const size_t n = m_weights.u.ColNum();
+
+        m_evalOutput.Allocate(stepNum, totalRow / stepNum, inLen);
+        auto mem_out = LowerAccess(m_evalOutput.MutableData());
+        const auto mem_wcat = LowerAccess(m_weights.wcat);
+        NSGemm::Gemm(totalRow, inLen, 3 * n,
+                     LowerAccess(d.gradPre).RawMemory(), 3 * n, 1,
+                     mem_wcat.RawMemory(), 1, mem_wcat.RowLen(),
+                     mem_out.MutableRawMemory(), mem_out.RowLen());
+        m_evalOutput.SetEval();
+    }
+
+private:
+    OperHandle<TElem, DeviceType> m_oper1;
+    Weights<TElem, DeviceType> m_weights;
+    std::shared_ptr<StepData<TElem, DeviceType>> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+}
+
+using GruSequenceOutput = VarTypeDict<RnnLayerHiddenAfter,
+                                     LayerIO>;
+
+// The GRU step of GruStep with the gate weights stored side by side: x * [Wz | Wr | W] and
+// h * [Uz | Ur] are one GEMM each, and the activations, r * h and the interpolation of the
+// output are applied in the epilogues of the GEMMs. The backward pass is fused in the same way.
+// The weights keep the names of GruStep (e.g. name-Wz), each one is a view of its block.
+// Only matrices are supported as input, with one sample per row.
+//
+// FeedForwardSequence / FeedBackwardSequence process a whole sequence of such matrices (several
+// sequences of one length are rows of the same matrices): the input projections of all steps
+// are one GEMM, as are the input gradients and each weight gradient. Only the products with
+// [Uz | Ur] and U run step by step. The output and its gradient are GruSequenceOutput, with the
+// hidden state after the last step as RnnLayerHiddenAfter.
+template <typename TPolicies>
+class FusedGruStep
+{
+    static_assert(IsPolicyContainer<TPolicies>, "TPolicies is not a policy container.");
+    using CurLayerPolicy = PlainPolicy<TPolicies>;
+
+public:
+    static constexpr bool IsFeedbackOutput = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsFeedbackOutput;
+    static constexpr bool IsUpdate = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsUpdate;
+    using InputType = GruInput;
+    using OutputType = LayerIO;
+
+private:
+    using ElementType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Element;
+    using DeviceType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Device;
+    static_assert(!PolicySelect<InputPolicy, CurLayerPolicy>::BatchMode,
+                  "FusedGruStep takes matrices with one sample per row, not batches");
+    static constexpr bool UseBptt = PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::UseBptt;
+
+    using DataType = DynamicData<ElementType, DeviceType, CategoryTags::Matrix>;
+    using SeqDataType = DynamicData<ElementType, DeviceType, CategoryTags::MatrixSequence>;
+    using StepDataType = NSFusedGruStep::StepData<ElementType, DeviceType>;
+    using ForwardOp = NSFusedStep::StepOp<NSFusedGruStep::ForwardUnit<ElementType, DeviceType>,
+                                          DataType, DataType>;
+    using BackwardOp = NSFusedStep::StepOp<NSFusedGruStep::BackwardUnit<ElementType, DeviceType>,
+                                           DataType, DataType>;
+    using SeqForwardOp = NSFusedStep::StepOp<NSFusedGruStep::SeqForwardUnit<ElementType, DeviceType>,
+                                             SeqDataType, DataType>;
+    using SeqBackwardOp = NSFusedStep::StepOp<NSFusedGruStep::SeqBackwardUnit<ElementType, DeviceType>,
+                                              SeqDataType, DataType, DataType>;
+    using SeqInputGradOp = NSFusedStep::StepOp<NSFusedGruStep::SeqInputGradUnit<ElementType, DeviceType>,
+                                               DataType>;
+    using PartType = NSFusedStep::Part<DataType, StepDataType>;
+
+    // forward and backward are the new hidden state and the gradient of the one before, for a
+    // sequence the one after its last step and the one before its first step. rowNum counts the
+    // rows of all steps.
+    struct StepRecord
+    {
+        std::shared_ptr<StepDataType> data;
+        DataType forward;
+        DataType backward;
+        size_t rowNum;
+        bool sequence;
+    };
+
+public:
+    FusedGruStep(const std::string& p_name, size_t p_inLen, size_t p_outLen)
+        : m_name(p_name)
+        , m_inputLen(p_inLen)
+        , m_outputLen(p_outLen)
+    {
+        if ((m_inputLen == 0) || (m_outputLen == 0))
+        {
+            throw std::runtime_error("Invalidate matrix size for fused GRU step");
+        }
+    }
+
+public:
+    template <typename TInitializer, typename TBuffer,
+              typename TInitPolicies = typename TInitializer::PolicyCont>
+    void Init(TInitializer& initializer, TBuffer& loadBuffer, std::ostream* log = nullptr)
+    {
+        m_weights.wcat = InitBlock<TInitPolicies>(initializer, loadBuffer, log, {"-Wz", "-Wr", "-W"}, m_inputLen);
+        m_weights.ucat = InitBlock<TInitPolicies>(initializer, loadBuffer, log, {"-Uz", "-Ur"}, m_outputLen);
+        m_weights.u = InitBlock<TInitPolicies>(initializer, loadBuffer, log, {"-U"}, m_outputLen);
+    }
+
+    template <typename TSave>
+    void SaveWeights(TSave& saver) const
+    {
+        SaveBlock(saver, m_weights.wcat, {"-Wz", "-Wr", "-W"});
+        SaveBlock(saver, m_weights.ucat, {"-Uz", "-Ur"});
+        SaveBlock(saver, m_weights.u, {"-U"});
+    }
+
+    template <typename TIn>
+    auto FeedForward(const TIn& p_in)
+    {
+        const auto& x = p_in.template Get<LayerIO>();
+        const auto& h = p_in.template Get<RnnLayerHiddenBefore>();
+        static_assert(!std::is_same<RemConstRef<decltype(x)>, NullParameter>::value, "parameter is invalid");
+        static_assert(!std::is_same<RemConstRef<decltype(h)>, NullParameter>::value, "parameter is invalid");
+
+        auto data = std::make_shared<StepDataType>();
+        ForwardOp res(MakeDynamic(x), MakeDynamic(h), m_weights, data, x.RowNum(), m_outputLen);
+        if constexpr (IsUpdate || IsFeedbackOutput)
+        {
+            m_forward.push(StepRecord{data, MakeDynamic(res), DataType(), x.RowNum(), false});
+        }
+        return LayerIO::Create().template Set<LayerIO>(std::move(res));
+    }
+
+    // p_in: the input sequence as LayerIO, the hidden state before it as RnnLayerHiddenBefore
+    template <typename TIn>
+    auto FeedForwardSequence(const TIn& p_in)
+    {
+        const auto& x = p_in.template Get<LayerIO>();
+        const auto& h = p_in.template Get<RnnLayerHiddenBefore>();
+        static_assert(!std::is_same<RemConstRef<decltype(x)>, NullParameter>::value, "parameter is invalid");
+        static_assert(!std::is_same<RemConstRef<decltype(h)>, NullParameter>::value, "parameter is invalid");
+        if (x.Length() == 0)
+        {
+            throw std::runtime_error("Empty sequence for fused GRU step");
+        }
+
+        const size_t rowNum = x.RowNum();
+        auto data = std::make_shared<StepDataType>();
+        data->bptt = UseBptt;
+        SeqForwardOp res(MakeDynamic(x), MakeDynamic(h), m_weights, data, rowNum, m_outputLen, x.Length());
+        DataType last = MakeDynamic(NSFusedStep::Part<SeqDataType, StepDataType>(MakeDynamic(res), data,
+                                                                                  &StepDataType::hLast,
+                                                                                  rowNum, 0, m_outputLen));
+        if constexpr (IsUpdate || IsFeedbackOutput)
+        {
+            m_forward.push(StepRecord{data, last, DataType(), rowNum * x.Length(), true});
+        }
+        return GruSequenceOutput::Create().template Set<LayerIO>(std::move(res))
+                                          .template Set<RnnLayerHiddenAfter>(std::move(last));
+    }
+
+    template <typename TGrad>
+    auto FeedBackward(const TGrad& p_grad)
+    {
+        if constexpr ((!IsFeedbackOutput) && (!IsUpdate))
+        {
+            return OutputType::Create();
+        }
+        else
+        {
+            if (m_forward.empty())
+            {
+                throw std::runtime_error("Cannot do FeedBackward for fused GRU step");
+            }
+            if (m_forward.top().sequence)
+            {
+                throw std::runtime_error("FeedBackward after FeedForwardSequence for fused GRU step");
+            }
+            StepRecord rec = std::move(m_forward.top());
+            m_forward.pop();
+
+            const auto& grad = p_grad.template Get<LayerIO>();
+            const size_t rowNum = grad.RowNum();
+            rec.backward = MakeDynamic(BackwardOp(MakeDynamic(grad), rec.forward, m_weights, rec.data,
+                                                  rowNum, m_outputLen));
+            auto gradHidden = rec.backward;
+            if constexpr (IsUpdate)
+            {
+                m_backward.push_back(rec);
+            }
+
+            if constexpr (IsFeedbackOutput)
+            {
+                PartType gradPre(rec.backward, rec.data, &StepDataType::gradPre, rowNum, 0, 3 * m_outputLen);
+                auto gradInput = Dot(std::move(gradPre), Transpose(m_weights.wcat));
+                return InputType::Create().template Set<RnnLayerHiddenBefore>(std::move(gradHidden))
+                                          .template Set<LayerIO>(std::move(gradInput));
+            }
+            else
+            {
+                return InputType::Create();
+            }
+        }
+    }
+
+    // p_grad: the gradients of the outputs of the sequence as LayerIO, optionally a further
+    // gradient of its last output as RnnLayerHiddenAfter (e.g. from the sequence that followed).
+    // The result holds the gradient of the input sequence as LayerIO and the gradient of the
+    // hidden state before it as RnnLayerHiddenBefore.
+    template <typename TGrad>
+    auto FeedBackwardSequence(const TGrad& p_grad)
+    {
+        if constexpr ((!IsFeedbackOutput) && (!IsUpdate))
+        {
+            return OutputType::Create();
+        }
+        else
+        {
+            if (m_forward.empty() || (!m_forward.top().sequence))
+            {
+                throw std::runtime_error("Cannot do FeedBackwardSequence for fused GRU step");
+            }
+            StepRecord rec = std::move(m_forward.top());
+            m_forward.pop();
+
+            const auto& grad = p_grad.template Get<LayerIO>();
+            const auto& gradLast = p_grad.template Get<RnnLayerHiddenAfter>();
+            const size_t rowNum = grad.RowNum();
+            const size_t stepNum = grad.Length();
+            DataType carry;
+            if constexpr (std::is_same<RemConstRef<decltype(gradLast)>, NullParameter>::value)
+            {
+                carry = MakeDynamic(ZeroMatrix<ElementType, DeviceType>(rowNum, m_outputLen));
+            }
+            else
+            {
+                carry = MakeDynamic(gradLast);
+            }
+            rec.backward = MakeDynamic(SeqBackwardOp(MakeDynamic(grad), std::move(carry), rec.forward,
+                                                     m_weights, rec.data, rowNum, m_outputLen));
+            auto gradHidden = rec.backward;
+            if constexpr (IsUpdate)
+            {
+                m_backward.push_back(rec);
+            }
+
+            if constexpr (IsFeedbackOutput)
+            {
+                SeqInputGradOp gradInput(rec.backward, m_weights, rec.data, rowNum, m_inputLen, stepNum);
+                return InputType::Create().template Set<RnnLayerHiddenBefore>(std::move(gradHidden))
+                                          .template Set<LayerIO>(std::move(gradInput));
+            }
+            else
+            {
+                return InputType::Create();
+            }
+        }
+    }
+
+    template <typename TGradCollector>
+    void GradCollect(TGradCollector& col)
+    {
+        if constexpr (IsUpdate)
+        {
+            const size_t n = m_outputLen;
+            for (const auto& rec : m_backward)
+            {
+                const size_t rowNum = rec.rowNum;
+                PartType x(rec.forward, rec.data, &StepDataType::x, rowNum, 0, m_inputLen);
+                PartType h(rec.forward, rec.data, &StepDataType::h, rowNum, 0, n);
+                PartType rh(rec.forward, rec.data, &StepDataType::rh, rowNum, 0, n);
+                PartType gradPre(rec.backward, rec.data, &StepDataType::gradPre, rowNum, 0, 3 * n);
+                PartType gradPreZR(rec.backward, rec.data, &StepDataType::gradPre, rowNum, 0, 2 * n);
+                PartType gradPreHat(rec.backward, rec.data, &StepDataType::gradPre, rowNum, 2 * n, 3 * n);
+
+                col.Collect(m_weights.wcat, Dot(Transpose(std::move(x)), std::move(gradPre)));
+                col.Collect(m_weights.ucat, Dot(Transpose(std::move(h)), std::move(gradPreZR)));
+                col.Collect(m_weights.u, Dot(Transpose(std::move(rh)), std::move(gradPreHat)));
+            }
+            m_backward.clear();
+        }
+    }
+
+    void NeutralInvariant() const
+    {
+        if ((!m_forward.empty()) || (!m_backward.empty()))
+        {
+            throw std::runtime_error("NeutralInvariant Fail!");
+        }
+    }
+
+private:
+    // A block of weights named name + suffixes[k] side by side, each one rowNum * m_outputLen
+    template <typename TInitPolicies, typename TInitializer, typename TBuffer>
+    Matrix<ElementType, DeviceType> InitBlock(TInitializer& initializer, TBuffer& loadBuffer, std::ostream* log,
+                                              const std::vector<std::string>& suffixes, size_t rowNum)
+    {
+        std::vector<std::string> names;
+        for (const auto& suffix : suffixes)
+        {
+            names.push_back(m_name + suffix);
+        }
+
+        auto block = NSFusedStep::AdjacentBlocks<ElementType, DeviceType>(loadBuffer, names, rowNum, m_outputLen);
+        if (block.RowNum() != 0)
+        {
+            EnablePackCache(block);
+            for (const auto& name : names)
+            {
+                NSFusedStep::Log(log, "Load from load buffer: " + name);
+            }
+            return block;
+        }
+
+        block = Matrix<ElementType, DeviceType>(rowNum, names.size() * m_outputLen);
+        for (size_t k = 0; k < names.size(); ++k)
+        {
+            NSFusedStep::LoadPart<TInitPolicies>(initializer, loadBuffer, log, names[k],
+                                                 NSFusedStep::Slice(block, k, m_outputLen));
+        }
+        EnablePackCache(block);
+        return block;
+    }
+
+    template <typename TSave>
+    void SaveBlock(TSave& saver, const Matrix<ElementType, DeviceType>& block,
+                   const std::vector<std::string>& suffixes) const
+    {
+        for (size_t k = 0; k < suffixes.size(); ++k)
+        {
+            NSFusedStep::SavePart(saver, m_name + suffixes[k], NSFusedStep::Slice(block, k, m_outputLen));
+        }
+    }
+
+private:
+    const std::string m_name;
+    const size_t m_inputLen;
+    const size_t m_outputLen;
+
+    NSFusedGruStep::Weights<ElementType, DeviceType> m_weights;
+    std::stack<StepRecord, std::list<StepRecord>> m_forward;
+    std::vector<StepRecord> m_backward;
+};
+}
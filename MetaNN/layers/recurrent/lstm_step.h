@@ -0,0 +1,557 @@
+#pragma once
+
+#include <MetaNN/data/matrices/zero_matrix.h>
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/layers/facilities/common_io.h>
+#include <MetaNN/layers/facilities/policies.h>
+#include <MetaNN/layers/recurrent/facilities/fused_step.h>
+#include <MetaNN/policies/policy_operations.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace MetaNN
+{
+namespace NSLstmStep
+{
+// The values read by the backward pass and by the weight gradient. xh holds [x | h] for the
+// state [h | c] before the step and c its cell state, gates the activated i | f | o | g side
+// by side and tc = tanh(c') of the new cell state. state is the output [h' | c'], gradPre the
+// gradients of the pre-activations of the gates, grad the gradients [dx | dh | dc] of the inputs.
+template <typename TElem, typename TDevice>
+struct StepData
+{
+    Matrix<TElem, TDevice> xh;
+    Matrix<TElem, TDevice> c;
+    Matrix<TElem, TDevice> gates;
+    Matrix<TElem, TDevice> tc;
+    Matrix<TElem, TDevice> state;
+    Matrix<TElem, TDevice> gradPre;
+    Matrix<TElem, TDevice> grad;
+    bool feedback = true;
+};
+
+template <typename TElem, typename TDevice>
+struct Weights
+{
+    Matrix<TElem, TDevice> wcat;    // [Wi | Wf | Wo | Wg] above [Ui | Uf | Uo | Ug]
+};
+
+template <typename TElem, typename TDevice>
+using OperHandle = DynamicConstEvalHandle<Matrix<TElem, TDevice>>;
+
+// One step from the state [h | c] over the input x, the new state [h' | c'] is written to out
+template <typename TElem>
+void Forward(StepData<TElem, DeviceTags::CPU>& d, const Weights<TElem, DeviceTags::CPU>& w,
+             const Matrix<TElem, DeviceTags::CPU>& x, const Matrix<TElem, DeviceTags::CPU>& state,
+             Matrix<TElem, DeviceTags::CPU> out)
+{
+    using TMatrix = Matrix<TElem, DeviceTags::CPU>;
+    const size_t rowNum = x.RowNum();
+    const size_t inLen = x.ColNum();
+    const size_t n = out.ColNum() / 2;
+    const size_t xhLen = inLen + n;
+    assert((state.RowNum() == rowNum) && (state.ColNum() == 2 * n) && (out.RowNum() == rowNum));
+    assert((w.wcat.RowNum() == xhLen) && (w.wcat.ColNum() == 4 * n));
+
+    d.xh = TMatrix(rowNum, xhLen);
+    d.c = state;
+    d.c.Shrink(0, rowNum, n, 2 * n);
+    d.gates = TMatrix(rowNum, 4 * n);
+    d.tc = TMatrix(rowNum, n);
+    d.state = out;
+
+    const auto mem_x = LowerAccess(x);
+    const auto mem_c = LowerAccess(d.c);
+    const auto mem_state = LowerAccess(state);
+    const auto mem_wcat = LowerAccess(w.wcat);
+    auto mem_out = LowerAccess(out);
+
+    TElem* xh = LowerAccess(d.xh).MutableRawMemory();
+    TElem* gates = LowerAccess(d.gates).MutableRawMemory();
+    TElem* tc = LowerAccess(d.tc).MutableRawMemory();
+    TElem* res = mem_out.MutableRawMemory();
+    const TElem* c = mem_c.RawMemory();
+    const size_t rsC = mem_c.RowLen();
+    const size_t rsOut = mem_out.RowLen();
+
+    for (size_t i = 0; i < rowNum; ++i)
+    {
+        const TElem* xRow = mem_x.RawMemory() + i * mem_x.RowLen();
+        const TElem* hRow = mem_state.RawMemory() + i * mem_state.RowLen();
+        std::copy(xRow, xRow + inLen, xh + i * xhLen);
+        std::copy(hRow, hRow + n, xh + i * xhLen + inLen);
+    }
+
+    // [i | f | o | g] = [x | h] * [W ; U], the sigmoid of i, f, o and the tanh of g are applied
+    // on the last store
+    auto gateFun = [n](size_t, size_t, size_t col, TElem value) -> TElem
+    {
+        return (col < 3 * n) ? 1 / (1 + std::exp(-value)) : std::tanh(value);
+    };
+    NSGemm::Gemm(rowNum, 4 * n, xhLen,
+                 (const TElem*)xh, xhLen, 1,
+                 mem_wcat.RawMemory(), mem_wcat.RowLen(), 1,
+                 gates, 4 * n, NSGemm::MakeEpilogue(gateFun));
+
+    // c' = f * c + i * g and h' = o * tanh(c'), row by row over contiguous gate blocks
+    ParallelFor(rowNum, 8 * n, [&](size_t rowB, size_t rowE)
+                {
+                    for (size_t r = rowB; r < rowE; ++r)
+                    {
+                        const TElem* gi = gates + r * 4 * n;
+                        const TElem* gf = gi + n;
+                        const TElem* go = gi + 2 * n;
+                        const TElem* gg = gi + 3 * n;
+                        const TElem* cRow = c + r * rsC;
+                        TElem* hOut = res + r * rsOut;
+                        TElem* cOut = hOut + n;
+                        TElem* tRow = tc + r * n;
+                        for (size_t j = 0; j < n; ++j)
+                        {
+                            cOut[j] = gf[j] * cRow[j] + gi[j] * gg[j];
+                        }
+                        for (size_t j = 0; j < n; ++j)
+                        {
+                            tRow[j] = std::tanh(cOut[j]);
+                            hOut[j] = go[j] * tRow[j];
+                        }
+                    }
+                });
+}
+
+// The backward pass of Forward from the gradients of h' and of [h' | c']. d.gradPre is filled,
+// out receives [dx | dh | dc]; dx and dh only with d.feedback.
+template <typename TElem>
+void Backward(StepData<TElem, DeviceTags::CPU>& d, const Weights<TElem, DeviceTags::CPU>& w,
+              const Matrix<TElem, DeviceTags::CPU>& gradOut, const Matrix<TElem, DeviceTags::CPU>& gradState,
+              Matrix<TElem, DeviceTags::CPU> out)
+{
+    const size_t rowNum = d.gates.RowNum();
+    const size_t n = d.tc.ColNum();
+    const size_t xhLen = d.xh.ColNum();
+    const size_t inLen = xhLen - n;
+    assert((gradOut.RowNum() == rowNum) && (gradOut.ColNum() == n));
+    assert((gradState.RowNum() == rowNum) && (gradState.ColNum() == 2 * n));
+    assert((out.RowNum() == rowNum) && (out.ColNum() == inLen + 2 * n));
+
+    d.gradPre = Matrix<TElem, DeviceTags::CPU>(rowNum, 4 * n);
+    d.grad = out;
+
+    const auto mem_gradOut = LowerAccess(gradOut);
+    const auto mem_gradState = LowerAccess(gradState);
+    const auto mem_c = LowerAccess(d.c);
+    const auto mem_wcat = LowerAccess(w.wcat);
+    auto mem_out = LowerAccess(out);
+
+    const TElem* gates = LowerAccess(d.gates).RawMemory();
+    const TElem* tc = LowerAccess(d.tc).RawMemory();
+    TElem* gradPre = LowerAccess(d.gradPre).MutableRawMemory();
+    TElem* res = mem_out.MutableRawMemory();
+    const size_t rsOut = mem_out.RowLen();
+
+    // the gradients of all pre-activations and of c in one pass
+    ParallelFor(rowNum, 16 * n, [&](size_t rowB, size_t rowE)
+                {
+                    for (size_t r = rowB; r < rowE; ++r)
+                    {
+                        const TElem* dOutRow = mem_gradOut.RawMemory() + r * mem_gradOut.RowLen();
+                        const TElem* dStateRow = mem_gradState.RawMemory() + r * mem_gradState.RowLen();
+                        const TElem* cRow = mem_c.RawMemory() + r * mem_c.RowLen();
+                        const TElem* gateRow = gates + r * 4 * n;
+                        const TElem* tRow = tc + r * n;
+                        TElem* preRow = gradPre + r * 4 * n;
+                        TElem* dcRow = res + r * rsOut + inLen + n;
+                        for (size_t j = 0; j < n; ++j)
+                        {
+                            const TElem i = gateRow[j];
+                            const TElem f = gateRow[n + j];
+                            const TElem o = gateRow[2 * n + j];
+                            const TElem g = gateRow[3 * n + j];
+                            const TElem t = tRow[j];
+                            const TElem dh = dOutRow[j] + dStateRow[j];
+                            const TElem dc = dStateRow[n + j] + dh * o * (1 - t * t);
+                            preRow[j] = dc * g * i * (1 - i);
+                            preRow[n + j] = dc * cRow[j] * f * (1 - f);
+                            preRow[2 * n + j] = dh * t * o * (1 - o);
+                            preRow[3 * n + j] = dc * i * (1 - g * g);
+                            dcRow[j] = dc * f;
+                        }
+                    }
+                });
+
+    // [dx | dh] = gradPre * [W ; U]^T
+    if (d.feedback)
+    {
+        NSGemm::Gemm(rowNum, xhLen, 4 * n,
+                     (const TElem*)gradPre, 4 * n, 1,
+                     mem_wcat.RawMemory(), 1, mem_wcat.RowLen(),
+                     res, rsOut);
+    }
+}
+
+template <typename TElem, typename TDevice>
+class ForwardUnit;
+
+// oper1: x, oper2: the state [h | c] before the step; the output is the new state
+template <typename TElem>
+class ForwardUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = Matrix<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    ForwardUnit(OperHandle<TElem, DeviceType> oper1,
+                OperHandle<TElem, DeviceType> oper2,
+                WeightType weights,
+                std::shared_ptr<StepDataType> data,
+                EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& x = m_oper1.Data();
+        m_evalOutput.Allocate(x.RowNum(), m_weights.wcat.ColNum() / 2);
+        Forward(*m_data, m_weights, x, m_oper2.Data(), m_evalOutput.MutableData());
+        m_evalOutput.SetEval();
+    }
+
+private:
+    OperHandle<TElem, DeviceType> m_oper1;
+    OperHandle<TElem, DeviceType> m_oper2;
+    WeightType m_weights;
+    std::shared_ptr<StepDataType> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+
+template <typename TElem, typename TDevice>
+class BackwardUnit;
+
+// oper1: the gradient of h', oper2: the gradient of [h' | c'], oper3: the forward step (only
+// read for the evaluation order). The output is [dx | dh | dc].
+template <typename TElem>
+class BackwardUnit<TElem, DeviceTags::CPU>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+    using OutputType = Matrix<TElem, DeviceType>;
+    using WeightType = Weights<TElem, DeviceType>;
+    using StepDataType = StepData<TElem, DeviceType>;
+
+    BackwardUnit(OperHandle<TElem, DeviceType> oper1,
+                 OperHandle<TElem, DeviceType> oper2,
+                 OperHandle<TElem, DeviceType> oper3,
+                 WeightType weights,
+                 std::shared_ptr<StepDataType> data,
+                 EvalHandle<OutputType> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_oper3(std::move(oper3))
+        , m_weights(std::move(weights))
+        , m_data(std::move(data))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& gradOut = m_oper1.Data();
+        const size_t n = m_weights.wcat.ColNum() / 4;
+        m_evalOutput.Allocate(gradOut.RowNum(), m_weights.wcat.RowNum() + n);
+        Backward(*m_data, m_weights, gradOut, m_oper2.Data(), m_evalOutput.MutableData());
+        m_evalOutput.SetEval();
+    }
+
+private:
+    OperHandle<TElem, DeviceType> m_oper1;
+    OperHandle<TElem, DeviceType> m_oper2;
+    OperHandle<TElem, DeviceType> m_oper3;
+    WeightType m_weights;
+    std::shared_ptr<StepDataType> m_data;
+    EvalHandle<OutputType> m_evalOutput;
+};
+}
+
+using LstmInput = VarTypeDict<RnnLayerHiddenBefore,
+                              LayerIO>;
+
+using LstmOutput = VarTypeDict<RnnLayerHiddenAfter,
+                               LayerIO>;
+
+// An LSTM step with the weights of its four gates in one matrix: [i | f | o | g] = [x | h] *
+// [W ; U] is a single GEMM with the sigmoid and tanh of the gates in its epilogue, and the cell
+// update c' = f * c + i * g, h' = o * tanh(c') is one pass over the rows. The backward pass
+// forms the gradients of all pre-activations in one pass and [dx | dh] in one GEMM.
+//
+// The state of the step is [h | c] side by side. It is passed as RnnLayerHiddenBefore and comes
+// back as RnnLayerHiddenAfter along with the output h as LayerIO; FeedBackward takes the
+// gradients of both the same way (either may be left out) and returns the gradient of the
+// state before the step as RnnLayerHiddenBefore. The weights are named name-Wi, name-Wf, ...
+// name-Ug, each one a view of its block. Only matrices are supported as input, with one sample
+// per row.
+template <typename TPolicies>
+class LstmStep
+{
+    static_assert(IsPolicyContainer<TPolicies>, "TPolicies is not a policy container.");
+    using CurLayerPolicy = PlainPolicy<TPolicies>;
+
+public:
+    static constexpr bool IsFeedbackOutput = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsFeedbackOutput;
+    static constexpr bool IsUpdate = PolicySelect<FeedbackPolicy, CurLayerPolicy>::IsUpdate;
+    // RecurrentLayer carries RnnLayerHiddenAfter to the next step instead of the output
+    static constexpr bool SeparateState = true;
+    using InputType = LstmInput;
+    using OutputType = LstmOutput;
+
+private:
+    using ElementType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Element;
+    using DeviceType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Device;
+    static_assert(!PolicySelect<InputPolicy, CurLayerPolicy>::BatchMode,
+                  "LstmStep takes matrices with one sample per row, not batches");
+
+    using DataType = DynamicData<ElementType, DeviceType, CategoryTags::Matrix>;
+    using StepDataType = NSLstmStep::StepData<ElementType, DeviceType>;
+    using ForwardOp = NSFusedStep::StepOp<NSLstmStep::ForwardUnit<ElementType, DeviceType>,
+                                          DataType, DataType>;
+    using BackwardOp = NSFusedStep::StepOp<NSLstmStep::BackwardUnit<ElementType, DeviceType>,
+                                           DataType, DataType, DataType>;
+    using PartType = NSFusedStep::Part<DataType, StepDataType>;
+
+    // forward and backward are the new state and [dx | dh | dc]
+    struct StepRecord
+    {
+        std::shared_ptr<StepDataType> data;
+        DataType forward;
+        DataType backward;
+        size_t rowNum;
+    };
+
+public:
+    LstmStep(const std::string& p_name, size_t p_inLen, size_t p_outLen)
+        : m_name(p_name)
+        , m_inputLen(p_inLen)
+        , m_outputLen(p_outLen)
+    {
+        if ((m_inputLen == 0) || (m_outputLen == 0))
+        {
+            throw std::runtime_error("Invalidate matrix size for LSTM step");
+        }
+    }
+
+public:
+    template <typename TInitializer, typename TBuffer,
+              typename TInitPolicies = typename TInitializer::PolicyCont>
+    void Init(TInitializer& initializer, TBuffer& loadBuffer, std::ostream* log = nullptr)
+    {
+        const size_t n = m_outputLen;
+        const auto names = WeightNames();
+        const std::vector<std::string> wNames(names.begin(), names.begin() + 4);
+        const std::vector<std::string> uNames(names.begin() + 4, names.end());
+
+        // the weights of a previous LstmStep (e.g. packed in an arena) are used in place
+        auto w = NSFusedStep::AdjacentBlocks<ElementType, DeviceType>(loadBuffer, wNames, m_inputLen, n);
+        auto u = NSFusedStep::AdjacentBlocks<ElementType, DeviceType>(loadBuffer, uNames, n, n);
+        if ((w.RowNum() != 0) && (u.RowNum() != 0))
+        {
+            auto mem_w = LowerAccess(w);
+            const auto mem_u = LowerAccess(u);
+            if ((mem_u.SharedMemory() == mem_w.SharedMemory()) && (mem_u.RowLen() == mem_w.RowLen()) &&
+                (mem_u.RawMemory() == mem_w.RawMemory() + m_inputLen * mem_w.RowLen()))
+            {
+                m_weights.wcat = Matrix<ElementType, DeviceType>(mem_w.SharedMemory(), mem_w.MutableRawMemory(),
+                                                                 m_inputLen + n, 4 * n, mem_w.RowLen());
+                EnablePackCache(m_weights.wcat);
+                for (const auto& name : names)
+                {
+                    NSFusedStep::Log(log, "Load from load buffer: " + name);
+                }
+                return;
+            }
+        }
+
+        m_weights.wcat = Matrix<ElementType, DeviceType>(m_inputLen + n, 4 * n);
+        for (size_t k = 0; k < names.size(); ++k)
+        {
+            NSFusedStep::LoadPart<TInitPolicies>(initializer, loadBuffer, log, names[k], WeightPart(k));
+        }
+        EnablePackCache(m_weights.wcat);
+    }
+
+    template <typename TSave>
+    void SaveWeights(TSave& saver) const
+    {
+        const auto names = WeightNames();
+        for (size_t k = 0; k < names.size(); ++k)
+        {
+            NSFusedStep::SavePart(saver, names[k], WeightPart(k));
+        }
+    }
+
+    template <typename TIn>
+    auto FeedForward(const TIn& p_in)
+    {
+        const auto& x = p_in.template Get<LayerIO>();
+        const auto& s = p_in.template Get<RnnLayerHiddenBefore>();
+        static_assert(!std::is_same<RemConstRef<decltype(x)>, NullParameter>::value, "parameter is invalid");
+        static_assert(!std::is_same<RemConstRef<decltype(s)>, NullParameter>::value, "parameter is invalid");
+
+        const size_t rowNum = x.RowNum();
+        if ((x.ColNum() != m_inputLen) || (s.RowNum() != rowNum) || (s.ColNum() != 2 * m_outputLen))
+        {
+            throw std::runtime_error("LSTM step input or state [h | c] mismatch");
+        }
+
+        auto data = std::make_shared<StepDataType>();
+        data->feedback = IsFeedbackOutput;
+        DataType state = MakeDynamic(ForwardOp(MakeDynamic(x), MakeDynamic(s), m_weights, data,
+                                               rowNum, 2 * m_outputLen));
+        PartType out(state, data, &StepDataType::state, rowNum, 0, m_outputLen);
+        if constexpr (IsUpdate || IsFeedbackOutput)
+        {
+            m_forward.push(StepRecord{data, state, DataType(), rowNum});
+        }
+        return OutputType::Create().template Set<LayerIO>(std::move(out))
+                                   .template Set<RnnLayerHiddenAfter>(std::move(state));
+    }
+
+    // p_grad: the gradient of the output as LayerIO and of the state after the step as
+    // RnnLayerHiddenAfter, a missing or empty one counts as zero
+    template <typename TGrad>
+    auto FeedBackward(const TGrad& p_grad)
+    {
+        if constexpr ((!IsFeedbackOutput) && (!IsUpdate))
+        {
+            return InputType::Create();
+        }
+        else
+        {
+            if (m_forward.empty())
+            {
+                throw std::runtime_error("Cannot do FeedBackward for LSTM step");
+            }
+            StepRecord rec = std::move(m_forward.top());
+            m_forward.pop();
+
+            const size_t rowNum = rec.rowNum;
+            const size_t n = m_outputLen;
+            DataType gradOut = GradOrZero(p_grad.template Get<LayerIO>(), rowNum, n);
+            DataType gradState = GradOrZero(p_grad.template Get<RnnLayerHiddenAfter>(), rowNum, 2 * n);
+            rec.backward = MakeDynamic(BackwardOp(std::move(gradOut), std::move(gradState), rec.forward,
+                                                  m_weights, rec.data, rowNum, m_inputLen + 2 * n));
+            if constexpr (IsUpdate)
+            {
+                m_backward.push_back(rec);
+            }
+
+            if constexpr (IsFeedbackOutput)
+            {
+                PartType gradInput(rec.backward, rec.data, &StepDataType::grad, rowNum, 0, m_inputLen);
+                PartType gradHidden(rec.backward, rec.data, &StepDataType::grad, rowNum,
+                                    m_inputLen, m_inputLen + 2 * n);
+                return InputType::Create().template Set<RnnLayerHiddenBefore>(std::move(gradHidden))
+                                          .template Set<LayerIO>(std::move(gradInput));
+            }
+            else
+            {
+                return InputType::Create();
+            }
+        }
+    }
+
+    template <typename TGradCollector>
+    void GradCollect(TGradCollector& col)
+    {
+        if constexpr (IsUpdate)
+        {
+            const size_t n = m_outputLen;
+            for (const auto& rec : m_backward)
+            {
+                PartType xh(rec.forward, rec.data, &StepDataType::xh, rec.rowNum, 0, m_inputLen + n);
+                PartType gradPre(rec.backward, rec.data, &StepDataType::gradPre, rec.rowNum, 0, 4 * n);
+                col.Collect(m_weights.wcat, Dot(Transpose(std::move(xh)), std::move(gradPre)));
+            }
+            m_backward.clear();
+        }
+    }
+
+    void NeutralInvariant() const
+    {
+        if ((!m_forward.empty()) || (!m_backward.empty()))
+        {
+            throw std::runtime_error("NeutralInvariant Fail!");
+        }
+    }
+
+private:
+    // name-Wi, name-Wf, name-Wo, name-Wg, then name-Ui ... name-Ug
+    std::vector<std::string> WeightNames() const
+    {
+        std::vector<std::string> res;
+        for (const char* kind : {"-W", "-U"})
+        {
+            for (const char* gate : {"i", "f", "o", "g"})
+            {
+                res.push_back(m_name + kind + gate);
+            }
+        }
+        return res;
+    }
+
+    // The view of the k-th weight of WeightNames in m_weights.wcat
+    Matrix<ElementType, DeviceType> WeightPart(size_t k) const
+    {
+        const size_t n = m_outputLen;
+        auto res = m_weights.wcat;
+        if (k < 4)
+        {
+            res.Shrink(0, m_inputLen, k * n, (k + 1) * n);
+        }
+        else
+        {
+            res.Shrink(m_inputLen, m_inputLen + n, (k - 4) * n, (k - 3) * n);
+        }
+        return res;
+    }
+
+    template <typename TGradVal>
+    static DataType GradOrZero(const TGradVal& grad, size_t rowNum, size_t colNum)
+    {
+        if constexpr (!std::is_same<RemConstRef<TGradVal>, NullParameter>::value)
+        {
+            DataType res = MakeDynamic(grad);
+            if (!res.IsEmpty())
+            {
+                if ((res.RowNum() != rowNum) || (res.ColNum() != colNum))
+                {
+                    throw std::runtime_error("LSTM step gradient mismatch");
+                }
+                return res;
+            }
+        }
+        return MakeDynamic(ZeroMatrix<ElementType, DeviceType>(rowNum, colNum));
+    }
+
+private:
+    const std::string m_name;
+    const size_t m_inputLen;
+    const size_t m_outputLen;
+
+    NSLstmStep::Weights<ElementType, DeviceType> m_weights;
+    std::stack<StepRecord, std::list<StepRecord>> m_forward;
+    std::vector<StepRecord> m_backward;
+};
+}
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <MetaNN/layers/recurrent/fused_gru_step.h>
 #include <MetaNN/layers/recurrent/gru_step.h>
+#include <MetaNN/layers/recurrent/lstm_step.h>
+#include <algorithm>
 #include <cassert>
+#include <deque>
+#include <stdexcept>
+#include <vector>
 
 namespace MetaNN
 {
@@ -15,10 +21,55 @@ struct StepEnum2Type_<RecurrentLayerPolicy::StepTypeCate::GRU, TPolicy>
     using type = GruStep<TPolicy>;
 };
 
+template <typename TPolicy>
+struct StepEnum2Type_<RecurrentLayerPolicy::StepTypeCate::FusedGRU, TPolicy>
+{
+    using type = FusedGruStep<TPolicy>;
+};
+
+template <typename TPolicy>
+struct StepEnum2Type_<RecurrentLayerPolicy::StepTypeCate::LSTM, TPolicy>
+{
+    using type = LstmStep<TPolicy>;
+};
+
 template <typename TStep, typename TPolicy>
 using StepEnum2Type = typename StepEnum2Type_<TStep, TPolicy>::type;
+
+// Whether TStep passes its state on as RnnLayerHiddenAfter (e.g. [h | c] of LstmStep) rather
+// than as its output
+template <typename TStep, typename = void>
+struct SeparateState_ : std::false_type {};
+
+template <typename TStep>
+struct SeparateState_<TStep, std::void_t<decltype(TStep::SeparateState)>>
+    : std::bool_constant<TStep::SeparateState> {};
+
+// In place of the forward-only step of a layer without checkpoints
+struct NoStep
+{
+    template <typename... T>
+    NoStep(const T&...) {}
+};
 }
 
+// The cost of the recorded activations of a RecurrentLayer, to tune PCheckpointSegment. Memory
+// grows with the stored hidden states and with the steps whose activations are held at once,
+// time with the forward steps computed a second time during FeedBackward. With PEnableMemoryReport
+// the live bytes of the allocator are sampled when each FeedForward / FeedBackward call of the
+// layer starts and returns; they count all live buffers of the process, not only those of the
+// layer. Sampling takes a snapshot of the allocator statistics, so it is off by default.
+struct RecurrentMemoryReport
+{
+    size_t segment = 0;              // the checkpoint segment length, 0 without checkpoints
+    size_t forwardSteps = 0;
+    size_t recomputedSteps = 0;
+    size_t peakCheckpoints = 0;      // hidden states stored at once
+    size_t peakRecordedSteps = 0;    // steps with recorded activations at once
+    size_t liveBytes = 0;            // at the last sample, with PEnableMemoryReport only
+    size_t peakLiveBytes = 0;
+};
+
 template <typename TPolicies>
 class RecurrentLayer
 {
@@ -31,6 +82,20 @@ public:
 
 private:
     static constexpr bool UseBptt = PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::UseBptt;
+    static constexpr size_t CheckpointSegment = PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::CheckpointSegment;
+    static constexpr bool UseCheckpoint = (CheckpointSegment > 0) && (IsUpdate || IsFeedbackOutput);
+    static constexpr bool UseMemoryReport = PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::MemoryReport;
+
+    // Truncated BPTT: the forward pass runs in windows of BpttWindow steps; once all outputs of a
+    // window are fed back, the gradient goes on through the steps before the window, up to
+    // BpttLength steps in all, and is dropped there. The hidden state goes on into the next window.
+    // Collecting the gradients after each window (e.g. into an accumulating GradCollector) keeps
+    // the memory constant however long the stream runs.
+    static constexpr size_t BpttWindow = PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::BpttWindow;
+    static constexpr size_t BpttLength = std::max(BpttWindow,
+                                                  PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::BpttLength);
+    static constexpr bool UseTruncate = (BpttWindow > 0) && UseBptt && (IsUpdate || IsFeedbackOutput);
+    static_assert(!(UseTruncate && UseCheckpoint), "Truncated BPTT cannot be combined with checkpoints");
 
     using StepPolicy = typename std::conditional_t<(!IsFeedbackOutput) && IsUpdate && UseBptt,
                                                    ChangePolicy_<PFeedbackOutput, TPolicies>,
@@ -38,6 +103,15 @@ private:
 
     using StepEnum = typename PolicySelect<RecurrentLayerPolicy, CurLayerPolicy>::Step;
     using StepType = NSRecurrentLayer::StepEnum2Type<StepEnum, StepPolicy>;
+    static constexpr bool SeparateState = NSRecurrentLayer::SeparateState_<StepType>::value;
+
+    // With checkpoints the forward pass runs a step that records nothing, sharing the weights
+    // of m_step; m_step records the steps of one segment at a time, recomputed from its
+    // checkpoint when FeedBackward reaches it.
+    using ForwardStepPolicy = ChangePolicy<PNoUpdate, ChangePolicy<PFeedbackNoOutput, StepPolicy>>;
+    using ForwardStepType = std::conditional_t<UseCheckpoint,
+                                               NSRecurrentLayer::StepEnum2Type<StepEnum, ForwardStepPolicy>,
+                                               NSRecurrentLayer::NoStep>;
 
     using ElementType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Element;
     using DeviceType = typename PolicySelect<OperandPolicy, CurLayerPolicy>::Device;
@@ -53,10 +127,13 @@ public:
 
 public:
     template <typename...T>
-    RecurrentLayer(T&&... params)
-        : m_step(std::forward<T>(params)...)
+    RecurrentLayer(const T&... params)
+        : m_step(params...)
+        , m_forwardStep(params...)
         , m_inForward(true)
-    {}
+    {
+        m_report.segment = UseCheckpoint ? CheckpointSegment : 0;
+    }
 
 public:
     template <typename TInitializer, typename TBuffer, 
@@ -64,6 +141,11 @@ public:
     void Init(TInitializer& initializer, TBuffer& loadBuffer, std::ostream* log = nullptr)
     {
         m_step.template Init<TInitializer, TBuffer, TInitPolicies>(initializer, loadBuffer, log);
+        if constexpr (UseCheckpoint)
+        {
+            // picks up the weights m_step has just placed in the load buffer
+            m_forwardStep.template Init<TInitializer, TBuffer, TInitPolicies>(initializer, loadBuffer, nullptr);
+        }
     }
 
     template <typename TSave>
@@ -83,20 +165,35 @@ public:
     {
         auto& init = p_in.template Get<RnnLayerHiddenBefore>();
         using rawType = std::decay_t<decltype(init)>;
+        if constexpr (UseTruncate)
+        {
+            if ((!m_inForward) || (m_window.size() == BpttWindow))
+            {
+                throw std::runtime_error("The window of the recurrent layer is not fed back yet");
+            }
+        }
         m_inForward = true;
+        SampleMemory();
 
         if constexpr(std::is_same<rawType, NullParameter>::value)
         {
             assert(!m_hiddens.IsEmpty());
             auto real_in = std::move(p_in).template Set<RnnLayerHiddenBefore>(m_hiddens);
-            auto res = m_step.FeedForward(std::move(real_in));
-            m_hiddens = MakeDynamic(res.template Get<LayerIO>());
+            auto res = StepForward(std::move(real_in), false);
+            m_hiddens = CarriedState(State(res));
+            SampleMemory();
             return res;
         }
         else
         {
-            auto res = m_step.FeedForward(std::forward<TIn>(p_in));
-            m_hiddens = MakeDynamic(res.template Get<LayerIO>());
+            if constexpr (UseTruncate)
+            {
+                // a given hidden state starts a new stream
+                m_history.clear();
+            }
+            auto res = StepForward(std::forward<TIn>(p_in), true);
+            m_hiddens = CarriedState(State(res));
+            SampleMemory();
             return res;
         }
     }
@@ -104,42 +201,319 @@ public:
     template <typename TGrad>
     auto FeedBackward(const TGrad& p_grad)
     {
+        SampleMemory();
+        if constexpr (UseCheckpoint)
+        {
+            if (m_recordedSteps == 0)
+            {
+                Recompute();
+            }
+        }
+        if constexpr (IsUpdate || IsFeedbackOutput)
+        {
+            if (m_recordedSteps != 0)
+            {
+                --m_recordedSteps;
+            }
+        }
+        if constexpr (UseTruncate)
+        {
+            if (m_inForward)
+            {
+                if (m_window.empty())
+                {
+                    throw std::runtime_error("Cannot do FeedBackward for recurrent layer");
+                }
+                m_backwardLeft = m_window.size();
+            }
+            --m_backwardLeft;
+        }
+
         if constexpr(UseBptt)
         {
             auto gradVal = p_grad.template Get<LayerIO>();
+            auto res = m_step.FeedBackward(StepGrad(gradVal, !m_inForward));
+            m_inForward = false;
+            m_gradHiddens = CarriedState(res.template Get<RnnLayerHiddenBefore>());
+            if constexpr (UseTruncate)
+            {
+                if (m_backwardLeft == 0) FinishWindow();
+            }
+            SampleMemory();
+            return res;
+        }
+        else
+        {
+            auto res = m_step.FeedBackward(std::forward<TGrad>(p_grad));
+            SampleMemory();
+            return res;
+        }
+    }
+
+    // A whole sequence in one call, for steps that support it (FusedGruStep). The hidden state
+    // is carried over between calls as in FeedForward; the sequences are fed back in reverse.
+    template <typename TIn>
+    auto FeedForwardSequence(TIn&& p_in)
+    {
+        static_assert(!UseTruncate, "Truncated BPTT works step by step");
+        static_assert(!UseCheckpoint, "Checkpoints are stored step by step");
+        auto& init = p_in.template Get<RnnLayerHiddenBefore>();
+        using rawType = std::decay_t<decltype(init)>;
+        m_inForward = true;
+
+        if constexpr(std::is_same<rawType, NullParameter>::value)
+        {
+            assert(!m_hiddens.IsEmpty());
+            auto real_in = std::move(p_in).template Set<RnnLayerHiddenBefore>(m_hiddens);
+            auto res = m_step.FeedForwardSequence(std::move(real_in));
+            m_hiddens = MakeDynamic(res.template Get<RnnLayerHiddenAfter>());
+            return res;
+        }
+        else
+        {
+            auto res = m_step.FeedForwardSequence(std::forward<TIn>(p_in));
+            m_hiddens = MakeDynamic(res.template Get<RnnLayerHiddenAfter>());
+            return res;
+        }
+    }
+
+    template <typename TGrad>
+    auto FeedBackwardSequence(const TGrad& p_grad)
+    {
+        if constexpr(UseBptt)
+        {
             if (!m_inForward)
             {
-                auto newGrad = MakeDynamic(gradVal + m_hiddens);
-                auto input = LayerIO::Create().template Set<LayerIO>(newGrad);
-                auto res = m_step.FeedBackward(std::move(input));
-                m_hiddens = MakeDynamic(res.template Get<RnnLayerHiddenBefore>());
-                return std::move(res);
+                auto input = GruSequenceOutput::Create().template Set<LayerIO>(p_grad.template Get<LayerIO>())
+                                                        .template Set<RnnLayerHiddenAfter>(m_gradHiddens);
+                auto res = m_step.FeedBackwardSequence(std::move(input));
+                m_gradHiddens = MakeDynamic(res.template Get<RnnLayerHiddenBefore>());
+                return res;
             }
             else
             {
                 m_inForward = false;
-                
-                auto newGrad = MakeDynamic(gradVal);
-                auto input = LayerIO::Create().template Set<LayerIO>(newGrad);
-                auto res = m_step.FeedBackward(std::move(input));
-                m_hiddens = MakeDynamic(res.template Get<RnnLayerHiddenBefore>());
-                return std::move(res);
+                auto res = m_step.FeedBackwardSequence(p_grad);
+                m_gradHiddens = MakeDynamic(res.template Get<RnnLayerHiddenBefore>());
+                return res;
             }
         }
         else
         {
-            return m_step.FeedBackward(std::forward<TGrad>(p_grad));
+            return m_step.FeedBackwardSequence(p_grad);
         }
     }
 
     void NeutralInvariant()
     {
         m_step.NeutralInvariant();
+        if ((!m_inputs.empty()) || (!m_checkpoints.empty()) || (m_recordedSteps != 0) || (!m_window.empty()))
+        {
+            throw std::runtime_error("NeutralInvariant Fail!");
+        }
+    }
+
+    const RecurrentMemoryReport& MemoryReport() const
+    {
+        return m_report;
+    }
+
+    void ResetMemoryReport()
+    {
+        m_report = RecurrentMemoryReport();
+        m_report.segment = UseCheckpoint ? CheckpointSegment : 0;
+    }
+
+private:
+    // One FeedForward step: recorded by m_step, or with checkpoints run by m_forwardStep while
+    // its input and every CheckpointSegment-th hidden state are kept for Recompute, as well as
+    // each hidden state given by the caller (givenState), which starts a new segment. They are
+    // kept as values: an expression would hold the operators of the steps that computed it.
+    template <typename TIn>
+    auto StepForward(TIn&& p_in, [[maybe_unused]] bool givenState)
+    {
+        ++m_report.forwardSteps;
+        if constexpr (UseTruncate)
+        {
+            m_window.push_back(WindowStep{MakeDynamic(p_in.template Get<LayerIO>()),
+                                          MakeDynamic(p_in.template Get<RnnLayerHiddenBefore>())});
+        }
+        if constexpr (UseCheckpoint)
+        {
+            const size_t step = m_inputs.size();
+            if (givenState || m_checkpoints.empty() || (step - m_checkpoints.back().step == CheckpointSegment))
+            {
+                m_checkpoints.push_back(Checkpoint{step,
+                                                   MakeDynamic(Evaluate(p_in.template Get<RnnLayerHiddenBefore>()))});
+                m_report.peakCheckpoints = std::max(m_report.peakCheckpoints, m_checkpoints.size());
+            }
+            m_inputs.push_back(MakeDynamic(Evaluate(p_in.template Get<LayerIO>())));
+            return m_forwardStep.FeedForward(std::forward<TIn>(p_in));
+        }
+        else
+        {
+            if constexpr (IsUpdate || IsFeedbackOutput)
+            {
+                ++m_recordedSteps;
+                m_report.peakRecordedSteps = std::max(m_report.peakRecordedSteps, m_recordedSteps);
+            }
+            return m_step.FeedForward(std::forward<TIn>(p_in));
+        }
+    }
+
+    // The state a step passes on to the next one
+    template <typename TRes>
+    static decltype(auto) State(const TRes& res)
+    {
+        if constexpr (SeparateState)
+        {
+            return res.template Get<RnnLayerHiddenAfter>();
+        }
+        else
+        {
+            return res.template Get<LayerIO>();
+        }
+    }
+
+    // The input of m_step.FeedBackward from the gradient of the output of the step, with carry
+    // the gradient of the state it passed on as well
+    template <typename TGradVal>
+    auto StepGrad(const TGradVal& gradVal, bool carry)
+    {
+        constexpr bool hasGrad = !std::is_same<TGradVal, NullParameter>::value;
+        if constexpr (SeparateState)
+        {
+            DataType grad;
+            if constexpr (hasGrad) grad = MakeDynamic(gradVal);
+            return OutputType::Create().template Set<LayerIO>(std::move(grad))
+                                       .template Set<RnnLayerHiddenAfter>(carry ? m_gradHiddens : DataType());
+        }
+        else if constexpr (hasGrad)
+        {
+            DataType grad = carry ? MakeDynamic(gradVal + m_gradHiddens) : MakeDynamic(gradVal);
+            return LayerIO::Create().template Set<LayerIO>(std::move(grad));
+        }
+        else
+        {
+            return LayerIO::Create().template Set<LayerIO>(m_gradHiddens);
+        }
+    }
+
+    // Runs the last segment not fed back yet through m_step again, from its checkpoint
+    void Recompute()
+    {
+        if (m_inputs.empty())
+        {
+            throw std::runtime_error("Cannot do FeedBackward for recurrent layer");
+        }
+        const size_t begin = m_checkpoints.back().step;
+        DataType hidden = std::move(m_checkpoints.back().hidden);
+        m_checkpoints.pop_back();
+        for (size_t t = begin; t < m_inputs.size(); ++t)
+        {
+            auto in = InputType::Create().template Set<LayerIO>(m_inputs[t])
+                                         .template Set<RnnLayerHiddenBefore>(hidden);
+            hidden = MakeDynamic(State(m_step.FeedForward(std::move(in))));
+        }
+        m_recordedSteps = m_inputs.size() - begin;
+        m_report.recomputedSteps += m_recordedSteps;
+        m_report.peakRecordedSteps = std::max(m_report.peakRecordedSteps, m_recordedSteps);
+        m_inputs.resize(begin);
+    }
+
+    // The state passed on to the next FeedForward, or its gradient passed on to the next
+    // FeedBackward. With checkpoints it is detached from the step that computed it, so that
+    // neither pass keeps the activations of the steps before alive.
+    template <typename TState>
+    DataType CarriedState(const TState& state)
+    {
+        if constexpr (UseCheckpoint)
+        {
+            return MakeDynamic(Evaluate(state));
+        }
+        else
+        {
+            return MakeDynamic(state);
+        }
+    }
+
+    void SampleMemory()
+    {
+        if constexpr (UseMemoryReport)
+        {
+            m_report.liveBytes = Allocator<DeviceType>::Stats().m_liveBytes;
+            m_report.peakLiveBytes = std::max(m_report.peakLiveBytes, m_report.liveBytes);
+        }
+    }
+
+    // Feeds the gradient of the hidden state before the window back through the steps before it
+    // (recomputed from their inputs), up to BpttLength steps in all, and drops it. Only the last
+    // BpttLength - BpttWindow steps and the hidden state are kept, detached from the steps before.
+    void FinishWindow()
+    {
+        const size_t extra = std::min(BpttLength - m_window.size(), m_history.size());
+        if (extra != 0)
+        {
+            DataType hidden = m_history[m_history.size() - extra].hidden;
+            for (size_t t = m_history.size() - extra; t < m_history.size(); ++t)
+            {
+                auto in = InputType::Create().template Set<LayerIO>(m_history[t].input)
+                                             .template Set<RnnLayerHiddenBefore>(hidden);
+                hidden = MakeDynamic(State(m_step.FeedForward(std::move(in))));
+            }
+            m_report.recomputedSteps += extra;
+            m_report.peakRecordedSteps = std::max(m_report.peakRecordedSteps, extra);
+            for (size_t t = 0; t < extra; ++t)
+            {
+                auto res = m_step.FeedBackward(StepGrad(NullParameter(), true));
+                m_gradHiddens = MakeDynamic(res.template Get<RnnLayerHiddenBefore>());
+            }
+        }
+        m_gradHiddens = DataType();
+
+        for (auto& step : m_window)
+        {
+            m_history.push_back(std::move(step));
+        }
+        m_window.clear();
+        const size_t keep = BpttLength - BpttWindow;
+        while (m_history.size() > keep)
+        {
+            m_history.pop_front();
+        }
+        for (auto& step : m_history)
+        {
+            step.input = MakeDynamic(Evaluate(step.input));
+            step.hidden = MakeDynamic(Evaluate(step.hidden));
+        }
+        m_hiddens = MakeDynamic(Evaluate(m_hiddens));
+        m_inForward = true;
     }
 
 private:
     StepType m_step;
+    ForwardStepType m_forwardStep;
     DataType m_hiddens;
     bool     m_inForward;
+
+    struct WindowStep
+    {
+        DataType input;
+        DataType hidden;    // the hidden state before the step
+    };
+    std::vector<WindowStep> m_window;
+    std::deque<WindowStep> m_history;
+    size_t m_backwardLeft = 0;
+    DataType m_gradHiddens;
+
+    std::vector<DataType> m_inputs;
+    struct Checkpoint
+    {
+        size_t step;        // the first step of the segment
+        DataType hidden;    // the hidden state before it
+    };
+    std::vector<Checkpoint> m_checkpoints;
+    size_t m_recordedSteps = 0;
+    RecurrentMemoryReport m_report;
 };
 }
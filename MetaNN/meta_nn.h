@@ -21,6 +21,7 @@
 #include <MetaNN/data/sequence.h>
 #include <MetaNN/data/batch/array.h>
 #include <MetaNN/data/batch/duplicate.h>
+#include <MetaNN/data/batch/one_hot_vector.h>
 
 #include <MetaNN/operators/abs.h>
 #include <MetaNN/operators/add.h>
@@ -36,6 +37,8 @@
 #include <MetaNN/operators/sigmoid_derivative.h>
 #include <MetaNN/operators/sign.h>
 #include <MetaNN/operators/softmax.h>
+#include <MetaNN/operators/softmax_cross_entropy.h>
+#include <MetaNN/operators/softmax_cross_entropy_derivative.h>
 #include <MetaNN/operators/softmax_derivative.h>
 #include <MetaNN/operators/substract.h>
 #include <MetaNN/operators/tanh.h>
@@ -49,6 +52,7 @@
 #include <MetaNN/layers/elementary/add_layer.h>
 #include <MetaNN/layers/elementary/bias_layer.h>
 #include <MetaNN/layers/elementary/element_mul_layer.h>
+#include <MetaNN/layers/elementary/embedding_layer.h>
 #include <MetaNN/layers/elementary/interpolate_layer.h>
 #include <MetaNN/layers/elementary/sigmoid_layer.h>
 #include <MetaNN/layers/elementary/softmax_layer.h>
@@ -61,11 +65,21 @@
 #include <MetaNN/layers/recurrent/recurrent_layer.h>
 
 #include <MetaNN/layers/cost/negative_log_likelihood_layer.h>
+#include <MetaNN/layers/cost/softmax_cross_entropy_layer.h>
 
 #include <MetaNN/model/param_initializer/constant_filler.h>
 #include <MetaNN/model/param_initializer/gaussian_filler.h>
 #include <MetaNN/model/param_initializer/uniform_filler.h>
 #include <MetaNN/model/param_initializer/var_scale_filler.h>
 #include <MetaNN/model/param_initializer/param_initializer.h>
+#include <MetaNN/model/param_initializer/param_arena.h>
+
+#include <MetaNN/model/grad_col/grad_norm.h>
+
+#include <MetaNN/model/optimizer/adagrad.h>
+#include <MetaNN/model/optimizer/adam.h>
+#include <MetaNN/model/optimizer/momentum.h>
+#include <MetaNN/model/optimizer/rmsprop.h>
+#include <MetaNN/model/optimizer/sgd.h>
 
 #include <MetaNN/facilities/cont_metafuns/sequential.h>
\ No newline at end of file
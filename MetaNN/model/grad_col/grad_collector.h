@@ -1,5 +1,11 @@
 #pragma once
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/model/param_initializer/param_arena.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <unordered_map>
+#include <vector>
 
 namespace MetaNN
 {
@@ -16,10 +22,27 @@ struct MatrixGradInfo
     Array<GradItemType> grad;
 };
 
+// Gradients that only touch some rows of a weight matrix (e.g. an embedding table):
+// rows[i][k] is the row of weight updated by row k of grad[i]. An accumulating collector keeps
+// one entry, each row appearing once in rows[0].
 template <typename TElement, typename TDevice>
+struct MatrixRowGradInfo
+{
+    using GradItemType = DynamicData<TElement, TDevice, CategoryTags::BatchMatrix>;
+
+    MatrixRowGradInfo(Matrix<TElement, TDevice> p_weight)
+        : weight(std::move(p_weight)) {}
+
+    Matrix<TElement, TDevice> weight;
+    std::vector<std::vector<size_t>> rows;
+    std::vector<GradItemType> grad;
+};
+
+template <typename TElement, typename TDevice,
+          typename TInfo = MatrixGradInfo<TElement, TDevice>>
 class GradCollectorIterator
 {
-    using IteratorType = typename std::unordered_map<const TElement*, MatrixGradInfo<TElement, TDevice>>::iterator;
+    using IteratorType = typename std::unordered_map<const TElement*, TInfo>::iterator;
 
 public:
     GradCollectorIterator(IteratorType it)
@@ -62,11 +85,119 @@ private:
     IteratorType m_it;
 };
 
+namespace NSGradCollector
+{
+template <typename TGrad>
+constexpr bool IsDot = false;
+
+template <typename TP1, typename TP2>
+constexpr bool IsDot<BinaryOp<BinaryOpTags::Dot, TP1, TP2>> = true;
+
+// buf += grad, the gradients of a batch are added up
+template <typename TElement, typename TGrad>
+void AddTo(Matrix<TElement, DeviceTags::CPU>& buf, const TGrad& grad)
+{
+    if constexpr (IsDot<TGrad>)
+    {
+        DotAccumulate(buf, grad);
+    }
+    else
+    {
+        const auto g = [&grad]()
+        {
+            if constexpr (IsMatrix<TGrad>) return Evaluate(grad);
+            else return Evaluate(Collapse(grad));
+        }();
+        assert((g.RowNum() == buf.RowNum()) && (g.ColNum() == buf.ColNum()));
+
+        const auto mem_g = LowerAccess(g);
+        auto mem_buf = LowerAccess(buf);
+        for (size_t i = 0; i < buf.RowNum(); ++i)
+        {
+            const TElement* src = mem_g.RawMemory() + i * mem_g.RowLen();
+            TElement* dst = mem_buf.MutableRawMemory() + i * mem_buf.RowLen();
+            for (size_t j = 0; j < buf.ColNum(); ++j)
+            {
+                dst[j] += src[j];
+            }
+        }
+    }
+}
+
+// The distance between two gradient rows of CollectRows in g, the evaluated gradient
+template <typename TGrad>
+size_t RowStride(const std::vector<size_t>& rows, const TGrad& g, size_t colNum)
+{
+    assert((g.RowNum() == 1) && (g.ColNum() == colNum));
+    if constexpr (IsMatrix<TGrad>)
+    {
+        assert(rows.size() == 1);
+        return 0;
+    }
+    else
+    {
+        assert(rows.size() == g.BatchNum());
+        return LowerAccess(g).RawMatrixSize();
+    }
+}
+
+// buf.row(rows[k]) += grad[k * stride, k * stride + buf.ColNum())
+template <typename TElement>
+void AddRows(Matrix<TElement, DeviceTags::CPU>& buf, const std::vector<size_t>& rows,
+             const TElement* grad, size_t stride)
+{
+    auto mem_buf = LowerAccess(buf);
+    for (size_t k = 0; k < rows.size(); ++k)
+    {
+        assert(rows[k] < buf.RowNum());
+        const TElement* src = grad + k * stride;
+        TElement* dst = mem_buf.MutableRawMemory() + rows[k] * mem_buf.RowLen();
+        for (size_t j = 0; j < buf.ColNum(); ++j)
+        {
+            dst[j] += src[j];
+        }
+    }
+}
+
+template <typename TElement>
+void ScaleInPlace(Matrix<TElement, DeviceTags::CPU>& buf, TElement factor)
+{
+    auto mem = LowerAccess(buf);
+    const size_t colNum = buf.ColNum();
+    ParallelFor(buf.RowNum(), colNum, [&mem, colNum, factor](size_t rowB, size_t rowE)
+                {
+                    for (size_t i = rowB; i < rowE; ++i)
+                    {
+                        TElement* p = mem.MutableRawMemory() + i * mem.RowLen();
+                        for (size_t j = 0; j < colNum; ++j)
+                        {
+                            p[j] *= factor;
+                        }
+                    }
+                });
+}
+}
+
 template <typename TElement, typename TDevice>
 class GradCollector
 {
 public:
-    GradCollector() = default;
+    // With accumulate, each weight owns one gradient buffer and Collect adds the gradient to it
+    // right away (a Dot is computed by a GEMM with beta = 1), so the memory does not grow with
+    // the number of collected gradients. MatrixGradInfo::grad then holds just this buffer.
+    // With keepRows, the gradients of CollectRows are kept as rows, visited by rows_begin() /
+    // rows_end(). Otherwise they are added to a dense gradient of the weight, visited by
+    // begin() / end() as those of Collect.
+    explicit GradCollector(bool accumulate = false, bool keepRows = false)
+        : m_accumulate(accumulate)
+        , m_keepRows(keepRows) {}
+
+    // Accumulates into the gradient block of arena for the weights in it (see ContainsView)
+    explicit GradCollector(ParamArena<TElement, TDevice>& arena, bool keepRows = false)
+        : m_accumulate(true)
+        , m_keepRows(keepRows)
+        , m_arena(&arena) {}
+
     GradCollector(const GradCollector&) = delete;
     GradCollector(GradCollector&&) = default;
     GradCollector& operator = (const GradCollector&) = delete;
@@ -79,10 +210,18 @@ public:
         auto mem = LowerAccess(weight);
         auto buf = mem.RawMemory();
 
+        if (m_accumulate)
+        {
+            Accumulate(weight, grad);
+            return;
+        }
+
         auto it = m_matricesInfo.find(buf);
 
         if (it != m_matricesInfo.end())
         {
+            // A sum kept by MergeGrads is no longer the only gradient
+            m_buffers.erase(buf);
             if constexpr(IsMatrix<TGrad>)
             {
                 it->second.grad.push_back(MakeDynamic(grad));
@@ -117,9 +256,146 @@ public:
         }
     }
 
+    // grad holds one gradient row (1 * weight.ColNum()) per entry of rows, in the same order.
+    // Without keepRows, the rows are added to a zeroed gradient of the size of weight (see
+    // CollectDenseRows). An accumulating collector adds the rows to the gradient buffer of
+    // weight if Collect made one, and to a buffer of the rows met so far otherwise (see
+    // AccumulateRows).
+    template<typename TGrad>
+    void CollectRows(const Matrix<TElement, TDevice>& weight,
+                     std::vector<size_t> rows, const TGrad& grad)
+    {
+        if (!m_keepRows)
+        {
+            CollectDenseRows(weight, rows, grad);
+            return;
+        }
+        if (m_accumulate)
+        {
+            AccumulateRows(weight, rows, grad);
+            return;
+        }
+
+        auto mem = LowerAccess(weight);
+        auto buf = mem.RawMemory();
+
+        auto it = m_rowsInfo.find(buf);
+        if (it == m_rowsInfo.end())
+        {
+            it = m_rowsInfo.insert({buf, MatrixRowGradInfo<TElement, TDevice>(weight)}).first;
+        }
+        m_rowSums.erase(buf);
+
+        if constexpr (IsMatrix<TGrad>)
+        {
+            assert(rows.size() == 1);
+            it->second.grad.push_back(MakeDynamic(MakeDuplicate(1, grad)));
+        }
+        else if constexpr (IsBatchMatrix<TGrad>)
+        {
+            assert(rows.size() == grad.BatchNum());
+            it->second.grad.push_back(MakeDynamic(grad));
+        }
+        else
+        {
+            static_assert(DependencyFalse<TGrad>);
+        }
+        it->second.rows.push_back(std::move(rows));
+    }
+
+    // Multiplies all gradients by factor: the buffers of the collector (those of an accumulating
+    // collector and the sums kept by MergeGrads) in place, the other gradients lazily
+    void Scale(TElement factor)
+    {
+        for (auto& [key, buf] : m_buffers)
+        {
+            NSGradCollector::ScaleInPlace(buf, factor);
+        }
+        for (auto& [key, info] : m_matricesInfo)
+        {
+            if (m_buffers.find(key) != m_buffers.end())
+            {
+                continue;
+            }
+            Array<typename MatrixGradInfo<TElement, TDevice>::GradItemType> scaled(info.grad.RowNum(),
+                                                                                  info.grad.ColNum());
+            scaled.push_back(MakeDynamic(Collapse(info.grad) * Scalar<TElement, TDevice>(factor)));
+            info.grad = std::move(scaled);
+        }
+        for (auto& [key, info] : m_rowsInfo)
+        {
+            if (auto sumIt = m_rowSums.find(key); sumIt != m_rowSums.end())
+            {
+                auto mem = LowerAccess(sumIt->second.buf);
+                TElement* p = mem.MutableRawMemory();
+                const size_t count = info.rows[0].size() * info.weight.ColNum();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    p[i] *= factor;
+                }
+                continue;
+            }
+            for (auto& g : info.grad)
+            {
+                g = MakeDynamic(g * Scalar<TElement, TDevice>(factor));
+            }
+        }
+    }
+
+    // Used by MergeGrads: the gradients of weight are replaced by their sum grad, which the
+    // collector scales in place if computed (and not one of the collected gradients)
+    void SetMerged(const Matrix<TElement, TDevice>& weight, Matrix<TElement, TDevice> grad, bool computed)
+    {
+        const TElement* key = LowerAccess(weight).RawMemory();
+        auto& info = m_matricesInfo.at(key);
+        Array<typename MatrixGradInfo<TElement, TDevice>::GradItemType> merged(info.grad.RowNum(),
+                                                                              info.grad.ColNum());
+        merged.push_back(MakeDynamic(grad));
+        info.grad = std::move(merged);
+        if (computed)
+        {
+            m_buffers[key] = std::move(grad);
+        }
+    }
+
+    // Used by MergeGrads: the row gradients of weight are replaced by sum, in which row k is the
+    // gradient of row rows[k] of weight
+    void SetMergedRows(const Matrix<TElement, TDevice>& weight, std::vector<size_t> rows,
+                       Batch<TElement, TDevice, CategoryTags::Matrix> sum)
+    {
+        const TElement* key = LowerAccess(weight).RawMemory();
+        auto& info = m_rowsInfo.at(key);
+        info.rows.clear();
+        info.rows.push_back(std::move(rows));
+        info.grad.clear();
+        info.grad.push_back(MakeDynamic(sum));
+        m_rowSums[key].buf = std::move(sum);
+    }
+
+    // Used by MergeGrads once the row gradients of weight are added to its dense gradient
+    void DropRows(const Matrix<TElement, TDevice>& weight)
+    {
+        const TElement* key = LowerAccess(weight).RawMemory();
+        m_rowsInfo.erase(key);
+        m_rowSums.erase(key);
+    }
+
     void clear()
     {
         m_matricesInfo.clear();
+        m_rowsInfo.clear();
+        m_buffers.clear();
+        m_rowSums.clear();
+    }
+
+    bool IsAccumulate() const
+    {
+        return m_accumulate;
+    }
+
+    bool IsKeepRows() const
+    {
+        return m_keepRows;
     }
 
     size_t size() const
@@ -147,7 +423,189 @@ public:
         return GradCollectorIterator<TElement, TDevice>(m_matricesInfo.end());
     }
 
+    // Weights collected through CollectRows with keepRows, they are not visited by begin() / end()
+    size_t rows_size() const
+    {
+        return m_rowsInfo.size();
+    }
+
+    auto rows_begin()
+    {
+        using InfoType = MatrixRowGradInfo<TElement, TDevice>;
+        return GradCollectorIterator<TElement, TDevice, InfoType>(m_rowsInfo.begin());
+    }
+
+    auto rows_end()
+    {
+        using InfoType = MatrixRowGradInfo<TElement, TDevice>;
+        return GradCollectorIterator<TElement, TDevice, InfoType>(m_rowsInfo.end());
+    }
+
 private:
+    template<typename TGrad>
+    void Accumulate(const Matrix<TElement, TDevice>& weight, const TGrad& grad)
+    {
+        static_assert(std::is_same<TDevice, DeviceTags::CPU>::value,
+                      "Gradient accumulation is only implemented on CPU");
+        static_assert(IsMatrix<TGrad> || IsBatchMatrix<TGrad>);
+
+        NSGradCollector::AddTo(DenseBuffer(weight), grad);
+    }
+
+    // The gradient buffer of weight, zeroed when created. Rows accumulated for weight before
+    // are moved into it.
+    Matrix<TElement, TDevice>& DenseBuffer(const Matrix<TElement, TDevice>& weight)
+    {
+        const TElement* key = LowerAccess(weight).RawMemory();
+        auto it = m_buffers.find(key);
+        if (it != m_buffers.end())
+        {
+            return it->second;
+        }
+
+        Matrix<TElement, TDevice> gradBuf = (m_arena && m_arena->ContainsView(weight)) ?
+                                            m_arena->Grad(weight) :
+                                            Matrix<TElement, TDevice>(weight.RowNum(), weight.ColNum());
+        auto mem = LowerAccess(gradBuf);
+        for (size_t i = 0; i < gradBuf.RowNum(); ++i)
+        {
+            memset(mem.MutableRawMemory() + i * mem.RowLen(), 0, sizeof(TElement) * gradBuf.ColNum());
+        }
+
+        MatrixGradInfo<TElement, TDevice> mgi(weight);
+        mgi.grad.push_back(MakeDynamic(gradBuf));
+        m_matricesInfo.insert({key, std::move(mgi)});
+        it = m_buffers.insert({key, std::move(gradBuf)}).first;
+
+        if (auto rowIt = m_rowsInfo.find(key); rowIt != m_rowsInfo.end())
+        {
+            const auto mem_rows = LowerAccess(m_rowSums.at(key).buf);
+            NSGradCollector::AddRows(it->second, rowIt->second.rows[0],
+                                     mem_rows.RawMemory(), mem_rows.RawMatrixSize());
+            m_rowsInfo.erase(rowIt);
+            m_rowSums.erase(key);
+        }
+        return it->second;
+    }
+
+    // The rows are added to the gradient buffer of weight (accumulate), or to a new zeroed
+    // matrix collected as a dense gradient
+    template<typename TGrad>
+    void CollectDenseRows(const Matrix<TElement, TDevice>& weight,
+                          const std::vector<size_t>& rows, const TGrad& grad)
+    {
+        static_assert(std::is_same<TDevice, DeviceTags::CPU>::value,
+                      "Row gradients are only implemented on CPU");
+        static_assert(IsMatrix<TGrad> || IsBatchMatrix<TGrad>);
+
+        const auto g = Evaluate(grad);
+        const size_t stride = NSGradCollector::RowStride(rows, g, weight.ColNum());
+        const TElement* src = LowerAccess(g).RawMemory();
+        if (m_accumulate)
+        {
+            NSGradCollector::AddRows(DenseBuffer(weight), rows, src, stride);
+            return;
+        }
+
+        Matrix<TElement, TDevice> dense(weight.RowNum(), weight.ColNum());
+        auto mem = LowerAccess(dense);
+        memset(mem.MutableRawMemory(), 0, sizeof(TElement) * weight.RowNum() * weight.ColNum());
+        NSGradCollector::AddRows(dense, rows, src, stride);
+        Collect(weight, dense);
+    }
+
+    // The rows of weight are summed into m_rowSums, reallocated twice as large (at most the row
+    // number of weight) when full, so the memory is bounded by the rows touched, not the steps
+    template<typename TGrad>
+    void AccumulateRows(const Matrix<TElement, TDevice>& weight,
+                        const std::vector<size_t>& rows, const TGrad& grad)
+    {
+        static_assert(std::is_same<TDevice, DeviceTags::CPU>::value,
+                      "Gradient accumulation is only implemented on CPU");
+        static_assert(IsMatrix<TGrad> || IsBatchMatrix<TGrad>);
+
+        const auto g = Evaluate(grad);
+        const auto mem_g = LowerAccess(g);
+        const size_t stride = NSGradCollector::RowStride(rows, g, weight.ColNum());
+
+        const TElement* key = LowerAccess(weight).RawMemory();
+        if (auto it = m_buffers.find(key); it != m_buffers.end())
+        {
+            NSGradCollector::AddRows(it->second, rows, mem_g.RawMemory(), stride);
+            return;
+        }
+
+        auto it = m_rowsInfo.find(key);
+        if (it == m_rowsInfo.end())
+        {
+            it = m_rowsInfo.insert({key, MatrixRowGradInfo<TElement, TDevice>(weight)}).first;
+            it->second.rows.emplace_back();
+        }
+        auto& info = it->second;
+        auto& touched = info.rows[0];
+        auto& sum = m_rowSums[key];
+
+        std::vector<size_t> pos(rows.size());
+        const size_t oldNum = touched.size();
+        for (size_t k = 0; k < rows.size(); ++k)
+        {
+            assert(rows[k] < weight.RowNum());
+            auto [posIt, isNew] = sum.pos.insert({rows[k], touched.size()});
+            if (isNew)
+            {
+                touched.push_back(rows[k]);
+            }
+            pos[k] = posIt->second;
+        }
+
+        const size_t colNum = weight.ColNum();
+        if (touched.size() > sum.buf.BatchNum())
+        {
+            const size_t capacity = std::min(weight.RowNum(),
+                                             std::max(touched.size(), 2 * sum.buf.BatchNum()));
+            Batch<TElement, TDevice, CategoryTags::Matrix> newBuf(capacity, 1, colNum);
+            auto mem_new = LowerAccess(newBuf);
+            memset(mem_new.MutableRawMemory(), 0, sizeof(TElement) * capacity * colNum);
+            if (oldNum != 0)
+            {
+                const auto mem_old = LowerAccess(sum.buf);
+                memcpy(mem_new.MutableRawMemory(), mem_old.RawMemory(), sizeof(TElement) * oldNum * colNum);
+            }
+            sum.buf = std::move(newBuf);
+        }
+
+        auto mem_sum = LowerAccess(sum.buf);
+        for (size_t k = 0; k < rows.size(); ++k)
+        {
+            const TElement* src = mem_g.RawMemory() + k * stride;
+            TElement* dst = mem_sum.MutableRawMemory() + pos[k] * colNum;
+            for (size_t j = 0; j < colNum; ++j)
+            {
+                dst[j] += src[j];
+            }
+        }
+
+        auto view = sum.buf;
+        view.ShrinkBatch(touched.size());
+        info.grad.clear();
+        info.grad.push_back(MakeDynamic(view));
+    }
+
+private:
+    bool m_accumulate;
+    bool m_keepRows;
+    ParamArena<TElement, TDevice>* m_arena = nullptr;
     std::unordered_map<const TElement*, MatrixGradInfo<TElement, TDevice>> m_matricesInfo;
+    std::unordered_map<const TElement*, MatrixRowGradInfo<TElement, TDevice>> m_rowsInfo;
+    std::unordered_map<const TElement*, Matrix<TElement, TDevice>> m_buffers;
+
+    // Rows summed by AccumulateRows or MergeGrads, row k of buf is the gradient of row rows[0][k]
+    // of the weight and pos maps a row of the weight to k (for AccumulateRows)
+    struct RowSum
+    {
+        Batch<TElement, TDevice, CategoryTags::Matrix> buf;
+        std::unordered_map<size_t, size_t> pos;
+    };
+    std::unordered_map<const TElement*, RowSum> m_rowSums;
 };
 }
@@ -0,0 +1,133 @@
+#pragma once
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/model/grad_col/merged_grad.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace MetaNN
+{
+template <typename TElement, typename TDevice>
+struct GradNormInfo
+{
+    Matrix<TElement, TDevice> weight;
+    TElement l1;
+    TElement l2;
+};
+
+template <typename TElement, typename TDevice>
+struct GradNorms
+{
+    std::vector<GradNormInfo<TElement, TDevice>> params;
+    TElement l1 = TElement();
+    TElement l2 = TElement();
+};
+
+namespace NSGradNorm
+{
+constexpr size_t SegmentSize = 1 << 14;
+
+// The L1 norm and the squared L2 norm of len elements
+template <typename TElement>
+std::array<double, 2> Reduce(const TElement* p, size_t len)
+{
+    double l1 = 0;
+    double l2 = 0;
+    for (size_t j = 0; j < len; ++j)
+    {
+        l1 += std::abs(p[j]);
+        l2 += (double)p[j] * p[j];
+    }
+    return {l1, l2};
+}
+}
+
+// The L1 and L2 norms of the gradient of each weight in col and of all of them, in one pass
+// over the evaluated gradients. Each weight is counted once, with all its gradients summed.
+// Segments of similar size are reduced in parallel and added up in a fixed order, so the result
+// does not depend on the number of threads.
+template <typename TElement, typename TDevice>
+GradNorms<TElement, TDevice> GradNorm(GradCollector<TElement, TDevice>& col)
+{
+    const auto grads = MergeGrads(col);
+
+    struct Segment
+    {
+        size_t param;
+        size_t b;
+        size_t e;
+    };
+    std::vector<Segment> segments;
+    for (size_t i = 0; i < grads.size(); ++i)
+    {
+        const auto& g = grads[i].grad;
+        const bool flat = (LowerAccess(g).RowLen() == g.ColNum()) || (g.RowNum() <= 1);
+        const size_t count = flat ? g.RowNum() * g.ColNum() : g.RowNum();
+        const size_t step = flat ? NSGradNorm::SegmentSize
+                                 : std::max<size_t>(1, NSGradNorm::SegmentSize / std::max<size_t>(g.ColNum(), 1));
+        for (size_t b = 0; b < count; b += step)
+        {
+            segments.push_back(Segment{i, b, std::min(count, b + step)});
+        }
+    }
+
+    std::vector<std::array<double, 2>> partial(segments.size());
+    ParallelFor(segments.size(), NSGradNorm::SegmentSize, [&](size_t segB, size_t segE)
+                {
+                    for (size_t id = segB; id < segE; ++id)
+                    {
+                        const Segment& seg = segments[id];
+                        const auto& g = grads[seg.param].grad;
+                        const auto mem = LowerAccess(g);
+                        if ((mem.RowLen() == g.ColNum()) || (g.RowNum() <= 1))
+                        {
+                            partial[id] = NSGradNorm::Reduce(mem.RawMemory() + seg.b, seg.e - seg.b);
+                            continue;
+                        }
+                        std::array<double, 2> sum{0, 0};
+                        for (size_t r = seg.b; r < seg.e; ++r)
+                        {
+                            const auto cur = NSGradNorm::Reduce(mem.RawMemory() + r * mem.RowLen(), g.ColNum());
+                            sum[0] += cur[0];
+                            sum[1] += cur[1];
+                        }
+                        partial[id] = sum;
+                    }
+                });
+
+    GradNorms<TElement, TDevice> res;
+    std::vector<std::array<double, 2>> perParam(grads.size(), std::array<double, 2>{0, 0});
+    for (size_t id = 0; id < segments.size(); ++id)
+    {
+        perParam[segments[id].param][0] += partial[id][0];
+        perParam[segments[id].param][1] += partial[id][1];
+    }
+    double l1 = 0;
+    double l2 = 0;
+    for (size_t i = 0; i < grads.size(); ++i)
+    {
+        res.params.push_back(GradNormInfo<TElement, TDevice>{grads[i].weight, (TElement)perParam[i][0],
+                                                             (TElement)std::sqrt(perParam[i][1])});
+        l1 += perParam[i][0];
+        l2 += perParam[i][1];
+    }
+    res.l1 = (TElement)l1;
+    res.l2 = (TElement)std::sqrt(l2);
+    return res;
+}
+
+// Scales the gradients of col down so that their global L2 norm is at most maxNorm. Returns the
+// norms before clipping. GradNorm leaves the merged gradients in col, so they are read once for
+// the norms and scaled once, and a later MergeGrads (e.g. that of the optimizer) reuses them.
+template <typename TElement, typename TDevice>
+GradNorms<TElement, TDevice> ClipGradByGlobalNorm(GradCollector<TElement, TDevice>& col, TElement maxNorm)
+{
+    auto res = GradNorm(col);
+    if (res.l2 > maxNorm)
+    {
+        col.Scale(maxNorm / res.l2);
+    }
+    return res;
+}
+}
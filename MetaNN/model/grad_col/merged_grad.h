@@ -0,0 +1,212 @@
+#pragma once
+#include <MetaNN/model/grad_col/grad_collector.h>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace MetaNN
+{
+// The gradient of one weight, evaluated and summed over everything collected for it. When
+// sparse, row k of grad is the gradient of row rows[k] of weight, each row appearing once.
+template <typename TElement, typename TDevice>
+struct MergedGrad
+{
+    Matrix<TElement, TDevice> weight;
+    Matrix<TElement, TDevice> grad;
+    std::vector<size_t> rows;
+    bool sparse = false;
+};
+
+namespace NSMergedGrad
+{
+template <typename TGrad, typename TFun>
+void ForEachGradRow(const std::vector<size_t>& rows, const TGrad& grad, const TFun& fun)
+{
+    assert(rows.size() == grad.BatchNum());
+    const auto mem = LowerAccess(grad);
+    for (size_t k = 0; k < rows.size(); ++k)
+    {
+        fun(rows[k], mem.RawMemory() + k * mem.RawMatrixSize());
+    }
+}
+
+// A batch of 1 * colNum matrices viewed as one matrix of BatchNum() rows, sharing its memory
+template <typename TElement, typename TDevice>
+Matrix<TElement, TDevice> RowMatrix(const Batch<TElement, TDevice, CategoryTags::Matrix>& rows)
+{
+    const auto mem = LowerAccess(rows);
+    assert((rows.BatchNum() > 0) && (rows.RowNum() == 1) && (mem.RawMatrixSize() == rows.ColNum()));
+    return Matrix<TElement, TDevice>(LowerAccess(rows[0]).SharedMemory(), (TElement*)mem.RawMemory(),
+                                     rows.BatchNum(), rows.ColNum(), rows.ColNum());
+}
+}
+
+// Evaluates all gradients of col in one EvalPlan::Eval. A weight with one dense gradient (e.g.
+// the buffer of an accumulating collector) gets this gradient itself, without copy. Row
+// gradients are added to the dense gradient of their weight if there is one, and summed into
+// a sparse gradient otherwise (rows already summed by an accumulating collector are not copied).
+// The sums replace the gradients in col, so that Scale works on them in place and a later
+// MergeGrads, e.g. that of the optimizer after ClipGradByGlobalNorm, does not evaluate again.
+template <typename TElement, typename TDevice>
+std::vector<MergedGrad<TElement, TDevice>> MergeGrads(GradCollector<TElement, TDevice>& col)
+{
+    static_assert(std::is_same<TDevice, DeviceTags::CPU>::value,
+                  "MergeGrads is only implemented on CPU");
+    using ItemHandle = decltype(col.begin()->grad[0].EvalRegister());
+    using DenseHandle = decltype(Collapse(col.begin()->grad).EvalRegister());
+    using RowHandle = decltype(col.rows_begin()->grad[0].EvalRegister());
+
+    std::vector<MergedGrad<TElement, TDevice>> res;
+    std::vector<ItemHandle> itemHandles;
+    std::vector<DenseHandle> denseHandles;
+    std::vector<bool> isSingle;
+    for (auto it = col.begin(); it != col.end(); ++it)
+    {
+        res.push_back(MergedGrad<TElement, TDevice>{it->weight, {}, {}, false});
+        isSingle.push_back(it->grad.size() == 1);
+        if (isSingle.back())
+        {
+            itemHandles.push_back(it->grad[0].EvalRegister());
+        }
+        else
+        {
+            denseHandles.push_back(Collapse(it->grad).EvalRegister());
+        }
+    }
+
+    std::vector<const MatrixRowGradInfo<TElement, TDevice>*> rowInfos;
+    std::vector<std::vector<RowHandle>> rowHandles;
+    for (auto it = col.rows_begin(); it != col.rows_end(); ++it)
+    {
+        rowInfos.push_back(&(*it));
+        rowHandles.emplace_back();
+        for (const auto& g : it->grad)
+        {
+            rowHandles.back().push_back(g.EvalRegister());
+        }
+    }
+    EvalPlan<TDevice>::Eval();
+
+    std::unordered_map<const TElement*, size_t> denseIds;
+    std::vector<bool> denseComputed(res.size(), false);
+    size_t itemId = 0;
+    size_t denseId = 0;
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        auto& cur = res[i];
+        cur.grad = isSingle[i] ? itemHandles[itemId++].Data() : denseHandles[denseId++].Data();
+        denseComputed[i] = !isSingle[i];
+        if ((cur.grad.RowNum() != cur.weight.RowNum()) || (cur.grad.ColNum() != cur.weight.ColNum()))
+        {
+            throw std::runtime_error("Gradient and weight do not match in MergeGrads");
+        }
+        denseIds.insert({LowerAccess(cur.weight).RawMemory(), i});
+    }
+
+    std::vector<Matrix<TElement, TDevice>> rowsToDense;
+    std::vector<Batch<TElement, TDevice, CategoryTags::Matrix>> rowSums;
+    std::vector<bool> rowComputed;
+    for (size_t i = 0; i < rowInfos.size(); ++i)
+    {
+        const auto& info = *rowInfos[i];
+        const size_t colNum = info.weight.ColNum();
+        const TElement* key = LowerAccess(info.weight).RawMemory();
+        if (auto it = denseIds.find(key); it != denseIds.end())
+        {
+            auto& dense = res[it->second].grad;
+            Matrix<TElement, TDevice> sum(dense.RowNum(), colNum);
+            auto mem_sum = LowerAccess(sum);
+            const auto mem_dense = LowerAccess(dense);
+            for (size_t r = 0; r < sum.RowNum(); ++r)
+            {
+                std::copy(mem_dense.RawMemory() + r * mem_dense.RowLen(),
+                          mem_dense.RawMemory() + r * mem_dense.RowLen() + colNum,
+                          mem_sum.MutableRawMemory() + r * mem_sum.RowLen());
+            }
+            for (size_t k = 0; k < info.grad.size(); ++k)
+            {
+                NSMergedGrad::ForEachGradRow(info.rows[k], rowHandles[i][k].Data(),
+                                             [&mem_sum, colNum](size_t row, const TElement* g)
+                                             {
+                                                 TElement* dst = mem_sum.MutableRawMemory() + row * mem_sum.RowLen();
+                                                 for (size_t j = 0; j < colNum; ++j) dst[j] += g[j];
+                                             });
+            }
+            dense = std::move(sum);
+            denseComputed[it->second] = true;
+            rowsToDense.push_back(info.weight);
+            continue;
+        }
+
+        // Repeated rows are summed, so that each row appears once
+        std::unordered_map<size_t, size_t> pos;
+        MergedGrad<TElement, TDevice> cur{info.weight, {}, {}, true};
+        size_t rowNum = 0;
+        for (const auto& rows : info.rows)
+        {
+            rowNum += rows.size();
+            for (size_t row : rows)
+            {
+                if (pos.insert({row, cur.rows.size()}).second)
+                {
+                    cur.rows.push_back(row);
+                }
+            }
+        }
+        if (cur.rows.empty())
+        {
+            continue;
+        }
+
+        Batch<TElement, TDevice, CategoryTags::Matrix> sum;
+        if ((info.grad.size() == 1) && (rowNum == cur.rows.size()) &&
+            (rowHandles[i][0].Data().RowNum() == 1) && (LowerAccess(rowHandles[i][0].Data()).RawMatrixSize() == colNum))
+        {
+            sum = rowHandles[i][0].Data();
+            rowComputed.push_back(false);
+        }
+        else
+        {
+            rowComputed.push_back(true);
+            sum = Batch<TElement, TDevice, CategoryTags::Matrix>(cur.rows.size(), 1, colNum);
+            auto mem_sum = LowerAccess(sum);
+            memset(mem_sum.MutableRawMemory(), 0, sizeof(TElement) * cur.rows.size() * colNum);
+            for (size_t k = 0; k < info.grad.size(); ++k)
+            {
+                NSMergedGrad::ForEachGradRow(info.rows[k], rowHandles[i][k].Data(),
+                                             [&](size_t row, const TElement* g)
+                                             {
+                                                 TElement* dst = mem_sum.MutableRawMemory() + pos[row] * colNum;
+                                                 for (size_t j = 0; j < colNum; ++j) dst[j] += g[j];
+                                             });
+            }
+        }
+        cur.grad = NSMergedGrad::RowMatrix(sum);
+        rowSums.push_back(std::move(sum));
+        res.push_back(std::move(cur));
+    }
+
+    if (!col.IsAccumulate())
+    {
+        for (size_t i = 0; i < denseComputed.size(); ++i)
+        {
+            col.SetMerged(res[i].weight, res[i].grad, denseComputed[i]);
+        }
+        for (const auto& weight : rowsToDense)
+        {
+            col.DropRows(weight);
+        }
+        for (size_t i = 0; i < rowSums.size(); ++i)
+        {
+            if (rowComputed[i])
+            {
+                const auto& cur = res[denseComputed.size() + i];
+                col.SetMergedRows(cur.weight, cur.rows, rowSums[i]);
+            }
+        }
+    }
+    return res;
+}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <MetaNN/model/optimizer/facilities/optimizer.h>
+
+namespace MetaNN
+{
+// s += g * g, w -= lr * g / (sqrt(s) + eps)
+template <typename TElem, typename TDevice>
+class AdaGrad : public Optimizer<AdaGrad<TElem, TDevice>, TElem, TDevice, 1>
+{
+    using BaseType = Optimizer<AdaGrad<TElem, TDevice>, TElem, TDevice, 1>;
+
+public:
+    AdaGrad(TElem learningRate, TElem eps = (TElem)1e-8)
+        : BaseType(learningRate)
+        , m_eps(eps) {}
+
+    auto Rule() const
+    {
+        const TElem lr = this->LearningRate();
+        const TElem eps = m_eps;
+        return [lr, eps](auto& w, const auto& g, auto& s)
+        {
+            s = s + g * g;
+            w = w - lr * g / (NSOptimizer::Sqrt(s) + eps);
+        };
+    }
+
+private:
+    TElem m_eps;
+};
+}
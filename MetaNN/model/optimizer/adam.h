@@ -0,0 +1,49 @@
+#pragma once
+
+#include <MetaNN/model/optimizer/facilities/optimizer.h>
+#include <cmath>
+
+namespace MetaNN
+{
+// m = beta1 * m + (1 - beta1) * g, v = beta2 * v + (1 - beta2) * g * g,
+// w -= lr * m_hat / (sqrt(v_hat) + eps) with the bias-corrected m_hat and v_hat of step t.
+// The corrections are folded into the step size and eps, so they cost nothing per element.
+template <typename TElem, typename TDevice>
+class Adam : public Optimizer<Adam<TElem, TDevice>, TElem, TDevice, 2>
+{
+    using BaseType = Optimizer<Adam<TElem, TDevice>, TElem, TDevice, 2>;
+
+public:
+    Adam(TElem learningRate, TElem beta1 = (TElem)0.9, TElem beta2 = (TElem)0.999,
+         TElem eps = (TElem)1e-8)
+        : BaseType(learningRate)
+        , m_beta1(beta1)
+        , m_beta2(beta2)
+        , m_eps(eps) {}
+
+    auto Rule() const
+    {
+        const double t = (double)this->StepNum();
+        const double c1 = 1 - std::pow((double)m_beta1, t);
+        const double c2 = std::sqrt(1 - std::pow((double)m_beta2, t));
+
+        const TElem lr = (TElem)(this->LearningRate() * c2 / c1);
+        const TElem eps = (TElem)(m_eps * c2);
+        const TElem b1 = m_beta1;
+        const TElem b1c = 1 - m_beta1;
+        const TElem b2 = m_beta2;
+        const TElem b2c = 1 - m_beta2;
+        return [lr, eps, b1, b1c, b2, b2c](auto& w, const auto& g, auto& m, auto& v)
+        {
+            m = b1 * m + b1c * g;
+            v = b2 * v + b2c * g * g;
+            w = w - lr * m / (NSOptimizer::Sqrt(v) + eps);
+        };
+    }
+
+private:
+    TElem m_beta1;
+    TElem m_beta2;
+    TElem m_eps;
+};
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/model/grad_col/merged_grad.h>
+#include <MetaNN/model/optimizer/facilities/simd_lane.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace MetaNN
+{
+namespace NSOptimizer
+{
+// fun(w, g, s...) on one row: Width elements per step as a Lane, then the remaining ones
+template <typename TElem, size_t TStateNum, typename TFun, size_t... I>
+void UpdateRow(const TFun& fun, size_t len, TElem* w, const TElem* g,
+               const std::array<TElem*, TStateNum>& s, std::index_sequence<I...>)
+{
+    using TLane = LaneType<TElem>;
+    size_t j = 0;
+    if constexpr (!std::is_same<TLane, TElem>::value)
+    {
+        for (; j + TLane::Width <= len; j += TLane::Width)
+        {
+            TLane lw = TLane::Load(w + j);
+            const TLane lg = TLane::Load(g + j);
+            std::array<TLane, TStateNum> ls{TLane::Load(s[I] + j)...};
+            fun(lw, lg, ls[I]...);
+            lw.Store(w + j);
+            (ls[I].Store(s[I] + j), ...);
+        }
+    }
+    for (; j < len; ++j)
+    {
+        fun(w[j], g[j], s[I][j]...);
+    }
+}
+
+template <typename TElem>
+void ZeroFill(Matrix<TElem, DeviceTags::CPU>& mat)
+{
+    auto mem = LowerAccess(mat);
+    for (size_t i = 0; i < mat.RowNum(); ++i)
+    {
+        memset(mem.MutableRawMemory() + i * mem.RowLen(), 0, sizeof(TElem) * mat.ColNum());
+    }
+}
+}
+
+// Applies the gradients of a GradCollector to the weights in place. Each weight has TStateNum
+// weight-sized state matrices. TDerived::Rule() is called once per Update and returns
+// fun(w, g, s...), which updates one weight element (or one Lane of them) from its gradient
+// and its states.
+// A weight is identified by its memory, as in GradCollector: a weight shared by several layers
+// has one gradient and one state. Weights only updated through CollectRows of a collector with
+// keepRows (e.g. embeddings) have just their gradient rows updated, the states of the other rows are left untouched.
+template <typename TDerived, typename TElem, typename TDevice, size_t TStateNum>
+class Optimizer
+{
+    static_assert(std::is_same<TDevice, DeviceTags::CPU>::value,
+                  "Optimizers are only implemented on CPU");
+
+public:
+    Optimizer(TElem learningRate)
+        : m_learningRate(learningRate) {}
+
+    TElem LearningRate() const
+    {
+        return m_learningRate;
+    }
+
+    void SetLearningRate(TElem learningRate)
+    {
+        m_learningRate = learningRate;
+    }
+
+    size_t StepNum() const
+    {
+        return m_stepNum;
+    }
+
+    // One step over all weights in col. The collector is not cleared.
+    void Update(GradCollector<TElem, TDevice>& col)
+    {
+        constexpr size_t StateNum = TStateNum;
+        ++m_stepNum;
+
+        const auto grads = MergeGrads(col);
+        std::vector<Param> params;
+        for (const auto& merged : grads)
+        {
+            const auto& weight = merged.weight;
+            auto mem_w = LowerAccess(weight);
+            auto& states = GetStates(weight);
+
+            Param param;
+            // A write access: the packed GEMM panels of the weight (EnablePackCache) are rebuilt
+            param.weight = mem_w.MutableRawMemory();
+            param.weightRowLen = mem_w.RowLen();
+            param.colNum = weight.ColNum();
+            param.stateRowLen = 0;
+            for (size_t s = 0; s < StateNum; ++s)
+            {
+                auto mem_s = LowerAccess(states[s]);
+                param.states[s] = mem_s.MutableRawMemory();
+                param.stateRowLen = mem_s.RowLen();
+            }
+            const auto mem_g = LowerAccess(merged.grad);
+            param.grad = mem_g.RawMemory();
+            param.gradRowLen = mem_g.RowLen();
+            param.rowNum = merged.grad.RowNum();
+            param.rows = merged.sparse ? merged.rows.data() : nullptr;
+            params.push_back(param);
+        }
+
+        // Rows of all weights are cut into segments of similar size, updated in parallel. A dense
+        // weight stored without gaps between rows (e.g. in a ParamArena), with such gradient and
+        // states, is cut as one flat array.
+        struct Segment
+        {
+            size_t param;
+            size_t b;
+            size_t e;
+        };
+        std::vector<Segment> segments;
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            auto& p = params[i];
+            p.flat = (p.rows == nullptr) && (p.weightRowLen == p.colNum) && (p.gradRowLen == p.colNum) &&
+                     ((StateNum == 0) || (p.stateRowLen == p.colNum));
+            const size_t count = p.flat ? p.rowNum * p.colNum : p.rowNum;
+            const size_t step = p.flat ? SegmentSize : std::max<size_t>(1, SegmentSize / std::max<size_t>(p.colNum, 1));
+            for (size_t b = 0; b < count; b += step)
+            {
+                segments.push_back(Segment{i, b, std::min(count, b + step)});
+            }
+        }
+
+        const auto fun = static_cast<TDerived&>(*this).Rule();
+        ParallelFor(segments.size(), SegmentSize * (2 + StateNum), [&](size_t segB, size_t segE)
+                    {
+                        for (size_t id = segB; id < segE; ++id)
+                        {
+                            const Segment& seg = segments[id];
+                            const Param& p = params[seg.param];
+                            std::array<TElem*, StateNum> s;
+                            if (p.flat)
+                            {
+                                for (size_t k = 0; k < StateNum; ++k)
+                                {
+                                    s[k] = p.states[k] + seg.b;
+                                }
+                                NSOptimizer::UpdateRow(fun, seg.e - seg.b, p.weight + seg.b, p.grad + seg.b, s,
+                                                       std::make_index_sequence<StateNum>());
+                                continue;
+                            }
+                            for (size_t r = seg.b; r < seg.e; ++r)
+                            {
+                                const size_t row = p.rows ? p.rows[r] : r;
+                                for (size_t k = 0; k < StateNum; ++k)
+                                {
+                                    s[k] = p.states[k] + row * p.stateRowLen;
+                                }
+                                NSOptimizer::UpdateRow(fun, p.colNum, p.weight + row * p.weightRowLen,
+                                                       p.grad + r * p.gradRowLen, s,
+                                                       std::make_index_sequence<StateNum>());
+                            }
+                        }
+                    });
+    }
+
+    // Drops the states of all weights
+    void Reset()
+    {
+        m_states.clear();
+        m_stepNum = 0;
+    }
+
+private:
+    static constexpr size_t SegmentSize = 1 << 14;
+
+    struct Param
+    {
+        TElem* weight;
+        size_t weightRowLen;
+        const TElem* grad;
+        size_t gradRowLen;
+        std::array<TElem*, TStateNum> states;
+        size_t stateRowLen;
+        size_t colNum;
+        size_t rowNum;
+        const size_t* rows;
+        bool flat;
+    };
+
+    struct StateEntry
+    {
+        std::weak_ptr<TElem> owner;
+        size_t rowNum;
+        size_t colNum;
+        std::array<Matrix<TElem, TDevice>, TStateNum> states;
+    };
+
+    // The states of a weight start at zero. They are dropped when the memory of the weight has
+    // been released, so that a new weight at the same address starts afresh.
+    auto& GetStates(const Matrix<TElem, TDevice>& weight)
+    {
+        const auto mem = LowerAccess(weight);
+        auto it = m_states.find(mem.RawMemory());
+        if ((it != m_states.end()) && (it->second.owner.expired() || (it->second.rowNum != weight.RowNum()) ||
+                                       (it->second.colNum != weight.ColNum())))
+        {
+            m_states.erase(it);
+            it = m_states.end();
+        }
+        if (it == m_states.end())
+        {
+            StateEntry entry;
+            entry.owner = mem.SharedMemory();
+            entry.rowNum = weight.RowNum();
+            entry.colNum = weight.ColNum();
+            for (auto& state : entry.states)
+            {
+                state = Matrix<TElem, TDevice>(weight.RowNum(), weight.ColNum());
+                NSOptimizer::ZeroFill(state);
+            }
+            it = m_states.insert({mem.RawMemory(), std::move(entry)}).first;
+        }
+        return it->second.states;
+    }
+
+private:
+    TElem m_learningRate;
+    size_t m_stepNum = 0;
+    std::unordered_map<const TElem*, StateEntry> m_states;
+};
+}
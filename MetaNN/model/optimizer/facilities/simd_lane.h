@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace MetaNN
+{
+namespace NSOptimizer
+{
+// The update rules are written once against a value type T: T is either the element type itself
+// (scalar tail) or a Lane holding Width elements in one SIMD register.
+template <typename TOps>
+struct Lane
+{
+    using ElementType = typename TOps::ElementType;
+    using RegType = typename TOps::RegType;
+    static constexpr size_t Width = TOps::Width;
+
+    Lane(RegType val) : m_val(val) {}
+    Lane(ElementType val) : m_val(TOps::Set1(val)) {}
+
+    static Lane Load(const ElementType* p) { return TOps::Load(p); }
+    void Store(ElementType* p) const { TOps::Store(p, m_val); }
+
+    friend Lane operator+ (Lane a, Lane b) { return TOps::Add(a.m_val, b.m_val); }
+    friend Lane operator- (Lane a, Lane b) { return TOps::Sub(a.m_val, b.m_val); }
+    friend Lane operator* (Lane a, Lane b) { return TOps::Mul(a.m_val, b.m_val); }
+    friend Lane operator/ (Lane a, Lane b) { return TOps::Div(a.m_val, b.m_val); }
+
+    RegType m_val;
+};
+
+template <typename TOps>
+Lane<TOps> Sqrt(Lane<TOps> x) { return TOps::Sqrt(x.m_val); }
+
+inline float Sqrt(float x) { return std::sqrt(x); }
+inline double Sqrt(double x) { return std::sqrt(x); }
+
+#if defined(__AVX512F__)
+struct LaneOpsFloat
+{
+    using ElementType = float;
+    using RegType = __m512;
+    static constexpr size_t Width = 16;
+    static RegType Set1(float v) { return _mm512_set1_ps(v); }
+    static RegType Load(const float* p) { return _mm512_loadu_ps(p); }
+    static void Store(float* p, RegType v) { _mm512_storeu_ps(p, v); }
+    static RegType Add(RegType a, RegType b) { return _mm512_add_ps(a, b); }
+    static RegType Sub(RegType a, RegType b) { return _mm512_sub_ps(a, b); }
+    static RegType Mul(RegType a, RegType b) { return _mm512_mul_ps(a, b); }
+    static RegType Div(RegType a, RegType b) { return _mm512_div_ps(a, b); }
+    // the zero-masking form: _mm512_sqrt_ps trips -Wmaybe-uninitialized in the GCC headers
+    static RegType Sqrt(RegType a) { return _mm512_maskz_sqrt_ps((__mmask16)-1, a); }
+};
+
+struct LaneOpsDouble
+{
+    using ElementType = double;
+    using RegType = __m512d;
+    static constexpr size_t Width = 8;
+    static RegType Set1(double v) { return _mm512_set1_pd(v); }
+    static RegType Load(const double* p) { return _mm512_loadu_pd(p); }
+    static void Store(double* p, RegType v) { _mm512_storeu_pd(p, v); }
+    static RegType Add(RegType a, RegType b) { return _mm512_add_pd(a, b); }
+    static RegType Sub(RegType a, RegType b) { return _mm512_sub_pd(a, b); }
+    static RegType Mul(RegType a, RegType b) { return _mm512_mul_pd(a, b); }
+    static RegType Div(RegType a, RegType b) { return _mm512_div_pd(a, b); }
+    static RegType Sqrt(RegType a) { return _mm512_maskz_sqrt_pd((__mmask8)-1, a); }
+};
+#elif defined(__AVX__)
+struct LaneOpsFloat
+{
+    using ElementType = float;
+    using RegType = __m256;
+    static constexpr size_t Width = 8;
+    static RegType Set1(float v) { return _mm256_set1_ps(v); }
+    static RegType Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, RegType v) { _mm256_storeu_ps(p, v); }
+    static RegType Add(RegType a, RegType b) { return _mm256_add_ps(a, b); }
+    static RegType Sub(RegType a, RegType b) { return _mm256_sub_ps(a, b); }
+    static RegType Mul(RegType a, RegType b) { return _mm256_mul_ps(a, b); }
+    static RegType Div(RegType a, RegType b) { return _mm256_div_ps(a, b); }
+    static RegType Sqrt(RegType a) { return _mm256_sqrt_ps(a); }
+};
+
+struct LaneOpsDouble
+{
+    using ElementType = double;
+    using RegType = __m256d;
+    static constexpr size_t Width = 4;
+    static RegType Set1(double v) { return _mm256_set1_pd(v); }
+    static RegType Load(const double* p) { return _mm256_loadu_pd(p); }
+    static void Store(double* p, RegType v) { _mm256_storeu_pd(p, v); }
+    static RegType Add(RegType a, RegType b) { return _mm256_add_pd(a, b); }
+    static RegType Sub(RegType a, RegType b) { return _mm256_sub_pd(a, b); }
+    static RegType Mul(RegType a, RegType b) { return _mm256_mul_pd(a, b); }
+    static RegType Div(RegType a, RegType b) { return _mm256_div_pd(a, b); }
+    static RegType Sqrt(RegType a) { return _mm256_sqrt_pd(a); }
+};
+#elif defined(__SSE2__)
+struct LaneOpsFloat
+{
+    using ElementType = float;
+    using RegType = __m128;
+    static constexpr size_t Width = 4;
+    static RegType Set1(float v) { return _mm_set1_ps(v); }
+    static RegType Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, RegType v) { _mm_storeu_ps(p, v); }
+    static RegType Add(RegType a, RegType b) { return _mm_add_ps(a, b); }
+    static RegType Sub(RegType a, RegType b) { return _mm_sub_ps(a, b); }
+    static RegType Mul(RegType a, RegType b) { return _mm_mul_ps(a, b); }
+    static RegType Div(RegType a, RegType b) { return _mm_div_ps(a, b); }
+    static RegType Sqrt(RegType a) { return _mm_sqrt_ps(a); }
+};
+
+struct LaneOpsDouble
+{
+    using ElementType = double;
+    using RegType = __m128d;
+    static constexpr size_t Width = 2;
+    static RegType Set1(double v) { return _mm_set1_pd(v); }
+    static RegType Load(const double* p) { return _mm_loadu_pd(p); }
+    static void Store(double* p, RegType v) { _mm_storeu_pd(p, v); }
+    static RegType Add(RegType a, RegType b) { return _mm_add_pd(a, b); }
+    static RegType Sub(RegType a, RegType b) { return _mm_sub_pd(a, b); }
+    static RegType Mul(RegType a, RegType b) { return _mm_mul_pd(a, b); }
+    static RegType Div(RegType a, RegType b) { return _mm_div_pd(a, b); }
+    static RegType Sqrt(RegType a) { return _mm_sqrt_pd(a); }
+};
+#endif
+
+// LaneType<TElem> is TElem itself when there is no SIMD type for it
+template <typename TElem>
+struct LaneType_ { using type = TElem; };
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+template <>
+struct LaneType_<float> { using type = Lane<LaneOpsFloat>; };
+
+template <>
+struct LaneType_<double> { using type = Lane<LaneOpsDouble>; };
+#endif
+
+template <typename TElem>
+using LaneType = typename LaneType_<TElem>::type;
+}
+}
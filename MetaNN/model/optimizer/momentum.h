@@ -0,0 +1,32 @@
+#pragma once
+
+#include <MetaNN/model/optimizer/facilities/optimizer.h>
+
+namespace MetaNN
+{
+// v = momentum * v + g, w -= lr * v
+template <typename TElem, typename TDevice>
+class Momentum : public Optimizer<Momentum<TElem, TDevice>, TElem, TDevice, 1>
+{
+    using BaseType = Optimizer<Momentum<TElem, TDevice>, TElem, TDevice, 1>;
+
+public:
+    Momentum(TElem learningRate, TElem momentum = (TElem)0.9)
+        : BaseType(learningRate)
+        , m_momentum(momentum) {}
+
+    auto Rule() const
+    {
+        const TElem lr = this->LearningRate();
+        const TElem mu = m_momentum;
+        return [lr, mu](auto& w, const auto& g, auto& v)
+        {
+            v = mu * v + g;
+            w = w - lr * v;
+        };
+    }
+
+private:
+    TElem m_momentum;
+};
+}
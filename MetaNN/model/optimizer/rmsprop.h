@@ -0,0 +1,36 @@
+#pragma once
+
+#include <MetaNN/model/optimizer/facilities/optimizer.h>
+
+namespace MetaNN
+{
+// s = rho * s + (1 - rho) * g * g, w -= lr * g / (sqrt(s) + eps)
+template <typename TElem, typename TDevice>
+class RMSProp : public Optimizer<RMSProp<TElem, TDevice>, TElem, TDevice, 1>
+{
+    using BaseType = Optimizer<RMSProp<TElem, TDevice>, TElem, TDevice, 1>;
+
+public:
+    RMSProp(TElem learningRate, TElem rho = (TElem)0.9, TElem eps = (TElem)1e-8)
+        : BaseType(learningRate)
+        , m_rho(rho)
+        , m_eps(eps) {}
+
+    auto Rule() const
+    {
+        const TElem lr = this->LearningRate();
+        const TElem rho = m_rho;
+        const TElem rho1 = 1 - m_rho;
+        const TElem eps = m_eps;
+        return [lr, rho, rho1, eps](auto& w, const auto& g, auto& s)
+        {
+            s = rho * s + rho1 * g * g;
+            w = w - lr * g / (NSOptimizer::Sqrt(s) + eps);
+        };
+    }
+
+private:
+    TElem m_rho;
+    TElem m_eps;
+};
+}
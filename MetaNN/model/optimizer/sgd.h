@@ -0,0 +1,26 @@
+#pragma once
+
+#include <MetaNN/model/optimizer/facilities/optimizer.h>
+
+namespace MetaNN
+{
+// w -= lr * g
+template <typename TElem, typename TDevice>
+class SGD : public Optimizer<SGD<TElem, TDevice>, TElem, TDevice, 0>
+{
+    using BaseType = Optimizer<SGD<TElem, TDevice>, TElem, TDevice, 0>;
+
+public:
+    SGD(TElem learningRate)
+        : BaseType(learningRate) {}
+
+    auto Rule() const
+    {
+        const TElem lr = this->LearningRate();
+        return [lr](auto& w, const auto& g)
+        {
+            w = w - lr * g;
+        };
+    }
+};
+}
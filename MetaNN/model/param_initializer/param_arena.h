@@ -0,0 +1,251 @@
+#pragma once
+
+#include <MetaNN/data/facilities/allocators.h>
+#include <MetaNN/data/matrices/cpu_matrix.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace MetaNN
+{
+// All parameters of a model in one aligned block, and their gradients in a second block with
+// the same layout. Each parameter starts on an allocator-aligned boundary and its rows are
+// stored without gaps, unless it is a part of a larger packed matrix; the padding between
+// parameters is zero in both blocks, so that the whole arena can be processed as one flat array.
+//
+// Usage: layers store their parameters in the load buffer of Init, Pack moves them into the
+// arena, and a second Init picks up the arena views from the load buffer:
+//     model.Init(initializer, params);
+//     arena.Pack(params);
+//     model.Init(initializer, params);
+// A load buffer read from a file can be packed before the first Init.
+template <typename TElem, typename TDevice>
+class ParamArena
+{
+    static_assert(std::is_same<TDevice, DeviceTags::CPU>::value,
+                  "ParamArena is only implemented on CPU");
+
+    static constexpr size_t AlignElem = (NSAllocator::Alignment % sizeof(TElem) == 0) ?
+                                        NSAllocator::Alignment / sizeof(TElem) : 1;
+
+    static size_t AlignUp(size_t size)
+    {
+        return (size + AlignElem - 1) / AlignElem * AlignElem;
+    }
+
+    // The matrices of params sharing one allocation
+    struct Group
+    {
+        std::vector<Matrix<TElem, TDevice>*> mats;
+        const TElem* begin = nullptr;
+        const TElem* end = nullptr;
+        bool single = true;
+        size_t offset = 0;
+    };
+
+    // A packed parameter, at the key address of m_slots
+    struct Slot
+    {
+        size_t rowNum;
+        size_t colNum;
+        size_t rowLen;
+    };
+
+public:
+    ParamArena() = default;
+    ParamArena(const ParamArena&) = delete;
+    ParamArena& operator = (const ParamArena&) = delete;
+
+    // Copies every matrix of params into a new arena and replaces it by a view of its copy.
+    // A matrix is stored without gaps between rows. Several different matrices that are views
+    // of one allocation (e.g. the gate weights of a fused layer, stored side by side) keep their
+    // relative layout instead, so that they remain parts of one matrix. Entries sharing one
+    // matrix still share it afterwards. Views of a previous arena are copied as well, the
+    // previous arena is released once they are no longer used.
+    template <typename TBuffer>
+    void Pack(TBuffer& params)
+    {
+        std::vector<Group> groups;
+        std::unordered_map<const TElem*, size_t> groupIds;
+        for (auto& [name, mat] : params)
+        {
+            if (mat.RowNum() * mat.ColNum() == 0)
+            {
+                throw std::runtime_error("Empty parameter matrix: " + name);
+            }
+            const auto mem = LowerAccess(mat);
+            auto it = groupIds.insert({mem.SharedMemory().get(), groups.size()}).first;
+            if (it->second == groups.size())
+            {
+                groups.emplace_back();
+            }
+            auto& group = groups[it->second];
+            const TElem* begin = mem.RawMemory();
+            const TElem* end = begin + (mat.RowNum() - 1) * mem.RowLen() + mat.ColNum();
+            if (!group.mats.empty() && (*group.mats[0] != mat))
+            {
+                group.single = false;
+            }
+            group.begin = group.mats.empty() ? begin : std::min(group.begin, begin);
+            group.end = group.mats.empty() ? end : std::max(group.end, end);
+            group.mats.push_back(&mat);
+        }
+
+        size_t size = 0;
+        for (auto& group : groups)
+        {
+            group.offset = size;
+            const auto& first = *group.mats[0];
+            size += AlignUp(group.single ? first.RowNum() * first.ColNum() : (size_t)(group.end - group.begin));
+        }
+
+        auto weights = Allocator<TDevice>::template Allocate<TElem>(size);
+        auto grads = Allocator<TDevice>::template Allocate<TElem>(size);
+        if (size != 0)
+        {
+            memset(weights.get(), 0, sizeof(TElem) * size);
+            memset(grads.get(), 0, sizeof(TElem) * size);
+        }
+
+        // Views of one allocation may overlap and are all copied; the same values are written
+        std::unordered_multimap<const TElem*, Slot> slots;
+        for (auto& group : groups)
+        {
+            for (auto* mat : group.mats)
+            {
+                const size_t rowNum = mat->RowNum();
+                const size_t colNum = mat->ColNum();
+                const auto mem = LowerAccess(*mat);
+                const size_t rowLen = group.single ? colNum : mem.RowLen();
+                TElem* dst = weights.get() + group.offset +
+                             (group.single ? 0 : (size_t)(mem.RawMemory() - group.begin));
+                for (size_t i = 0; i < rowNum; ++i)
+                {
+                    std::copy(mem.RawMemory() + i * mem.RowLen(), mem.RawMemory() + i * mem.RowLen() + colNum,
+                              dst + i * rowLen);
+                }
+                if (!FindSlot(slots, dst, rowNum, colNum, rowLen))
+                {
+                    slots.insert({dst, Slot{rowNum, colNum, rowLen}});
+                }
+                *mat = Matrix<TElem, TDevice>(weights, dst, rowNum, colNum, rowLen);
+            }
+        }
+
+        m_weights = std::move(weights);
+        m_grads = std::move(grads);
+        m_size = size;
+        m_slots = std::move(slots);
+    }
+
+    // Number of elements of each block, padding included
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    size_t ParamNum() const
+    {
+        return m_slots.size();
+    }
+
+    // The writable blocks count as a write of the block, as MutableRawMemory does: the packed
+    // GEMM panels of the parameters (see EnablePackCache) are rebuilt by the next GEMM
+    TElem* Data()
+    {
+        Allocator<TDevice>::MarkWritten(m_weights);
+        return m_weights.get();
+    }
+
+    const TElem* Data() const { return m_weights.get(); }
+
+    TElem* GradData()
+    {
+        Allocator<TDevice>::MarkWritten(m_grads);
+        return m_grads.get();
+    }
+
+    const TElem* GradData() const { return m_grads.get(); }
+
+    // Both blocks as 1 * Size() matrices
+    Matrix<TElem, TDevice> Flat() const
+    {
+        return Matrix<TElem, TDevice>(m_weights, m_weights.get(), m_size ? 1 : 0, m_size, m_size);
+    }
+
+    Matrix<TElem, TDevice> FlatGrad() const
+    {
+        return Matrix<TElem, TDevice>(m_grads, m_grads.get(), m_size ? 1 : 0, m_size, m_size);
+    }
+
+    // Whether weight is one of the packed parameters (not a part of one)
+    bool Contains(const Matrix<TElem, TDevice>& weight) const
+    {
+        const auto mem = LowerAccess(weight);
+        return (mem.SharedMemory() == m_weights) &&
+               FindSlot(m_slots, mem.RawMemory(), weight.RowNum(), weight.ColNum(), mem.RowLen());
+    }
+
+    // Whether weight lies in the arena: a packed parameter, a part of one, or a matrix spanning
+    // several parameters packed side by side (e.g. the fused gate weights of a layer)
+    bool ContainsView(const Matrix<TElem, TDevice>& weight) const
+    {
+        return Offset(weight) != m_size;
+    }
+
+    // The part of the gradient block laid out as weight in the arena, for any weight of ContainsView
+    Matrix<TElem, TDevice> Grad(const Matrix<TElem, TDevice>& weight) const
+    {
+        const size_t offset = Offset(weight);
+        if (offset == m_size)
+        {
+            throw std::runtime_error("The matrix is not in the arena");
+        }
+        return Matrix<TElem, TDevice>(m_grads, m_grads.get() + offset,
+                                      weight.RowNum(), weight.ColNum(), LowerAccess(weight).RowLen());
+    }
+
+    void ZeroGrad()
+    {
+        if (m_size != 0)
+        {
+            memset(m_grads.get(), 0, sizeof(TElem) * m_size);
+        }
+    }
+
+private:
+    static bool FindSlot(const std::unordered_multimap<const TElem*, Slot>& slots, const TElem* p,
+                         size_t rowNum, size_t colNum, size_t rowLen)
+    {
+        const auto range = slots.equal_range(p);
+        return std::any_of(range.first, range.second, [=](const auto& slot)
+                           {
+                               return (slot.second.rowNum == rowNum) && (slot.second.colNum == colNum) &&
+                                      (slot.second.rowLen == rowLen);
+                           });
+    }
+
+    // The offset of weight in the arena, m_size if it is not in the arena
+    size_t Offset(const Matrix<TElem, TDevice>& weight) const
+    {
+        const auto mem = LowerAccess(weight);
+        if ((!m_weights) || (mem.SharedMemory() != m_weights) || (weight.RowNum() * weight.ColNum() == 0))
+        {
+            return m_size;
+        }
+        const size_t offset = mem.RawMemory() - m_weights.get();
+        const size_t last = offset + (weight.RowNum() - 1) * mem.RowLen() + weight.ColNum();
+        return (last <= m_size) ? offset : m_size;
+    }
+
+private:
+    std::shared_ptr<TElem> m_weights;
+    std::shared_ptr<TElem> m_grads;
+    size_t m_size = 0;
+    std::unordered_multimap<const TElem*, Slot> m_slots;
+};
+}
@@ -4,6 +4,7 @@
 #include <MetaNN/data/matrices/trival_matrix.h>
 #include <MetaNN/evaluate/facilities/eval_plan.h>
 #include <MetaNN/operators/facilities/tags.h>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <cassert>
 #include <type_traits>
@@ -148,7 +149,8 @@ struct Calculator
 template <>
 struct OperSeq_<UnaryOpTags::Abs>
 {
-    using type = OperSeqContainer<NSAbs::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSAbs::NSCaseGen::Calculator>;
 };
 
 struct OperAbs
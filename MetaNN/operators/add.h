@@ -5,6 +5,7 @@
 #include <MetaNN/data/matrices/trival_matrix.h>
 #include <MetaNN/evaluate/facilities/eval_plan.h>
 #include <MetaNN/operators/facilities/tags.h>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <cassert>
 #include <type_traits>
@@ -51,20 +52,23 @@ public:
         const size_t src2PackNum = mem_v2.RowLen();
         const size_t tgtPackNum = mem_res.RowLen();
 
-        const TElem* r1 = mem_v1.RawMemory();
-        const TElem* r2 = mem_v2.RawMemory();
-        TElem* r = mem_res.MutableRawMemory();
+        ParallelFor(rowNum, colNum, [&](size_t rowB, size_t rowE)
+                    {
+                        const TElem* r1 = mem_v1.RawMemory() + rowB * src1PackNum;
+                        const TElem* r2 = mem_v2.RawMemory() + rowB * src2PackNum;
+                        TElem* r = mem_res.MutableRawMemory() + rowB * tgtPackNum;
 
-        for (size_t i = 0; i < rowNum; ++i)
-        {
-            for (size_t j = 0; j < colNum; ++j)
-            {
-                r[j] = r1[j] + r2[j];
-            }
-            r1 += src1PackNum;
-            r2 += src2PackNum;
-            r += tgtPackNum;
-        }
+                        for (size_t i = rowB; i < rowE; ++i)
+                        {
+                            for (size_t j = 0; j < colNum; ++j)
+                            {
+                                r[j] = r1[j] + r2[j];
+                            }
+                            r1 += src1PackNum;
+                            r2 += src2PackNum;
+                            r += tgtPackNum;
+                        }
+                    });
         m_evalOutput.SetEval();
     }
 
@@ -100,31 +104,34 @@ public:
         m_evalOutput.Allocate(batchNum, rowNum, colNum);
         auto& res = m_evalOutput.MutableData();
         
-        for (size_t cur_bat = 0; cur_bat < batchNum; ++cur_bat)
-        {
-            const auto mem_v1 = LowerAccess(p_v1[cur_bat]);
-            const auto mem_v2 = LowerAccess(p_v2[cur_bat]);
-            auto mem_res = LowerAccess(res[cur_bat]);
+        const auto mem_v1 = LowerAccess(p_v1);
+        const auto mem_v2 = LowerAccess(p_v2);
+        auto mem_res = LowerAccess(res);
 
-            const size_t src1PackNum = mem_v1.RowLen();
-            const size_t src2PackNum = mem_v2.RowLen();
-            const size_t tgtPackNum = mem_res.RowLen();
+        const size_t src1PackNum = mem_v1.RowLen();
+        const size_t src2PackNum = mem_v2.RowLen();
+        const size_t tgtPackNum = mem_res.RowLen();
+        
+        const size_t src1MatrixSize = mem_v1.RawMatrixSize();
+        const size_t src2MatrixSize = mem_v2.RawMatrixSize();
+        const size_t tgtMatrixSize = mem_res.RawMatrixSize();
 
-            const auto* r1 = mem_v1.RawMemory();
-            const auto* r2 = mem_v2.RawMemory();
-            auto* r = mem_res.MutableRawMemory();
+        ParallelFor(batchNum * rowNum, colNum, [&](size_t rowB, size_t rowE)
+                    {
+                        for (size_t id = rowB; id < rowE; ++id)
+                        {
+                            const size_t cur_bat = id / rowNum;
+                            const size_t i = id % rowNum;
+                            const auto* r1 = mem_v1.RawMemory() + cur_bat * src1MatrixSize + i * src1PackNum;
+                            const auto* r2 = mem_v2.RawMemory() + cur_bat * src2MatrixSize + i * src2PackNum;
+                            auto* r = mem_res.MutableRawMemory() + cur_bat * tgtMatrixSize + i * tgtPackNum;
 
-            for (size_t i = 0; i < rowNum; ++i)
-            {
-                for (size_t j = 0; j < colNum; ++j)
-                {
-                    r[j] = r1[j] + r2[j];
-                }
-                r1 += src1PackNum;
-                r2 += src2PackNum;
-                r += tgtPackNum;
-            }
-        }
+                            for (size_t j = 0; j < colNum; ++j)
+                            {
+                                r[j] = r1[j] + r2[j];
+                            }
+                        }
+                    });
         m_evalOutput.SetEval();
     }
 
@@ -166,7 +173,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::Add>
 {
-    using type = OperSeqContainer<NSAdd::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSAdd::NSCaseGen::Calculator>;
 };
 
 struct OperAdd
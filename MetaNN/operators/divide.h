@@ -1,6 +1,7 @@
 #pragma once
 
 #include <MetaNN/operators/facilities/tags.h>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <type_traits>
 namespace MetaNN
@@ -164,7 +165,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::Divide>
 {
-    using type = OperSeqContainer<NSDivide::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSDivide::NSCaseGen::Calculator>;
 };
 
 struct OperDivide
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstring>
+#include <utility>
+#include <vector>
+
 namespace MetaNN
 {
 template <>
@@ -50,6 +54,49 @@ namespace NSDot
 {
 namespace NSCaseGen
 {
+// The handle of X for an operand Transpose(X): the GEMM reads X with swapped strides
+template <typename TOperHandle>
+struct TransposeHandle
+{
+    TOperHandle handle;
+
+    auto DataPtr() const { return handle.DataPtr(); }
+};
+
+// Element (b, i, j) of an operand read by the GEMM is mem[b * bs + i * rs + j * cs]
+template <typename TElem>
+struct GemmOperand
+{
+    const TElem* mem;
+    size_t rowNum;
+    size_t colNum;
+    size_t rs;
+    size_t cs;
+    size_t bs;
+};
+
+template <typename TElem, typename TOperHandle>
+GemmOperand<TElem> MakeGemmOperand(const TOperHandle& handle)
+{
+    const auto& data = handle.Data();
+    const auto mem = LowerAccess(data);
+    size_t bs = 0;
+    if constexpr (IsBatchMatrix<RemConstRef<decltype(data)>>)
+    {
+        bs = mem.RawMatrixSize();
+    }
+    return GemmOperand<TElem>{mem.RawMemory(), data.RowNum(), data.ColNum(), mem.RowLen(), 1, bs};
+}
+
+template <typename TElem, typename TOperHandle>
+GemmOperand<TElem> MakeGemmOperand(const TransposeHandle<TOperHandle>& handle)
+{
+    auto res = MakeGemmOperand<TElem>(handle.handle);
+    std::swap(res.rowNum, res.colNum);
+    std::swap(res.rs, res.cs);
+    return res;
+}
+
 template <typename TOperHandle1, typename TOperHandle2, typename TElem, typename TDevice, typename TCate>
 class EvalUnit;
 
@@ -70,35 +117,22 @@ public:
 
     void Eval() override
     {
-        const auto& p_v1 = m_oper1.Data();
-        const auto& p_v2 = m_oper2.Data();
+        const auto v1 = MakeGemmOperand<ElementType>(m_oper1);
+        const auto v2 = MakeGemmOperand<ElementType>(m_oper2);
 
-        const size_t rowNum = p_v1.RowNum();
-        const size_t colNum = p_v2.ColNum();
-        const size_t midNum = p_v1.ColNum();
-        assert(p_v2.RowNum() == midNum);
+        const size_t rowNum = v1.rowNum;
+        const size_t colNum = v2.colNum;
+        const size_t midNum = v1.colNum;
+        assert(v2.rowNum == midNum);
         
         m_evalOutput.Allocate(rowNum, colNum);
         auto& res = m_evalOutput.MutableData();
-        
         auto mem_res = LowerAccess(res);
-        const size_t tgtPackNum = mem_res.RowLen();
-        
-        TElem* r = mem_res.MutableRawMemory();
 
-        for (size_t i = 0; i < rowNum; ++i)
-        {
-            for (size_t j = 0; j < colNum; ++j)
-            {
-                *r = TElem();
-                for (size_t k = 0; k < midNum; ++k)
-                {
-                    *r += p_v1(i, k) * p_v2(k, j);
-                }
-                ++r;
-            }
-            r += tgtPackNum - colNum;
-        }
+        NSGemm::Gemm(rowNum, colNum, midNum,
+                     v1.mem, v1.rs, v1.cs,
+                     v2.mem, v2.rs, v2.cs,
+                     mem_res.MutableRawMemory(), mem_res.RowLen());
         m_evalOutput.SetEval();
     }
 
@@ -118,61 +152,78 @@ public:
 
     EvalUnit(TOperHandle1 oper1,
              TOperHandle2 oper2,
+             size_t batchNum,
              EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> evalOutput)
         : m_oper1(std::move(oper1))
         , m_oper2(std::move(oper2))
+        , m_batchNum(batchNum)
         , m_evalOutput(evalOutput) { }
 
     void Eval() override
     {
-        const auto& p_v1 = m_oper1.Data();
-        const auto& p_v2 = m_oper2.Data();
+        const auto v1 = MakeGemmOperand<ElementType>(m_oper1);
+        const auto v2 = MakeGemmOperand<ElementType>(m_oper2);
 
-        const size_t rowNum = p_v1.RowNum();
-        const size_t colNum = p_v2.ColNum();
-        const size_t midNum = p_v1.ColNum();
-        const size_t batchNum = p_v1.BatchNum();
+        const size_t rowNum = v1.rowNum;
+        const size_t colNum = v2.colNum;
+        const size_t midNum = v1.colNum;
+        const size_t batchNum = m_batchNum;
         
-        assert(p_v2.RowNum() == midNum);
-        assert(p_v2.BatchNum() == batchNum);
+        assert(v2.rowNum == midNum);
         
         m_evalOutput.Allocate(batchNum, rowNum, colNum);
         auto& res = m_evalOutput.MutableData();
+        auto mem_res = LowerAccess(res);
         
-        for (size_t cur_batch = 0; cur_batch < batchNum; ++cur_batch)
-        {
-            auto mem_res = LowerAccess(res[cur_batch]);
-            const size_t tgtPackNum = mem_res.RowLen();
-        
-            TElem* r = mem_res.MutableRawMemory();
-            auto cur_v1 = p_v1[cur_batch];
-            auto cur_v2 = p_v2[cur_batch];
-
-            for (size_t i = 0; i < rowNum; ++i)
-            {
-                for (size_t j = 0; j < colNum; ++j)
-                {
-                    *r = TElem();
-                    for (size_t k = 0; k < midNum; ++k)
-                    {
-                        *r += cur_v1(i, k) * cur_v2(k, j);
-                    }
-                    ++r;
-                }
-                r += tgtPackNum - colNum;
-            }
-        }
+        NSGemm::BatchGemm(batchNum, rowNum, colNum, midNum,
+                          v1.mem, v1.rs, v1.cs, v1.bs,
+                          v2.mem, v2.rs, v2.cs, v2.bs,
+                          mem_res.MutableRawMemory(), mem_res.RowLen(), mem_res.RawMatrixSize());
         m_evalOutput.SetEval();
     }
 
 private:
     TOperHandle1 m_oper1;
     TOperHandle2 m_oper2;
+    size_t m_batchNum;
     EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> m_evalOutput;
 };
 
 struct Calculator
 {
+    template <typename TOper>
+    static auto OperandRegister(const TOper& oper)
+    {
+        return oper.EvalRegister();
+    }
+
+    // The batch EvalUnit reads a shared matrix directly instead of its duplicated copies
+    template <typename TData>
+    static auto OperandRegister(const Duplicate<TData>& oper)
+    {
+        return oper.Element().EvalRegister();
+    }
+
+    // Transposed operands are not copied, the GEMM swaps the strides of the data instead
+    template <typename TOper>
+    static auto GemmOperandRegister(const TOper& oper)
+    {
+        return oper.EvalRegister();
+    }
+
+    template <typename TData>
+    static auto GemmOperandRegister(const Duplicate<TData>& oper)
+    {
+        return GemmOperandRegister(oper.Element());
+    }
+
+    template <typename TData>
+    static auto GemmOperandRegister(const UnaryOp<UnaryOpTags::Transpose, TData>& oper)
+    {
+        using THandle = decltype(GemmOperandRegister(oper.Operand()));
+        return TransposeHandle<THandle>{GemmOperandRegister(oper.Operand())};
+    }
+
     template <typename TCaseTail, typename TEvalRes, typename TOper>
     static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
     {
@@ -185,8 +236,8 @@ struct Calculator
         
         const auto& oper1 = oper.Operand1();
         const auto& oper2 = oper.Operand2();
-        auto handle1 = oper1.EvalRegister();
-        auto handle2 = oper2.EvalRegister();
+        auto handle1 = GemmOperandRegister(oper1);
+        auto handle2 = GemmOperandRegister(oper2);
         using UnitType = EvalUnit<decltype(handle1), decltype(handle2), ElementType, DeviceType, CategoryType>;
         using GroupType = TrivalEvalGroup<UnitType>;
 
@@ -194,8 +245,147 @@ struct Calculator
         const void* dataPtr = outHandle.DataPtr();
         auto depVec = {handle1.DataPtr(), handle2.DataPtr()};
         
-        UnitType unit(std::move(handle1), std::move(handle2), std::move(outHandle));
-        EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+        if constexpr (std::is_same<CategoryType, CategoryTags::BatchMatrix>::value)
+        {
+            UnitType unit(std::move(handle1), std::move(handle2), oper.BatchNum(), std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+        }
+        else
+        {
+            UnitType unit(std::move(handle1), std::move(handle2), std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+        }
+    }
+};
+}
+
+// Dot(one-hot, w) selects rows of w: each output row is copied from the hot row of w,
+// neither the one-hot matrix nor the GEMM over its columns is computed
+namespace NSCaseOneHot
+{
+template <typename TOperHandle, typename TElem, typename TDevice, typename TCate>
+class EvalUnit;
+
+template <typename TOperHandle, typename TElem>
+class EvalUnit<TOperHandle, TElem, DeviceTags::CPU, CategoryTags::Matrix>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+
+    EvalUnit(size_t hotPos, TOperHandle oper,
+             EvalHandle<Matrix<ElementType, DeviceType>> evalOutput)
+        : m_hotPos(hotPos)
+        , m_oper(std::move(oper))
+        , m_evalOutput(std::move(evalOutput)) { }
+
+    void Eval() override
+    {
+        const auto& p_w = m_oper.Data();
+        const size_t colNum = p_w.ColNum();
+        assert(m_hotPos < p_w.RowNum());
+
+        m_evalOutput.Allocate(1, colNum);
+        auto& res = m_evalOutput.MutableData();
+
+        const auto mem_w = LowerAccess(p_w);
+        auto mem_res = LowerAccess(res);
+        memcpy(mem_res.MutableRawMemory(), mem_w.RawMemory() + m_hotPos * mem_w.RowLen(),
+               sizeof(ElementType) * colNum);
+        m_evalOutput.SetEval();
+    }
+
+private:
+    size_t m_hotPos;
+    TOperHandle m_oper;
+    EvalHandle<Matrix<ElementType, DeviceType>> m_evalOutput;
+};
+
+template <typename TOperHandle, typename TElem>
+class EvalUnit<TOperHandle, TElem, DeviceTags::CPU, CategoryTags::BatchMatrix>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+
+    EvalUnit(std::vector<size_t> hotPos, TOperHandle oper,
+             EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> evalOutput)
+        : m_hotPos(std::move(hotPos))
+        , m_oper(std::move(oper))
+        , m_evalOutput(std::move(evalOutput)) { }
+
+    void Eval() override
+    {
+        const auto& p_w = m_oper.Data();
+        const size_t colNum = p_w.ColNum();
+        const size_t batchNum = m_hotPos.size();
+
+        m_evalOutput.Allocate(batchNum, 1, colNum);
+        auto& res = m_evalOutput.MutableData();
+
+        const auto mem_w = LowerAccess(p_w);
+        auto mem_res = LowerAccess(res);
+        const size_t srcStride = BatchStride(p_w);
+        for (size_t curBatch = 0; curBatch < batchNum; ++curBatch)
+        {
+            assert(m_hotPos[curBatch] < p_w.RowNum());
+            memcpy(mem_res.MutableRawMemory() + curBatch * mem_res.RawMatrixSize(),
+                   mem_w.RawMemory() + curBatch * srcStride + m_hotPos[curBatch] * mem_w.RowLen(),
+                   sizeof(ElementType) * colNum);
+        }
+        m_evalOutput.SetEval();
+    }
+
+private:
+    template <typename TData>
+    static size_t BatchStride(const TData& data)
+    {
+        if constexpr (IsBatchMatrix<TData>)
+        {
+            return LowerAccess(data).RawMatrixSize();
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+private:
+    std::vector<size_t> m_hotPos;
+    TOperHandle m_oper;
+    EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> m_evalOutput;
+};
+
+struct Calculator
+{
+    template <typename TCaseTail, typename TEvalRes, typename TOper>
+    static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
+    {
+        using ElementType = typename TEvalRes::DataType::ElementType;
+        using DeviceType = typename TEvalRes::DataType::DeviceType;
+        using CategoryType = DataCategory<typename TEvalRes::DataType>;
+        using TOneHot = OneHotType<ElementType, DeviceType, CategoryType>;
+
+        if (auto ptr = DataCast<TOneHot>(oper.Operand1()))
+        {
+            auto handle2 = NSCaseGen::Calculator::OperandRegister(oper.Operand2());
+            using UnitType = EvalUnit<decltype(handle2), ElementType, DeviceType, CategoryType>;
+            using GroupType = TrivalEvalGroup<UnitType>;
+
+            auto outHandle = evalRes.Handle();
+            const void* dataPtr = outHandle.DataPtr();
+            auto depVec = {handle2.DataPtr()};
+
+            UnitType unit(ptr->HotPos(), std::move(handle2), std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+            return;
+        }
+
+        using THead = SeqHead<TCaseTail>;
+        using TTail = SeqTail<TCaseTail>;
+        THead::template EvalRegister<TTail>(evalRes, oper);
     }
 };
 }
@@ -204,7 +394,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::Dot>
 {
-    using type = OperSeqContainer<NSDot::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSDot::NSCaseOneHot::Calculator,
+                                  NSDot::NSCaseGen::Calculator>;
 };
 
 struct OperDot
@@ -272,4 +463,33 @@ auto Dot(TP1&& p_m1, TP2&& p_m2)
 {
     return OperDot::Eval(std::forward<TP1>(p_m1), std::forward<TP2>(p_m2));
 }
+
+// p_res += p_dot by a GEMM with beta = 1, the product is never stored on its own.
+// The products of all batches are added for a batch Dot.
+template <typename TElem, typename TP1, typename TP2>
+void DotAccumulate(Matrix<TElem, DeviceTags::CPU>& p_res,
+                   const BinaryOp<BinaryOpTags::Dot, TP1, TP2>& p_dot)
+{
+    using Calculator = NSDot::NSCaseGen::Calculator;
+    auto handle1 = Calculator::GemmOperandRegister(p_dot.Operand1());
+    auto handle2 = Calculator::GemmOperandRegister(p_dot.Operand2());
+    EvalPlan<DeviceTags::CPU>::Eval();
+
+    const auto v1 = NSDot::NSCaseGen::MakeGemmOperand<TElem>(handle1);
+    const auto v2 = NSDot::NSCaseGen::MakeGemmOperand<TElem>(handle2);
+    assert(v1.colNum == v2.rowNum);
+    assert(p_res.RowNum() == v1.rowNum);
+    assert(p_res.ColNum() == v2.colNum);
+
+    size_t batchNum = 1;
+    if constexpr (IsBatchMatrix<BinaryOp<BinaryOpTags::Dot, TP1, TP2>>)
+    {
+        batchNum = p_dot.BatchNum();
+    }
+    auto mem_res = LowerAccess(p_res);
+    NSGemm::GemmSum(batchNum, v1.rowNum, v2.colNum, v1.colNum,
+                    v1.mem, v1.rs, v1.cs, v1.bs,
+                    v2.mem, v2.rs, v2.cs, v2.bs,
+                    mem_res.MutableRawMemory(), mem_res.RowLen());
+}
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <type_traits>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 namespace MetaNN
 {
@@ -167,7 +168,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::ElementMul>
 {
-    using type = OperSeqContainer<NSElementMul::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSElementMul::NSCaseGen::Calculator>;
 };
 
 struct OperElementMul
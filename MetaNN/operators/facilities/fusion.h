@@ -0,0 +1,743 @@
+#pragma once
+
+#include <MetaNN/data/batch/duplicate.h>
+#include <MetaNN/data/batch/one_hot_vector.h>
+#include <MetaNN/data/dynamic.h>
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/evaluate/facilities/eval_plan.h>
+#include <MetaNN/operators/facilities/gemm.h>
+#include <MetaNN/operators/facilities/tags.h>
+#include <MetaNN/operators/operators.h>
+#include <cmath>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace MetaNN
+{
+// Element-wise operators nested in each other are evaluated by a single unit: the expression
+// tree is walked once per element, leaves are read in place and no intermediate is written.
+// If the tree reads exactly one Dot, the unit runs its GEMM and the tree becomes the GEMM
+// epilogue, so e.g. Sigmoid(Dot(x, w) + b) is computed while the product is stored.
+namespace NSFusion
+{
+template <typename TOpTag>
+struct ElemFun
+{
+    static constexpr bool valid = false;
+};
+
+template <>
+struct ElemFun<UnaryOpTags::Abs>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 1;
+
+    template <typename T>
+    static T Apply(T x)
+    {
+        return (x > T()) ? x : -x;
+    }
+};
+
+template <>
+struct ElemFun<UnaryOpTags::Sign>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 1;
+
+    template <typename T>
+    static T Apply(T x)
+    {
+        if (x == T()) return T();
+        return (x > T()) ? static_cast<T>(1) : -static_cast<T>(1);
+    }
+};
+
+template <>
+struct ElemFun<UnaryOpTags::Sigmoid>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 16;
+
+    template <typename T>
+    static T Apply(T x)
+    {
+        return (T)(1 / (1 + exp(-x)));
+    }
+};
+
+template <>
+struct ElemFun<UnaryOpTags::Tanh>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 16;
+
+    template <typename T>
+    static T Apply(T x)
+    {
+        return (T)(tanh(x));
+    }
+};
+
+template <>
+struct ElemFun<BinaryOpTags::Add>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 1;
+
+    template <typename T>
+    static T Apply(T x1, T x2)
+    {
+        return x1 + x2;
+    }
+};
+
+template <>
+struct ElemFun<BinaryOpTags::Substract>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 1;
+
+    template <typename T>
+    static T Apply(T x1, T x2)
+    {
+        return x1 - x2;
+    }
+};
+
+template <>
+struct ElemFun<BinaryOpTags::ElementMul>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 1;
+
+    template <typename T>
+    static T Apply(T x1, T x2)
+    {
+        return x1 * x2;
+    }
+};
+
+template <>
+struct ElemFun<BinaryOpTags::Divide>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 4;
+
+    template <typename T>
+    static T Apply(T x1, T x2)
+    {
+        return x1 / x2;
+    }
+};
+
+template <>
+struct ElemFun<BinaryOpTags::SigmoidDerivative>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 2;
+
+    template <typename T>
+    static T Apply(T grad, T out)
+    {
+        return grad * out * (1 - out);
+    }
+};
+
+template <>
+struct ElemFun<BinaryOpTags::TanhDerivative>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 2;
+
+    template <typename T>
+    static T Apply(T grad, T out)
+    {
+        return grad * (1 - out * out);
+    }
+};
+
+template <>
+struct ElemFun<TernaryOpTags::Interpolate>
+{
+    static constexpr bool valid = true;
+    static constexpr size_t cost = 2;
+
+    template <typename T>
+    static T Apply(T x1, T x2, T lambda)
+    {
+        return x1 * lambda + x2 * (1 - lambda);
+    }
+};
+
+template <typename TCate>
+constexpr bool ValidCate = std::is_same<TCate, CategoryTags::Matrix>::value ||
+                           std::is_same<TCate, CategoryTags::BatchMatrix>::value;
+
+template <typename TOpTag, typename TCate, typename... TOperands>
+constexpr bool FusableImp = ElemFun<TOpTag>::valid && ValidCate<TCate> &&
+                            (std::is_same<DataCategory<TOperands>, TCate>::value && ...);
+
+// Operators that can be evaluated inside a fused unit
+template <typename T>
+constexpr bool Fusable = false;
+
+template <typename TOpTag, typename TData>
+constexpr bool Fusable<UnaryOp<TOpTag, TData>> =
+    FusableImp<TOpTag, OperCateCal<TOpTag, TData>, TData>;
+
+template <typename TOpTag, typename TData1, typename TData2>
+constexpr bool Fusable<BinaryOp<TOpTag, TData1, TData2>> =
+    FusableImp<TOpTag, OperCateCal<TOpTag, TData1, TData2>, TData1, TData2>;
+
+template <typename TOpTag, typename TData1, typename TData2, typename TData3>
+constexpr bool Fusable<TernaryOp<TOpTag, TData1, TData2, TData3>> =
+    FusableImp<TOpTag, OperCateCal<TOpTag, TData1, TData2, TData3>, TData1, TData2, TData3>;
+
+// Fusion only pays off if at least one operand is an element-wise operator itself
+template <typename T>
+constexpr bool HasFusableOperand = false;
+
+template <typename TOpTag, typename TData>
+constexpr bool HasFusableOperand<UnaryOp<TOpTag, TData>> = Fusable<TData>;
+
+template <typename TOpTag, typename TData1, typename TData2>
+constexpr bool HasFusableOperand<BinaryOp<TOpTag, TData1, TData2>> = Fusable<TData1> || Fusable<TData2>;
+
+template <typename TOpTag, typename TData1, typename TData2, typename TData3>
+constexpr bool HasFusableOperand<TernaryOp<TOpTag, TData1, TData2, TData3>> =
+    Fusable<TData1> || Fusable<TData2> || Fusable<TData3>;
+
+// Number of Dot operators read by a fused tree
+template <typename T, bool = Fusable<T>>
+struct DotNum_
+{
+    static constexpr size_t value = 0;
+};
+
+// Dot(one-hot, w) is a row gather (see dot.h), it is evaluated by its own unit
+template <typename T>
+constexpr bool IsOneHot = false;
+
+template <typename TElem, typename TDevice>
+constexpr bool IsOneHot<OneHotVector<TElem, TDevice>> = true;
+
+template <typename TElem, typename TDevice>
+constexpr bool IsOneHot<BatchOneHotVector<TElem, TDevice>> = true;
+
+template <typename TData1, typename TData2>
+struct DotNum_<BinaryOp<BinaryOpTags::Dot, TData1, TData2>, false>
+{
+    static constexpr size_t value = IsOneHot<TData1> ? 0 : 1;
+};
+
+template <typename TOpTag, typename TData>
+struct DotNum_<UnaryOp<TOpTag, TData>, true>
+{
+    static constexpr size_t value = DotNum_<TData>::value;
+};
+
+template <typename TOpTag, typename TData1, typename TData2>
+struct DotNum_<BinaryOp<TOpTag, TData1, TData2>, true>
+{
+    static constexpr size_t value = DotNum_<TData1>::value + DotNum_<TData2>::value;
+};
+
+template <typename TOpTag, typename TData1, typename TData2, typename TData3>
+struct DotNum_<TernaryOp<TOpTag, TData1, TData2, TData3>, true>
+{
+    static constexpr size_t value = DotNum_<TData1>::value + DotNum_<TData2>::value +
+                                    DotNum_<TData3>::value;
+};
+
+template <typename T>
+constexpr bool HasEpilogueDot = (DotNum_<T>::value == 1);
+
+// A leaf is evaluated by its own units and read in place. Element (batch, row, col) is at
+// batch * m_matrixSize + row * RowStride() + col * ColStride(), a matrix read by a batch tree
+// has m_matrixSize = 0. A transposed leaf reads the data below the Transpose with swapped strides.
+template <typename THandle, bool isTrans = false>
+class Leaf
+{
+public:
+    using Transposed = Leaf<THandle, !isTrans>;
+
+    Leaf(THandle handle)
+        : m_handle(std::move(handle)) {}
+
+    void CollectDeps(std::vector<const void*>& deps) const
+    {
+        deps.push_back(m_handle.DataPtr());
+    }
+
+    void Prepare()
+    {
+        const auto& data = m_handle.Data();
+        const auto mem = LowerAccess(data);
+        m_mem = mem.RawMemory();
+        m_rowLen = mem.RowLen();
+        if constexpr (IsBatchMatrix<RemConstRef<decltype(data)>>)
+        {
+            m_matrixSize = mem.RawMatrixSize();
+        }
+        else
+        {
+            m_matrixSize = 0;
+        }
+    }
+
+    template <typename TAcc>
+    auto Get(size_t batch, size_t row, size_t col, TAcc) const
+    {
+        return m_mem[batch * m_matrixSize + row * RowStride() + col * ColStride()];
+    }
+
+    template <typename TFun>
+    void VisitDot(const TFun&) const {}
+
+    Transposed Transpose() const { return Transposed(m_handle); }
+
+    auto Mem() const { return m_mem; }
+    size_t RowStride() const { return isTrans ? 1 : m_rowLen; }
+    size_t ColStride() const { return isTrans ? m_rowLen : 1; }
+    size_t MatrixSize() const { return m_matrixSize; }
+
+    static constexpr size_t cost = 1;
+    static constexpr bool hasDot = false;
+
+private:
+    THandle m_handle;
+    const typename RemConstRef<decltype(std::declval<THandle>().Data())>::ElementType* m_mem = nullptr;
+    size_t m_rowLen = 0;
+    size_t m_matrixSize = 0;
+};
+
+template <typename TData>
+struct Leaf_
+{
+    using type = Leaf<decltype(std::declval<TData>().EvalRegister())>;
+
+    static type Create(const TData& data)
+    {
+        return type(data.EvalRegister());
+    }
+};
+
+// A duplicated matrix is read from the matrix itself, without building the batch
+template <typename TData>
+struct Leaf_<Duplicate<TData>>
+{
+    using type = typename Leaf_<TData>::type;
+
+    static type Create(const Duplicate<TData>& data)
+    {
+        return Leaf_<TData>::Create(data.Element());
+    }
+};
+
+template <typename TData>
+struct Leaf_<UnaryOp<UnaryOpTags::Transpose, TData>>
+{
+    using type = typename Leaf_<TData>::type::Transposed;
+
+    static type Create(const UnaryOp<UnaryOpTags::Transpose, TData>& data)
+    {
+        return Leaf_<TData>::Create(data.Operand()).Transpose();
+    }
+};
+
+// The Dot whose GEMM is run by the fused unit: the tree reads the accumulated product
+template <typename TLeaf1, typename TLeaf2>
+class DotNode
+{
+public:
+    DotNode(TLeaf1 leaf1, TLeaf2 leaf2, size_t midNum)
+        : m_leaf1(std::move(leaf1))
+        , m_leaf2(std::move(leaf2))
+        , m_midNum(midNum) {}
+
+    void CollectDeps(std::vector<const void*>& deps) const
+    {
+        m_leaf1.CollectDeps(deps);
+        m_leaf2.CollectDeps(deps);
+    }
+
+    void Prepare()
+    {
+        m_leaf1.Prepare();
+        m_leaf2.Prepare();
+    }
+
+    template <typename TAcc>
+    TAcc Get(size_t, size_t, size_t, TAcc acc) const
+    {
+        return acc;
+    }
+
+    template <typename TFun>
+    void VisitDot(const TFun& fun) const
+    {
+        fun(*this);
+    }
+
+    const TLeaf1& Leaf1() const { return m_leaf1; }
+    const TLeaf2& Leaf2() const { return m_leaf2; }
+    size_t MidNum() const { return m_midNum; }
+
+    static constexpr size_t cost = 0;
+    static constexpr bool hasDot = true;
+
+private:
+    TLeaf1 m_leaf1;
+    TLeaf2 m_leaf2;
+    size_t m_midNum;
+};
+
+// An operand operator is inlined only if the tree is the sole reader of its result. If the
+// result is evaluated, registered in the plan or held outside of the parent operator, it is
+// read as a leaf, so a shared subexpression is computed once.
+template <typename TInline, typename TLeaf>
+class Branch
+{
+public:
+    Branch(TInline node)
+        : m_inline(std::move(node)) {}
+
+    Branch(TLeaf leaf)
+        : m_leaf(std::move(leaf)) {}
+
+    void CollectDeps(std::vector<const void*>& deps) const
+    {
+        if (m_inline) m_inline->CollectDeps(deps);
+        else m_leaf->CollectDeps(deps);
+    }
+
+    void Prepare()
+    {
+        if (m_inline) m_inline->Prepare();
+        else m_leaf->Prepare();
+    }
+
+    template <typename TAcc>
+    TAcc Get(size_t batch, size_t row, size_t col, TAcc acc) const
+    {
+        if (m_inline) return m_inline->Get(batch, row, col, acc);
+        return m_leaf->Get(batch, row, col, acc);
+    }
+
+    template <typename TFun>
+    void VisitDot(const TFun& fun) const
+    {
+        if (m_inline) m_inline->VisitDot(fun);
+    }
+
+    static constexpr size_t cost = TInline::cost;
+    static constexpr bool hasDot = TInline::hasDot;
+
+private:
+    std::optional<TInline> m_inline;
+    std::optional<TLeaf> m_leaf;
+};
+
+// parentUses: use count of the result buffer of the operator reading oper. Every copy of the
+// parent holds a copy of oper, further holders mean that the result is read elsewhere.
+template <typename TOper>
+bool ReadAsLeaf(const TOper& oper, long parentUses)
+{
+    const auto& buf = oper.ResultBuffer();
+    return buf.IsEvaluated() || (buf.UseCount() > parentUses) || buf.IsRegistered();
+}
+
+// Dot(one-hot, w) behind a DynamicData is only known at run time, it is read as a leaf so
+// that the row gather of dot.h computes it
+template <typename TOper>
+bool GathersRows(const TOper&)
+{
+    return false;
+}
+
+template <typename TData1, typename TData2>
+bool GathersRows(const BinaryOp<BinaryOpTags::Dot, TData1, TData2>& oper)
+{
+    if constexpr (IsDynamic<TData1>)
+    {
+        using TOper = BinaryOp<BinaryOpTags::Dot, TData1, TData2>;
+        using TOneHot = OneHotType<typename TOper::ElementType, typename TOper::DeviceType,
+                                   DataCategory<TOper>>;
+        return DataCast<TOneHot>(oper.Operand1()) != nullptr;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+// TDot: Dot operators in the tree are evaluated as the GEMM of the fused unit
+template <typename TData, bool TDot, bool = Fusable<TData>>
+struct Inline_ : Leaf_<TData> {};
+
+template <typename TData1, typename TData2>
+struct Inline_<BinaryOp<BinaryOpTags::Dot, TData1, TData2>, true, false>
+{
+    using type = DotNode<typename Leaf_<TData1>::type, typename Leaf_<TData2>::type>;
+
+    static type Create(const BinaryOp<BinaryOpTags::Dot, TData1, TData2>& oper)
+    {
+        return type(Leaf_<TData1>::Create(oper.Operand1()),
+                    Leaf_<TData2>::Create(oper.Operand2()),
+                    oper.Operand1().ColNum());
+    }
+};
+
+template <typename TElem, typename TDevice, typename TData2>
+struct Inline_<BinaryOp<BinaryOpTags::Dot, OneHotVector<TElem, TDevice>, TData2>, true, false>
+    : Leaf_<BinaryOp<BinaryOpTags::Dot, OneHotVector<TElem, TDevice>, TData2>> {};
+
+template <typename TElem, typename TDevice, typename TData2>
+struct Inline_<BinaryOp<BinaryOpTags::Dot, BatchOneHotVector<TElem, TDevice>, TData2>, true, false>
+    : Leaf_<BinaryOp<BinaryOpTags::Dot, BatchOneHotVector<TElem, TDevice>, TData2>> {};
+
+template <typename TData, bool TDot>
+constexpr bool Inlinable = !std::is_same<typename Inline_<TData, TDot>::type,
+                                         typename Leaf_<TData>::type>::value;
+
+template <typename TData, bool TDot, bool = Inlinable<TData, TDot>>
+struct Node_ : Leaf_<TData>
+{
+    static auto Create(const TData& data, long)
+    {
+        return Leaf_<TData>::Create(data);
+    }
+};
+
+template <typename TData, bool TDot>
+struct Node_<TData, TDot, true>
+{
+    using type = Branch<typename Inline_<TData, TDot>::type, typename Leaf_<TData>::type>;
+
+    static type Create(const TData& oper, long parentUses)
+    {
+        if (ReadAsLeaf(oper, parentUses) || GathersRows(oper))
+        {
+            return type(Leaf_<TData>::Create(oper));
+        }
+        return type(Inline_<TData, TDot>::Create(oper));
+    }
+};
+
+template <typename TOpTag, typename... TChildren>
+class OperNode;
+
+template <typename TData, bool TDot>
+using Node = typename Node_<TData, TDot>::type;
+
+template <typename TOpTag, typename TData, bool TDot>
+struct Inline_<UnaryOp<TOpTag, TData>, TDot, true>
+{
+    using type = OperNode<TOpTag, Node<TData, TDot>>;
+
+    static type Create(const UnaryOp<TOpTag, TData>& oper)
+    {
+        const long uses = oper.ResultBuffer().UseCount();
+        return type(Node_<TData, TDot>::Create(oper.Operand(), uses));
+    }
+};
+
+template <typename TOpTag, typename TData1, typename TData2, bool TDot>
+struct Inline_<BinaryOp<TOpTag, TData1, TData2>, TDot, true>
+{
+    using type = OperNode<TOpTag, Node<TData1, TDot>, Node<TData2, TDot>>;
+
+    static type Create(const BinaryOp<TOpTag, TData1, TData2>& oper)
+    {
+        const long uses = oper.ResultBuffer().UseCount();
+        return type(Node_<TData1, TDot>::Create(oper.Operand1(), uses),
+                    Node_<TData2, TDot>::Create(oper.Operand2(), uses));
+    }
+};
+
+template <typename TOpTag, typename TData1, typename TData2, typename TData3, bool TDot>
+struct Inline_<TernaryOp<TOpTag, TData1, TData2, TData3>, TDot, true>
+{
+    using type = OperNode<TOpTag, Node<TData1, TDot>, Node<TData2, TDot>, Node<TData3, TDot>>;
+
+    static type Create(const TernaryOp<TOpTag, TData1, TData2, TData3>& oper)
+    {
+        const long uses = oper.ResultBuffer().UseCount();
+        return type(Node_<TData1, TDot>::Create(oper.Operand1(), uses),
+                    Node_<TData2, TDot>::Create(oper.Operand2(), uses),
+                    Node_<TData3, TDot>::Create(oper.Operand3(), uses));
+    }
+};
+
+template <typename TOpTag, typename... TChildren>
+class OperNode
+{
+public:
+    OperNode(TChildren... children)
+        : m_children(std::move(children)...) {}
+
+    void CollectDeps(std::vector<const void*>& deps) const
+    {
+        std::apply([&deps](const auto&... child) { (child.CollectDeps(deps), ...); }, m_children);
+    }
+
+    void Prepare()
+    {
+        std::apply([](auto&... child) { (child.Prepare(), ...); }, m_children);
+    }
+
+    template <typename TAcc>
+    auto Get(size_t batch, size_t row, size_t col, TAcc acc) const
+    {
+        return std::apply([batch, row, col, acc](const auto&... child)
+                          {
+                              return ElemFun<TOpTag>::Apply(child.Get(batch, row, col, acc)...);
+                          }, m_children);
+    }
+
+    template <typename TFun>
+    void VisitDot(const TFun& fun) const
+    {
+        std::apply([&fun](const auto&... child) { (child.VisitDot(fun), ...); }, m_children);
+    }
+
+    static constexpr size_t cost = ElemFun<TOpTag>::cost + (TChildren::cost + ...);
+    static constexpr bool hasDot = (TChildren::hasDot || ...);
+
+private:
+    std::tuple<TChildren...> m_children;
+};
+
+template <typename TRoot, typename TElem, typename TDevice, typename TCate>
+class EvalUnit;
+
+template <typename TRoot, typename TElem, typename TCate>
+class EvalUnit<TRoot, TElem, DeviceTags::CPU, TCate>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+    using ResType = PrincipalDataType<TCate, TElem, DeviceTags::CPU>;
+
+public:
+    EvalUnit(TRoot root, size_t rowNum, size_t colNum, size_t batchNum,
+             EvalHandle<ResType> evalOutput)
+        : m_root(std::move(root))
+        , m_rowNum(rowNum)
+        , m_colNum(colNum)
+        , m_batchNum(batchNum)
+        , m_evalOutput(std::move(evalOutput)) { }
+
+    void Eval() override
+    {
+        if constexpr (std::is_same<TCate, CategoryTags::BatchMatrix>::value)
+        {
+            m_evalOutput.Allocate(m_batchNum, m_rowNum, m_colNum);
+        }
+        else
+        {
+            m_evalOutput.Allocate(m_rowNum, m_colNum);
+        }
+        auto& res = m_evalOutput.MutableData();
+        auto mem_res = LowerAccess(res);
+        const size_t tgtPackNum = mem_res.RowLen();
+        size_t tgtMatrixSize = 0;
+        if constexpr (std::is_same<TCate, CategoryTags::BatchMatrix>::value)
+        {
+            tgtMatrixSize = mem_res.RawMatrixSize();
+        }
+
+        m_root.Prepare();
+        const TRoot& root = m_root;
+        const size_t rowNum = m_rowNum;
+        const size_t colNum = m_colNum;
+        if constexpr (TRoot::hasDot)
+        {
+            auto epilogue = [&root](size_t b, size_t i, size_t j, TElem acc) -> TElem
+            {
+                return root.Get(b, i, j, acc);
+            };
+            // the Dot may be read as a leaf, then the tree is computed as without it
+            bool gemm = false;
+            root.VisitDot([&](const auto& dot)
+                          {
+                              gemm = true;
+                              const auto& leaf1 = dot.Leaf1();
+                              const auto& leaf2 = dot.Leaf2();
+                              NSGemm::BatchGemm(m_batchNum, rowNum, colNum, dot.MidNum(),
+                                                leaf1.Mem(), leaf1.RowStride(), leaf1.ColStride(), leaf1.MatrixSize(),
+                                                leaf2.Mem(), leaf2.RowStride(), leaf2.ColStride(), leaf2.MatrixSize(),
+                                                mem_res.MutableRawMemory(), tgtPackNum, tgtMatrixSize,
+                                                NSGemm::MakeEpilogue(epilogue));
+                          });
+            if (gemm)
+            {
+                m_evalOutput.SetEval();
+                return;
+            }
+        }
+        ParallelFor(m_batchNum * rowNum, colNum * TRoot::cost, [&](size_t rowB, size_t rowE)
+                    {
+                        for (size_t id = rowB; id < rowE; ++id)
+                        {
+                            const size_t b = id / rowNum;
+                            const size_t i = id % rowNum;
+                            TElem* r = mem_res.MutableRawMemory() + b * tgtMatrixSize + i * tgtPackNum;
+                            for (size_t j = 0; j < colNum; ++j)
+                            {
+                                r[j] = root.Get(b, i, j, TElem());
+                            }
+                        }
+                    });
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TRoot m_root;
+    size_t m_rowNum;
+    size_t m_colNum;
+    size_t m_batchNum;
+    EvalHandle<ResType> m_evalOutput;
+};
+
+// Placed before the calculator of each element-wise operator
+struct Calculator
+{
+    template <typename TCaseTail, typename TEvalRes, typename TOper>
+    static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
+    {
+        if constexpr (!(Fusable<TOper> && (HasFusableOperand<TOper> || HasEpilogueDot<TOper>)))
+        {
+            using THead = SeqHead<TCaseTail>;
+            using TTail = SeqTail<TCaseTail>;
+            THead::template EvalRegister<TTail>(evalRes, oper);
+        }
+        else
+        {
+            using ElementType = typename TEvalRes::DataType::ElementType;
+            using DeviceType = typename TEvalRes::DataType::DeviceType;
+            using CategoryType = DataCategory<typename TEvalRes::DataType>;
+
+            auto root = Inline_<TOper, HasEpilogueDot<TOper>>::Create(oper);
+            std::vector<const void*> depVec;
+            root.CollectDeps(depVec);
+
+            size_t batchNum = 1;
+            if constexpr (std::is_same<CategoryType, CategoryTags::BatchMatrix>::value)
+            {
+                batchNum = oper.BatchNum();
+            }
+
+            using UnitType = EvalUnit<decltype(root), ElementType, DeviceType, CategoryType>;
+            using GroupType = TrivalEvalGroup<UnitType>;
+
+            auto outHandle = evalRes.Handle();
+            const void* dataPtr = outHandle.DataPtr();
+            UnitType unit(std::move(root), oper.RowNum(), oper.ColNum(), batchNum, std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+        }
+    }
+};
+}
+}
@@ -0,0 +1,786 @@
+#pragma once
+
+#include <MetaNN/data/facilities/allocators.h>
+#include <MetaNN/data/facilities/tags.h>
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+namespace MetaNN
+{
+namespace NSGemm
+{
+// C(m x n) = A(m x k) * B(k x n)
+// A(i, p) = a[i * rsA + p * csA], B(p, j) = b[p * rsB + j * csB], C(i, j) = c[i * rsC + j]
+// Blocking follows the usual jc(NC) -> pc(KC) -> ic(MC) -> jr(NR) -> ir(MR) scheme:
+// a KC x NC panel of B and a MC x KC block of A are packed into contiguous buffers
+// so that the micro-kernel streams both operands with unit stride.
+template <typename TElem>
+struct GenericKernel
+{
+    static constexpr size_t MR = 4;
+    static constexpr size_t NR = 4;
+    static constexpr size_t MC = 64;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 1024;
+
+    static void Compute(size_t kc, const TElem* a, const TElem* b, TElem* tile)
+    {
+        TElem acc[MR * NR] = {};
+        for (size_t p = 0; p < kc; ++p)
+        {
+            for (size_t i = 0; i < MR; ++i)
+            {
+                const TElem ai = a[i];
+                for (size_t j = 0; j < NR; ++j)
+                {
+                    acc[i * NR + j] += ai * b[j];
+                }
+            }
+            a += MR;
+            b += NR;
+        }
+        std::copy(acc, acc + MR * NR, tile);
+    }
+};
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+template <typename TVecOps, size_t TMR, size_t TNRegs>
+struct SimdKernel
+{
+    using ElementType = typename TVecOps::ElementType;
+    using RegType = typename TVecOps::RegType;
+
+    static constexpr size_t MR = TMR;
+    static constexpr size_t NR = TNRegs * TVecOps::Width;
+    static constexpr size_t MC = 96;
+    static constexpr size_t KC = 256;
+    static constexpr size_t NC = 2048;
+
+    static void Compute(size_t kc, const ElementType* a, const ElementType* b, ElementType* tile)
+    {
+        ComputeImpl(std::make_index_sequence<MR>(), kc, a, b, tile);
+    }
+
+private:
+    template <size_t... I>
+    static void ComputeImpl(std::index_sequence<I...>, size_t kc,
+                            const ElementType* a, const ElementType* b, ElementType* tile)
+    {
+        RegType acc[MR][TNRegs];
+        for (size_t i = 0; i < MR; ++i)
+            for (size_t r = 0; r < TNRegs; ++r)
+                acc[i][r] = TVecOps::Zero();
+
+        for (size_t p = 0; p < kc; ++p)
+        {
+            RegType bv[TNRegs];
+            for (size_t r = 0; r < TNRegs; ++r)
+                bv[r] = TVecOps::Load(b + r * TVecOps::Width);
+
+            (UpdateRow(acc[I], TVecOps::Broadcast(a + I), bv), ...);
+            a += MR;
+            b += NR;
+        }
+
+        for (size_t i = 0; i < MR; ++i)
+            for (size_t r = 0; r < TNRegs; ++r)
+                TVecOps::Store(tile + i * NR + r * TVecOps::Width, acc[i][r]);
+    }
+
+    static void UpdateRow(RegType (&accRow)[TNRegs], RegType av, const RegType (&bv)[TNRegs])
+    {
+        for (size_t r = 0; r < TNRegs; ++r)
+            accRow[r] = TVecOps::Fma(av, bv[r], accRow[r]);
+    }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct VecOpsFloat
+{
+    using ElementType = float;
+    using RegType = __m512;
+    static constexpr size_t Width = 16;
+    static RegType Zero() { return _mm512_setzero_ps(); }
+    static RegType Load(const float* p) { return _mm512_loadu_ps(p); }
+    static RegType Broadcast(const float* p) { return _mm512_set1_ps(*p); }
+    static RegType Fma(RegType a, RegType b, RegType c) { return _mm512_fmadd_ps(a, b, c); }
+    static void Store(float* p, RegType v) { _mm512_storeu_ps(p, v); }
+};
+
+struct VecOpsDouble
+{
+    using ElementType = double;
+    using RegType = __m512d;
+    static constexpr size_t Width = 8;
+    static RegType Zero() { return _mm512_setzero_pd(); }
+    static RegType Load(const double* p) { return _mm512_loadu_pd(p); }
+    static RegType Broadcast(const double* p) { return _mm512_set1_pd(*p); }
+    static RegType Fma(RegType a, RegType b, RegType c) { return _mm512_fmadd_pd(a, b, c); }
+    static void Store(double* p, RegType v) { _mm512_storeu_pd(p, v); }
+};
+
+template <typename TElem>
+struct Kernel_ { using type = GenericKernel<TElem>; };
+
+template <>
+struct Kernel_<float> { using type = SimdKernel<VecOpsFloat, 12, 2>; };
+
+template <>
+struct Kernel_<double> { using type = SimdKernel<VecOpsDouble, 12, 2>; };
+
+#elif defined(__AVX2__) && defined(__FMA__)
+struct VecOpsFloat
+{
+    using ElementType = float;
+    using RegType = __m256;
+    static constexpr size_t Width = 8;
+    static RegType Zero() { return _mm256_setzero_ps(); }
+    static RegType Load(const float* p) { return _mm256_loadu_ps(p); }
+    static RegType Broadcast(const float* p) { return _mm256_broadcast_ss(p); }
+    static RegType Fma(RegType a, RegType b, RegType c) { return _mm256_fmadd_ps(a, b, c); }
+    static void Store(float* p, RegType v) { _mm256_storeu_ps(p, v); }
+};
+
+struct VecOpsDouble
+{
+    using ElementType = double;
+    using RegType = __m256d;
+    static constexpr size_t Width = 4;
+    static RegType Zero() { return _mm256_setzero_pd(); }
+    static RegType Load(const double* p) { return _mm256_loadu_pd(p); }
+    static RegType Broadcast(const double* p) { return _mm256_broadcast_sd(p); }
+    static RegType Fma(RegType a, RegType b, RegType c) { return _mm256_fmadd_pd(a, b, c); }
+    static void Store(double* p, RegType v) { _mm256_storeu_pd(p, v); }
+};
+
+template <typename TElem>
+struct Kernel_ { using type = GenericKernel<TElem>; };
+
+template <>
+struct Kernel_<float> { using type = SimdKernel<VecOpsFloat, 6, 2>; };
+
+template <>
+struct Kernel_<double> { using type = SimdKernel<VecOpsDouble, 6, 2>; };
+
+#else
+template <typename TElem>
+struct Kernel_ { using type = GenericKernel<TElem>; };
+#endif
+
+template <typename TElem>
+using Kernel = typename Kernel_<TElem>::type;
+
+template <typename TElem>
+class PackBuffer
+{
+public:
+    TElem* Get(size_t size)
+    {
+        if (size > m_size)
+        {
+            m_buf.reset(static_cast<TElem*>(::operator new(sizeof(TElem) * size, std::align_val_t(64))));
+            m_size = size;
+        }
+        return m_buf.get();
+    }
+
+private:
+    struct Deleter
+    {
+        void operator()(TElem* p) const { ::operator delete(p, std::align_val_t(64)); }
+    };
+    std::unique_ptr<TElem, Deleter> m_buf;
+    size_t m_size = 0;
+};
+
+template <size_t MR, typename TElem>
+void PackA(size_t mc, size_t kc, const TElem* a, size_t rsA, size_t csA, TElem* buf)
+{
+    for (size_t ir = 0; ir < mc; ir += MR)
+    {
+        const size_t mr = std::min(MR, mc - ir);
+        const TElem* aPanel = a + ir * rsA;
+        for (size_t p = 0; p < kc; ++p)
+        {
+            size_t i = 0;
+            for (; i < mr; ++i)
+            {
+                buf[i] = aPanel[i * rsA + p * csA];
+            }
+            for (; i < MR; ++i)
+            {
+                buf[i] = TElem();
+            }
+            buf += MR;
+        }
+    }
+}
+
+// Column j of B (or C) lives at offset colMap(j) from the base pointer.
+struct StridedColumn
+{
+    size_t colStride;
+    size_t operator() (size_t j) const { return j * colStride; }
+};
+
+// A batch of matrices laid side by side: column j belongs to matrix j / colNum.
+struct BatchedColumn
+{
+    size_t colNum;
+    size_t colStride;
+    size_t batchStride;
+    size_t operator() (size_t j) const
+    {
+        return (j / colNum) * batchStride + (j % colNum) * colStride;
+    }
+};
+
+template <size_t N, typename TColMap>
+bool ColumnOffsets(const TColMap& colMap, size_t start, size_t count, size_t (&offset)[N])
+{
+    bool contiguous = true;
+    for (size_t j = 0; j < count; ++j)
+    {
+        offset[j] = colMap(start + j);
+        contiguous = contiguous && (offset[j] == offset[0] + j);
+    }
+    return contiguous;
+}
+
+template <size_t NR, typename TElem, typename TColMap>
+void PackB(size_t kc, size_t nc, const TElem* b, size_t rsB,
+           const TColMap& colMap, size_t jc, TElem* buf)
+{
+    size_t offset[NR];
+    for (size_t jr = 0; jr < nc; jr += NR)
+    {
+        const size_t nr = std::min(NR, nc - jr);
+        const bool contiguous = ColumnOffsets(colMap, jc + jr, nr, offset);
+        for (size_t p = 0; p < kc; ++p)
+        {
+            const TElem* bRow = b + p * rsB;
+            size_t j = 0;
+            if (contiguous)
+            {
+                std::copy(bRow + offset[0], bRow + offset[0] + nr, buf);
+                j = nr;
+            }
+            else
+            {
+                for (; j < nr; ++j)
+                {
+                    buf[j] = bRow[offset[j]];
+                }
+            }
+            for (; j < NR; ++j)
+            {
+                buf[j] = TElem();
+            }
+            buf += NR;
+        }
+    }
+}
+
+// Packed B panels of weights that are the B operand of many GEMMs (e.g. the weight of a
+// layer run at every time step). The whole matrix is packed with the layout GemmImpl builds
+// block by block: block (jc, pc) starts at jc * k + pc * (NR-padded width of block jc).
+// Entries are keyed by the start of the weight memory; a weight is only cached once it is
+// tracked, and its packs are dropped when the write version of its allocation changes
+// (MutableRawMemory, InvalidatePackCache, see Allocator) or when the memory is released.
+//
+// Find runs on the worker threads for every GEMM, so it takes no global lock: the tracked
+// weights are published as an immutable sorted list, and only a hit locks its own entry.
+// Track replaces the list; the replaced lists are kept until the cache is destroyed, since
+// Find may still be reading them. Weights are tracked when layers are initialized, so they
+// stay few.
+template <typename TElem>
+class PackCache
+{
+    struct Entry;
+    using TrackedList = std::vector<std::pair<const TElem*, std::shared_ptr<Entry>>>;
+
+public:
+    static PackCache& Instance()
+    {
+        static PackCache inst;
+        return inst;
+    }
+
+    // Tracking a weight again drops its packs
+    void Track(const std::shared_ptr<TElem>& owner, const TElem* mem)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto list = std::make_unique<TrackedList>();
+        if (const auto* cur = m_tracked.load(std::memory_order_relaxed))
+        {
+            for (const auto& item : *cur)
+            {
+                if ((item.first != mem) && (!item.second->owner.expired()))
+                {
+                    list->push_back(item);
+                }
+            }
+        }
+        auto entry = std::make_shared<Entry>();
+        entry->owner = owner;
+        entry->written = Allocator<DeviceTags::CPU>::WriteVersion(owner);
+        list->emplace_back(mem, std::move(entry));
+        std::sort(list->begin(), list->end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        m_tracked.store(list.get(), std::memory_order_release);
+        m_lists.push_back(std::move(list));
+    }
+
+    // The packed panels of B(p, j) = b[p * rsB + j * csB], nullptr if b is not tracked
+    std::shared_ptr<const TElem> Find(const TElem* b, size_t rsB, size_t csB, size_t k, size_t n)
+    {
+        const auto* list = m_tracked.load(std::memory_order_acquire);
+        if (!list) return nullptr;
+        auto it = std::lower_bound(list->begin(), list->end(), b,
+                                   [](const auto& item, const TElem* key) { return item.first < key; });
+        if ((it == list->end()) || (it->first != b)) return nullptr;
+
+        Entry& entry = *(it->second);
+        std::shared_ptr<TElem> owner = entry.owner.lock();
+        if (!owner) return nullptr;
+
+        size_t written = 0;
+        {
+            std::lock_guard<std::mutex> guard(entry.mutex);
+            written = Allocator<DeviceTags::CPU>::WriteVersion(owner);
+            if (entry.written != written)
+            {
+                entry.packs.clear();
+                entry.written = written;
+            }
+            for (const auto& pack : entry.packs)
+            {
+                if ((pack.rsB == rsB) && (pack.csB == csB) && (pack.k == k) && (pack.n == n))
+                {
+                    return pack.panels;
+                }
+            }
+        }
+
+        // Packed without the lock: packing may run on the worker threads
+        std::shared_ptr<const TElem> panels = Pack(b, rsB, csB, k, n);
+        m_packNum.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> guard(entry.mutex);
+        if ((entry.written == written) && (Allocator<DeviceTags::CPU>::WriteVersion(owner) == written))
+        {
+            entry.packs.push_back(Packed{rsB, csB, k, n, panels});
+        }
+        return panels;
+    }
+
+    // Number of weights packed so far
+    size_t PackNum() const
+    {
+        return m_packNum.load(std::memory_order_relaxed);
+    }
+
+private:
+    PackCache() = default;
+
+    static std::shared_ptr<const TElem> Pack(const TElem* b, size_t rsB, size_t csB, size_t k, size_t n)
+    {
+        using KernelType = Kernel<TElem>;
+        constexpr size_t NR = KernelType::NR;
+        constexpr size_t KC = KernelType::KC;
+        constexpr size_t NC = KernelType::NC;
+        static_assert(NC % NR == 0);
+
+        const size_t size = std::max<size_t>(k * ((n + NR - 1) / NR) * NR, 1);
+        std::shared_ptr<TElem> res(static_cast<TElem*>(::operator new(sizeof(TElem) * size, std::align_val_t(64))),
+                                   [](TElem* p) { ::operator delete(p, std::align_val_t(64)); });
+
+        for (size_t jc = 0; jc < n; jc += NC)
+        {
+            const size_t nc = std::min(NC, n - jc);
+            const size_t panelNum = (nc + NR - 1) / NR;
+            for (size_t pc = 0; pc < k; pc += KC)
+            {
+                const size_t kc = std::min(KC, k - pc);
+                TElem* dst = res.get() + jc * k + pc * panelNum * NR;
+                ParallelFor(panelNum, kc * NR, [&](size_t panelB, size_t panelE)
+                            {
+                                PackB<NR>(kc, std::min(nc, panelE * NR) - panelB * NR,
+                                          b + pc * rsB, rsB, StridedColumn{csB}, jc + panelB * NR,
+                                          dst + panelB * NR * kc);
+                            });
+            }
+        }
+        return res;
+    }
+
+private:
+    struct Packed
+    {
+        size_t rsB;
+        size_t csB;
+        size_t k;
+        size_t n;
+        std::shared_ptr<const TElem> panels;
+    };
+
+    struct Entry
+    {
+        std::mutex mutex;
+        std::weak_ptr<TElem> owner;     // set before the entry is published
+        size_t written = 0;
+        std::vector<Packed> packs;
+    };
+
+    std::mutex m_mutex;                 // serializes Track
+    std::atomic<const TrackedList*> m_tracked{nullptr};
+    std::vector<std::unique_ptr<const TrackedList>> m_lists;
+    std::atomic<size_t> m_packNum{0};
+};
+
+// Applied to each element of C when it is stored for the last time:
+// value = epilogue(batch, row, col, value). NoEpilogue keeps the plain product.
+struct NoEpilogue
+{
+    static constexpr bool active = false;
+
+    template <typename TElem>
+    TElem operator() (size_t, size_t, size_t, TElem value) const
+    {
+        return value;
+    }
+};
+
+template <typename TEpilogue>
+struct ActiveEpilogue
+{
+    static constexpr bool active = true;
+    const TEpilogue& m_fun;
+
+    template <typename TElem>
+    TElem operator() (size_t batch, size_t row, size_t col, TElem value) const
+    {
+        return m_fun(batch, row, col, value);
+    }
+};
+
+template <typename TEpilogue>
+auto MakeEpilogue(const TEpilogue& fun)
+{
+    return ActiveEpilogue<TEpilogue>{fun};
+}
+
+// Maps folded GEMM positions back to the batch layout, keeps NoEpilogue as it is
+template <typename TFun>
+const NoEpilogue& Rebind(const NoEpilogue& epilogue, const TFun&)
+{
+    return epilogue;
+}
+
+template <typename TEpilogue, typename TFun>
+auto Rebind(const ActiveEpilogue<TEpilogue>&, const TFun& fun)
+{
+    return ActiveEpilogue<TFun>{fun};
+}
+
+template <typename TKernel, typename TElem, typename TColMap, typename TEpilogue>
+void MacroKernel(size_t mc, size_t nc, size_t kc,
+                 const TElem* packA, const TElem* packB,
+                 TElem* c, size_t rsC, const TColMap& colMap, size_t jc,
+                 bool accumulate, bool last, const TEpilogue& epilogue,
+                 size_t batch, size_t rowBase, size_t colBase)
+{
+    constexpr size_t MR = TKernel::MR;
+    constexpr size_t NR = TKernel::NR;
+    alignas(64) TElem tile[MR * NR];
+    size_t offset[NR];
+
+    for (size_t jr = 0; jr < nc; jr += NR)
+    {
+        const size_t nr = std::min(NR, nc - jr);
+        const bool contiguous = ColumnOffsets(colMap, jc + jr, nr, offset);
+        for (size_t ir = 0; ir < mc; ir += MR)
+        {
+            const size_t mr = std::min(MR, mc - ir);
+            TKernel::Compute(kc, packA + ir * kc, packB + jr * kc, tile);
+
+            if constexpr (TEpilogue::active)
+            {
+                if (last)
+                {
+                    for (size_t i = 0; i < mr; ++i)
+                    {
+                        const TElem* src = tile + i * NR;
+                        TElem* dst = c + (ir + i) * rsC;
+                        const size_t row = rowBase + ir + i;
+                        for (size_t j = 0; j < nr; ++j)
+                        {
+                            const TElem value = accumulate ? (dst[offset[j]] + src[j]) : src[j];
+                            dst[offset[j]] = epilogue(batch, row, colBase + jr + j, value);
+                        }
+                    }
+                    continue;
+                }
+            }
+
+            for (size_t i = 0; i < mr; ++i)
+            {
+                const TElem* src = tile + i * NR;
+                TElem* dst = c + (ir + i) * rsC;
+                if (contiguous)
+                {
+                    dst += offset[0];
+                    if (accumulate)
+                    {
+                        for (size_t j = 0; j < nr; ++j) dst[j] += src[j];
+                    }
+                    else
+                    {
+                        std::copy(src, src + nr, dst);
+                    }
+                }
+                else if (accumulate)
+                {
+                    for (size_t j = 0; j < nr; ++j) dst[offset[j]] += src[j];
+                }
+                else
+                {
+                    for (size_t j = 0; j < nr; ++j) dst[offset[j]] = src[j];
+                }
+            }
+        }
+    }
+}
+
+// Computes C_t = A_t * B for t in [0, batchNum), with A_t = a + t * bsA and C_t = c + t * bsC.
+// The shared B panel is packed once and reused by every batch. packedB, if not null, holds B
+// already packed by PackCache. With accumulate the product is added to C (beta = 1).
+template <typename TElem, typename TColMapB, typename TColMapC, typename TEpilogue = NoEpilogue>
+void GemmImpl(size_t batchNum, size_t m, size_t n, size_t k,
+              const TElem* a, size_t rsA, size_t csA, size_t bsA,
+              const TElem* b, size_t rsB, const TColMapB& colMapB,
+              TElem* c, size_t rsC, const TColMapC& colMapC, size_t bsC,
+              const TElem* packedB, bool accumulate, const TEpilogue& epilogue = TEpilogue())
+{
+    using KernelType = Kernel<TElem>;
+    constexpr size_t MR = KernelType::MR;
+    constexpr size_t NR = KernelType::NR;
+    constexpr size_t MC = KernelType::MC;
+    constexpr size_t KC = KernelType::KC;
+    constexpr size_t NC = KernelType::NC;
+
+    if ((batchNum == 0) || (m == 0) || (n == 0)) return;
+    if (k == 0)
+    {
+        for (size_t t = 0; t < batchNum; ++t)
+        {
+            for (size_t i = 0; i < m; ++i)
+            {
+                TElem* cRow = c + t * bsC + i * rsC;
+                for (size_t j = 0; j < n; ++j)
+                {
+                    cRow[colMapC(j)] = epilogue(t, i, j, accumulate ? cRow[colMapC(j)] : TElem());
+                }
+            }
+        }
+        return;
+    }
+
+    thread_local PackBuffer<TElem> bufB;
+    TElem* packB = packedB ? nullptr : bufB.Get(KC * NC);
+
+    // Work items are (batch, MC block of rows, range of NR panels). Panel ranges are only
+    // split when there are too few row blocks to keep every thread busy.
+    const size_t icNum = (m + MC - 1) / MC;
+    const size_t blockNum = batchNum * icNum;
+    const size_t concurrency = ParallelConcurrency();
+
+    for (size_t jc = 0; jc < n; jc += NC)
+    {
+        const size_t nc = std::min(NC, n - jc);
+        const size_t panelNum = (nc + NR - 1) / NR;
+        const size_t splitNum = std::min(panelNum, (2 * concurrency + blockNum - 1) / blockNum);
+        const size_t splitSize = (panelNum + splitNum - 1) / splitNum;
+
+        for (size_t pc = 0; pc < k; pc += KC)
+        {
+            const size_t kc = std::min(KC, k - pc);
+            const TElem* panelsB = packB;
+            if (packedB)
+            {
+                panelsB = packedB + jc * k + pc * panelNum * NR;
+            }
+            else
+            {
+                ParallelFor(panelNum, kc * NR, [&](size_t panelB, size_t panelE)
+                            {
+                                PackB<NR>(kc, std::min(nc, panelE * NR) - panelB * NR,
+                                          b + pc * rsB, rsB, colMapB, jc + panelB * NR,
+                                          packB + panelB * NR * kc);
+                            });
+            }
+
+            ParallelFor(blockNum * splitNum, MC * kc * splitSize * NR, [&](size_t itemB, size_t itemE)
+                        {
+                            thread_local PackBuffer<TElem> bufA;
+                            TElem* packA = bufA.Get(MC * KC);
+                            size_t packedBlock = (size_t)-1;
+                            for (size_t item = itemB; item < itemE; ++item)
+                            {
+                                const size_t block = item / splitNum;
+                                const size_t t = block / icNum;
+                                const size_t ic = (block % icNum) * MC;
+                                const size_t mc = std::min(MC, m - ic);
+                                if (block != packedBlock)
+                                {
+                                    PackA<MR>(mc, kc, a + t * bsA + ic * rsA + pc * csA, rsA, csA, packA);
+                                    packedBlock = block;
+                                }
+
+                                const size_t jr = (item % splitNum) * splitSize * NR;
+                                if (jr >= nc) continue;
+                                MacroKernel<KernelType>(mc, std::min(nc - jr, splitSize * NR), kc,
+                                                        packA, panelsB + jr * kc,
+                                                        c + t * bsC + ic * rsC, rsC, colMapC, jc + jr,
+                                                        accumulate || (pc != 0), pc + kc == k, epilogue,
+                                                        t, ic, jc + jr);
+                            }
+                        });
+        }
+    }
+}
+
+template <typename TElem, typename TEpilogue = NoEpilogue>
+void Gemm(size_t m, size_t n, size_t k,
+          const TElem* a, size_t rsA, size_t csA,
+          const TElem* b, size_t rsB, size_t csB,
+          TElem* c, size_t rsC,
+          const TEpilogue& epilogue = TEpilogue())
+{
+    auto packedB = PackCache<TElem>::Instance().Find(b, rsB, csB, k, n);
+    GemmImpl(1, m, n, k, a, rsA, csA, 0,
+             b, rsB, StridedColumn{csB},
+             c, rsC, StridedColumn{1}, 0, packedB.get(), false, epilogue);
+}
+
+// C_t = A_t * B_t for t in [0, batchNum). A batch stride of 0 marks an operand shared by all
+// batches, which is then never replicated:
+// * shared B: the batch is folded into the rows of one GEMM when A and C rows are evenly
+//   strided across batches, otherwise B is still packed only once per block;
+// * shared A: the batch is folded into the columns of one GEMM, so A is packed only once.
+// The epilogue always sees the (batch, row, col) position in the unfolded result.
+template <typename TElem, typename TEpilogue = NoEpilogue>
+void BatchGemm(size_t batchNum, size_t m, size_t n, size_t k,
+               const TElem* a, size_t rsA, size_t csA, size_t bsA,
+               const TElem* b, size_t rsB, size_t csB, size_t bsB,
+               TElem* c, size_t rsC, size_t bsC,
+               const TEpilogue& epilogue = TEpilogue())
+{
+    if (batchNum == 0) return;
+    if (bsB == 0)
+    {
+        auto packedB = PackCache<TElem>::Instance().Find(b, rsB, csB, k, n);
+        if ((batchNum == 1) || ((bsA == m * rsA) && (bsC == m * rsC)))
+        {
+            auto fun = [&epilogue, m](size_t, size_t row, size_t col, TElem value)
+            {
+                return epilogue(row / m, row % m, col, value);
+            };
+            GemmImpl(1, batchNum * m, n, k, a, rsA, csA, 0,
+                     b, rsB, StridedColumn{csB},
+                     c, rsC, StridedColumn{1}, 0,
+                     packedB.get(), false, Rebind(epilogue, fun));
+        }
+        else
+        {
+            GemmImpl(batchNum, m, n, k, a, rsA, csA, bsA,
+                     b, rsB, StridedColumn{csB},
+                     c, rsC, StridedColumn{1}, bsC, packedB.get(), false, epilogue);
+        }
+    }
+    else if (bsA == 0)
+    {
+        auto fun = [&epilogue, n](size_t, size_t row, size_t col, TElem value)
+        {
+            return epilogue(col / n, row, col % n, value);
+        };
+        GemmImpl(1, m, batchNum * n, k, a, rsA, csA, 0,
+                 b, rsB, BatchedColumn{n, csB, bsB},
+                 c, rsC, BatchedColumn{n, 1, bsC}, 0,
+                 (const TElem*)nullptr, false, Rebind(epilogue, fun));
+    }
+    else
+    {
+        for (size_t t = 0; t < batchNum; ++t)
+        {
+            auto fun = [&epilogue, t](size_t, size_t row, size_t col, TElem value)
+            {
+                return epilogue(t, row, col, value);
+            };
+            Gemm(m, n, k, a + t * bsA, rsA, csA, b + t * bsB, rsB, csB, c + t * bsC, rsC,
+                 Rebind(epilogue, fun));
+        }
+    }
+}
+
+// C += sum_t A_t * B_t for t in [0, batchNum). When the batches of A follow each other along
+// the columns and those of B along the rows, the sum is a single GEMM over batchNum * k.
+template <typename TElem>
+void GemmSum(size_t batchNum, size_t m, size_t n, size_t k,
+             const TElem* a, size_t rsA, size_t csA, size_t bsA,
+             const TElem* b, size_t rsB, size_t csB, size_t bsB,
+             TElem* c, size_t rsC)
+{
+    if ((batchNum > 1) && (bsA == k * csA) && (bsB == k * rsB))
+    {
+        k *= batchNum;
+        batchNum = 1;
+    }
+    for (size_t t = 0; t < batchNum; ++t)
+    {
+        auto packedB = PackCache<TElem>::Instance().Find(b + t * bsB, rsB, csB, k, n);
+        GemmImpl(1, m, n, k, a + t * bsA, rsA, csA, 0,
+                 b + t * bsB, rsB, StridedColumn{csB},
+                 c, rsC, StridedColumn{1}, 0, packedB.get(), true);
+    }
+}
+}
+
+// Lets the GEMMs reading weight as their B operand reuse its packed panels. The panels are
+// rebuilt once the memory of the weight is accessed for writing through MutableRawMemory, or
+// after InvalidatePackCache. Writes through SetValue, or through a pointer obtained before the
+// weight was last read by a GEMM, need InvalidatePackCache.
+template <typename TWeight>
+void EnablePackCache(const TWeight& weight)
+{
+    if constexpr (std::is_same<typename TWeight::DeviceType, DeviceTags::CPU>::value)
+    {
+        const auto mem = LowerAccess(weight);
+        using ElementType = typename TWeight::ElementType;
+        NSGemm::PackCache<ElementType>::Instance().Track(mem.SharedMemory(), mem.RawMemory());
+    }
+}
+
+template <typename TWeight>
+void InvalidatePackCache(const TWeight& weight)
+{
+    if constexpr (std::is_same<typename TWeight::DeviceType, DeviceTags::CPU>::value)
+    {
+        // every tracked view of the allocation is repacked
+        Allocator<DeviceTags::CPU>::MarkWritten(LowerAccess(weight).SharedMemory());
+    }
+}
+}
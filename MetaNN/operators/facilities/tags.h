@@ -21,6 +21,7 @@ namespace BinaryOpTags
     struct Divide;
     struct Dot;
     struct NegativeLogLikelihood;
+    struct SoftmaxCrossEntropy;
     struct SigmoidDerivative;
     struct TanhDerivative;
     struct VecSoftmaxDerivative;
@@ -30,6 +31,7 @@ namespace TernaryOpTags
 {
     struct Interpolate;
     struct NegativeLogLikelihoodDerivative;
+    struct SoftmaxCrossEntropyDerivative;
 };
 
 namespace ConvRelated
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <MetaNN/operators/facilities/fusion.h>
+
 namespace MetaNN
 {
 namespace NSInterpolate
@@ -186,7 +188,8 @@ struct Calculator
 template <>
 struct OperSeq_<TernaryOpTags::Interpolate>
 {
-    using type = OperSeqContainer<NSInterpolate::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSInterpolate::NSCaseGen::Calculator>;
 };
 
 struct OperInterpolate
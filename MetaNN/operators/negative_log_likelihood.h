@@ -177,12 +177,126 @@ struct Calculator
     }
 };
 }
+
+namespace NSCaseOneHot
+{
+template <typename TOperHandle, typename TElem, typename TDevice, typename TCate>
+class EvalUnit;
+
+template <typename TOperHandle, typename TElem>
+class EvalUnit<TOperHandle, TElem, DeviceTags::CPU, CategoryTags::Scalar>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+
+    EvalUnit(TOperHandle oper, size_t hotPos,
+             EvalHandle<Scalar<ElementType, DeviceType>> evalOutput)
+        : m_oper(std::move(oper))
+        , m_hotPos(hotPos)
+        , m_evalOutput(std::move(evalOutput)) { }
+
+    void Eval() override
+    {
+        const auto& p_pre = m_oper.Data();
+        assert(p_pre.RowNum() == 1);
+        assert(m_hotPos < p_pre.ColNum());
+        m_evalOutput.Allocate();
+
+        const auto mem = LowerAccess(p_pre);
+        m_evalOutput.MutableData().Value() = -log(mem.RawMemory()[m_hotPos]);
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle m_oper;
+    size_t m_hotPos;
+    EvalHandle<Scalar<ElementType, DeviceType>> m_evalOutput;
+};
+
+template <typename TOperHandle, typename TElem>
+class EvalUnit<TOperHandle, TElem, DeviceTags::CPU, CategoryTags::BatchScalar>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+
+    EvalUnit(TOperHandle oper, std::vector<size_t> hotPos,
+             EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Scalar>> evalOutput)
+        : m_oper(std::move(oper))
+        , m_hotPos(std::move(hotPos))
+        , m_evalOutput(std::move(evalOutput)) { }
+
+    void Eval() override
+    {
+        const auto& p_pre = m_oper.Data();
+        const size_t batchNum = m_hotPos.size();
+        assert(p_pre.RowNum() == 1);
+        assert(p_pre.BatchNum() == batchNum);
+
+        m_evalOutput.Allocate(batchNum);
+        auto& aim = m_evalOutput.MutableData();
+
+        const auto mem = LowerAccess(p_pre);
+        const TElem* r = mem.RawMemory();
+        const size_t matrixSize = mem.RawMatrixSize();
+        for (size_t curBatch = 0; curBatch < batchNum; ++curBatch)
+        {
+            assert(m_hotPos[curBatch] < p_pre.ColNum());
+            aim.SetValue(curBatch, -log(r[curBatch * matrixSize + m_hotPos[curBatch]]));
+        }
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle m_oper;
+    std::vector<size_t> m_hotPos;
+    EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Scalar>> m_evalOutput;
+};
+
+// One-hot labels: only the predicted probability of the hot position is read,
+// the label itself is never materialized
+struct Calculator
+{
+    template <typename TCaseTail, typename TEvalRes, typename TOper>
+    static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
+    {
+        using ElementType = typename TEvalRes::DataType::ElementType;
+        using DeviceType = typename TEvalRes::DataType::DeviceType;
+        using CategoryType = DataCategory<typename TEvalRes::DataType>;
+        using TLabel = OneHotType<ElementType, DeviceType,
+                                  DataCategory<RemConstRef<decltype(oper.Operand1())>>>;
+
+        if (auto ptr = DataCast<TLabel>(oper.Operand1()))
+        {
+            auto handle2 = oper.Operand2().EvalRegister();
+            using UnitType = EvalUnit<decltype(handle2), ElementType, DeviceType, CategoryType>;
+            using GroupType = TrivalEvalGroup<UnitType>;
+
+            auto outHandle = evalRes.Handle();
+            const void* dataPtr = outHandle.DataPtr();
+            auto depVec = {handle2.DataPtr()};
+
+            UnitType unit(std::move(handle2), ptr->HotPos(), std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+            return;
+        }
+
+        using THead = SeqHead<TCaseTail>;
+        using TTail = SeqTail<TCaseTail>;
+        THead::template EvalRegister<TTail>(evalRes, oper);
+    }
+};
+}
 }
 
 template <>
 struct OperSeq_<BinaryOpTags::NegativeLogLikelihood>
 {
-    using type = OperSeqContainer<NSNegativeLogLikelihood::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSNegativeLogLikelihood::NSCaseOneHot::Calculator,
+                                  NSNegativeLogLikelihood::NSCaseGen::Calculator>;
 };
 
 struct OperNegativeLogLikelihood
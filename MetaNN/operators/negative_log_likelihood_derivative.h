@@ -4,6 +4,7 @@
 #include <type_traits>
 #include <vector>
 #include <cmath>
+#include <cstring>
 
 namespace MetaNN
 {
@@ -253,12 +254,152 @@ struct Calculator
     }
 };
 }
+
+namespace NSCaseOneHot
+{
+template <typename TOperHandle1, typename TOperHandle2, typename TElem, typename TDevice, typename TCate>
+class EvalUnit;
+
+template <typename TOperHandle1, typename TOperHandle2, typename TElem>
+class EvalUnit<TOperHandle1, TOperHandle2, TElem, DeviceTags::CPU, CategoryTags::Matrix>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = typename DeviceTags::CPU;
+
+public:
+    EvalUnit(TOperHandle1 grad, size_t hotPos, TOperHandle2 operPre,
+             EvalHandle<Matrix<ElementType, DeviceType>> evalOutput)
+        : m_grad(std::move(grad))
+        , m_hotPos(hotPos)
+        , m_handlePre(std::move(operPre))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& p_pre = m_handlePre.Data();
+        const auto& p_grad = m_grad.Data();
+
+        const size_t colNum = p_pre.ColNum();
+        assert(p_pre.RowNum() == 1);
+        assert(m_hotPos < colNum);
+
+        m_evalOutput.Allocate(1, colNum);
+        auto& res = m_evalOutput.MutableData();
+
+        const auto mem_pre = LowerAccess(p_pre);
+        auto mem_res = LowerAccess(res);
+        ElementType* r = mem_res.MutableRawMemory();
+        memset(r, 0, sizeof(ElementType) * colNum);
+        r[m_hotPos] = -p_grad.Value() / mem_pre.RawMemory()[m_hotPos];
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle1 m_grad;
+    size_t m_hotPos;
+    TOperHandle2 m_handlePre;
+    EvalHandle<Matrix<ElementType, DeviceType>> m_evalOutput;
+};
+
+template <typename TOperHandle1, typename TOperHandle2, typename TElem>
+class EvalUnit<TOperHandle1, TOperHandle2, TElem, DeviceTags::CPU, CategoryTags::BatchMatrix>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = typename DeviceTags::CPU;
+
+public:
+    EvalUnit(TOperHandle1 grad, std::vector<size_t> hotPos, TOperHandle2 operPre,
+             EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> evalOutput)
+        : m_grad(std::move(grad))
+        , m_hotPos(std::move(hotPos))
+        , m_handlePre(std::move(operPre))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& p_pre = m_handlePre.Data();
+        const auto& p_grad = m_grad.Data();
+
+        const size_t colNum = p_pre.ColNum();
+        const size_t batchNum = m_hotPos.size();
+        assert(p_pre.RowNum() == 1);
+        assert(p_pre.BatchNum() == batchNum);
+        assert(p_grad.BatchNum() == batchNum);
+
+        m_evalOutput.Allocate(batchNum, 1, colNum);
+        auto& res = m_evalOutput.MutableData();
+
+        const auto mem_pre = LowerAccess(p_pre);
+        auto mem_res = LowerAccess(res);
+        const ElementType* p = mem_pre.RawMemory();
+        ElementType* r = mem_res.MutableRawMemory();
+        const size_t srcMatrixSize = mem_pre.RawMatrixSize();
+        const size_t tgtMatrixSize = mem_res.RawMatrixSize();
+
+        for (size_t curBatch = 0; curBatch < batchNum; ++curBatch)
+        {
+            const size_t pos = m_hotPos[curBatch];
+            assert(pos < colNum);
+            memset(r, 0, sizeof(ElementType) * colNum);
+            r[pos] = -p_grad[curBatch] / p[pos];
+            p += srcMatrixSize;
+            r += tgtMatrixSize;
+        }
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle1 m_grad;
+    std::vector<size_t> m_hotPos;
+    TOperHandle2 m_handlePre;
+    EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> m_evalOutput;
+};
+
+// One-hot labels: the gradient is zero except at the hot position
+struct Calculator
+{
+    template <typename TCaseTail, typename TEvalRes, typename TOper>
+    static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
+    {
+        using ElementType = typename TEvalRes::DataType::ElementType;
+        using DeviceType = typename TEvalRes::DataType::DeviceType;
+        using CategoryType = DataCategory<typename TEvalRes::DataType>;
+        using TLabel = OneHotType<ElementType, DeviceType, CategoryType>;
+
+        if (auto ptr = DataCast<TLabel>(oper.Operand2()))
+        {
+            auto handle1 = oper.Operand1().EvalRegister();
+            auto handle3 = oper.Operand3().EvalRegister();
+            using UnitType = EvalUnit<decltype(handle1), decltype(handle3),
+                                      ElementType, DeviceType, CategoryType>;
+            using GroupType = TrivalEvalGroup<UnitType>;
+
+            auto outHandle = evalRes.Handle();
+            const void* dataPtr = outHandle.DataPtr();
+            auto depVec = {handle1.DataPtr(), handle3.DataPtr()};
+
+            UnitType unit(std::move(handle1), ptr->HotPos(), std::move(handle3), std::move(outHandle));
+            EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+            return;
+        }
+
+        using THead = SeqHead<TCaseTail>;
+        using TTail = SeqTail<TCaseTail>;
+        THead::template EvalRegister<TTail>(evalRes, oper);
+    }
+};
+}
 }
 
 template <>
 struct OperSeq_<TernaryOpTags::NegativeLogLikelihoodDerivative>
 {
-    using type = OperSeqContainer<NSNegativeLogLikelihoodDerivative::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSNegativeLogLikelihoodDerivative::NSCaseOneHot::Calculator,
+                                  NSNegativeLogLikelihoodDerivative::NSCaseGen::Calculator>;
 };
 
 struct OperNegativeLogLikelihoodDerivative
@@ -6,6 +6,7 @@
 #include <MetaNN/operators/facilities/organizer.h>
 #include <MetaNN/operators/facilities/traits.h>
 #include <MetaNN/operators/facilities/oper_aux_params.h>
+#include <MetaNN/operators/facilities/gemm.h>
 
 namespace MetaNN
 {
@@ -76,6 +77,11 @@ public:
         return static_cast<const OperOrganizer<TOpTag, Cate>&>(*this);
     }
 
+    const auto& ResultBuffer() const
+    {
+        return m_evalBuf;
+    }
+
 private:
     TData m_data;
     
@@ -157,6 +163,11 @@ public:
         return static_cast<const OperOrganizer<TOpTag, Cate>&>(*this);
     }
 
+    const auto& ResultBuffer() const
+    {
+        return m_evalBuf;
+    }
+
 private:
     TData1 m_data1;
     TData2 m_data2;
@@ -249,6 +260,11 @@ public:
         return static_cast<const OperOrganizer<TOpTag, Cate>&>(*this);
     }
 
+    const auto& ResultBuffer() const
+    {
+        return m_evalBuf;
+    }
+
 private:
     TData1 m_data1;
     TData2 m_data2;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <type_traits>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <cmath>
 
@@ -168,7 +169,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::SigmoidDerivative>
 {
-    using type = OperSeqContainer<NSSigmoidDerivative::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSSigmoidDerivative::NSCaseGen::Calculator>;
 };
 
 struct OperSigmoidDerivative
@@ -4,6 +4,7 @@
 #include <MetaNN/data/matrices/trival_matrix.h>
 #include <MetaNN/evaluate/facilities/eval_plan.h>
 #include <MetaNN/operators/facilities/tags.h>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <cassert>
 #include <type_traits>
@@ -158,7 +159,8 @@ struct Calculator
 template <>
 struct OperSeq_<UnaryOpTags::Sign>
 {
-    using type = OperSeqContainer<NSSign::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSSign::NSCaseGen::Calculator>;
 };
 
 struct OperSign
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <type_traits>
+#include <algorithm>
+#include <cmath>
+
+namespace MetaNN
+{
+template <>
+struct OperCategory_<BinaryOpTags::SoftmaxCrossEntropy,
+                     CategoryTags::Matrix,
+                     CategoryTags::Matrix>
+{
+    using type = CategoryTags::Scalar;
+};
+
+template <>
+struct OperCategory_<BinaryOpTags::SoftmaxCrossEntropy,
+                     CategoryTags::BatchMatrix,
+                     CategoryTags::BatchMatrix>
+{
+    using type = CategoryTags::BatchScalar;
+};
+
+namespace NSSoftmaxCrossEntropy
+{
+// log(sum_j exp(x_j)) of one row, shifted by the maximum so that exp cannot overflow
+template <typename TElem>
+TElem LogSumExp(const TElem* x, size_t colNum)
+{
+    if (colNum == 0) return TElem();
+    const TElem maxElem = *std::max_element(x, x + colNum);
+    TElem sum = TElem();
+    for (size_t j = 0; j < colNum; ++j)
+    {
+        sum += exp(x[j] - maxElem);
+    }
+    return maxElem + log(sum);
+}
+
+// -sum_ij tar_ij * log(softmax(pre_i)_j) with one softmax per row
+template <typename TElem>
+TElem Loss(const TElem* tar, size_t tarRowLen,
+           const TElem* pre, size_t preRowLen,
+           size_t rowNum, size_t colNum)
+{
+    TElem res = TElem();
+    for (size_t i = 0; i < rowNum; ++i)
+    {
+        const TElem lse = LogSumExp(pre, colNum);
+        for (size_t j = 0; j < colNum; ++j)
+        {
+            res += tar[j] * (lse - pre[j]);
+        }
+        tar += tarRowLen;
+        pre += preRowLen;
+    }
+    return res;
+}
+
+namespace NSCaseGen
+{
+template <typename TOperHandle1, typename TOperHandle2, typename TElem, typename TDevice, typename TCate>
+class EvalUnit;
+
+template <typename TOperHandle1, typename TOperHandle2, typename TElem>
+class EvalUnit<TOperHandle1, TOperHandle2, TElem, DeviceTags::CPU, CategoryTags::Scalar>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+
+    EvalUnit(TOperHandle1 oper1,
+             TOperHandle2 oper2,
+             EvalHandle<Scalar<ElementType, DeviceType>> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_evalOutput(evalOutput) { }
+
+    void Eval() override
+    {
+        const auto& p_tar = m_oper1.Data();
+        const auto& p_pre = m_oper2.Data();
+        m_evalOutput.Allocate();
+
+        const size_t rowNum = p_tar.RowNum();
+        const size_t colNum = p_tar.ColNum();
+        assert(p_pre.RowNum() == rowNum);
+        assert(p_pre.ColNum() == colNum);
+
+        const auto mem_v1 = LowerAccess(p_tar);
+        const auto mem_v2 = LowerAccess(p_pre);
+
+        m_evalOutput.MutableData().Value() = Loss(mem_v1.RawMemory(), mem_v1.RowLen(),
+                                                  mem_v2.RawMemory(), mem_v2.RowLen(),
+                                                  rowNum, colNum);
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle1 m_oper1;
+    TOperHandle2 m_oper2;
+    EvalHandle<Scalar<ElementType, DeviceType>> m_evalOutput;
+};
+
+template <typename TOperHandle1, typename TOperHandle2, typename TElem>
+class EvalUnit<TOperHandle1, TOperHandle2, TElem, DeviceTags::CPU, CategoryTags::BatchScalar>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = DeviceTags::CPU;
+
+    EvalUnit(TOperHandle1 oper1,
+             TOperHandle2 oper2,
+             EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Scalar>> evalOutput)
+        : m_oper1(std::move(oper1))
+        , m_oper2(std::move(oper2))
+        , m_evalOutput(std::move(evalOutput)) { }
+
+    void Eval() override
+    {
+        const auto& p_tar = m_oper1.Data();
+        const auto& p_pre = m_oper2.Data();
+
+        const size_t rowNum = p_tar.RowNum();
+        const size_t colNum = p_tar.ColNum();
+        const size_t batchNum = p_tar.BatchNum();
+        assert(p_pre.RowNum() == rowNum);
+        assert(p_pre.ColNum() == colNum);
+        assert(p_pre.BatchNum() == batchNum);
+
+        m_evalOutput.Allocate(batchNum);
+        auto& aim = m_evalOutput.MutableData();
+
+        const auto mem_v1 = LowerAccess(p_tar);
+        const auto mem_v2 = LowerAccess(p_pre);
+        const size_t src1MatrixSize = mem_v1.RawMatrixSize();
+        const size_t src2MatrixSize = mem_v2.RawMatrixSize();
+
+        ParallelFor(batchNum, rowNum * colNum * 20, [&](size_t batchB, size_t batchE)
+                    {
+                        for (size_t curBatch = batchB; curBatch < batchE; ++curBatch)
+                        {
+                            aim.SetValue(curBatch, Loss(mem_v1.RawMemory() + curBatch * src1MatrixSize, mem_v1.RowLen(),
+                                                        mem_v2.RawMemory() + curBatch * src2MatrixSize, mem_v2.RowLen(),
+                                                        rowNum, colNum));
+                        }
+                    });
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle1 m_oper1;
+    TOperHandle2 m_oper2;
+    EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Scalar>> m_evalOutput;
+};
+
+struct Calculator
+{
+    template <typename TCaseTail, typename TEvalRes, typename TOper>
+    static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
+    {
+        static_assert(std::is_same<TCaseTail, OperSeqContainer<>>::value,
+                      "General Case is not the last one");
+
+        using ElementType = typename TEvalRes::DataType::ElementType;
+        using DeviceType = typename TEvalRes::DataType::DeviceType;
+        using CategoryType = DataCategory<typename TEvalRes::DataType>;
+
+        const auto& oper1 = oper.Operand1();
+        const auto& oper2 = oper.Operand2();
+        auto handle1 = oper1.EvalRegister();
+        auto handle2 = oper2.EvalRegister();
+        using UnitType = EvalUnit<decltype(handle1), decltype(handle2), ElementType, DeviceType, CategoryType>;
+        using GroupType = TrivalEvalGroup<UnitType>;
+
+        auto outHandle = evalRes.Handle();
+        const void* dataPtr = outHandle.DataPtr();
+        auto depVec = {handle1.DataPtr(), handle2.DataPtr()};
+
+        UnitType unit(std::move(handle1), std::move(handle2), std::move(outHandle));
+        EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+    }
+};
+}
+}
+
+template <>
+struct OperSeq_<BinaryOpTags::SoftmaxCrossEntropy>
+{
+    using type = OperSeqContainer<NSSoftmaxCrossEntropy::NSCaseGen::Calculator>;
+};
+
+// NegativeLogLikelihood(tar, VecSoftmax(pre)) computed from the scores pre with log-sum-exp,
+// the probabilities are never stored. Each row of pre is normalized on its own.
+struct OperSoftmaxCrossEntropy
+{
+    template <typename T1, typename T2>
+    static constexpr bool valid = (IsMatrix<T1> && IsMatrix<T2>) ||
+                                  (IsBatchMatrix<T1> && IsBatchMatrix<T2>);
+
+    template <typename T1, typename T2,
+              std::enable_if_t<std::is_same<DataCategory<T1>, DataCategory<T2>>::value>* = nullptr>
+    static auto Eval(T1&& p_m1, T2&& p_m2)
+    {
+        using rawM1 = RemConstRef<T1>;
+        using rawM2 = RemConstRef<T2>;
+
+        static_assert(std::is_same<typename rawM1::ElementType, typename rawM2::ElementType>::value,
+                      "Matrices with different element types cannot do SoftmaxCrossEntropy directly");
+        static_assert(std::is_same<typename rawM1::DeviceType, typename rawM2::DeviceType>::value,
+                      "Matrices with different device types cannot do SoftmaxCrossEntropy directly");
+
+        using ResType = BinaryOp<BinaryOpTags::SoftmaxCrossEntropy, rawM1, rawM2>;
+        return ResType(std::forward<T1>(p_m1), std::forward<T2>(p_m2));
+    }
+};
+
+template <typename TP1, typename TP2,
+          std::enable_if_t<OperSoftmaxCrossEntropy::valid<TP1, TP2>>* = nullptr>
+auto SoftmaxCrossEntropy(TP1&& p_tar, TP2&& p_pre)
+{
+    return OperSoftmaxCrossEntropy::Eval(std::forward<TP1>(p_tar), std::forward<TP2>(p_pre));
+}
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <MetaNN/evaluate/cpu/parallel_for.h>
+#include <MetaNN/operators/facilities/organizer.h>
+#include <type_traits>
+#include <cmath>
+
+namespace MetaNN
+{
+template <>
+struct OperCategory_<TernaryOpTags::SoftmaxCrossEntropyDerivative,
+                     CategoryTags::Scalar, CategoryTags::Matrix, CategoryTags::Matrix>
+{
+    using type = CategoryTags::Matrix;
+};
+
+template <>
+struct OperCategory_<TernaryOpTags::SoftmaxCrossEntropyDerivative,
+                     CategoryTags::BatchScalar, CategoryTags::BatchMatrix, CategoryTags::BatchMatrix>
+{
+    using type = CategoryTags::BatchMatrix;
+};
+
+template <>
+class OperOrganizer<TernaryOpTags::SoftmaxCrossEntropyDerivative, CategoryTags::Matrix>
+    : public OperOrganizer<TernaryOpTags::NegativeLogLikelihoodDerivative, CategoryTags::Matrix>
+{
+    using BaseType = OperOrganizer<TernaryOpTags::NegativeLogLikelihoodDerivative, CategoryTags::Matrix>;
+public:
+    using BaseType::BaseType;
+};
+
+template <>
+class OperOrganizer<TernaryOpTags::SoftmaxCrossEntropyDerivative, CategoryTags::BatchMatrix>
+    : public OperOrganizer<TernaryOpTags::NegativeLogLikelihoodDerivative, CategoryTags::BatchMatrix>
+{
+    using BaseType = OperOrganizer<TernaryOpTags::NegativeLogLikelihoodDerivative, CategoryTags::BatchMatrix>;
+public:
+    using BaseType::BaseType;
+};
+
+template <typename TOp1, typename TOp2, typename TOp3>
+struct OperElementType_<TernaryOpTags::SoftmaxCrossEntropyDerivative,
+                        TOp1, TOp2, TOp3>
+{
+    using type = typename TOp2::ElementType;
+};
+
+template <typename TOp1, typename TOp2, typename TOp3>
+struct OperDeviceType_<TernaryOpTags::SoftmaxCrossEntropyDerivative,
+                       TOp1, TOp2, TOp3>
+{
+    using type = typename TOp2::DeviceType;
+};
+
+namespace NSSoftmaxCrossEntropyDerivative
+{
+// grad * (softmax(pre_i) * sum_j tar_ij - tar_i) for each row i: softmax - label for one-hot labels
+template <typename TElem>
+void Backward(TElem grad,
+              const TElem* tar, size_t tarRowLen,
+              const TElem* pre, size_t preRowLen,
+              TElem* res, size_t resRowLen,
+              size_t rowNum, size_t colNum)
+{
+    for (size_t i = 0; i < rowNum; ++i)
+    {
+        const TElem lse = NSSoftmaxCrossEntropy::LogSumExp(pre, colNum);
+        TElem tarSum = TElem();
+        for (size_t j = 0; j < colNum; ++j)
+        {
+            tarSum += tar[j];
+        }
+        for (size_t j = 0; j < colNum; ++j)
+        {
+            res[j] = grad * ((TElem)exp(pre[j] - lse) * tarSum - tar[j]);
+        }
+        tar += tarRowLen;
+        pre += preRowLen;
+        res += resRowLen;
+    }
+}
+
+namespace NSCaseGen
+{
+template <typename TOperHandle1, typename TOperHandle2, typename TOperHandle3, typename TElem, typename TDevice, typename TCate>
+class EvalUnit;
+
+template <typename TOperHandle1, typename TOperHandle2, typename TOperHandle3, typename TElem>
+class EvalUnit<TOperHandle1, TOperHandle2, TOperHandle3, TElem, DeviceTags::CPU, CategoryTags::Matrix>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = typename DeviceTags::CPU;
+
+public:
+    EvalUnit(TOperHandle1 grad, TOperHandle2 operTar, TOperHandle3 operPre,
+             EvalHandle<Matrix<ElementType, DeviceType>> evalOutput)
+        : m_grad(std::move(grad))
+        , m_handleTar(std::move(operTar))
+        , m_handlePre(std::move(operPre))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& p_tar = m_handleTar.Data();
+        const auto& p_pre = m_handlePre.Data();
+        const auto& p_grad = m_grad.Data();
+
+        const size_t rowNum = p_tar.RowNum();
+        const size_t colNum = p_tar.ColNum();
+        assert(p_pre.RowNum() == rowNum);
+        assert(p_pre.ColNum() == colNum);
+
+        m_evalOutput.Allocate(rowNum, colNum);
+        auto& res = m_evalOutput.MutableData();
+
+        const auto mem_v1 = LowerAccess(p_tar);
+        const auto mem_v2 = LowerAccess(p_pre);
+        auto mem_res = LowerAccess(res);
+
+        Backward(p_grad.Value(),
+                 mem_v1.RawMemory(), mem_v1.RowLen(),
+                 mem_v2.RawMemory(), mem_v2.RowLen(),
+                 mem_res.MutableRawMemory(), mem_res.RowLen(),
+                 rowNum, colNum);
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle1 m_grad;
+    TOperHandle2 m_handleTar;
+    TOperHandle3 m_handlePre;
+    EvalHandle<Matrix<ElementType, DeviceType>> m_evalOutput;
+};
+
+template <typename TOperHandle1, typename TOperHandle2, typename TOperHandle3, typename TElem>
+class EvalUnit<TOperHandle1, TOperHandle2, TOperHandle3, TElem, DeviceTags::CPU, CategoryTags::BatchMatrix>
+    : public BaseEvalUnit<DeviceTags::CPU>
+{
+public:
+    using ElementType = TElem;
+    using DeviceType = typename DeviceTags::CPU;
+
+public:
+    EvalUnit(TOperHandle1 grad, TOperHandle2 operTar, TOperHandle3 operPre,
+             EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> evalOutput)
+        : m_grad(std::move(grad))
+        , m_handleTar(std::move(operTar))
+        , m_handlePre(std::move(operPre))
+        , m_evalOutput(std::move(evalOutput)) {}
+
+    void Eval() override
+    {
+        const auto& p_tar = m_handleTar.Data();
+        const auto& p_pre = m_handlePre.Data();
+        const auto& p_grad = m_grad.Data();
+
+        const size_t rowNum = p_tar.RowNum();
+        const size_t colNum = p_tar.ColNum();
+        const size_t batchNum = p_tar.BatchNum();
+        assert(p_pre.RowNum() == rowNum);
+        assert(p_pre.ColNum() == colNum);
+        assert(p_pre.BatchNum() == batchNum);
+        assert(p_grad.BatchNum() == batchNum);
+
+        m_evalOutput.Allocate(batchNum, rowNum, colNum);
+        auto& res = m_evalOutput.MutableData();
+
+        const auto mem_v1 = LowerAccess(p_tar);
+        const auto mem_v2 = LowerAccess(p_pre);
+        auto mem_res = LowerAccess(res);
+        const size_t src1MatrixSize = mem_v1.RawMatrixSize();
+        const size_t src2MatrixSize = mem_v2.RawMatrixSize();
+        const size_t tgtMatrixSize = mem_res.RawMatrixSize();
+
+        ParallelFor(batchNum, rowNum * colNum * 24, [&](size_t batchB, size_t batchE)
+                    {
+                        for (size_t curBatch = batchB; curBatch < batchE; ++curBatch)
+                        {
+                            Backward(p_grad[curBatch],
+                                     mem_v1.RawMemory() + curBatch * src1MatrixSize, mem_v1.RowLen(),
+                                     mem_v2.RawMemory() + curBatch * src2MatrixSize, mem_v2.RowLen(),
+                                     mem_res.MutableRawMemory() + curBatch * tgtMatrixSize, mem_res.RowLen(),
+                                     rowNum, colNum);
+                        }
+                    });
+        m_evalOutput.SetEval();
+    }
+
+private:
+    TOperHandle1 m_grad;
+    TOperHandle2 m_handleTar;
+    TOperHandle3 m_handlePre;
+    EvalHandle<Batch<ElementType, DeviceType, CategoryTags::Matrix>> m_evalOutput;
+};
+
+struct Calculator
+{
+    template <typename TCaseTail, typename TEvalRes, typename TOper>
+    static void EvalRegister(TEvalRes& evalRes, const TOper& oper)
+    {
+        static_assert(std::is_same<TCaseTail, OperSeqContainer<>>::value,
+                      "General Case is not the last one");
+
+        using ElementType = typename TEvalRes::DataType::ElementType;
+        using DeviceType = typename TEvalRes::DataType::DeviceType;
+        using CategoryType = DataCategory<typename TEvalRes::DataType>;
+
+        auto handle1 = oper.Operand1().EvalRegister();
+        auto handle2 = oper.Operand2().EvalRegister();
+        auto handle3 = oper.Operand3().EvalRegister();
+        using UnitType = EvalUnit<decltype(handle1), decltype(handle2), decltype(handle3),
+                                  ElementType, DeviceType, CategoryType>;
+        using GroupType = TrivalEvalGroup<UnitType>;
+
+        auto outHandle = evalRes.Handle();
+        const void* dataPtr = outHandle.DataPtr();
+        auto depVec = {handle1.DataPtr(), handle2.DataPtr(), handle3.DataPtr()};
+
+        UnitType unit(std::move(handle1), std::move(handle2), std::move(handle3), std::move(outHandle));
+        EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+    }
+};
+}
+}
+
+template <>
+struct OperSeq_<TernaryOpTags::SoftmaxCrossEntropyDerivative>
+{
+    using type = OperSeqContainer<NSSoftmaxCrossEntropyDerivative::NSCaseGen::Calculator>;
+};
+
+struct OperSoftmaxCrossEntropyDerivative
+{
+    template <typename TGrad, typename TP1, typename TP2>
+    static constexpr bool valid = (IsScalar<TGrad> && IsMatrix<TP1> && IsMatrix<TP2>) ||
+                                  (IsBatchScalar<TGrad> && IsBatchMatrix<TP1> && IsBatchMatrix<TP2>);
+
+    template <typename TGrad, typename TP1, typename TP2>
+    static auto Eval(TGrad&& p_grad, TP1&& p_m1, TP2&& p_m2)
+    {
+        using rawGrad = RemConstRef<TGrad>;
+        using rawM1 = RemConstRef<TP1>;
+        using rawM2 = RemConstRef<TP2>;
+
+        static_assert(std::is_same<typename rawM1::ElementType, typename rawM2::ElementType>::value,
+                      "Matrices with different element types cannot do SoftmaxCrossEntropy derivative directly");
+        static_assert(std::is_same<typename rawM1::DeviceType, typename rawM2::DeviceType>::value,
+                      "Matrices with different device types cannot do SoftmaxCrossEntropy derivative directly");
+
+        using ResType = TernaryOp<TernaryOpTags::SoftmaxCrossEntropyDerivative,
+                                  rawGrad, rawM1, rawM2>;
+        return ResType(std::forward<TGrad>(p_grad), std::forward<TP1>(p_m1), std::forward<TP2>(p_m2));
+    }
+};
+
+// Gradient of SoftmaxCrossEntropy(tar, pre) with respect to the scores pre
+template <typename TGrad, typename TP1, typename TP2,
+          std::enable_if_t<OperSoftmaxCrossEntropyDerivative::valid<TGrad, TP1, TP2>>* = nullptr>
+auto SoftmaxCrossEntropyDerivative(TGrad&& p_grad, TP1&& p_tar, TP2&& p_pre)
+{
+    return OperSoftmaxCrossEntropyDerivative
+                ::Eval(std::forward<TGrad>(p_grad), std::forward<TP1>(p_tar), std::forward<TP2>(p_pre));
+}
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <MetaNN/evaluate/cpu/parallel_for.h>
 #include <MetaNN/operators/operators.h>
 #include <stdexcept>
 
@@ -287,6 +288,21 @@ struct Calculator
 
 namespace CaseGen
 {
+// grad * (diag(s) - s^T * s) is s_j * (grad_j - <grad, s>), the Jacobian is never built
+template <typename TElem>
+void Backward(size_t colNum, const TElem* grad, const TElem* sout, TElem* res)
+{
+    TElem inner = TElem();
+    for (size_t i = 0; i < colNum; ++i)
+    {
+        inner += grad[i] * sout[i];
+    }
+    for (size_t i = 0; i < colNum; ++i)
+    {
+        res[i] = sout[i] * (grad[i] - inner);
+    }
+}
+
 template <typename TOperHandle1, typename TOperHandle2, typename TElem, typename TDevice, typename TCate>
 class EvalUnit;
 
@@ -313,27 +329,15 @@ public:
         assert(p_grad.RowNum() == 1);
         assert(p_sout.RowNum() == 1);
         assert(colNum == p_sout.ColNum());
-                
-        Matrix<ElementType, DeviceType> tmp(colNum, colNum);
-        for (size_t i = 0; i < colNum; ++i)
-        {
-            for (size_t j = 0; j < colNum; ++j)
-            {
-                tmp.SetValue(i, j, -1 * p_sout(0, i) * p_sout(0, j));
-            }
-            auto value = tmp(i, i);
-            tmp.SetValue(i, i, p_sout(0, i) + value);
-        }
 
-        auto tempHandle = tmp.EvalRegister();
-        using EvalUnit = NSDot::NSCaseGen::EvalUnit<decltype(m_oper1), decltype(tempHandle), ElementType, DeviceType,
-                                                    CategoryTags::Matrix>;
-        using GroupType = TrivalEvalGroup<EvalUnit>;
+        m_evalOutput.Allocate(1, colNum);
+        auto& res = m_evalOutput.MutableData();
 
-        const void* dataPtr = m_evalOutput.DataPtr();
-        auto depVec = {m_oper1.DataPtr(), tempHandle.DataPtr()};
-        EvalUnit unit(m_oper1, std::move(tempHandle), std::move(m_evalOutput));
-        EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+        const auto mem_grad = LowerAccess(p_grad);
+        const auto mem_sout = LowerAccess(p_sout);
+        auto mem_res = LowerAccess(res);
+        Backward(colNum, mem_grad.RawMemory(), mem_sout.RawMemory(), mem_res.MutableRawMemory());
+        m_evalOutput.SetEval();
     }
 
 private:
@@ -368,30 +372,28 @@ public:
         assert(p_sout.RowNum() == 1);
         assert(colNum == p_sout.ColNum());
         assert(batchNum == p_sout.BatchNum());
-                
-        Batch<ElementType, DeviceType, CategoryTags::Matrix> tmp(batchNum, colNum, colNum);
-        for (size_t curBatch = 0; curBatch < batchNum; ++curBatch)
-        {
-            for (size_t i = 0; i < colNum; ++i)
-            {
-                for (size_t j = 0; j < colNum; ++j)
-                {
-                    tmp.SetValue(curBatch, i, j, -1 * p_sout[curBatch](0, i) * p_sout[curBatch](0, j));
-                }
-                auto value = tmp[curBatch](i, i);
-                tmp.SetValue(curBatch, i, i, p_sout[curBatch](0, i) + value);
-            }
-        }
 
-        auto tempHandle = tmp.EvalRegister();
-        using EvalUnit = NSDot::NSCaseGen::EvalUnit<decltype(m_oper1), decltype(tempHandle), ElementType, DeviceType,
-                                                    CategoryTags::BatchMatrix>;
-        using GroupType = TrivalEvalGroup<EvalUnit>;
+        m_evalOutput.Allocate(batchNum, 1, colNum);
+        auto& res = m_evalOutput.MutableData();
 
-        const void* dataPtr = m_evalOutput.DataPtr();
-        auto depVec = {m_oper1.DataPtr(), tempHandle.DataPtr()};
-        EvalUnit unit(m_oper1, std::move(tempHandle), std::move(m_evalOutput));
-        EvalPlan<DeviceType>::template Register<GroupType>(std::move(unit), dataPtr, std::move(depVec));
+        const auto mem_grad = LowerAccess(p_grad);
+        const auto mem_sout = LowerAccess(p_sout);
+        auto mem_res = LowerAccess(res);
+        const size_t gradMatrixSize = mem_grad.RawMatrixSize();
+        const size_t soutMatrixSize = mem_sout.RawMatrixSize();
+        const size_t tgtMatrixSize = mem_res.RawMatrixSize();
+
+        ParallelFor(batchNum, colNum * 3, [&](size_t batchB, size_t batchE)
+                    {
+                        for (size_t curBatch = batchB; curBatch < batchE; ++curBatch)
+                        {
+                            Backward(colNum,
+                                     mem_grad.RawMemory() + curBatch * gradMatrixSize,
+                                     mem_sout.RawMemory() + curBatch * soutMatrixSize,
+                                     mem_res.MutableRawMemory() + curBatch * tgtMatrixSize);
+                        }
+                    });
+        m_evalOutput.SetEval();
     }
 
 private:
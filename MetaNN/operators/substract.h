@@ -1,6 +1,7 @@
 #pragma once
 
 #include <type_traits>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 namespace MetaNN
 {
@@ -166,7 +167,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::Substract>
 {
-    using type = OperSeqContainer<NSSubstract::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSSubstract::NSCaseGen::Calculator>;
 };
 
 struct OperSubstract
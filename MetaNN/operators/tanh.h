@@ -1,6 +1,7 @@
 #pragma once
 
 #include <type_traits>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <cmath>
 
@@ -41,18 +42,21 @@ public:
         const size_t src1PackNum = mem_v1.RowLen();
         const size_t tgtPackNum = mem_res.RowLen();
 
-        const ElementType* r1 = mem_v1.RawMemory();
-        ElementType* r = mem_res.MutableRawMemory();
-
-        for (size_t i = 0; i < rowNum; ++i)
-        {
-            for (size_t j = 0; j < colNum; ++j)
-            {
-                r[j] = (ElementType)(tanh(r1[j]));
-            }
-            r1 += src1PackNum;
-            r += tgtPackNum;
-        }
+        ParallelFor(rowNum, colNum * 16, [&](size_t rowB, size_t rowE)
+                    {
+                        const ElementType* r1 = mem_v1.RawMemory() + rowB * src1PackNum;
+                        ElementType* r = mem_res.MutableRawMemory() + rowB * tgtPackNum;
+
+                        for (size_t i = rowB; i < rowE; ++i)
+                        {
+                            for (size_t j = 0; j < colNum; ++j)
+                            {
+                                r[j] = (ElementType)(tanh(r1[j]));
+                            }
+                            r1 += src1PackNum;
+                            r += tgtPackNum;
+                        }
+                    });
         m_evalOutput.SetEval();
     }
 
@@ -84,27 +88,29 @@ public:
         m_evalOutput.Allocate(batchNum, rowNum, colNum);
         auto& res = m_evalOutput.MutableData();
         
-        for (size_t cur_batch = 0; cur_batch < batchNum; ++cur_batch)
-        {
-            auto mem_v1 = LowerAccess(p_v[cur_batch]);
-            auto mem_res = LowerAccess(res[cur_batch]);
-
-            const size_t src1PackNum = mem_v1.RowLen();
-            const size_t tgtPackNum = mem_res.RowLen();
-
-            const ElementType* r1 = mem_v1.RawMemory();
-            ElementType* r = mem_res.MutableRawMemory();
-
-            for (size_t i = 0; i < rowNum; ++i)
-            {
-                for (size_t j = 0; j < colNum; ++j)
-                {
-                    r[j] = (ElementType)(tanh(r1[j]));
-                }
-                r1 += src1PackNum;
-                r += tgtPackNum;
-            }
-        }
+        auto mem_v1 = LowerAccess(p_v);
+        auto mem_res = LowerAccess(res);
+
+        const size_t src1PackNum = mem_v1.RowLen();
+        const size_t tgtPackNum = mem_res.RowLen();
+        const size_t src1MatrixSize = mem_v1.RawMatrixSize();
+        const size_t tgtMatrixSize = mem_res.RawMatrixSize();
+
+        ParallelFor(batchNum * rowNum, colNum * 16, [&](size_t rowB, size_t rowE)
+                    {
+                        for (size_t id = rowB; id < rowE; ++id)
+                        {
+                            const size_t cur_batch = id / rowNum;
+                            const size_t i = id % rowNum;
+                            const ElementType* r1 = mem_v1.RawMemory() + cur_batch * src1MatrixSize + i * src1PackNum;
+                            ElementType* r = mem_res.MutableRawMemory() + cur_batch * tgtMatrixSize + i * tgtPackNum;
+
+                            for (size_t j = 0; j < colNum; ++j)
+                            {
+                                r[j] = (ElementType)(tanh(r1[j]));
+                            }
+                        }
+                    });
         m_evalOutput.SetEval();
     }
 
@@ -143,7 +149,8 @@ struct Calculator
 template <>
 struct OperSeq_<UnaryOpTags::Tanh>
 {
-    using type = OperSeqContainer<NSTanh::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSTanh::NSCaseGen::Calculator>;
 };
 
 struct OperTanh
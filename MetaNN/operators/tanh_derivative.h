@@ -1,6 +1,7 @@
 #pragma once
 
 #include <type_traits>
+#include <MetaNN/operators/facilities/fusion.h>
 #include <MetaNN/operators/operators.h>
 #include <cmath>
 
@@ -167,7 +168,8 @@ struct Calculator
 template <>
 struct OperSeq_<BinaryOpTags::TanhDerivative>
 {
-    using type = OperSeqContainer<NSTanhDerivative::NSCaseGen::Calculator>;
+    using type = OperSeqContainer<NSFusion::Calculator,
+                                  NSTanhDerivative::NSCaseGen::Calculator>;
 };
 
 struct OperTanhDerivative